@@ -0,0 +1,210 @@
+#include "cellar_alarm.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+// A raised alarm clears after its rule has held this long.
+#ifndef CELLAR_ALARM_CLEAR_MS
+#define CELLAR_ALARM_CLEAR_MS (60 * 1000)
+#endif
+// Rates are measured against a reference value at least this old, so that
+// sensor noise between two close samples is not mistaken for a trend. A jump
+// larger than the whole span allows is reported at once.
+#ifndef CELLAR_ALARM_RATE_SPAN_MS
+#define CELLAR_ALARM_RATE_SPAN_MS (30 * 1000)
+#endif
+#ifndef CELLAR_ALARM_MAX_RULES
+#define CELLAR_ALARM_MAX_RULES 8
+#endif
+
+static const char *TAG = "cellar_alarm";
+
+typedef enum {
+    ALARM_NONE = 0,
+    ALARM_LOW,
+    ALARM_HIGH,
+    ALARM_RATE,
+} alarm_kind_t;
+
+static const char *const KIND_NAMES[] = {"ok", "low", "high", "rate"};
+static const char *const KIND_BANNER[] = {"OK", "LOW", "HIGH", "RATE"};
+
+typedef struct {
+    alarm_kind_t raised;
+    int64_t ok_since_ms;  // first in-limits sample while raised, 0 if none yet
+    bool have_ref;
+    float ref_value;
+    int64_t ref_ms;
+} rule_state_t;
+
+static const cellar_alarm_rule_t *s_rules = NULL;
+static size_t s_rule_count = 0;
+static rule_state_t s_state[CELLAR_ALARM_MAX_RULES];
+// Evaluated by the sampler, read by the uplink and display paths.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t cellar_alarm_init(const cellar_alarm_rule_t *rules, size_t count) {
+    if (count > 0 && !rules) return ESP_ERR_INVALID_ARG;
+    if (count > CELLAR_ALARM_MAX_RULES) {
+        ESP_LOGW(TAG, "Only the first %d of %u rules are used", CELLAR_ALARM_MAX_RULES, (unsigned)count);
+        count = CELLAR_ALARM_MAX_RULES;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_rules = rules;
+    s_rule_count = count;
+    memset(s_state, 0, sizeof(s_state));
+    portEXIT_CRITICAL(&s_lock);
+    for (size_t i = 0; i < count; ++i) {
+        ESP_LOGI(TAG, "%s: min %.2f max %.2f rate %.2f/min", rules[i].channel,
+                 rules[i].min, rules[i].max, rules[i].max_rate_per_min);
+    }
+    return ESP_OK;
+}
+
+static float channel_value(const cellar_sample_t *sample, const char *channel) {
+    if (strcmp(channel, "pressure_hpa") == 0) return sample->pressure_hpa;
+    if (strcmp(channel, "humidity_pct") == 0) return sample->humidity_pct;
+    if (strcmp(channel, "opt3001_lux") == 0) return sample->opt3001_lux;
+    if (strcmp(channel, "veml7700_lux") == 0) return sample->veml7700_lux;
+    for (int i = 0; i < sample->temp_count; ++i) {
+        if (strcmp(sample->temps[i].id, channel) == 0) return sample->temps[i].value_c;
+    }
+    return NAN;
+}
+
+static alarm_kind_t check_rule(const cellar_alarm_rule_t *rule, rule_state_t *st,
+                               float value, int64_t now_ms) {
+    alarm_kind_t kind = ALARM_NONE;
+    if (!isnan(rule->min) && value < rule->min) {
+        kind = ALARM_LOW;
+    } else if (!isnan(rule->max) && value > rule->max) {
+        kind = ALARM_HIGH;
+    }
+
+    if (!isnan(rule->max_rate_per_min)) {
+        if (!st->have_ref) {
+            st->have_ref = true;
+            st->ref_value = value;
+            st->ref_ms = now_ms;
+        } else {
+            float delta = fabsf(value - st->ref_value);
+            int64_t span_ms = now_ms - st->ref_ms;
+            float allowed_span = rule->max_rate_per_min * CELLAR_ALARM_RATE_SPAN_MS / 60000.0f;
+            if (span_ms >= CELLAR_ALARM_RATE_SPAN_MS) {
+                if (delta * 60000.0f / (float)span_ms > rule->max_rate_per_min && kind == ALARM_NONE) {
+                    kind = ALARM_RATE;
+                }
+                st->ref_value = value;
+                st->ref_ms = now_ms;
+            } else if (delta > allowed_span && kind == ALARM_NONE) {
+                kind = ALARM_RATE;
+            }
+        }
+    }
+    return kind;
+}
+
+bool cellar_alarm_evaluate(const cellar_sample_t *sample) {
+    if (!sample) return false;
+    bool changed = false;
+    int64_t now_ms = sample->mono_ms;
+    for (size_t i = 0; i < s_rule_count; ++i) {
+        const cellar_alarm_rule_t *rule = &s_rules[i];
+        rule_state_t *st = &s_state[i];
+        float value = channel_value(sample, rule->channel);
+        if (isnan(value)) continue;
+
+        alarm_kind_t kind = check_rule(rule, st, value, now_ms);
+        alarm_kind_t raised = st->raised;
+        if (kind != ALARM_NONE) {
+            st->ok_since_ms = 0;
+            if (raised == ALARM_NONE) {
+                raised = kind;
+                ESP_LOGW(TAG, "%s %s (%.2f)", rule->channel, KIND_NAMES[kind], value);
+            }
+        } else if (raised != ALARM_NONE) {
+            if (st->ok_since_ms == 0) {
+                st->ok_since_ms = now_ms;
+            } else if (now_ms - st->ok_since_ms >= CELLAR_ALARM_CLEAR_MS) {
+                ESP_LOGI(TAG, "%s back to normal (%.2f)", rule->channel, value);
+                raised = ALARM_NONE;
+                st->ok_since_ms = 0;
+            }
+        }
+        if (raised != st->raised) {
+            portENTER_CRITICAL(&s_lock);
+            st->raised = raised;
+            portEXIT_CRITICAL(&s_lock);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+size_t cellar_alarm_active_count(void) {
+    size_t count = 0;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < s_rule_count; ++i) {
+        if (s_state[i].raised != ALARM_NONE) count++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return count;
+}
+
+bool cellar_alarm_banner(char *buf, size_t len) {
+    if (!buf || len == 0) return false;
+    buf[0] = '\0';
+    size_t first = SIZE_MAX;
+    size_t count = 0;
+    alarm_kind_t kind = ALARM_NONE;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < s_rule_count; ++i) {
+        if (s_state[i].raised == ALARM_NONE) continue;
+        if (first == SIZE_MAX) {
+            first = i;
+            kind = s_state[i].raised;
+        }
+        count++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (count == 0) return false;
+
+    // Kind first: DS18B20 ids are long and the line clips at 21 characters.
+    if (count > 1) {
+        snprintf(buf, len, "%s+%u %s", KIND_BANNER[kind], (unsigned)(count - 1), s_rules[first].channel);
+    } else {
+        snprintf(buf, len, "%s %s", KIND_BANNER[kind], s_rules[first].channel);
+    }
+    return true;
+}
+
+int cellar_alarm_format_json(char *buf, size_t len) {
+    if (!buf || len == 0) return -1;
+    alarm_kind_t raised[CELLAR_ALARM_MAX_RULES];
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < s_rule_count; ++i) raised[i] = s_state[i].raised;
+    portEXIT_CRITICAL(&s_lock);
+
+    int written = snprintf(buf, len, "[");
+    bool first = true;
+    for (size_t i = 0; i < s_rule_count && written > 0 && written < (int)len; ++i) {
+        if (raised[i] == ALARM_NONE) continue;
+        written += snprintf(buf + written, len - written, "%s\"%s:%s\"", first ? "" : ",",
+                            s_rules[i].channel, KIND_NAMES[raised[i]]);
+        first = false;
+    }
+    if (written > 0 && written < (int)len) {
+        written += snprintf(buf + written, len - written, "]");
+    }
+    if (written <= 0 || written >= (int)len) {
+        buf[0] = '\0';
+        return -1;
+    }
+    return written;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cellar_sensors.h"
+#include "esp_err.h"
+
+// Threshold and rate-of-change alarms, evaluated on every sample the sampler
+// acquires rather than once per post interval.
+//
+// A rule watches one channel: a temperature sensor id ("bme280" or a DS18B20
+// ROM id), "pressure_hpa", "humidity_pct", "opt3001_lux" or "veml7700_lux".
+// Limits left at NAN are not checked. An alarm clears once its rule has held
+// for CELLAR_ALARM_CLEAR_MS, so a value hovering at a limit does not flap.
+typedef struct {
+    const char *channel;
+    float min;
+    float max;
+    float max_rate_per_min;  // largest allowed change per minute, either way
+} cellar_alarm_rule_t;
+
+// Use these rules from now on. The table must outlive the component.
+esp_err_t cellar_alarm_init(const cellar_alarm_rule_t *rules, size_t count);
+
+// Check a fresh sample against every rule. Returns true if an alarm was
+// raised or cleared, i.e. the sample should go to the server now. Channels
+// that are missing or NaN keep their previous state.
+bool cellar_alarm_evaluate(const cellar_sample_t *sample);
+
+// Number of alarms currently raised.
+size_t cellar_alarm_active_count(void);
+
+// One-line summary for the display, e.g. "HIGH bme280", or "HIGH+1 bme280"
+// when another alarm is raised as well. Returns false
+// (and an empty string) when nothing is raised.
+bool cellar_alarm_banner(char *buf, size_t len);
+
+// Raised alarms as a JSON array, e.g. ["bme280:high","opt3001_lux:rate"].
+// Returns the length written, or -1 if it did not fit.
+int cellar_alarm_format_json(char *buf, size_t len);
@@ -0,0 +1,400 @@
+#include "cellar_binlog.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cellar_tasks.h"
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Records waiting for the drain task; a power of two. 64 bytes each.
+#ifndef CELLAR_BINLOG_SLOTS
+#define CELLAR_BINLOG_SLOTS 64
+#endif
+// Records kept after logging, for GET /log. 60 bytes each.
+#ifndef CELLAR_BINLOG_RECENT
+#define CELLAR_BINLOG_RECENT 32
+#endif
+#define DRAIN_TASK_STACK 3072
+#define LINE_MAX 192
+// A line logged this much later than it was written says so.
+#define LAG_NOTE_MS 100
+
+_Static_assert((CELLAR_BINLOG_SLOTS & (CELLAR_BINLOG_SLOTS - 1)) == 0, "CELLAR_BINLOG_SLOTS must be a power of two");
+_Static_assert(sizeof(cellar_binlog_record_t) == 60, "record layout is shared with tools/binlog_decode.py");
+
+const char cellar_binlog_anchor[] = "cellar_binlog";
+
+// Bounded MPMC queue (Vyukov), used with one consumer. The slot for
+// position pos is free for the writer when its sequence is pos, and holds a
+// record for the reader when it is pos + 1. seq stores the sequence minus
+// the slot index, so the zeroed ring is already initialised.
+typedef struct {
+    atomic_uint seq;
+    cellar_binlog_record_t record;
+} slot_t;
+
+static slot_t s_slots[CELLAR_BINLOG_SLOTS];
+static atomic_uint s_head = 0;  // next write position
+static uint32_t s_tail = 0;     // next read position; consumer only
+static atomic_uint s_written = 0;
+static atomic_uint s_dropped = 0;
+static atomic_uint s_high_water = 0;
+static atomic_bool s_drain_idle = false;
+static TaskHandle_t s_task = NULL;
+
+static cellar_binlog_record_t s_recent[CELLAR_BINLOG_RECENT];
+static uint32_t s_recent_total = 0;
+static portMUX_TYPE s_recent_mux = portMUX_INITIALIZER_UNLOCKED;
+
+typedef enum { ARG_NONE, ARG_INT, ARG_WIDE, ARG_DOUBLE, ARG_STRING, ARG_POINTER } arg_kind_t;
+
+// One conversion: fmt[start, body) is "%" with flags, width and precision;
+// the length modifier follows; conv is the conversion character.
+typedef struct {
+    const char *start;
+    const char *body;
+    const char *end;  // just past conv
+    char conv;
+    arg_kind_t kind;
+    bool is_signed;
+} conv_t;
+
+// Parse the conversion starting at percent. False if unsupported.
+static bool parse_conv(const char *percent, conv_t *out) {
+    const char *p = percent + 1;
+    while (*p && strchr("-+ #0", *p)) p++;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    const char *body = p;
+    int longs = 0;
+    bool wide = false;
+    while (*p && strchr("hlzjtL", *p)) {
+        if (*p == 'l') longs++;
+        if (*p == 'z' || *p == 'j' || *p == 't') wide = true;
+        if (*p == 'L') return false;
+        p++;
+    }
+    *out = (conv_t){.start = percent, .body = body, .end = p + 1, .conv = *p};
+    switch (*p) {
+        case '%':
+            out->kind = ARG_NONE;
+            return body == percent + 1;
+        case 'd':
+        case 'i':
+            out->is_signed = true;
+            // fall through
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'c':
+            out->kind = (longs > 0 || wide) ? ARG_WIDE : ARG_INT;
+            return true;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            out->kind = ARG_DOUBLE;
+            return true;
+        case 's':
+            out->kind = ARG_STRING;
+            return longs == 0;
+        case 'p':
+            out->kind = ARG_POINTER;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Pull the conversion's argument off ap (by its C type) and widen it.
+static int64_t va_int(va_list *ap, const conv_t *c, const char *length) {
+    bool ll = length[0] == 'l' && length[1] == 'l';
+    if (c->kind == ARG_INT) return c->is_signed ? va_arg(*ap, int) : (int64_t)va_arg(*ap, unsigned int);
+    switch (length[0]) {
+        case 'l':
+            if (ll) return c->is_signed ? va_arg(*ap, long long) : (int64_t)va_arg(*ap, unsigned long long);
+            return c->is_signed ? va_arg(*ap, long) : (int64_t)va_arg(*ap, unsigned long);
+        case 'z':
+            return (int64_t)va_arg(*ap, size_t);
+        case 'j':
+            return c->is_signed ? va_arg(*ap, intmax_t) : (int64_t)va_arg(*ap, uintmax_t);
+        default:  // 't'
+            return va_arg(*ap, ptrdiff_t);
+    }
+}
+
+static void pack(cellar_binlog_record_t *record, const char *fmt, va_list *ap) {
+    uint8_t *out = record->args;
+    size_t room = sizeof(record->args);
+    const char *p = strchr(fmt, '%');
+    for (; p; p = strchr(p, '%')) {
+        conv_t c;
+        if (!parse_conv(p, &c)) break;
+        p = c.end;
+        if (c.kind == ARG_NONE) continue;
+        if (c.kind == ARG_INT || c.kind == ARG_WIDE) {
+            int64_t v = va_int(ap, &c, c.body);
+            size_t size = c.kind == ARG_INT ? 4 : 8;
+            if (room < size) break;
+            if (c.kind == ARG_INT) {
+                int32_t v32 = (int32_t)v;
+                memcpy(out, &v32, 4);
+            } else {
+                memcpy(out, &v, 8);
+            }
+            out += size;
+            room -= size;
+        } else if (c.kind == ARG_DOUBLE) {
+            double v = va_arg(*ap, double);
+            if (room < 8) break;
+            memcpy(out, &v, 8);
+            out += 8;
+            room -= 8;
+        } else if (c.kind == ARG_POINTER) {
+            uint64_t v = (uintptr_t)va_arg(*ap, void *);
+            if (room < 8) break;
+            memcpy(out, &v, 8);
+            out += 8;
+            room -= 8;
+        } else {
+            const char *s = va_arg(*ap, const char *);
+            if (!s) s = "(null)";
+            if (room < 1) break;
+            size_t n = strnlen(s, room - 1);
+            *out++ = (uint8_t)n;
+            memcpy(out, s, n);
+            out += n;
+            room -= n + 1;
+            if (s[n] != '\0') break;  // cut short; nothing after it fits either
+        }
+    }
+    record->len = (uint8_t)(out - record->args);
+    // Stopped before the end of the format: an unsupported conversion, or the
+    // arguments ran out of room.
+    if (p) record->level |= CELLAR_BINLOG_TRUNCATED;
+}
+
+static inline int32_t offset_of(const char *s) {
+    return (int32_t)((intptr_t)s - (intptr_t)cellar_binlog_anchor);
+}
+
+static inline const char *address_of(int32_t offset) {
+    return cellar_binlog_anchor + offset;
+}
+
+static inline slot_t *slot_at(uint32_t pos) {
+    return &s_slots[pos & (CELLAR_BINLOG_SLOTS - 1)];
+}
+
+static inline uint32_t load_seq(uint32_t pos) {
+    return atomic_load_explicit(&slot_at(pos)->seq, memory_order_acquire) + (pos & (CELLAR_BINLOG_SLOTS - 1));
+}
+
+static inline void store_seq(uint32_t pos, uint32_t seq) {
+    atomic_store_explicit(&slot_at(pos)->seq, seq - (pos & (CELLAR_BINLOG_SLOTS - 1)), memory_order_release);
+}
+
+void cellar_binlog_write(esp_log_level_t level, const char *tag, const char *fmt, ...) {
+    uint32_t pos = atomic_load_explicit(&s_head, memory_order_relaxed);
+    while (true) {
+        int32_t diff = (int32_t)(load_seq(pos) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s_head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&s_head, memory_order_relaxed);
+        }
+    }
+
+    cellar_binlog_record_t *record = &slot_at(pos)->record;
+    record->ms = esp_log_timestamp();
+    record->fmt = offset_of(fmt);
+    record->tag = offset_of(tag);
+    record->level = (uint8_t)level;
+    va_list ap;
+    va_start(ap, fmt);
+    pack(record, fmt, &ap);
+    va_end(ap);
+    store_seq(pos, pos + 1);
+
+    atomic_fetch_add_explicit(&s_written, 1, memory_order_relaxed);
+    if (atomic_exchange_explicit(&s_drain_idle, false, memory_order_acq_rel) && s_task) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+bool cellar_binlog_pop(cellar_binlog_record_t *out) {
+    if (load_seq(s_tail) != s_tail + 1) return false;
+    memcpy(out, &slot_at(s_tail)->record, sizeof(*out));
+    uint32_t waiting = (uint32_t)atomic_load_explicit(&s_head, memory_order_relaxed) - s_tail;
+    if (waiting > atomic_load_explicit(&s_high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&s_high_water, waiting, memory_order_relaxed);
+    }
+    store_seq(s_tail, s_tail + CELLAR_BINLOG_SLOTS);
+    s_tail++;
+    return true;
+}
+
+const char *cellar_binlog_tag(const cellar_binlog_record_t *record) {
+    return address_of(record->tag);
+}
+
+// Append to buf at *len, keeping it terminated.
+static void append(char *buf, size_t cap, size_t *len, int n) {
+    if (n > 0) *len += (size_t)n;
+    if (*len >= cap) *len = cap - 1;
+}
+
+int cellar_binlog_format(const cellar_binlog_record_t *record, char *buf, size_t cap) {
+    if (cap == 0) return 0;
+    const char *fmt = address_of(record->fmt);
+    const uint8_t *in = record->args;
+    const uint8_t *in_end = record->args + record->len;
+    size_t len = 0;
+    buf[0] = '\0';
+    const char *p = fmt;
+    while (*p && len < cap - 1) {
+        const char *percent = strchr(p, '%');
+        size_t literal = percent ? (size_t)(percent - p) : strlen(p);
+        if (literal > cap - 1 - len) literal = cap - 1 - len;
+        memcpy(buf + len, p, literal);
+        len += literal;
+        buf[len] = '\0';
+        if (!percent) break;
+        conv_t c;
+        if (!parse_conv(percent, &c)) break;
+        p = c.end;
+        if (c.kind == ARG_NONE) {
+            append(buf, cap, &len, snprintf(buf + len, cap - len, "%%"));
+            continue;
+        }
+        // The conversion rebuilt for the stored width: flags, width and
+        // precision as written, then "ll" for 64-bit integers.
+        char spec[24];
+        int head = (int)(c.body - c.start);
+        if (head > (int)sizeof(spec) - 4) break;
+        const char *length = c.kind == ARG_WIDE ? "ll" : "";
+        snprintf(spec, sizeof(spec), "%.*s%s%c", head, c.start, length, c.conv);
+        size_t size = c.kind == ARG_INT ? 4 : (c.kind == ARG_STRING ? 1 : 8);
+        if (in + size > in_end) break;
+        int n = 0;
+        if (c.kind == ARG_INT) {
+            int32_t v;
+            memcpy(&v, in, 4);
+            n = snprintf(buf + len, cap - len, spec, v);
+        } else if (c.kind == ARG_WIDE) {
+            int64_t v;
+            memcpy(&v, in, 8);
+            n = snprintf(buf + len, cap - len, spec, (long long)v);
+        } else if (c.kind == ARG_DOUBLE) {
+            double v;
+            memcpy(&v, in, 8);
+            n = snprintf(buf + len, cap - len, spec, v);
+        } else if (c.kind == ARG_POINTER) {
+            uint64_t v;
+            memcpy(&v, in, 8);
+            n = snprintf(buf + len, cap - len, "0x%llx", (unsigned long long)v);
+        } else {
+            size_t text = in[0];
+            if (in + 1 + text > in_end) break;
+            char s[CELLAR_BINLOG_ARGS_MAX];
+            memcpy(s, in + 1, text);
+            s[text] = '\0';
+            size = 1 + text;
+            n = snprintf(buf + len, cap - len, spec, s);
+        }
+        in += size;
+        append(buf, cap, &len, n);
+    }
+    if (record->level & CELLAR_BINLOG_TRUNCATED) {
+        append(buf, cap, &len, snprintf(buf + len, cap - len, " [truncated]"));
+    }
+    return (int)len;
+}
+
+static void keep_recent(const cellar_binlog_record_t *record) {
+    portENTER_CRITICAL(&s_recent_mux);
+    s_recent[s_recent_total % CELLAR_BINLOG_RECENT] = *record;
+    s_recent_total++;
+    portEXIT_CRITICAL(&s_recent_mux);
+}
+
+static void drain_task(void *arg) {
+    cellar_binlog_record_t record;
+    char line[LINE_MAX];
+    while (true) {
+        // Mark idle before the last look, so a write after it always notifies.
+        atomic_store_explicit(&s_drain_idle, true, memory_order_release);
+        if (!cellar_binlog_pop(&record)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        atomic_store_explicit(&s_drain_idle, false, memory_order_relaxed);
+        keep_recent(&record);
+        cellar_binlog_format(&record, line, sizeof(line));
+        esp_log_level_t level = (esp_log_level_t)(record.level & ~CELLAR_BINLOG_TRUNCATED);
+        uint32_t lag_ms = esp_log_timestamp() - record.ms;
+        if (lag_ms >= LAG_NOTE_MS) {
+            ESP_LOG_LEVEL(level, cellar_binlog_tag(&record), "%s (+%" PRIu32 "ms)", line, lag_ms);
+        } else {
+            ESP_LOG_LEVEL(level, cellar_binlog_tag(&record), "%s", line);
+        }
+    }
+}
+
+esp_err_t cellar_binlog_start(void) {
+    if (s_task) return ESP_OK;
+    BaseType_t created = xTaskCreatePinnedToCore(drain_task, "binlog", DRAIN_TASK_STACK, NULL, CELLAR_PRIO_LOG,
+                                                 &s_task, CELLAR_CORE_APP);
+    return created == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+size_t cellar_binlog_dump_max(void) {
+    return sizeof(cellar_binlog_dump_header_t) + CELLAR_BINLOG_RECENT * sizeof(cellar_binlog_record_t);
+}
+
+size_t cellar_binlog_dump(uint8_t *out, size_t cap) {
+    if (cap < sizeof(cellar_binlog_dump_header_t)) return 0;
+    size_t fits = (cap - sizeof(cellar_binlog_dump_header_t)) / sizeof(cellar_binlog_record_t);
+    cellar_binlog_record_t *records = (cellar_binlog_record_t *)(out + sizeof(cellar_binlog_dump_header_t));
+    portENTER_CRITICAL(&s_recent_mux);
+    uint32_t kept = s_recent_total < CELLAR_BINLOG_RECENT ? s_recent_total : CELLAR_BINLOG_RECENT;
+    uint32_t count = kept < fits ? kept : (uint32_t)fits;
+    for (uint32_t i = 0; i < count; i++) {
+        records[i] = s_recent[(s_recent_total - count + i) % CELLAR_BINLOG_RECENT];
+    }
+    portEXIT_CRITICAL(&s_recent_mux);
+    cellar_binlog_dump_header_t header = {
+        .magic = CELLAR_BINLOG_DUMP_MAGIC,
+        .version = CELLAR_BINLOG_DUMP_VERSION,
+        .record_size = sizeof(cellar_binlog_record_t),
+        .count = (uint16_t)count,
+        .dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed),
+    };
+    memcpy(out, &header, sizeof(header));
+    return sizeof(header) + count * sizeof(cellar_binlog_record_t);
+}
+
+void cellar_binlog_get_stats(cellar_binlog_stats_t *out) {
+    out->written = atomic_load_explicit(&s_written, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    out->high_water = atomic_load_explicit(&s_high_water, memory_order_relaxed);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+// Deferred binary logging for the lines every cycle writes: sensor values,
+// the post status, the charge estimate. ESP_LOGI formats such a line and
+// writes it to the UART in the calling task, which costs milliseconds at
+// 115200 baud. CELLAR_BLOGI instead stores the format's address, the tag
+// and the raw arguments in a lock-free ring, in about a microsecond. A task
+// at the lowest priority formats the records later and logs them through
+// esp_log, so they look the same. tools/binlog_decode.py decodes a raw dump
+// (GET /log on the local endpoint, or sim-binlog.bin) against the firmware
+// ELF.
+//
+// Rules for a call site:
+// - The format and the tag must be string literals, or live as long as the
+//   image. The record keeps only their addresses.
+// - %s arguments are copied, up to the room left in the record.
+// - * widths and precisions, %n and long double are not supported. The
+//   arguments from the first unsupported conversion on are dropped.
+// - Call from tasks only, not from ISRs.
+// Errors and warnings stay on ESP_LOGE/ESP_LOGW, which print at once.
+
+#define CELLAR_BINLOG_ARGS_MAX 46
+#define CELLAR_BINLOG_TRUNCATED 0x80  // in level: arguments did not all fit
+
+// One log call, as stored in the ring and in a dump (little-endian).
+typedef struct __attribute__((packed)) {
+    uint32_t ms;   // esp_log_timestamp() at the call
+    int32_t fmt;   // string addresses relative to cellar_binlog_anchor
+    int32_t tag;
+    uint8_t level; // esp_log_level_t, plus CELLAR_BINLOG_TRUNCATED
+    uint8_t len;   // bytes of args in use
+    // Per conversion: d i o u x X c as int32 (int64 with l, ll, z, j or t);
+    // floating point as double; p as uint64; s as a length byte and the text.
+    uint8_t args[CELLAR_BINLOG_ARGS_MAX];
+} cellar_binlog_record_t;
+
+// Dump layout: this header, then `count` records, oldest first.
+#define CELLAR_BINLOG_DUMP_MAGIC "CBLG"
+#define CELLAR_BINLOG_DUMP_VERSION 1
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t version;
+    uint8_t record_size;  // sizeof(cellar_binlog_record_t)
+    uint16_t count;
+    uint32_t dropped;     // records lost to a full ring since boot
+} cellar_binlog_dump_header_t;
+
+typedef struct {
+    uint32_t written;     // records stored
+    uint32_t dropped;     // records lost because the ring was full
+    uint32_t high_water;  // most records waiting at once
+} cellar_binlog_stats_t;
+
+// Record addresses are offsets from this string; the decoder finds it by name.
+extern const char cellar_binlog_anchor[];
+
+void cellar_binlog_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#if defined(LOG_LOCAL_LEVEL)
+#define CELLAR_BLOG(level, tag, fmt, ...)                                      \
+    do {                                                                       \
+        if (LOG_LOCAL_LEVEL >= (level)) cellar_binlog_write(level, tag, fmt, ##__VA_ARGS__); \
+    } while (0)
+#else
+#define CELLAR_BLOG(level, tag, fmt, ...) cellar_binlog_write(level, tag, fmt, ##__VA_ARGS__)
+#endif
+#define CELLAR_BLOGI(tag, fmt, ...) CELLAR_BLOG(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define CELLAR_BLOGD(tag, fmt, ...) CELLAR_BLOG(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+// Start the task that formats and logs the records. Records written before
+// this wait in the ring (CELLAR_BINLOG_SLOTS of them).
+esp_err_t cellar_binlog_start(void);
+
+// Take the oldest record. Only one task may consume: the drain task once
+// started.
+bool cellar_binlog_pop(cellar_binlog_record_t *out);
+
+// The record's message, without the level, time and tag prefix. Returns the
+// length, truncated to cap - 1.
+int cellar_binlog_format(const cellar_binlog_record_t *record, char *buf, size_t cap);
+const char *cellar_binlog_tag(const cellar_binlog_record_t *record);
+
+// The last CELLAR_BINLOG_RECENT records the drain task logged, as a dump.
+// Returns the bytes written; cellar_binlog_dump_max() is always enough.
+size_t cellar_binlog_dump(uint8_t *out, size_t cap);
+size_t cellar_binlog_dump_max(void);
+
+void cellar_binlog_get_stats(cellar_binlog_stats_t *out);
@@ -0,0 +1,188 @@
+#include "cellar_deflate.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// Plain C with no ESP-IDF dependencies so host/ can build and benchmark it.
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define WINDOW_SIZE (1u << CELLAR_DEFLATE_WINDOW_BITS)
+#define HASH_SIZE (1u << CELLAR_DEFLATE_HASH_BITS)
+
+#if CELLAR_DEFLATE_WINDOW_BITS < 8 || CELLAR_DEFLATE_WINDOW_BITS > 15
+#error "CELLAR_DEFLATE_WINDOW_BITS must be between 8 and 15"
+#endif
+
+static const uint16_t s_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t s_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t s_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t s_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// Nibble-at-a-time table: 64 bytes instead of 1 KiB.
+static const uint32_t s_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t cellar_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ s_crc_table[crc & 0x0F];
+        crc = (crc >> 4) ^ s_crc_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+typedef struct {
+    uint8_t *out;
+    size_t cap;
+    size_t len;
+    uint32_t bits;
+    int nbits;
+    bool overflow;
+} bit_writer_t;
+
+static void put_byte(bit_writer_t *w, uint8_t b) {
+    if (w->len < w->cap) {
+        w->out[w->len++] = b;
+    } else {
+        w->overflow = true;
+    }
+}
+
+// Deflate packs fields LSB-first.
+static void put_bits(bit_writer_t *w, uint32_t value, int count) {
+    w->bits |= value << w->nbits;
+    w->nbits += count;
+    while (w->nbits >= 8) {
+        put_byte(w, (uint8_t)w->bits);
+        w->bits >>= 8;
+        w->nbits -= 8;
+    }
+}
+
+static void flush_bits(bit_writer_t *w) {
+    if (w->nbits > 0) {
+        put_byte(w, (uint8_t)w->bits);
+    }
+    w->bits = 0;
+    w->nbits = 0;
+}
+
+// Huffman codes are defined MSB-first, so they go out bit-reversed.
+static void put_code(bit_writer_t *w, uint32_t code, int len) {
+    uint32_t rev = 0;
+    for (int i = 0; i < len; ++i) {
+        rev = (rev << 1) | ((code >> i) & 1);
+    }
+    put_bits(w, rev, len);
+}
+
+// Fixed literal/length code (RFC 1951 3.2.6).
+static void put_symbol(bit_writer_t *w, int sym) {
+    if (sym < 144) {
+        put_code(w, 0x30 + sym, 8);
+    } else if (sym < 256) {
+        put_code(w, 0x190 + (sym - 144), 9);
+    } else if (sym < 280) {
+        put_code(w, sym - 256, 7);
+    } else {
+        put_code(w, 0xC0 + (sym - 280), 8);
+    }
+}
+
+static void put_match(bit_writer_t *w, size_t len, size_t dist) {
+    int li = 28;
+    while (len < s_len_base[li]) li--;
+    put_symbol(w, 257 + li);
+    if (s_len_extra[li]) put_bits(w, (uint32_t)(len - s_len_base[li]), s_len_extra[li]);
+
+    int di = 29;
+    while (dist < s_dist_base[di]) di--;
+    put_code(w, (uint32_t)di, 5);
+    if (s_dist_extra[di]) put_bits(w, (uint32_t)(dist - s_dist_base[di]), s_dist_extra[di]);
+}
+
+static inline uint32_t hash3(const uint8_t *p) {
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - CELLAR_DEFLATE_HASH_BITS);
+}
+
+static void put_le32(bit_writer_t *w, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        put_byte(w, (uint8_t)(v >> (8 * i)));
+    }
+}
+
+size_t cellar_gzip_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap) {
+    if (!in || !out || in_len > CELLAR_DEFLATE_MAX_INPUT) return 0;
+
+    bit_writer_t w = {.out = out, .cap = out_cap};
+    // Header: magic, deflate, no flags, no mtime, no extra flags, OS unknown.
+    static const uint8_t header[10] = {0x1F, 0x8B, 0x08, 0, 0, 0, 0, 0, 0, 0xFF};
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        put_byte(&w, header[i]);
+    }
+
+    put_bits(&w, 1, 1);  // BFINAL
+    put_bits(&w, 1, 2);  // BTYPE = fixed Huffman
+
+    uint16_t head[HASH_SIZE];  // position + 1 of the last occurrence; 0 = none
+    memset(head, 0, sizeof(head));
+
+    size_t i = 0;
+    while (i < in_len && !w.overflow) {
+        size_t best_len = 0;
+        size_t best_dist = 0;
+        if (i + MIN_MATCH <= in_len) {
+            uint32_t h = hash3(in + i);
+            size_t cand = head[h];
+            head[h] = (uint16_t)(i + 1);
+            if (cand > 0 && i - (cand - 1) <= WINDOW_SIZE) {
+                cand--;
+                size_t max = in_len - i;
+                if (max > MAX_MATCH) max = MAX_MATCH;
+                size_t len = 0;
+                while (len < max && in[cand + len] == in[i + len]) len++;
+                if (len >= MIN_MATCH) {
+                    best_len = len;
+                    best_dist = i - cand;
+                }
+            }
+        }
+
+        if (best_len > 0) {
+            put_match(&w, best_len, best_dist);
+            // Index positions inside the match so later repeats can find them.
+            size_t end = i + best_len;
+            for (size_t k = i + 1; k < end && k + MIN_MATCH <= in_len; ++k) {
+                head[hash3(in + k)] = (uint16_t)(k + 1);
+            }
+            i = end;
+        } else {
+            put_symbol(&w, in[i]);
+            i++;
+        }
+    }
+
+    put_symbol(&w, 256);  // end of block
+    flush_bits(&w);
+    put_le32(&w, cellar_crc32(0, in, in_len));
+    put_le32(&w, (uint32_t)in_len);
+
+    return w.overflow ? 0 : w.len;
+}
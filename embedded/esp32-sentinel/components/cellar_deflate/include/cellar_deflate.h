@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ77 window. Telemetry bodies repeat keys and ROM ids every ~200 bytes, so
+// a 1 KiB window catches nearly everything a 32 KiB one would.
+#ifndef CELLAR_DEFLATE_WINDOW_BITS
+#define CELLAR_DEFLATE_WINDOW_BITS 10
+#endif
+
+// Hash table of last positions (2 bytes per slot, on the caller's stack).
+#ifndef CELLAR_DEFLATE_HASH_BITS
+#define CELLAR_DEFLATE_HASH_BITS 9
+#endif
+
+// Positions are stored as 16-bit offsets.
+#define CELLAR_DEFLATE_MAX_INPUT 65534
+
+// Worst case output for in_len bytes: fixed-Huffman literals are at most
+// 9 bits, plus the gzip header and trailer.
+#define CELLAR_GZIP_BOUND(in_len) ((in_len) + (in_len) / 8 + 32)
+
+// Compress in[0..in_len) into one gzip member (RFC 1952) holding a single
+// fixed-Huffman deflate block. Greedy matching, one candidate per hash slot;
+// no allocation. Returns the compressed length, or 0 if out_cap is too small
+// or in_len exceeds CELLAR_DEFLATE_MAX_INPUT.
+size_t cellar_gzip_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+
+// Standard CRC-32 (IEEE, reflected). Pass 0 to start.
+uint32_t cellar_crc32(uint32_t crc, const uint8_t *data, size_t len);
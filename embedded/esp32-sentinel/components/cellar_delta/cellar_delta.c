@@ -0,0 +1,125 @@
+#include "cellar_delta.h"
+
+#include <string.h>
+
+enum { STATE_CONTROL, STATE_ADD, STATE_INSERT, STATE_DONE };
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+bool cellar_delta_parse_header(const uint8_t *buf, size_t len, cellar_delta_header_t *out) {
+    if (!buf || !out || len < CELLAR_DELTA_HEADER_SIZE) return false;
+    if (memcmp(buf, CELLAR_DELTA_MAGIC, 4) != 0) return false;
+    out->old_size = le32(buf + 4);
+    out->new_size = le32(buf + 8);
+    memcpy(out->old_elf_sha256, buf + 12, 32);
+    memcpy(out->new_sha256, buf + 44, 32);
+    return out->new_size > 0;
+}
+
+void cellar_delta_init(cellar_delta_t *d, const cellar_delta_header_t *header,
+                       cellar_delta_read_fn read_old, cellar_delta_write_fn write_new, void *ctx) {
+    memset(d, 0, sizeof(*d));
+    d->read_old = read_old;
+    d->write_new = write_new;
+    d->ctx = ctx;
+    d->old_size = header->old_size;
+    d->new_size = header->new_size;
+    d->state = STATE_CONTROL;
+}
+
+static cellar_delta_status_t flush_out(cellar_delta_t *d) {
+    if (d->out_len == 0) return CELLAR_DELTA_OK;
+    if (d->write_new(d->ctx, d->out_buf, d->out_len) != 0) return CELLAR_DELTA_ERR_IO;
+    d->written += (uint32_t)d->out_len;
+    d->out_len = 0;
+    return CELLAR_DELTA_OK;
+}
+
+// Bytes that still fit in the output buffer and in the new image.
+static size_t out_room(const cellar_delta_t *d) {
+    size_t room = sizeof(d->out_buf) - d->out_len;
+    uint32_t left = d->new_size - d->written - (uint32_t)d->out_len;
+    return room < left ? room : left;
+}
+
+static cellar_delta_status_t finish_record(cellar_delta_t *d) {
+    int64_t pos = (int64_t)d->old_pos + d->seek;
+    if (pos < 0 || pos > d->old_size) return CELLAR_DELTA_ERR_RANGE;
+    d->old_pos = (uint32_t)pos;
+    d->state = STATE_CONTROL;
+    if (d->written + d->out_len == d->new_size) {
+        cellar_delta_status_t st = flush_out(d);
+        if (st != CELLAR_DELTA_OK) return st;
+        d->state = STATE_DONE;
+        return CELLAR_DELTA_DONE;
+    }
+    return CELLAR_DELTA_OK;
+}
+
+cellar_delta_status_t cellar_delta_feed(cellar_delta_t *d, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        if (d->state == STATE_DONE) return CELLAR_DELTA_ERR_FORMAT;  // trailing data
+
+        if (d->state == STATE_CONTROL) {
+            size_t take = sizeof(d->ctrl) - d->ctrl_len;
+            if (take > len) take = len;
+            memcpy(d->ctrl + d->ctrl_len, data, take);
+            d->ctrl_len += (uint8_t)take;
+            data += take;
+            len -= take;
+            if (d->ctrl_len < sizeof(d->ctrl)) break;
+
+            d->ctrl_len = 0;
+            d->add_left = le32(d->ctrl);
+            d->insert_left = le32(d->ctrl + 4);
+            d->seek = (int32_t)le32(d->ctrl + 8);
+            uint64_t produced = (uint64_t)d->written + d->out_len + d->add_left + d->insert_left;
+            if (produced > d->new_size) return CELLAR_DELTA_ERR_FORMAT;
+            if ((uint64_t)d->old_pos + d->add_left > d->old_size) return CELLAR_DELTA_ERR_RANGE;
+            d->state = d->add_left ? STATE_ADD : d->insert_left ? STATE_INSERT : STATE_CONTROL;
+            if (d->state == STATE_CONTROL) {
+                cellar_delta_status_t st = finish_record(d);
+                if (st != CELLAR_DELTA_OK) return st;
+            }
+            continue;
+        }
+
+        size_t n = d->state == STATE_ADD ? d->add_left : d->insert_left;
+        if (n > len) n = len;
+        size_t room = out_room(d);
+        if (n > room) n = room;
+        if (n == 0) {
+            cellar_delta_status_t st = flush_out(d);
+            if (st != CELLAR_DELTA_OK) return st;
+            continue;
+        }
+
+        uint8_t *out = d->out_buf + d->out_len;
+        if (d->state == STATE_ADD) {
+            if (d->read_old(d->ctx, d->old_pos, d->old_buf, n) != 0) return CELLAR_DELTA_ERR_IO;
+            for (size_t i = 0; i < n; ++i) out[i] = (uint8_t)(d->old_buf[i] + data[i]);
+            d->old_pos += (uint32_t)n;
+            d->add_left -= (uint32_t)n;
+            if (d->add_left == 0) d->state = d->insert_left ? STATE_INSERT : STATE_CONTROL;
+        } else {
+            memcpy(out, data, n);
+            d->insert_left -= (uint32_t)n;
+            if (d->insert_left == 0) d->state = STATE_CONTROL;
+        }
+        d->out_len += n;
+        data += n;
+        len -= n;
+
+        if (d->out_len == sizeof(d->out_buf)) {
+            cellar_delta_status_t st = flush_out(d);
+            if (st != CELLAR_DELTA_OK) return st;
+        }
+        if (d->state == STATE_CONTROL) {
+            cellar_delta_status_t st = finish_record(d);
+            if (st != CELLAR_DELTA_OK) return st;
+        }
+    }
+    return d->state == STATE_DONE ? CELLAR_DELTA_DONE : CELLAR_DELTA_OK;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming applier for binary firmware patches made by tools/mkdelta.py.
+//
+// A patch is a fixed header followed by a raw deflate stream. Inflated, the
+// stream is a list of bsdiff-style records, all integers little-endian:
+//
+//   u32 add_len, u32 insert_len, i32 seek,
+//   add_len bytes    new = old[pos++] + byte (mod 256)
+//   insert_len bytes copied to the output as they are
+//   then pos += seek
+//
+// Code that moved keeps most of its bytes, so the added differences are
+// mostly zero and deflate well. The applier reads the old image and writes
+// the new one through callbacks in CELLAR_DELTA_CHUNK pieces, so its RAM use
+// does not depend on the image size. Inflating is left to the caller (the
+// ROM inflater on the device, zlib on the host).
+
+#define CELLAR_DELTA_MAGIC "CDP1"
+#define CELLAR_DELTA_HEADER_SIZE 80
+#define CELLAR_DELTA_CHUNK 512
+
+typedef struct {
+    uint32_t old_size;
+    uint32_t new_size;
+    uint8_t old_elf_sha256[32];  // esp_app_desc_t.app_elf_sha256 of the base image
+    uint8_t new_sha256[32];      // SHA-256 of the complete new image file
+} cellar_delta_header_t;
+
+typedef enum {
+    CELLAR_DELTA_OK = 0,          // consumed, need more input
+    CELLAR_DELTA_DONE = 1,        // new_size bytes written
+    CELLAR_DELTA_ERR_FORMAT = -1, // malformed record or trailing data
+    CELLAR_DELTA_ERR_RANGE = -2,  // reads outside the old image
+    CELLAR_DELTA_ERR_IO = -3,     // a callback failed
+} cellar_delta_status_t;
+
+// Callbacks return 0 on success.
+typedef int (*cellar_delta_read_fn)(void *ctx, uint32_t offset, uint8_t *buf, size_t len);
+typedef int (*cellar_delta_write_fn)(void *ctx, const uint8_t *buf, size_t len);
+
+typedef struct {
+    cellar_delta_read_fn read_old;
+    cellar_delta_write_fn write_new;
+    void *ctx;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint32_t old_pos;
+    uint32_t written;
+    uint32_t add_left;
+    uint32_t insert_left;
+    int32_t seek;
+    uint8_t state;
+    uint8_t ctrl_len;
+    uint8_t ctrl[12];
+    size_t out_len;
+    uint8_t old_buf[CELLAR_DELTA_CHUNK];
+    uint8_t out_buf[CELLAR_DELTA_CHUNK];
+} cellar_delta_t;
+
+// Parse the CELLAR_DELTA_HEADER_SIZE-byte header. Returns false on a bad magic.
+bool cellar_delta_parse_header(const uint8_t *buf, size_t len, cellar_delta_header_t *out);
+
+void cellar_delta_init(cellar_delta_t *d, const cellar_delta_header_t *header,
+                       cellar_delta_read_fn read_old, cellar_delta_write_fn write_new, void *ctx);
+
+// Apply the next inflated bytes of the patch body.
+cellar_delta_status_t cellar_delta_feed(cellar_delta_t *d, const uint8_t *data, size_t len);
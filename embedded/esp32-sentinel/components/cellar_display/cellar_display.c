@@ -1,10 +1,13 @@
 #include "cellar_display.h"
 
 #include <math.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "cellar_supervisor.h"
+#include "cellar_tasks.h"
 #include "config.h"
 #include "esp_err.h"
 #include "esp_lcd_panel_io.h"
@@ -13,8 +16,8 @@
 #include "esp_lcd_types.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 
 // Default pins/addresses match config.h fallback values
 #ifndef OLED_ADDRESS
@@ -30,11 +33,24 @@
 #define I2C_FREQ_HZ 100000
 #endif
 
+#define PAGE_ROTATE_MS 3000
+#define ALARM_BLINK_MS 500
+// An idle display still checks in this often.
+#define DISPLAY_IDLE_WAIT_MS (60 * 1000)
+// A render and an I2C flush take ~100 ms at 100 kHz.
+#define DISPLAY_CHECKIN_MS (5 * 1000)
+#define DISPLAY_STALL_MS (10 * 1000)
+#define DISPLAY_TASK_STACK 4096
+#define OP_FLUSH "i2c flush"
+
 static const char *TAG = "cellar_display";
 static esp_lcd_panel_io_handle_t s_panel_io = NULL;
 static esp_lcd_panel_handle_t s_panel = NULL;
+static i2c_master_bus_handle_t s_bus = NULL;
 static bool s_display_ok = false;
 static uint8_t s_framebuffer[OLED_WIDTH * OLED_HEIGHT / 8] = {0};
+static uint8_t s_flushed[OLED_WIDTH * OLED_HEIGHT / 8] = {0};
+static bool s_flushed_valid = false;
 
 static cellar_display_status_t s_status = {
     .temp_count = 0,
@@ -44,10 +60,20 @@ static cellar_display_status_t s_status = {
     .http_status = -1,
     .post_err = ESP_OK,
     .ip_address = "",
-    .status_line = ""
+    .status_line = "",
+    .alarm_line = ""
 };
-static SemaphoreHandle_t s_mutex = NULL;
+// Seqlock around s_status: a writer makes the sequence odd, copies, then makes
+// it even again; the renderer retries if it saw an odd or changed sequence.
+// Writers only serialise against each other (for the length of a memcpy), so
+// an update is never dropped and never waits on rendering or I2C.
+static atomic_uint s_status_seq = 0;
+static portMUX_TYPE s_write_lock = portMUX_INITIALIZER_UNLOCKED;
 static TaskHandle_t s_display_task_handle = NULL;
+// Wakes the display task. A semaphore rather than a task notification, so a
+// restarted task picks up where the stalled one left off.
+static SemaphoreHandle_t s_wake = NULL;
+static cellar_supervisor_id_t s_supervisor_id = -1;
 
 // Minimal 5x7 ASCII font (0x20-0x7F), columns packed LSB = top row.
 static const uint8_t FONT_5X7[][5] = {
@@ -250,13 +276,34 @@ static void draw_text_scaled(int x, int y, const char *text, int scale, bool inv
 
 static void flush_display(void) {
     if (!s_display_ok) return;
+    // Skip the I2C transfer when the page looks exactly like the last one.
+    if (s_flushed_valid && memcmp(s_flushed, s_framebuffer, sizeof(s_framebuffer)) == 0) {
+        return;
+    }
+    cellar_supervisor_op(s_supervisor_id, OP_FLUSH);
     esp_err_t err = esp_lcd_panel_draw_bitmap(s_panel, 0, 0, OLED_WIDTH, OLED_HEIGHT, s_framebuffer);
+    cellar_supervisor_op(s_supervisor_id, "render");
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "SSD1306 flush failed: %s", esp_err_to_name(err));
+        s_flushed_valid = false;
+        return;
     }
+    memcpy(s_flushed, s_framebuffer, sizeof(s_flushed));
+    s_flushed_valid = true;
 }
 
-static void render_status_page(const cellar_display_status_t *status, int page) {
+// Row 7 normally shows the network status; a raised alarm takes it over and
+// alternates between inverted and plain text.
+static void draw_bottom_line(const cellar_display_status_t *status, const char *line_network,
+                             bool blink_on) {
+    if (status->alarm_line[0]) {
+        draw_text_line(7, status->alarm_line, blink_on);
+    } else {
+        draw_text_line(7, line_network, false);
+    }
+}
+
+static void render_status_page(const cellar_display_status_t *status, int page, bool blink_on) {
     clear_framebuffer();
 
     char line_temp[32];
@@ -341,7 +388,7 @@ static void render_status_page(const cellar_display_status_t *status, int page)
     if (status->status_line[0]) {
         snprintf(line_status, sizeof(line_status), "%s", status->status_line);
         draw_text_scaled(0, 0, line_status, 2, false);
-        draw_text_line(7, line_network, false);
+        draw_bottom_line(status, line_network, blink_on);
     } else {
         // Row 0-1 (pages 0-1): Temperature (2x scale = 14px)
         draw_text_scaled(0, 0, line_temp, 2, false);
@@ -353,30 +400,92 @@ static void render_status_page(const cellar_display_status_t *status, int page)
         draw_text_scaled(0, 24, line_mid, 2, false);
         // Row 5-6: Lux (1x)
         draw_text_scaled(0, 40, line_lux, 2, false);
-        // Row 7: Networking
-        draw_text_line(7, line_network, false);
+        // Row 7: Networking (or the alarm banner)
+        draw_bottom_line(status, line_network, blink_on);
     }
     flush_display();
 }
 
+static uint32_t read_status(cellar_display_status_t *out) {
+    uint32_t seq;
+    do {
+        seq = atomic_load_explicit(&s_status_seq, memory_order_acquire);
+        memcpy(out, &s_status, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1u) || seq != atomic_load_explicit(&s_status_seq, memory_order_relaxed));
+    return seq;
+}
+
+static int page_count(const cellar_display_status_t *status) {
+    // The claim/status screen ignores the page index.
+    if (status->status_line[0]) return 1;
+    // Each temperature gets 2 pages (pressure + humidity alternation)
+    int num_temps = status->temp_count > 0 ? status->temp_count : 1;
+    return num_temps * 2;
+}
+
+// Sleeps until new data arrives, the page is due to rotate or an alarm banner
+// is due to flash, and renders only when one of them actually changed.
 static void display_task(void *pvParameters) {
     int page = 0;
+    int rendered_page = -1;
+    uint32_t rendered_seq = UINT32_MAX;
+    bool blink_on = true;
+    bool rendered_blink = true;
+    bool was_alarm = false;
+    TickType_t rotated_at = xTaskGetTickCount();
+    TickType_t blinked_at = rotated_at;
     cellar_display_status_t local_status;
 
     while (true) {
-        if (xSemaphoreTake(s_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            memcpy(&local_status, &s_status, sizeof(cellar_display_status_t));
-            xSemaphoreGive(s_mutex);
+        cellar_supervisor_checkin(s_supervisor_id);
+        cellar_supervisor_op(s_supervisor_id, "render");
+        uint32_t seq = read_status(&local_status);
+        int max_pages = page_count(&local_status);
+        if (page >= max_pages) {
+            page = 0;
         }
+        bool alarm = local_status.alarm_line[0] != '\0';
+        if (alarm && !was_alarm) {
+            // A new alarm starts inverted and holds for a full blink period.
+            blink_on = true;
+            blinked_at = xTaskGetTickCount();
+        }
+        was_alarm = alarm;
 
-        // Each temperature gets 2 pages (pressure + humidity alternation)
-        int num_temps = local_status.temp_count > 0 ? local_status.temp_count : 1;
-        int max_pages = num_temps * 2;
-
-        render_status_page(&local_status, page);
-        page = (page + 1) % max_pages;
+        if (seq != rendered_seq || page != rendered_page || (alarm && blink_on != rendered_blink)) {
+            render_status_page(&local_status, page, blink_on);
+            rendered_seq = seq;
+            rendered_page = page;
+            rendered_blink = blink_on;
+        }
 
-        vTaskDelay(pdMS_TO_TICKS(3000));
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = pdMS_TO_TICKS(DISPLAY_IDLE_WAIT_MS);
+        if (max_pages > 1) {
+            TickType_t elapsed = now - rotated_at;
+            TickType_t period = pdMS_TO_TICKS(PAGE_ROTATE_MS);
+            wait = elapsed >= period ? 0 : period - elapsed;
+        }
+        if (alarm) {
+            TickType_t elapsed = now - blinked_at;
+            TickType_t period = pdMS_TO_TICKS(ALARM_BLINK_MS);
+            TickType_t blink_wait = elapsed >= period ? 0 : period - elapsed;
+            if (blink_wait < wait) wait = blink_wait;
+        }
+        cellar_supervisor_op(s_supervisor_id, NULL);
+        cellar_supervisor_checkin_within(s_supervisor_id, pdTICKS_TO_MS(wait));
+        if (xSemaphoreTake(s_wake, wait) != pdTRUE) {
+            now = xTaskGetTickCount();
+            if (max_pages > 1 && now - rotated_at >= pdMS_TO_TICKS(PAGE_ROTATE_MS)) {
+                page = (page + 1) % max_pages;
+                rotated_at = now;
+            }
+            if (alarm && now - blinked_at >= pdMS_TO_TICKS(ALARM_BLINK_MS)) {
+                blink_on = !blink_on;
+                blinked_at = now;
+            }
+        }
     }
 }
 
@@ -385,12 +494,6 @@ esp_err_t cellar_display_init(i2c_master_bus_handle_t bus) {
         return ESP_OK;
     }
 
-    s_mutex = xSemaphoreCreateMutex();
-    if (!s_mutex) {
-        ESP_LOGE(TAG, "Failed to create mutex");
-        return ESP_FAIL;
-    }
-
     esp_lcd_panel_io_i2c_config_t io_config = {
         .dev_addr = OLED_ADDRESS,
         .scl_speed_hz = I2C_FREQ_HZ,
@@ -406,6 +509,7 @@ esp_err_t cellar_display_init(i2c_master_bus_handle_t bus) {
         },
     };
 
+    s_bus = bus;
     esp_err_t err = esp_lcd_new_panel_io_i2c(bus, &io_config, &s_panel_io);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "SSD1306 IO init failed: %s", esp_err_to_name(err));
@@ -456,18 +560,56 @@ esp_err_t cellar_display_init(i2c_master_bus_handle_t bus) {
     return ESP_OK;
 }
 
-void cellar_display_start(void) {
-    if (s_display_ok && s_display_task_handle == NULL) {
-        xTaskCreate(display_task, "display_task", 4096, NULL, 5, &s_display_task_handle);
+static bool create_display_task(void) {
+    return xTaskCreatePinnedToCore(display_task, "display_task", DISPLAY_TASK_STACK, NULL, CELLAR_PRIO_DISPLAY,
+                                   &s_display_task_handle, CELLAR_CORE_APP) == pdPASS;
+}
+
+// Runs on the supervisor. A hung flush is a wedged bus: clock it free, which
+// fails the transfer. Stuck anywhere else, the task holds no driver lock and
+// is replaced. A second stall restarts the device.
+static bool recover_display(int attempt, const char *op) {
+    if (attempt > 1) return false;
+    if (op && strcmp(op, OP_FLUSH) == 0) {
+        esp_err_t err = i2c_master_bus_reset(s_bus);
+        ESP_LOGW(TAG, "Reset I2C bus under a hung flush: %s", esp_err_to_name(err));
+        return err == ESP_OK;
     }
+    ESP_LOGW(TAG, "Restarting display task");
+    vTaskDelete(s_display_task_handle);
+    s_display_task_handle = NULL;
+    s_flushed_valid = false;
+    return create_display_task();
+}
+
+void cellar_display_start(void) {
+    if (!s_display_ok || s_display_task_handle != NULL) return;
+    s_wake = xSemaphoreCreateBinary();
+    if (!s_wake) return;
+    cellar_supervisor_config_t supervised = {
+        .name = "display",
+        .period_ms = DISPLAY_CHECKIN_MS,
+        .timeout_ms = DISPLAY_STALL_MS,
+        .recover = recover_display,
+    };
+    s_supervisor_id = cellar_supervisor_add(&supervised);
+    create_display_task();
 }
 
 bool cellar_display_ready(void) { return s_display_ok; }
 
 void cellar_display_update(const cellar_display_status_t *status) {
-    if (!s_display_ok || !status || !s_mutex) return;
-    if (xSemaphoreTake(s_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        memcpy(&s_status, status, sizeof(cellar_display_status_t));
-        xSemaphoreGive(s_mutex);
+    if (!s_display_ok || !status) return;
+
+    portENTER_CRITICAL(&s_write_lock);
+    uint32_t seq = atomic_load_explicit(&s_status_seq, memory_order_relaxed);
+    atomic_store_explicit(&s_status_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&s_status, status, sizeof(cellar_display_status_t));
+    atomic_store_explicit(&s_status_seq, seq + 2, memory_order_release);
+    portEXIT_CRITICAL(&s_write_lock);
+
+    if (s_wake) {
+        xSemaphoreGive(s_wake);
     }
 }
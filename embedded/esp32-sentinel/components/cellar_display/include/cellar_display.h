@@ -20,6 +20,7 @@ typedef struct {
     esp_err_t post_err;      // esp_err_t from the POST attempt
     char ip_address[16];     // dotted-quad string
     char status_line[32];    // optional status message (e.g., "Waiting for approval")
+    char alarm_line[22];     // raised alarm; replaces the bottom line with a flashing inverted banner
 } cellar_display_status_t;
 
 // Initialize the SSD1306 display on the provided I2C bus. Safe to call once.
@@ -31,7 +32,8 @@ void cellar_display_start(void);
 // Returns true if the display was successfully initialized.
 bool cellar_display_ready(void);
 
-// Updates the internal status data. The display task will render it asynchronously.
+// Publishes new status data and wakes the display task. Never blocks and never
+// drops an update; the task re-renders only if the data or the page changed.
 void cellar_display_update(const cellar_display_status_t *status);
 
 // Deprecated: Alias for update
@@ -0,0 +1,431 @@
+#include "cellar_fault.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "driver/i2c_master.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "onewire_bus.h"
+
+#ifndef CELLAR_FAULTS
+#define CELLAR_FAULTS ""
+#endif
+
+#define FAULT_MAX_RULES 8
+#define FAULT_MAX_DEVICES 8
+#define FAULT_SPEC_MAX 256
+
+static const char *TAG = "cellar_fault";
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static cellar_fault_stats_t s_stats;
+static int s_rule_count = 0;
+
+void cellar_fault_get_stats(cellar_fault_stats_t *out) {
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void cellar_fault_log_stats(void) {
+    if (s_rule_count == 0) return;
+    cellar_fault_stats_t stats;
+    cellar_fault_get_stats(&stats);
+    ESP_LOGW(TAG, "Injected (%d rules): nack %lu, stretch %lu, stuck %lu, timeout %lu, corrupt %lu",
+             s_rule_count, (unsigned long)stats.nacks, (unsigned long)stats.stretches,
+             (unsigned long)stats.stuck, (unsigned long)stats.timeouts, (unsigned long)stats.corrupted);
+}
+
+#if CELLAR_FAULT_INJECTION
+
+typedef enum {
+    FAULT_BUS_I2C,
+    FAULT_BUS_ONEWIRE,
+} fault_bus_t;
+
+typedef struct {
+    fault_bus_t bus;
+    bool any;         // every device on the bus
+    uint64_t target;  // I2C address or 1-Wire ROM
+    float nack;
+    float corrupt;
+    float stuck_p;
+    uint32_t stuck_ms;
+    uint32_t stretch_ms;
+    uint32_t after_ms;
+} fault_rule_t;
+
+// Device handles are opaque on target, so remember each one's address as
+// the drivers add them.
+typedef struct {
+    i2c_master_dev_handle_t handle;
+    uint16_t addr;
+} fault_i2c_device_t;
+
+static fault_rule_t s_rules[FAULT_MAX_RULES];
+static bool s_configured = false;
+static fault_i2c_device_t s_i2c_devices[FAULT_MAX_DEVICES];
+// One bus of each kind, as on the sentinel.
+static int64_t s_i2c_stuck_until_us = 0;
+static int64_t s_ow_stuck_until_us = 0;
+static bool s_ow_matched = false;  // MATCH_ROM since the last reset
+static uint64_t s_ow_selected = 0;
+
+static bool parse_probability(const char *value, float *out) {
+    char *end;
+    float p = strtof(value, &end);
+    if (*end != '\0' || p < 0.0f || p > 1.0f) return false;
+    *out = p;
+    return true;
+}
+
+static bool parse_ms(const char *value, uint32_t *out, char **end) {
+    unsigned long ms = strtoul(value, end, 10);
+    if (*end == value) return false;
+    *out = (uint32_t)ms;
+    return true;
+}
+
+static bool parse_param(fault_rule_t *rule, char *param) {
+    char *value = strchr(param, '=');
+    if (!value) return false;
+    *value++ = '\0';
+    char *end;
+    if (strcmp(param, "nack") == 0) return parse_probability(value, &rule->nack);
+    if (strcmp(param, "corrupt") == 0) return parse_probability(value, &rule->corrupt);
+    if (strcmp(param, "stretch") == 0) return parse_ms(value, &rule->stretch_ms, &end) && *end == '\0';
+    if (strcmp(param, "after") == 0) return parse_ms(value, &rule->after_ms, &end) && *end == '\0';
+    if (strcmp(param, "stuck") == 0) {
+        char *slash = strchr(value, '/');
+        if (!slash) return false;
+        *slash = '\0';
+        return parse_probability(value, &rule->stuck_p) && parse_ms(slash + 1, &rule->stuck_ms, &end) &&
+               *end == '\0';
+    }
+    return false;
+}
+
+static bool parse_rule(fault_rule_t *rule, char *text) {
+    char *params = strchr(text, ':');
+    if (!params) return false;
+    *params++ = '\0';
+    char *at = strchr(text, '@');
+    if (at) *at++ = '\0';
+    if (strcmp(text, "i2c") == 0) {
+        rule->bus = FAULT_BUS_I2C;
+    } else if (strcmp(text, "ow") == 0) {
+        rule->bus = FAULT_BUS_ONEWIRE;
+    } else {
+        return false;
+    }
+    rule->any = at == NULL;
+    if (at) {
+        char *end;
+        rule->target = strtoull(at, &end, rule->bus == FAULT_BUS_I2C ? 0 : 16);
+        if (end == at || *end != '\0') return false;
+    }
+    char *save;
+    for (char *param = strtok_r(params, ",", &save); param; param = strtok_r(NULL, ",", &save)) {
+        if (!parse_param(rule, param)) return false;
+    }
+    return true;
+}
+
+esp_err_t cellar_fault_configure(const char *spec) {
+    fault_rule_t rules[FAULT_MAX_RULES];
+    int count = 0;
+    if (spec && spec[0]) {
+        char text[FAULT_SPEC_MAX];
+        if (strlen(spec) >= sizeof(text)) {
+            ESP_LOGE(TAG, "Fault spec too long");
+            return ESP_ERR_INVALID_ARG;
+        }
+        strcpy(text, spec);
+        char *save;
+        for (char *rule = strtok_r(text, ";", &save); rule; rule = strtok_r(NULL, ";", &save)) {
+            if (count == FAULT_MAX_RULES) {
+                ESP_LOGE(TAG, "More than %d fault rules", FAULT_MAX_RULES);
+                return ESP_ERR_INVALID_ARG;
+            }
+            rules[count] = (fault_rule_t){0};
+            if (!parse_rule(&rules[count], rule)) {
+                ESP_LOGE(TAG, "Bad fault rule in \"%s\"", spec);
+                return ESP_ERR_INVALID_ARG;
+            }
+            count++;
+        }
+    }
+    portENTER_CRITICAL(&s_lock);
+    memcpy(s_rules, rules, (size_t)count * sizeof(rules[0]));
+    s_rule_count = count;
+    s_configured = true;
+    portEXIT_CRITICAL(&s_lock);
+    if (count > 0) ESP_LOGW(TAG, "Injecting bus faults: %s", spec);
+    return ESP_OK;
+}
+
+static void ensure_configured(void) {
+    if (s_configured) return;
+    if (cellar_fault_configure(CELLAR_FAULTS) != ESP_OK) {
+        s_configured = true;  // a bad CELLAR_FAULTS is reported once
+    }
+}
+
+// Caller holds s_lock. The first rule naming the device applies, else the
+// first rule for its whole bus; no rule reads as all zeros.
+static fault_rule_t match_rule(fault_bus_t bus, bool known, uint64_t target) {
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    const fault_rule_t *any = NULL;
+    for (int i = 0; i < s_rule_count; ++i) {
+        const fault_rule_t *rule = &s_rules[i];
+        if (rule->bus != bus || now_ms < rule->after_ms) continue;
+        if (!rule->any && known && rule->target == target) return *rule;
+        if (rule->any && !any) any = rule;
+    }
+    return any ? *any : (fault_rule_t){0};
+}
+
+static void count(uint32_t *counter) {
+    portENTER_CRITICAL(&s_lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static bool chance(float p) {
+    if (p <= 0.0f) return false;
+    return p >= 1.0f || esp_random() < (uint32_t)(p * 4294967295.0f);
+}
+
+static void extend_stuck(int64_t *until_us, uint32_t ms) {
+    int64_t until = esp_timer_get_time() + (int64_t)ms * 1000;
+    portENTER_CRITICAL(&s_lock);
+    if (until > *until_us) *until_us = until;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Wait on a held line as a transfer with `timeout_ms` would (-1 waits as
+// long as it takes).
+static esp_err_t hold(int64_t hold_us, int timeout_ms) {
+    if (timeout_ms >= 0 && hold_us > (int64_t)timeout_ms * 1000) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        count(&s_stats.timeouts);
+        return ESP_ERR_TIMEOUT;
+    }
+    vTaskDelay(pdMS_TO_TICKS((hold_us + 999) / 1000));
+    return ESP_OK;
+}
+
+static void corrupt(const fault_rule_t *rule, uint8_t *data, size_t len) {
+    if (len == 0 || !chance(rule->corrupt)) return;
+    data[esp_random() % len] ^= (uint8_t)(1u << (esp_random() % 8));
+    count(&s_stats.corrupted);
+}
+
+// ---------------------------------------------------------------------------
+// I2C
+
+esp_err_t __real_i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                           i2c_master_dev_handle_t *ret_handle);
+esp_err_t __real_i2c_master_bus_rm_device(i2c_master_dev_handle_t handle);
+esp_err_t __real_i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle);
+esp_err_t __real_i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms);
+esp_err_t __real_i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                     size_t write_size, int xfer_timeout_ms);
+esp_err_t __real_i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                                    int xfer_timeout_ms);
+esp_err_t __real_i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                             size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                             int xfer_timeout_ms);
+
+static bool device_addr(i2c_master_dev_handle_t handle, uint16_t *addr) {
+    bool found = false;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < FAULT_MAX_DEVICES && !found; ++i) {
+        if (s_i2c_devices[i].handle == handle) {
+            *addr = s_i2c_devices[i].addr;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return found;
+}
+
+// Faults ahead of a transfer to `addr`: a held bus, then the target's own
+// stuck, stretch and NACK. *rule gets the rule for the read that follows.
+static esp_err_t i2c_before(bool known, uint16_t addr, int timeout_ms, fault_rule_t *rule) {
+    ensure_configured();
+    portENTER_CRITICAL(&s_lock);
+    *rule = match_rule(FAULT_BUS_I2C, known, addr);
+    int64_t held_us = s_i2c_stuck_until_us - esp_timer_get_time();
+    portEXIT_CRITICAL(&s_lock);
+    if (held_us > 0) {
+        count(&s_stats.stuck);
+        esp_err_t err = hold(held_us, timeout_ms);
+        if (err != ESP_OK) return err;
+    }
+    if (chance(rule->stuck_p)) {
+        // The target pulls SDA low part way through: this transfer fails too.
+        count(&s_stats.stuck);
+        extend_stuck(&s_i2c_stuck_until_us, rule->stuck_ms);
+        esp_err_t err = hold((int64_t)rule->stuck_ms * 1000, timeout_ms);
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
+    if (rule->stretch_ms > 0) {
+        count(&s_stats.stretches);
+        esp_err_t err = hold((int64_t)rule->stretch_ms * 1000, timeout_ms);
+        if (err != ESP_OK) return err;
+    }
+    if (chance(rule->nack)) {
+        count(&s_stats.nacks);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t __wrap_i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                           i2c_master_dev_handle_t *ret_handle) {
+    esp_err_t err = __real_i2c_master_bus_add_device(bus_handle, dev_config, ret_handle);
+    if (err != ESP_OK) return err;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < FAULT_MAX_DEVICES; ++i) {
+        if (s_i2c_devices[i].handle == NULL) {
+            s_i2c_devices[i] = (fault_i2c_device_t){*ret_handle, dev_config->device_address};
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t __wrap_i2c_master_bus_rm_device(i2c_master_dev_handle_t handle) {
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < FAULT_MAX_DEVICES; ++i) {
+        if (s_i2c_devices[i].handle == handle) s_i2c_devices[i].handle = NULL;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return __real_i2c_master_bus_rm_device(handle);
+}
+
+// The clocked-out reset frees a target holding SDA low.
+esp_err_t __wrap_i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle) {
+    esp_err_t err = __real_i2c_master_bus_reset(bus_handle);
+    if (err != ESP_OK) return err;
+    portENTER_CRITICAL(&s_lock);
+    s_i2c_stuck_until_us = 0;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t __wrap_i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms) {
+    fault_rule_t rule;
+    esp_err_t err = i2c_before(true, address, xfer_timeout_ms, &rule);
+    if (err == ESP_FAIL) return ESP_ERR_NOT_FOUND;
+    if (err != ESP_OK) return err;
+    return __real_i2c_master_probe(bus_handle, address, xfer_timeout_ms);
+}
+
+esp_err_t __wrap_i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                     size_t write_size, int xfer_timeout_ms) {
+    uint16_t addr = 0;
+    bool known = device_addr(i2c_dev, &addr);
+    fault_rule_t rule;
+    esp_err_t err = i2c_before(known, addr, xfer_timeout_ms, &rule);
+    if (err != ESP_OK) return err;
+    return __real_i2c_master_transmit(i2c_dev, write_buffer, write_size, xfer_timeout_ms);
+}
+
+esp_err_t __wrap_i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                                    int xfer_timeout_ms) {
+    uint16_t addr = 0;
+    bool known = device_addr(i2c_dev, &addr);
+    fault_rule_t rule;
+    esp_err_t err = i2c_before(known, addr, xfer_timeout_ms, &rule);
+    if (err == ESP_OK) err = __real_i2c_master_receive(i2c_dev, read_buffer, read_size, xfer_timeout_ms);
+    if (err == ESP_OK) corrupt(&rule, read_buffer, read_size);
+    return err;
+}
+
+esp_err_t __wrap_i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                             size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                             int xfer_timeout_ms) {
+    uint16_t addr = 0;
+    bool known = device_addr(i2c_dev, &addr);
+    fault_rule_t rule;
+    esp_err_t err = i2c_before(known, addr, xfer_timeout_ms, &rule);
+    if (err == ESP_OK) {
+        err = __real_i2c_master_transmit_receive(i2c_dev, write_buffer, write_size, read_buffer, read_size,
+                                                 xfer_timeout_ms);
+    }
+    if (err == ESP_OK) corrupt(&rule, read_buffer, read_size);
+    return err;
+}
+
+// ---------------------------------------------------------------------------
+// 1-Wire. Device rules follow the ROM the last MATCH_ROM selected.
+
+esp_err_t __real_onewire_bus_reset(onewire_bus_handle_t bus);
+esp_err_t __real_onewire_bus_write_bytes(onewire_bus_handle_t bus, const uint8_t *tx_data, uint8_t tx_data_size);
+esp_err_t __real_onewire_bus_read_bytes(onewire_bus_handle_t bus, uint8_t *rx_buf, size_t rx_buf_size);
+
+esp_err_t __wrap_onewire_bus_reset(onewire_bus_handle_t bus) {
+    ensure_configured();
+    portENTER_CRITICAL(&s_lock);
+    s_ow_matched = false;
+    fault_rule_t rule = match_rule(FAULT_BUS_ONEWIRE, false, 0);
+    bool held = s_ow_stuck_until_us > esp_timer_get_time();
+    portEXIT_CRITICAL(&s_lock);
+    // A line held low hides every presence pulse.
+    if (held || chance(rule.stuck_p)) {
+        if (!held) extend_stuck(&s_ow_stuck_until_us, rule.stuck_ms);
+        count(&s_stats.stuck);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (chance(rule.nack)) {
+        count(&s_stats.nacks);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return __real_onewire_bus_reset(bus);
+}
+
+esp_err_t __wrap_onewire_bus_write_bytes(onewire_bus_handle_t bus, const uint8_t *tx_data, uint8_t tx_data_size) {
+    if (tx_data_size >= 9 && tx_data[0] == ONEWIRE_CMD_MATCH_ROM) {
+        uint64_t rom;
+        memcpy(&rom, &tx_data[1], sizeof(rom));
+        portENTER_CRITICAL(&s_lock);
+        s_ow_selected = rom;
+        s_ow_matched = true;
+        portEXIT_CRITICAL(&s_lock);
+    }
+    return __real_onewire_bus_write_bytes(bus, tx_data, tx_data_size);
+}
+
+esp_err_t __wrap_onewire_bus_read_bytes(onewire_bus_handle_t bus, uint8_t *rx_buf, size_t rx_buf_size) {
+    esp_err_t err = __real_onewire_bus_read_bytes(bus, rx_buf, rx_buf_size);
+    if (err != ESP_OK) return err;
+    portENTER_CRITICAL(&s_lock);
+    fault_rule_t rule = match_rule(FAULT_BUS_ONEWIRE, s_ow_matched, s_ow_selected);
+    portEXIT_CRITICAL(&s_lock);
+    // A bus rule's NACK already hit the reset; a silent device reads as the pull-up.
+    if (!rule.any && chance(rule.nack)) {
+        memset(rx_buf, 0xFF, rx_buf_size);
+        count(&s_stats.nacks);
+        return ESP_OK;
+    }
+    corrupt(&rule, rx_buf, rx_buf_size);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t cellar_fault_configure(const char *spec) {
+    return spec && spec[0] ? ESP_ERR_NOT_SUPPORTED : ESP_OK;
+}
+
+#endif  // CELLAR_FAULT_INJECTION
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Fault injection between the sensor drivers and the I2C / 1-Wire buses.
+// Built with CELLAR_FAULT_INJECTION (see CMakeLists.txt), every
+// i2c_master_* and onewire_bus_* call goes through a shim that applies the
+// faults configured for its target; without it these calls do nothing.
+//
+// A spec is a ';'-separated list of `target:key=value,...` rules:
+//   i2c@0x76:nack=0.3,stretch=20;ow:corrupt=0.2;i2c@0x44:stuck=0.05/3000
+// Targets: `i2c@ADDR` or `ow@ROM` (the 64-bit address in hex) for one
+// device, `i2c` or `ow` for every device on the bus.
+//   nack=P         the target refuses a transfer with probability P: an I2C
+//                  NACK (ESP_FAIL, ESP_ERR_NOT_FOUND for a probe); on 1-Wire
+//                  no presence pulse (bus rule) or a silent device that reads
+//                  as 0xFF (device rule)
+//   stretch=MS     I2C: the target holds SCL for MS before every transfer; a
+//                  transfer whose timeout is shorter fails with ESP_ERR_TIMEOUT
+//   stuck=P/MS     with probability P a transfer leaves the bus held low for
+//                  MS. Every device on the bus waits for it, or times out;
+//                  on 1-Wire the reset finds no presence pulse meanwhile
+//   corrupt=P      flip one bit of a read with probability P (the DS18B20
+//                  scratchpad CRC catches it; I2C reads carry no check)
+//   after=MS       the rule applies only from MS after boot, so sensors are
+//                  found at start-up and fail later
+
+typedef struct {
+    uint32_t nacks;      // refused transfers and missing presence pulses
+    uint32_t stretches;  // transfers delayed by clock stretching
+    uint32_t stuck;      // transfers that found (or left) the bus held
+    uint32_t timeouts;   // transfers that gave up at their timeout
+    uint32_t corrupted;  // reads with a flipped bit
+} cellar_fault_stats_t;
+
+// Replace the active rules with `spec` (NULL or "" clears them). Until this
+// is called the shim uses CELLAR_FAULTS from config.h. ESP_ERR_INVALID_ARG
+// leaves the previous rules in place; ESP_ERR_NOT_SUPPORTED without
+// CELLAR_FAULT_INJECTION.
+esp_err_t cellar_fault_configure(const char *spec);
+
+void cellar_fault_get_stats(cellar_fault_stats_t *out);
+
+// One line of counters, if any rule is active.
+void cellar_fault_log_stats(void);
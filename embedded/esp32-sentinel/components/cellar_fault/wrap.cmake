@@ -0,0 +1,15 @@
+# Bus calls the fault shim sits in front of. Linking with -Wl,--wrap=<symbol>
+# sends every call from another object file to __wrap_<symbol> in
+# cellar_fault.c, which reaches the driver through __real_<symbol>.
+set(CELLAR_FAULT_WRAPPED
+    i2c_master_bus_add_device
+    i2c_master_bus_rm_device
+    i2c_master_bus_reset
+    i2c_master_probe
+    i2c_master_transmit
+    i2c_master_receive
+    i2c_master_transmit_receive
+    onewire_bus_reset
+    onewire_bus_write_bytes
+    onewire_bus_read_bytes
+)
@@ -0,0 +1,207 @@
+#include "cellar_gorilla.h"
+
+#include <string.h>
+
+// Plain C with no ESP-IDF dependencies so host/ can build and benchmark it.
+
+// Block layout, MSB-first bit stream:
+//   sample 0: 64-bit timestamp, 32-bit value
+//   sample n: timestamp delta-of-delta, then value XOR
+// Delta-of-delta buckets (ms, two's complement payload):
+//   0            dod == 0
+//   10   + 7     [-64, 63]
+//   110  + 9     [-256, 255]
+//   1110 + 12    [-2048, 2047]
+//   1111 + 32    any int32
+// Value XOR against the previous value:
+//   0                             identical
+//   10 + meaningful bits          fits the previous leading/trailing window
+//   11 + 5 lead + 5 (len-1) + len new window
+
+static uint32_t float_bits(float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+static float bits_float(uint32_t u) {
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+static int clz32(uint32_t x) {
+    return x ? __builtin_clz(x) : 32;
+}
+
+static int ctz32(uint32_t x) {
+    return x ? __builtin_ctz(x) : 32;
+}
+
+// Writes past cap are dropped; the caller checks bit_pos afterwards.
+static void put_bits(cellar_gorilla_enc_t *enc, uint64_t value, int nbits) {
+    for (int i = nbits - 1; i >= 0; --i) {
+        size_t byte = enc->bit_pos >> 3;
+        if (byte < enc->cap && ((value >> i) & 1u)) {
+            enc->buf[byte] |= (uint8_t)(0x80u >> (enc->bit_pos & 7));
+        }
+        enc->bit_pos++;
+    }
+}
+
+static bool get_bits(cellar_gorilla_dec_t *dec, int nbits, uint64_t *out) {
+    if (dec->bit_pos + (size_t)nbits > dec->cap * 8) return false;
+    uint64_t value = 0;
+    for (int i = 0; i < nbits; ++i) {
+        size_t pos = dec->bit_pos++;
+        value = (value << 1) | ((dec->buf[pos >> 3] >> (7 - (pos & 7))) & 1u);
+    }
+    *out = value;
+    return true;
+}
+
+static int64_t sign_extend(uint64_t value, int nbits) {
+    uint64_t sign = 1ull << (nbits - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+void cellar_gorilla_enc_init(cellar_gorilla_enc_t *enc, uint8_t *buf, size_t cap) {
+    memset(buf, 0, cap);
+    *enc = (cellar_gorilla_enc_t){.buf = buf, .cap = cap};
+}
+
+static void put_dod(cellar_gorilla_enc_t *enc, int64_t dod) {
+    if (dod == 0) {
+        put_bits(enc, 0x0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+        put_bits(enc, 0x2, 2);
+        put_bits(enc, (uint64_t)dod & 0x7F, 7);
+    } else if (dod >= -256 && dod <= 255) {
+        put_bits(enc, 0x6, 3);
+        put_bits(enc, (uint64_t)dod & 0x1FF, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        put_bits(enc, 0xE, 4);
+        put_bits(enc, (uint64_t)dod & 0xFFF, 12);
+    } else {
+        put_bits(enc, 0xF, 4);
+        put_bits(enc, (uint64_t)dod & 0xFFFFFFFFu, 32);
+    }
+}
+
+static void put_value(cellar_gorilla_enc_t *enc, uint32_t bits) {
+    uint32_t x = bits ^ enc->v_prev;
+    if (x == 0) {
+        put_bits(enc, 0x0, 1);
+        return;
+    }
+    int lead = clz32(x);
+    int trail = ctz32(x);
+    if (lead > 31) lead = 31;  // 5-bit field
+    int len = 32 - lead - trail;
+    // Reuse the previous window when x fits in it and that is no dearer than
+    // describing a new one. The window starts as all 32 bits.
+    int prev_len = 32 - enc->lead_prev - enc->trail_prev;
+    if (lead >= enc->lead_prev && trail >= enc->trail_prev && prev_len <= len + 10) {
+        put_bits(enc, 0x2, 2);
+        put_bits(enc, x >> enc->trail_prev, prev_len);
+        return;
+    }
+    put_bits(enc, 0x3, 2);
+    put_bits(enc, (uint64_t)lead, 5);
+    put_bits(enc, (uint64_t)(len - 1), 5);
+    put_bits(enc, x >> trail, len);
+    enc->lead_prev = (uint8_t)lead;
+    enc->trail_prev = (uint8_t)trail;
+}
+
+bool cellar_gorilla_enc_append(cellar_gorilla_enc_t *enc, int64_t ts_ms, float value) {
+    if (enc->count == UINT16_MAX) return false;
+    cellar_gorilla_enc_t saved = *enc;
+    uint32_t bits = float_bits(value);
+
+    if (enc->count == 0) {
+        put_bits(enc, (uint64_t)ts_ms, 64);
+        put_bits(enc, bits, 32);
+        enc->delta_prev = 0;
+    } else {
+        if (ts_ms < enc->t_prev) return false;
+        int64_t delta = ts_ms - enc->t_prev;
+        int64_t dod = delta - enc->delta_prev;
+        if (dod < INT32_MIN || dod > INT32_MAX) return false;
+        put_dod(enc, dod);
+        put_value(enc, bits);
+        enc->delta_prev = delta;
+    }
+
+    if (enc->bit_pos > enc->cap * 8) {
+        // Roll back; bits that landed past the old end are cleared so the
+        // block stays exactly as it was.
+        size_t first = (saved.bit_pos + 7) / 8;
+        if (saved.bit_pos & 7) {
+            enc->buf[saved.bit_pos >> 3] &= (uint8_t)(0xFF00u >> (saved.bit_pos & 7));
+        }
+        if (first < enc->cap) memset(enc->buf + first, 0, enc->cap - first);
+        *enc = saved;
+        return false;
+    }
+    enc->t_prev = ts_ms;
+    enc->v_prev = bits;
+    enc->count++;
+    return true;
+}
+
+void cellar_gorilla_dec_init(cellar_gorilla_dec_t *dec, const uint8_t *buf, size_t len, uint16_t count) {
+    *dec = (cellar_gorilla_dec_t){.buf = buf, .cap = len, .remaining = count};
+}
+
+bool cellar_gorilla_dec_next(cellar_gorilla_dec_t *dec, int64_t *ts_ms, float *value) {
+    if (dec->remaining == 0) return false;
+    uint64_t v;
+
+    if (dec->index == 0) {
+        uint64_t t;
+        if (!get_bits(dec, 64, &t) || !get_bits(dec, 32, &v)) return false;
+        dec->t_prev = (int64_t)t;
+        dec->delta_prev = 0;
+        dec->v_prev = (uint32_t)v;
+    } else {
+        // Timestamp: count leading 1s of the bucket prefix (at most four).
+        int ones = 0;
+        uint64_t bit;
+        while (ones < 4) {
+            if (!get_bits(dec, 1, &bit)) return false;
+            if (!bit) break;
+            ones++;
+        }
+        static const int widths[5] = {0, 7, 9, 12, 32};
+        int64_t dod = 0;
+        if (ones > 0) {
+            if (!get_bits(dec, widths[ones], &v)) return false;
+            dod = sign_extend(v, widths[ones]);
+        }
+        dec->delta_prev += dod;
+        dec->t_prev += dec->delta_prev;
+
+        if (!get_bits(dec, 1, &bit)) return false;
+        if (bit) {
+            if (!get_bits(dec, 1, &bit)) return false;
+            if (bit) {
+                uint64_t lead, len_minus_1;
+                if (!get_bits(dec, 5, &lead) || !get_bits(dec, 5, &len_minus_1)) return false;
+                int len = (int)len_minus_1 + 1;
+                if ((int)lead + len > 32) return false;
+                dec->lead_prev = (uint8_t)lead;
+                dec->trail_prev = (uint8_t)(32 - lead - len);
+            }
+            int len = 32 - dec->lead_prev - dec->trail_prev;
+            if (!get_bits(dec, len, &v)) return false;
+            dec->v_prev ^= (uint32_t)v << dec->trail_prev;
+        }
+    }
+
+    dec->index++;
+    dec->remaining--;
+    *ts_ms = dec->t_prev;
+    *value = bits_float(dec->v_prev);
+    return true;
+}
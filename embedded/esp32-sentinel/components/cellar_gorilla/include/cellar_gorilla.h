@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Gorilla-style encoding (Pelkonen et al., VLDB 2015) of one channel's
+// (timestamp, float) samples into a caller-owned fixed-size buffer:
+// timestamps as delta-of-delta in variable-width buckets, values as the XOR
+// with the previous value, storing only its meaningful bits. Steady sampling
+// and repeated values cost two bits per sample.
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;        // bytes
+    size_t bit_pos;
+    uint16_t count;
+    int64_t t_prev;
+    int64_t delta_prev;
+    uint32_t v_prev;
+    uint8_t lead_prev;
+    uint8_t trail_prev;
+} cellar_gorilla_enc_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t cap;
+    size_t bit_pos;
+    uint16_t remaining;
+    uint16_t index;
+    int64_t t_prev;
+    int64_t delta_prev;
+    uint32_t v_prev;
+    uint8_t lead_prev;
+    uint8_t trail_prev;
+} cellar_gorilla_dec_t;
+
+// Start a block in buf[0..cap). The buffer is zeroed.
+void cellar_gorilla_enc_init(cellar_gorilla_enc_t *enc, uint8_t *buf, size_t cap);
+
+// Append one sample. Returns false, leaving the block unchanged, if it does
+// not fit, the timestamp goes backwards, or the delta-of-delta does not fit
+// in 32 bits; start a new block then.
+bool cellar_gorilla_enc_append(cellar_gorilla_enc_t *enc, int64_t ts_ms, float value);
+
+// Bytes used so far (rounded up).
+static inline size_t cellar_gorilla_enc_bytes(const cellar_gorilla_enc_t *enc) {
+    return (enc->bit_pos + 7) / 8;
+}
+
+// Decode count samples from a block written by the encoder.
+void cellar_gorilla_dec_init(cellar_gorilla_dec_t *dec, const uint8_t *buf, size_t len, uint16_t count);
+
+// Next sample, oldest first. Returns false at the end or on a truncated block.
+bool cellar_gorilla_dec_next(cellar_gorilla_dec_t *dec, int64_t *ts_ms, float *value);
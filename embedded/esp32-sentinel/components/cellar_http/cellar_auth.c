@@ -1,41 +1,25 @@
 #include "cellar_auth.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include "esp_system.h" 
 #include "esp_mac.h" // For esp_read_mac
 
+#include "cellar_http.h"
+#include "cellar_netbuf.h"
+#include "cellar_power.h"
+#include "cellar_supervisor.h"
+#include "cellar_tasks.h"
+#include "cellar_time.h"
 #include "config.h"
-#include "esp_http_client.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "mbedtls/base64.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 
-typedef struct {
-    char *buf;
-    size_t len;
-    size_t cap;
-} resp_accum_t;
-
-static esp_err_t http_event_handler_accum(esp_http_client_event_t *evt) {
-    if (evt->event_id == HTTP_EVENT_ON_DATA && evt->user_data) {
-        resp_accum_t *acc = (resp_accum_t *)evt->user_data;
-        if (acc->buf && acc->cap > 1 && evt->data_len > 0) {
-            size_t space = (acc->cap - 1) - acc->len;
-            size_t to_copy = evt->data_len > space ? space : evt->data_len;
-            if (to_copy > 0) {
-                memcpy(acc->buf + acc->len, evt->data, to_copy);
-                acc->len += to_copy;
-                acc->buf[acc->len] = '\0';
-            }
-        }
-    }
-    return ESP_OK;
-}
-
 #ifndef DEVICE_ID
 #define DEVICE_ID "esp32-sentinel"
 #endif
@@ -47,9 +31,46 @@ static const char *KEY_REFRESH = "refresh";
 static const char *KEY_EXP = "access_exp";  // epoch seconds
 static const char *KEY_CLAIM = "claim_code";
 
+// Refresh this long before expiry at minimum; longer tokens refresh at 80%.
+#define REFRESH_MIN_MARGIN_MS (60 * 1000)
+#define REFRESH_RETRY_MS (30 * 1000)
+#define AUTH_RECHECK_MS (60 * 1000)
+#define AUTH_MAX_SLEEP_MS (60 * 60 * 1000)
+// Server-side hold for /device-claim/poll (the backend caps it at 30 s).
+#define CLAIM_LONG_POLL_S 25
+#define CLAIM_POLL_MIN_INTERVAL_MS 3000
+#define CLAIM_RETRY_MS (10 * 1000)
+#define CLAIM_BLOCKED_RETRY_MS (5 * 60 * 1000)
+// Used only when neither the JWT nor the response carries a usable expiry.
+#define FALLBACK_LIFETIME_S (15 * 60)
+// One refresh or claim round trip checks in within AUTH_CHECKIN_MS; the long
+// poll announces its own hold first.
+#define AUTH_CHECKIN_MS (30 * 1000)
+#define AUTH_STALL_MS (60 * 1000)
+// Request bodies, responses and the decoded JWT come from cellar_netbuf, so
+// the stack only has to cover the TLS handshake under cellar_http.
+#define AUTH_TASK_STACK 7168
+#define AUTH_BODY_MAX 512
+#define AUTH_RESP_MAX 1024
+#define JWT_B64_MAX 600
+#define JWT_CLAIMS_MAX 450
+
+typedef enum {
+    AUTH_STATE_ACTIVE,          // have tokens; refresh ahead of expiry
+    AUTH_STATE_CLAIM,           // submit the claim code
+    AUTH_STATE_AWAIT_APPROVAL,  // long-poll until an admin approves
+} auth_state_t;
+
 static char s_access_token[768] = {0};
 static char s_refresh_token[256] = {0};
-static time_t s_access_expiry = 0;
+static int64_t s_access_expiry = 0;       // UTC epoch seconds, 0 if unknown
+static int64_t s_access_lifetime_s = 0;   // exp - iat, 0 if unknown
+static int64_t s_access_deadline_ms = 0;  // esp_timer ms at expiry, 0 until known
+// Guards the token strings so a bearer copy never sees a half-written token.
+static portMUX_TYPE s_token_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_auth_task = NULL;
+static cellar_supervisor_id_t s_supervisor_id = -1;
+static auth_state_t s_state = AUTH_STATE_ACTIVE;
 static char s_claim_code[24] = {0};
 static char s_full_device_id[64] = {0}; // Derived from config DEVICE_ID + MAC
 
@@ -65,6 +86,7 @@ static void ensure_device_id(void) {
 }
 
 static void ensure_claim_code(void);
+static bool jwt_read_times(const char *jwt, int64_t *iat_s, int64_t *exp_s);
 
 static esp_err_t read_str(nvs_handle_t nvs, const char *key, char *buf, size_t buf_len) {
     size_t len = buf_len;
@@ -82,7 +104,7 @@ static void load_tokens(void) {
     read_str(nvs, KEY_REFRESH, s_refresh_token, sizeof(s_refresh_token));
     int64_t exp = 0;
     nvs_get_i64(nvs, KEY_EXP, &exp);
-    s_access_expiry = (time_t)exp;
+    s_access_expiry = exp;
     read_str(nvs, KEY_CLAIM, s_claim_code, sizeof(s_claim_code));
     nvs_close(nvs);
     // If an older, longer claim code is present, truncate to 8 hex chars.
@@ -93,13 +115,25 @@ static void load_tokens(void) {
 }
 
 static void persist_tokens(void) {
+    // A snapshot, so a cellar_auth_clear from the uplink cannot leave half a
+    // token in NVS.
+    char *access = cellar_netbuf_take(sizeof(s_access_token));
+    char refresh[sizeof(s_refresh_token)];
+    if (!access) return;
+    portENTER_CRITICAL(&s_token_mux);
+    memcpy(access, s_access_token, sizeof(s_access_token));
+    memcpy(refresh, s_refresh_token, sizeof(refresh));
+    int64_t expiry = s_access_expiry;
+    portEXIT_CRITICAL(&s_token_mux);
     nvs_handle_t nvs;
     if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        cellar_netbuf_give(access);
         return;
     }
-    nvs_set_str(nvs, KEY_ACCESS, s_access_token);
-    nvs_set_str(nvs, KEY_REFRESH, s_refresh_token);
-    nvs_set_i64(nvs, KEY_EXP, (int64_t)s_access_expiry);
+    nvs_set_str(nvs, KEY_ACCESS, access);
+    nvs_set_str(nvs, KEY_REFRESH, refresh);
+    cellar_netbuf_give(access);
+    nvs_set_i64(nvs, KEY_EXP, expiry);
     if (s_claim_code[0]) {
         nvs_set_str(nvs, KEY_CLAIM, s_claim_code);
     }
@@ -108,9 +142,13 @@ static void persist_tokens(void) {
 }
 
 void cellar_auth_clear(void) {
+    portENTER_CRITICAL(&s_token_mux);
     memset(s_access_token, 0, sizeof(s_access_token));
     memset(s_refresh_token, 0, sizeof(s_refresh_token));
     s_access_expiry = 0;
+    s_access_lifetime_s = 0;
+    s_access_deadline_ms = 0;
+    portEXIT_CRITICAL(&s_token_mux);
     // keep claim code
     nvs_handle_t nvs;
     if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
@@ -120,6 +158,9 @@ void cellar_auth_clear(void) {
         nvs_commit(nvs);
         nvs_close(nvs);
     }
+    if (s_auth_task) {
+        xTaskNotifyGive(s_auth_task);  // start re-claiming right away
+    }
 }
 
 void cellar_auth_clear_claim_code(void) {
@@ -136,12 +177,37 @@ void cellar_auth_clear_claim_code(void) {
 void cellar_auth_init(void) {
     load_tokens();
     ensure_device_id(); // Initialize the full device ID
+    if (s_access_token[0]) {
+        // Prefer the stored JWT's own claims over KEY_EXP. The monotonic
+        // deadline is derived from UTC once time is synced.
+        int64_t iat_s = 0;
+        int64_t exp_s = 0;
+        if (jwt_read_times(s_access_token, &iat_s, &exp_s)) {
+            s_access_expiry = exp_s;
+            s_access_lifetime_s = iat_s > 0 && exp_s > iat_s ? exp_s - iat_s : 0;
+        }
+    }
 }
 
 const char *cellar_auth_access_token(void) {
     return (s_access_token[0] != '\0') ? s_access_token : NULL;
 }
 
+bool cellar_auth_format_bearer(char *out, size_t out_len) {
+    static const char prefix[] = "Bearer ";
+    const size_t prefix_len = sizeof(prefix) - 1;
+    if (out_len <= prefix_len) return false;
+    memcpy(out, prefix, prefix_len);
+    // A plain copy under the lock: interrupts are masked on this core.
+    portENTER_CRITICAL(&s_token_mux);
+    size_t len = strlen(s_access_token);
+    bool fits = len > 0 && len < out_len - prefix_len;
+    if (fits) memcpy(out + prefix_len, s_access_token, len + 1);
+    portEXIT_CRITICAL(&s_token_mux);
+    if (!fits) out[0] = '\0';
+    return fits;
+}
+
 static void ensure_claim_code(void) {
 #ifdef CLAIM_CODE
     if (s_claim_code[0] == '\0') {
@@ -173,20 +239,43 @@ const char *cellar_auth_device_id(void) {
 
 void cellar_auth_log_status(void) {
     ESP_LOGI(TAG,
-             "id=%s, access token %s, refresh %s, exp=%ld",
+             "id=%s, access token %s, refresh %s, exp=%lld",
              s_full_device_id,
              s_access_token[0] ? "present" : "missing",
              s_refresh_token[0] ? "present" : "missing",
-             (long)s_access_expiry);
+             (long long)s_access_expiry);
+}
+
+// Monotonic expiry of the access token, or 0 if it cannot be known yet
+// (e.g. a token loaded from NVS before the first SNTP sync).
+static int64_t access_deadline_ms(void) {
+    int64_t utc_now = cellar_time_now_ms();
+    int64_t mono_now = cellar_time_mono_ms();
+    portENTER_CRITICAL(&s_token_mux);
+    if (s_access_deadline_ms <= 0 && s_access_expiry > 0 && utc_now > 0) {
+        s_access_deadline_ms = mono_now + (s_access_expiry * 1000 - utc_now);
+    }
+    int64_t deadline = s_access_deadline_ms;
+    portEXIT_CRITICAL(&s_token_mux);
+    return deadline;
+}
+
+static int64_t refresh_margin_ms(void) {
+    int64_t margin = s_access_lifetime_s * 1000 / 5;
+    return margin > REFRESH_MIN_MARGIN_MS ? margin : REFRESH_MIN_MARGIN_MS;
 }
 
 static bool access_valid(void) {
-    if (s_access_token[0] == '\0') return false;
-    time_t now = 0;
-    time(&now);
+    portENTER_CRITICAL(&s_token_mux);
+    bool present = s_access_token[0] != '\0';
     // If we don't have an expiry, treat as invalid and reclaim.
-    if (s_access_expiry <= 0) return false;
-    return now + 60 < s_access_expiry;  // refresh if within 60s of expiry
+    bool dated = s_access_expiry > 0 || s_access_deadline_ms > 0;
+    portEXIT_CRITICAL(&s_token_mux);
+    if (!present || !dated) return false;
+    int64_t deadline = access_deadline_ms();
+    // Known expiry but no clock yet: trust the token; a 401 forces a re-claim.
+    if (deadline <= 0) return true;
+    return cellar_time_mono_ms() + REFRESH_MIN_MARGIN_MS < deadline;
 }
 
 // Very small helper to grab a JSON string value for "key":"value"
@@ -207,151 +296,346 @@ static bool json_get_string(const char *body, const char *key, char *out, size_t
     return true;
 }
 
-extern const char server_root_cert_pem_start[] asm("_binary_server_root_cert_pem_start");
-extern const char server_root_cert_pem_end[]   asm("_binary_server_root_cert_pem_end");
+static bool json_get_int64(const char *body, const char *key, int64_t *out) {
+    char quoted[32];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    const char *found = strstr(body, quoted);
+    if (!found) return false;
+    const char *colon = strchr(found + strlen(quoted), ':');
+    if (!colon) return false;
+    char *end = NULL;
+    long long value = strtoll(colon + 1, &end, 10);
+    if (end == colon + 1) return false;
+    *out = value;
+    return true;
+}
+
+// The backend issues iat/exp in epoch milliseconds; standard JWTs use seconds.
+static int64_t normalize_epoch_s(int64_t value) {
+    return value > 100000000000LL ? value / 1000 : value;
+}
 
-static esp_err_t http_post_json(const char *url, const char *json_body, char *resp_buf, size_t resp_buf_len, int *out_status) {
-    resp_accum_t acc = {0};
-    acc.buf = resp_buf;
-    acc.cap = resp_buf_len;
-    if (resp_buf && resp_buf_len > 0) {
-        resp_buf[0] = '\0';
+// Decode the (unverified) JWT payload and read its iat/exp claims.
+static bool jwt_read_times(const char *jwt, int64_t *iat_s, int64_t *exp_s) {
+    const char *start = strchr(jwt, '.');
+    if (!start) return false;
+    start++;
+    const char *end = strchr(start, '.');
+    if (!end) return false;
+
+    size_t b64_len = (size_t)(end - start);
+    if (b64_len + 3 >= JWT_B64_MAX) return false;
+    unsigned char *b64 = cellar_netbuf_take(JWT_B64_MAX);
+    char *claims = cellar_netbuf_take(JWT_CLAIMS_MAX);
+    bool ok = false;
+    if (b64 && claims) {
+        // base64url -> base64 with padding
+        for (size_t i = 0; i < b64_len; ++i) {
+            char c = start[i];
+            b64[i] = (unsigned char)(c == '-' ? '+' : c == '_' ? '/' : c);
+        }
+        while (b64_len % 4) b64[b64_len++] = '=';
+
+        size_t claims_len = 0;
+        if (mbedtls_base64_decode((unsigned char *)claims, JWT_CLAIMS_MAX - 1, &claims_len, b64, b64_len) == 0) {
+            claims[claims_len] = '\0';
+            int64_t exp = 0;
+            int64_t iat = 0;
+            if (json_get_int64(claims, "exp", &exp)) {
+                *exp_s = normalize_epoch_s(exp);
+                *iat_s = json_get_int64(claims, "iat", &iat) ? normalize_epoch_s(iat) : 0;
+                ok = true;
+            }
+        }
     }
-    esp_http_client_config_t cfg = {
-        .url = url,
-        .timeout_ms = 8000,
-        .event_handler = http_event_handler_accum,
-        .user_data = &acc,
-        .buffer_size = resp_buf_len > 0 ? resp_buf_len : 512,
-        .disable_auto_redirect = true, // We don't want to follow redirects blindly
-    };
-#if CELLAR_API_USE_HTTPS
-    cfg.cert_pem = server_root_cert_pem_start;
-#endif
+    cellar_netbuf_give(claims);
+    cellar_netbuf_give(b64);
+    return ok;
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&cfg);
-    if (!client) return ESP_FAIL;
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_header(client, "Accept-Encoding", "identity");
-    esp_http_client_set_post_field(client, json_body, strlen(json_body));
+// Parse "2025-11-18T19:20:30[.fff]Z" as UTC epoch seconds.
+static bool parse_iso8601_utc(const char *iso, int64_t *epoch_s) {
+    int year, month, day, hour, minute, second;
+    if (sscanf(iso, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+        return false;
+    }
+    *epoch_s = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
 
-    esp_err_t err = esp_http_client_perform(client);
-    
-    // Special handling: if we get ESP_ERR_NOT_SUPPORTED or similar but have a valid status code, it might be the client
-    // complaining about missing auth credentials for a 401 response. We treat that as "success" (transport-wise).
-    int status = esp_http_client_get_status_code(client);
-    if (out_status) *out_status = status;
-
-    if (err == ESP_OK || (status > 0 && status < 600)) {
-        int64_t len = esp_http_client_get_content_length(client);
-        ESP_LOGI(TAG, "POST %s status=%d len=%lld", url, status, (long long)len);
-        ESP_LOGI(TAG, "Read %u bytes body", (unsigned)acc.len);
-        err = ESP_OK; // mask the error if we got a valid HTTP response
+// Work out when the access token expires: the JWT exp claim first, then the
+// response's ISO access_expires_at, then a conservative fallback.
+static void set_access_expiry(const char *jwt, const char *expires_at) {
+    int64_t mono_now = cellar_time_mono_ms();
+    int64_t utc_now = cellar_time_now_ms();
+    int64_t iat_s = 0;
+    int64_t exp_s = 0;
+    int64_t expiry = 0;
+    int64_t lifetime_s = 0;
+    int64_t deadline = 0;
+
+    if (jwt_read_times(jwt, &iat_s, &exp_s)) {
+        expiry = exp_s;
+        if (iat_s > 0 && exp_s > iat_s) {
+            // exp - iat is exact even when our clock is off or unsynced.
+            lifetime_s = exp_s - iat_s;
+            deadline = mono_now + lifetime_s * 1000;
+        }
+    } else if (expires_at && parse_iso8601_utc(expires_at, &exp_s)) {
+        expiry = exp_s;
     } else {
-        ESP_LOGE(TAG, "HTTP POST failed to %s: %s", url, esp_err_to_name(err));
+        lifetime_s = FALLBACK_LIFETIME_S;
+        deadline = mono_now + FALLBACK_LIFETIME_S * 1000LL;
+        expiry = utc_now > 0 ? utc_now / 1000 + FALLBACK_LIFETIME_S : 0;
+    }
+    if (deadline == 0 && expiry > 0 && utc_now > 0) {
+        lifetime_s = expiry - utc_now / 1000;
+        deadline = mono_now + (expiry * 1000 - utc_now);
     }
 
-    esp_http_client_cleanup(client);
-    return err;
+    portENTER_CRITICAL(&s_token_mux);
+    s_access_expiry = expiry;
+    s_access_lifetime_s = lifetime_s;
+    s_access_deadline_ms = deadline;
+    portEXIT_CRITICAL(&s_token_mux);
 }
 
-static esp_err_t refresh_tokens(void) {
-    if (s_refresh_token[0] == '\0') return ESP_FAIL;
-    char body[512];
-    snprintf(body, sizeof(body), "{\"device_id\":\"%s\",\"refresh_token\":\"%s\"}", s_full_device_id, s_refresh_token);
-    char resp[1024];
-    int status = 0;
-    esp_err_t err = http_post_json(CELLAR_API_BASE "/device-token", body, resp, sizeof(resp), &status);
-    if (err != ESP_OK || status != 200) return ESP_FAIL;
+// Copy src into dst, truncated to cap - 1 bytes and always NUL-terminated.
+static void copy_token(char *dst, size_t cap, const char *src) {
+    size_t len = strnlen(src, cap - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
 
-    char access[768] = {0};
+// Adopt the token pair from a /device-token or /device-claim/poll response.
+static esp_err_t adopt_tokens(const char *resp) {
+    char *access = cellar_netbuf_take(sizeof(s_access_token));
     char refresh[256] = {0};
-    if (!json_get_string(resp, "access_token", access, sizeof(access))) {
-        ESP_LOGE(TAG, "Failed to parse access_token from refresh response: %s", resp);
+    char expires_at[40] = {0};
+    if (!access) return ESP_ERR_NO_MEM;
+    if (!json_get_string(resp, "access_token", access, sizeof(s_access_token))) {
+        ESP_LOGE(TAG, "Failed to parse access_token from response: %s", resp);
+        cellar_netbuf_give(access);
         return ESP_FAIL;
     }
     json_get_string(resp, "refresh_token", refresh, sizeof(refresh));
-    strncpy(s_access_token, access, sizeof(s_access_token) - 1);
+    json_get_string(resp, "access_expires_at", expires_at, sizeof(expires_at));
+
+    portENTER_CRITICAL(&s_token_mux);
+    copy_token(s_access_token, sizeof(s_access_token), access);
     if (refresh[0]) {
-        strncpy(s_refresh_token, refresh, sizeof(s_refresh_token) - 1);
+        copy_token(s_refresh_token, sizeof(s_refresh_token), refresh);
     }
-    // Force 15 min expiry since server sends ISO string which atoll parses as garbage (e.g. 2025 -> 2s)
-    time_t now = 0;
-    time(&now);
-    s_access_expiry = now + (15 * 60);
-    
+    portEXIT_CRITICAL(&s_token_mux);
+    set_access_expiry(access, expires_at[0] ? expires_at : NULL);
+
+    ESP_LOGI(TAG, "Parsed token len=%d refresh_len=%d exp=%lld lifetime=%llds",
+             (int)strnlen(access, sizeof(s_access_token)),
+             (int)strnlen(refresh, sizeof(refresh)),
+             (long long)s_access_expiry,
+             (long long)s_access_lifetime_s);
+    cellar_netbuf_give(access);
     persist_tokens();
     return ESP_OK;
 }
 
-static esp_err_t claim_and_poll(void) {
-    char claim_body[256];
-    const char *claim = cellar_auth_claim_code();
-    snprintf(claim_body, sizeof(claim_body), "{\"device_id\":\"%s\",\"claim_code\":\"%s\"}", s_full_device_id, claim);
-    char resp[1024];
+static esp_err_t refresh_tokens(void) {
+    // Copied under the lock: the uplink's cellar_auth_clear may wipe it meanwhile.
+    char refresh[sizeof(s_refresh_token)];
+    portENTER_CRITICAL(&s_token_mux);
+    memcpy(refresh, s_refresh_token, sizeof(refresh));
+    portEXIT_CRITICAL(&s_token_mux);
+    if (refresh[0] == '\0') return ESP_FAIL;
+    char *body = cellar_netbuf_take(AUTH_BODY_MAX);
+    char *resp = cellar_netbuf_take(AUTH_RESP_MAX);
+    esp_err_t err = ESP_ERR_NO_MEM;
     int status = 0;
-    esp_err_t err = http_post_json(CELLAR_API_BASE "/device-claim", claim_body, resp, sizeof(resp), &status);
-    if (err != ESP_OK || (status != 200 && status != 202)) return err;
-
-    for (int attempt = 0; attempt < 10; ++attempt) { // Poll for 30s (10 * 3s)
-        vTaskDelay(pdMS_TO_TICKS(3000));
-        memset(resp, 0, sizeof(resp));
-        err = http_post_json(CELLAR_API_BASE "/device-claim/poll", claim_body, resp, sizeof(resp), &status);
-        
-        // If we get 401/403, it means "Not yet approved" (server rejected request because device isn't claimed yet).
-        // We treat this as a "pending" state and continue polling.
-        if (err == ESP_OK && (status == 401 || status == 403)) {
-            ESP_LOGD(TAG, "Poll status %d (pending approval)...", status);
-            continue;
+    if (body && resp) {
+        snprintf(body, AUTH_BODY_MAX, "{\"device_id\":\"%s\",\"refresh_token\":\"%s\"}",
+                 s_full_device_id, refresh);
+        cellar_supervisor_op(s_supervisor_id, "refresh");
+        cellar_power_acquire(CELLAR_POWER_NET);
+        err = cellar_http_post_json("/device-token", body, NULL, 0, resp, AUTH_RESP_MAX, &status);
+        cellar_power_release(CELLAR_POWER_NET);
+    }
+    cellar_netbuf_give(body);
+    if (err == ESP_OK) {
+        if (status == 401 || status == 403 || status == 404) {
+            err = ESP_ERR_NOT_ALLOWED;
+        } else {
+            err = status == 200 ? adopt_tokens(resp) : ESP_FAIL;
         }
+    }
+    cellar_netbuf_give(resp);
+    return err;
+}
+
+// ACTIVE: refresh ahead of expiry; fall back to claiming when the server
+// rejects the refresh token (or there is none).
+static uint32_t step_active(void) {
+    if (access_valid()) {
+        int64_t deadline = access_deadline_ms();
+        if (deadline <= 0) return AUTH_RECHECK_MS;  // expiry known only in UTC; wait for SNTP
+        int64_t until = deadline - refresh_margin_ms() - cellar_time_mono_ms();
+        if (until > 0) return until < AUTH_MAX_SLEEP_MS ? (uint32_t)until : AUTH_MAX_SLEEP_MS;
+    }
+    if (s_refresh_token[0] == '\0') {
+        s_state = AUTH_STATE_CLAIM;
+        return 0;
+    }
+    esp_err_t err = refresh_tokens();
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Refresh succeeded");
+        return 0;
+    }
+    if (err == ESP_ERR_NOT_ALLOWED) {
+        ESP_LOGW(TAG, "Refresh token rejected; re-claiming");
+        cellar_auth_clear();
+        s_state = AUTH_STATE_CLAIM;
+        return 0;
+    }
+    ESP_LOGW(TAG, "Refresh failed; retrying in %ds", REFRESH_RETRY_MS / 1000);
+    return REFRESH_RETRY_MS;
+}
 
-        if (err != ESP_OK) continue;
+static void format_claim_body(char *out, size_t out_len, int wait_seconds) {
+    int written = snprintf(out, out_len, "{\"device_id\":\"%s\",\"claim_code\":\"%s\"",
+                           s_full_device_id, cellar_auth_claim_code());
+    if (wait_seconds > 0) {
+        written += snprintf(out + written, out_len - written, ",\"wait_seconds\":%d", wait_seconds);
+    }
+    snprintf(out + written, out_len - written, "}");
+}
 
-        ESP_LOGI(TAG, "Poll resp attempt %d: (len=%d)", attempt, (int)strlen(resp));
-        char json_status[32] = {0};
-        if (!json_get_string(resp, "status", json_status, sizeof(json_status))) continue;
-        
-        if (strcmp(json_status, "pending") == 0) {
-            continue;
-        }
-        if (strcmp(json_status, "approved") == 0) {
-            char access[768] = {0};
-            char refresh[256] = {0};
-            if (!json_get_string(resp, "access_token", access, sizeof(access))) {
-                ESP_LOGW(TAG, "Poll approved but no access_token");
-                continue;
-            }
-            json_get_string(resp, "refresh_token", refresh, sizeof(refresh));
-            strncpy(s_access_token, access, sizeof(s_access_token) - 1);
-            strncpy(s_refresh_token, refresh, sizeof(s_refresh_token) - 1);
-            
-            // Force 15 min expiry since server sends ISO string
-            time_t now = 0;
-            time(&now);
-            s_access_expiry = now + (15 * 60);
-
-            ESP_LOGI(TAG, "Parsed token len=%d refresh_len=%d exp=%ld",
-                     (int)strlen(s_access_token),
-                     (int)strlen(s_refresh_token),
-                     (long)s_access_expiry);
-            persist_tokens();
-            return ESP_OK;
-        }
+// CLAIM: register the claim code with the server.
+static uint32_t step_claim(void) {
+    char *body = cellar_netbuf_take(AUTH_BODY_MAX);
+    char *resp = cellar_netbuf_take(AUTH_RESP_MAX);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    int status = 0;
+    if (body && resp) {
+        format_claim_body(body, AUTH_BODY_MAX, 0);
+        cellar_supervisor_op(s_supervisor_id, "claim");
+        cellar_power_acquire(CELLAR_POWER_NET);
+        err = cellar_http_post_json("/device-claim", body, NULL, 0, resp, AUTH_RESP_MAX, &status);
+        cellar_power_release(CELLAR_POWER_NET);
     }
-    return ESP_ERR_TIMEOUT;
+    cellar_netbuf_give(resp);
+    cellar_netbuf_give(body);
+    if (err != ESP_OK) return CLAIM_RETRY_MS;
+    if (status == 403) {
+        ESP_LOGW(TAG, "Device is blocked; retrying claim in %ds", CLAIM_BLOCKED_RETRY_MS / 1000);
+        return CLAIM_BLOCKED_RETRY_MS;
+    }
+    if (status != 200 && status != 202) {
+        ESP_LOGW(TAG, "Claim rejected (status %d)", status);
+        return CLAIM_RETRY_MS;
+    }
+    ESP_LOGI(TAG, "Claim submitted; waiting for approval of code %s", cellar_auth_claim_code());
+    s_state = AUTH_STATE_AWAIT_APPROVAL;
+    return 0;
+}
+
+// AWAIT_APPROVAL: long-poll; the server answers as soon as an admin approves.
+// No power lock here: the request mostly sits idle, and the chip may sleep.
+static uint32_t step_await_approval(void) {
+    char *body = cellar_netbuf_take(AUTH_BODY_MAX);
+    char *resp = cellar_netbuf_take(AUTH_RESP_MAX);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    int status = 0;
+    int64_t started = cellar_time_mono_ms();
+    if (body && resp) {
+        format_claim_body(body, AUTH_BODY_MAX, CLAIM_LONG_POLL_S);
+        cellar_supervisor_op(s_supervisor_id, "claim poll");
+        cellar_supervisor_checkin_within(s_supervisor_id, (CLAIM_LONG_POLL_S + 10) * 1000);
+        err = cellar_http_post_json("/device-claim/poll", body, NULL, (CLAIM_LONG_POLL_S + 10) * 1000,
+                                    resp, AUTH_RESP_MAX, &status);
+    }
+    cellar_netbuf_give(body);
+    if (err != ESP_OK || status == 401 || status == 403 || status == 404) {
+        cellar_netbuf_give(resp);
+        if (err != ESP_OK) return CLAIM_RETRY_MS;
+        // Claim unknown, replaced or blocked: submit it again.
+        ESP_LOGW(TAG, "Poll status %d; resubmitting claim", status);
+        s_state = AUTH_STATE_CLAIM;
+        return CLAIM_RETRY_MS;
+    }
+
+    char json_status[32] = {0};
+    bool approved = status == 200 && json_get_string(resp, "status", json_status, sizeof(json_status)) &&
+                    strcmp(json_status, "approved") == 0;
+    esp_err_t adopted = approved ? adopt_tokens(resp) : ESP_FAIL;
+    cellar_netbuf_give(resp);
+    if (adopted == ESP_OK) {
+        ESP_LOGI(TAG, "Device approved");
+        s_state = AUTH_STATE_ACTIVE;
+        return 0;
+    }
+    if (approved) ESP_LOGW(TAG, "Poll approved but no access_token");
+
+    // Servers without long-poll answer at once; never poll faster than this.
+    int64_t elapsed = cellar_time_mono_ms() - started;
+    return elapsed < CLAIM_POLL_MIN_INTERVAL_MS ? (uint32_t)(CLAIM_POLL_MIN_INTERVAL_MS - elapsed) : 0;
 }
 
 esp_err_t cellar_auth_ensure_access_token(void) {
     if (access_valid()) return ESP_OK;
+    if (s_auth_task) {
+        xTaskNotifyGive(s_auth_task);
+    }
+    return ESP_ERR_INVALID_STATE;
+}
 
-    ESP_LOGI(TAG, "Access token missing/expiring; attempting refresh");
-    if (refresh_tokens() == ESP_OK && access_valid()) {
-        ESP_LOGI(TAG, "Refresh succeeded");
-        return ESP_OK;
+// Owns the token lifecycle (refresh, claim, approval) so the sampling and
+// telemetry paths never block on it.
+static void auth_task(void *arg) {
+    s_state = (s_access_token[0] || s_refresh_token[0]) ? AUTH_STATE_ACTIVE : AUTH_STATE_CLAIM;
+    while (true) {
+        cellar_supervisor_checkin(s_supervisor_id);
+        uint32_t wait_ms = 0;
+        switch (s_state) {
+            case AUTH_STATE_ACTIVE:
+                wait_ms = step_active();
+                break;
+            case AUTH_STATE_CLAIM:
+                wait_ms = step_claim();
+                break;
+            case AUTH_STATE_AWAIT_APPROVAL:
+                wait_ms = step_await_approval();
+                break;
+        }
+        cellar_supervisor_op(s_supervisor_id, NULL);
+        if (wait_ms > 0) {
+            // Woken early by cellar_auth_clear or a caller that needs a token.
+            cellar_supervisor_checkin_within(s_supervisor_id, wait_ms);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+        }
     }
-    ESP_LOGW(TAG, "Refresh failed; attempting claim/poll");
-    cellar_auth_clear();
-    return claim_and_poll();
+}
+
+esp_err_t cellar_auth_start(void) {
+    if (s_auth_task) return ESP_OK;
+    // No recover hook: a stuck round trip may hold pool buffers and the HTTP
+    // client, so only a restart is safe.
+    cellar_supervisor_config_t supervised = {
+        .name = "auth",
+        .period_ms = AUTH_CHECKIN_MS,
+        .timeout_ms = AUTH_STALL_MS,
+    };
+    s_supervisor_id = cellar_supervisor_add(&supervised);
+    if (xTaskCreatePinnedToCore(auth_task, "auth", AUTH_TASK_STACK, NULL, CELLAR_PRIO_AUTH, &s_auth_task,
+                                CELLAR_CORE_NET) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start auth task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
 }
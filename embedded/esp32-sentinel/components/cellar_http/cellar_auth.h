@@ -1,17 +1,28 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "esp_err.h"
 
 // Initialize NVS-backed token storage (call after nvs_flash_init and Wi-Fi up).
 void cellar_auth_init(void);
 
-// Ensure a valid access token is available. Will attempt refresh first, then
-// claim/poll using CLAIM_CODE if missing/expired. Returns ESP_OK on success.
+// Start the background task that owns the token lifecycle: it refreshes the
+// access token ahead of its JWT expiry and runs the claim/approval flow when
+// there are no tokens. Call after cellar_auth_init and once the network is up.
+esp_err_t cellar_auth_start(void);
+
+// Non-blocking: ESP_OK if a valid access token is cached. Otherwise wakes the
+// auth task to refresh or claim and returns ESP_ERR_INVALID_STATE.
 esp_err_t cellar_auth_ensure_access_token(void);
 
 // Get the currently cached access token (NULL if unavailable).
 const char *cellar_auth_access_token(void);
 
+// Write "Bearer <token>" into out. Safe against a concurrent refresh.
+bool cellar_auth_format_bearer(char *out, size_t out_len);
+
 // Return the claim code being used (from config or generated/stored).
 const char *cellar_auth_claim_code(void);
 const char *cellar_auth_device_id(void);
@@ -1,13 +1,26 @@
 #include "cellar_http.h"
 
+#include <errno.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
 #include "cellar_auth.h"
+#include "cellar_binlog.h"
+#include "cellar_deflate.h"
+#include "cellar_netbuf.h"
+#include "cellar_power.h"
+#include "cellar_tls.h"
 
 #ifndef DEVICE_ID
 #define DEVICE_ID "esp32-sentinel"
@@ -17,10 +30,33 @@
 #error "CELLAR_API_BASE must be defined in config.h (e.g. http://host:3000/api)"
 #endif
 
-static const char *POST_URL = CELLAR_API_BASE "/sensor-readings";
+#define HTTP_TIMEOUT_MS 8000
+
+// Gzip telemetry bodies at least this large (needs API support for
+// Content-Encoding: gzip, which the wine-cellar backend has).
+#ifndef CELLAR_HTTP_GZIP
+#define CELLAR_HTTP_GZIP 1
+#endif
+#ifndef CELLAR_HTTP_GZIP_MIN_BYTES
+#define CELLAR_HTTP_GZIP_MIN_BYTES 512
+#endif
+
+// Per-reading budget for the telemetry body, plus room for the envelope.
+#define READING_JSON_MAX 640
+#define ENVELOPE_JSON_MAX 512
+// "Bearer " plus the access token.
+#define AUTH_HEADER_MAX 900
 
 static const char *TAG = "cellar_http";
 
+// One client (and so one TCP/TLS connection) shared by telemetry and auth.
+// esp_http_client keeps the socket open between requests to the same host.
+static esp_http_client_handle_t s_client = NULL;
+static SemaphoreHandle_t s_client_lock = NULL;
+// When the current perform started; ON_CONNECTED only fires for a new
+// connection, so the gap is the TCP + TLS handshake.
+static int64_t s_perform_started_us = 0;
+
 static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
     if (evt->event_id == HTTP_EVENT_ON_DATA && evt->user_data) {
         resp_accum_t *acc = (resp_accum_t *)evt->user_data;
@@ -33,107 +69,376 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
                 acc->buf[acc->len] = '\0';
             }
         }
+    } else if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        cellar_power_record(CELLAR_ACTIVITY_TLS_CONNECT, esp_timer_get_time() - s_perform_started_us);
     } else if (evt->event_id == HTTP_EVENT_ERROR) {
         ESP_LOGW(TAG, "HTTP event error");
     }
     return ESP_OK;
 }
 
-extern const char server_root_cert_pem_start[] asm("_binary_server_root_cert_pem_start");
-extern const char server_root_cert_pem_end[]   asm("_binary_server_root_cert_pem_end");
+esp_err_t cellar_http_init(void) {
+    if (s_client_lock) return ESP_OK;
+#if CELLAR_API_USE_HTTPS
+    // Without the resident anchors, cellar_tls_configure falls back to
+    // esp-tls's defaults; the connection still verifies.
+    cellar_tls_init();
+#endif
+    s_client_lock = xSemaphoreCreateMutex();
+    return s_client_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
 
-esp_err_t cellar_http_post(const cellar_measurement_t *measurement, cellar_http_result_t *result_out) {
-    if (!measurement) return ESP_ERR_INVALID_ARG;
+static esp_http_client_handle_t ensure_client(void) {
+    if (s_client) return s_client;
+    esp_http_client_config_t config = {
+        .url = CELLAR_API_BASE,
+        .event_handler = http_event_handler,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+        .buffer_size_tx = 1024,        // Authorization header carries the JWT
+        .disable_auto_redirect = true, // We don't want to follow redirects blindly
+        .keep_alive_enable = true,
+    };
+#if CELLAR_API_USE_HTTPS
+    cellar_tls_configure(&config);
+#endif
+    s_client = esp_http_client_init(&config);
+    if (!s_client) {
+        ESP_LOGE(TAG, "Failed to init HTTP client");
+    }
+    return s_client;
+}
 
-    if (result_out) {
-        result_out->status_code = -1;
-        result_out->err = ESP_FAIL;
+static esp_err_t post_body(const char *path,
+                           const char *body,
+                           size_t body_len,
+                           const char *content_encoding,
+                           const char *bearer,
+                           int timeout_ms,
+                           char *resp_buf,
+                           size_t resp_buf_len,
+                           int *out_status) {
+    if (!path || !body) return ESP_ERR_INVALID_ARG;
+    if (out_status) *out_status = -1;
+    if (resp_buf && resp_buf_len > 0) resp_buf[0] = '\0';
+    if (!s_client_lock && cellar_http_init() != ESP_OK) return ESP_ERR_NO_MEM;
+
+    char url[160];
+    int url_len = snprintf(url, sizeof(url), "%s%s", CELLAR_API_BASE, path);
+    if (url_len < 0 || url_len >= (int)sizeof(url)) return ESP_ERR_INVALID_SIZE;
+
+    resp_accum_t acc = {.buf = resp_buf, .len = 0, .cap = resp_buf_len};
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    esp_http_client_handle_t client = ensure_client();
+    if (!client) {
+        xSemaphoreGive(s_client_lock);
+        return ESP_FAIL;
+    }
+
+    esp_http_client_set_url(client, url);
+    esp_http_client_set_timeout_ms(client, timeout_ms > 0 ? timeout_ms : HTTP_TIMEOUT_MS);
+    esp_http_client_set_method(client, HTTP_METHOD_POST);
+    esp_http_client_set_user_data(client, &acc);
+    esp_http_client_set_header(client, "Content-Type", "application/json");
+    esp_http_client_set_header(client, "Accept-Encoding", "identity");
+    if (bearer) {
+        esp_http_client_set_header(client, "Authorization", bearer);
+    } else {
+        esp_http_client_delete_header(client, "Authorization");
+    }
+    if (content_encoding) {
+        esp_http_client_set_header(client, "Content-Encoding", content_encoding);
+    } else {
+        esp_http_client_delete_header(client, "Content-Encoding");
+    }
+    esp_http_client_set_post_field(client, body, (int)body_len);
+
+    s_perform_started_us = esp_timer_get_time();
+    esp_err_t err = esp_http_client_perform(client);
+    // A 401 can surface as an error from the client's own auth handling even
+    // though the server answered; a valid status means the transport worked.
+    int status = esp_http_client_get_status_code(client);
+    if (err == ESP_OK || (status > 0 && status < 600)) {
+        CELLAR_BLOGI(TAG, "POST %s (%u B%s) status=%d len=%u", path, (unsigned)body_len,
+                     content_encoding ? " gzip" : "", status, (unsigned)acc.len);
+        err = ESP_OK;
+    } else {
+        ESP_LOGE(TAG, "HTTP POST failed to %s: %s", path, esp_err_to_name(err));
+        status = -1;
+        // Drop the broken connection; the next request reconnects.
+        esp_http_client_cleanup(client);
+        s_client = NULL;
+    }
+    if (s_client) {
+        esp_http_client_set_user_data(s_client, NULL);
+    }
+    xSemaphoreGive(s_client_lock);
+
+    if (out_status) *out_status = status;
+    return err;
+}
+
+esp_err_t cellar_http_post_json(const char *path,
+                                const char *json_body,
+                                const char *bearer,
+                                int timeout_ms,
+                                char *resp_buf,
+                                size_t resp_buf_len,
+                                int *out_status) {
+    if (!json_body) return ESP_ERR_INVALID_ARG;
+    return post_body(path, json_body, strlen(json_body), NULL, bearer, timeout_ms,
+                     resp_buf, resp_buf_len, out_status);
+}
+
+// Split CELLAR_API_BASE ("http[s]://host[:port]/...") into host and port.
+static bool api_host_port(char *host, size_t host_len, char *port, size_t port_len) {
+    const char *base = CELLAR_API_BASE;
+    bool https = strncmp(base, "https", 5) == 0;
+    const char *p = strstr(base, "://");
+    p = p ? p + 3 : base;
+    size_t n = strcspn(p, ":/");
+    if (n == 0 || n >= host_len) return false;
+    memcpy(host, p, n);
+    host[n] = '\0';
+    if (p[n] == ':') {
+        size_t m = strcspn(p + n + 1, "/");
+        if (m == 0 || m >= port_len) return false;
+        memcpy(port, p + n + 1, m);
+        port[m] = '\0';
+    } else {
+        snprintf(port, port_len, "%s", https ? "443" : "80");
     }
+    return true;
+}
 
-    const char *device_id = measurement->device_id ? measurement->device_id : DEVICE_ID;
-    char payload[512];
-    int written = snprintf(payload, sizeof(payload), "{\"device_id\":\"%s\"", device_id);
+esp_err_t cellar_http_probe(int timeout_ms) {
+    char host[96];
+    char port[8];
+    if (!api_host_port(host, sizeof(host), port, sizeof(port))) return ESP_ERR_INVALID_ARG;
 
-    if (measurement->timestamp_iso8601 && measurement->timestamp_iso8601[0] != '\0') {
-        written += snprintf(payload + written,
-                            sizeof(payload) - written,
-                            ",\"measured_at\":\"%s\"",
-                            measurement->timestamp_iso8601);
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    int gai = getaddrinfo(host, port, &hints, &res);
+    if (gai != 0 || !res) {
+        ESP_LOGW(TAG, "Probe: DNS lookup for %s failed (%d)", host, gai);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    bool has_measurement = false;
+    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock < 0) {
+        freeaddrinfo(res);
+        return ESP_FAIL;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
 
-    if (measurement->temperatures_json && measurement->temperatures_json[0] != '\0') {
+    esp_err_t err = ESP_FAIL;
+    if (connect(sock, res->ai_addr, res->ai_addrlen) == 0) {
+        err = ESP_OK;
+    } else if (errno == EINPROGRESS) {
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        FD_SET(sock, &wfds);
+        struct timeval tv = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        if (select(sock + 1, NULL, &wfds, NULL, &tv) > 0) {
+            int so_err = 0;
+            socklen_t len = sizeof(so_err);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_err, &len);
+            err = so_err == 0 ? ESP_OK : ESP_FAIL;
+        } else {
+            err = ESP_ERR_TIMEOUT;
+        }
+    }
+    close(sock);
+    freeaddrinfo(res);
+    CELLAR_BLOGI(TAG, "Probe %s:%s -> %s", host, port, esp_err_to_name(err));
+    return err;
+}
+
+// snprintf that keeps counting past the end of buf without writing there, so
+// one overflow check at the end covers a whole sequence of appends.
+static void append(char *buf, size_t cap, int *written, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t pos = *written < 0 ? cap : (size_t)*written;
+    int n = vsnprintf(pos < cap ? buf + pos : NULL, pos < cap ? cap - pos : 0, fmt, args);
+    va_end(args);
+    if (n < 0 || *written < 0) {
+        *written = -1;
+    } else {
+        *written += n;
+    }
+}
+
+// Append the fields of one reading, each with a leading comma. Returns false
+// if the reading has no measurement values at all.
+static bool append_fields(char *buf, size_t cap, int *written, const cellar_measurement_t *m) {
+    bool has_measurement = false;
+    if (m->measured_at_ms > 0) {
+        append(buf, cap, written, ",\"measured_at\":%lld", (long long)m->measured_at_ms);
+    }
+    if (m->temperatures_json && m->temperatures_json[0] != '\0') {
         has_measurement = true;
-        written += snprintf(payload + written, sizeof(payload) - written, ",\"temperatures\":%s", measurement->temperatures_json);
+        append(buf, cap, written, ",\"temperatures\":%s", m->temperatures_json);
     }
-    if (!isnan(measurement->pressure_hpa)) {
+    if (!isnan(m->pressure_hpa)) {
         has_measurement = true;
-        written += snprintf(payload + written, sizeof(payload) - written, ",\"pressure_hpa\":%.2f", measurement->pressure_hpa);
+        append(buf, cap, written, ",\"pressure_hpa\":%.2f", m->pressure_hpa);
     }
-    if (!isnan(measurement->humidity_pct)) {
+    if (!isnan(m->humidity_pct)) {
         has_measurement = true;
-        written += snprintf(payload + written, sizeof(payload) - written, ",\"humidity_pct\":%.1f", measurement->humidity_pct);
+        append(buf, cap, written, ",\"humidity_pct\":%.1f", m->humidity_pct);
     }
-    if (!isnan(measurement->illuminance_lux)) {
+    if (!isnan(m->illuminance_lux)) {
         has_measurement = true;
-        written += snprintf(payload + written, sizeof(payload) - written, ",\"illuminance_lux\":%.1f", measurement->illuminance_lux);
+        append(buf, cap, written, ",\"illuminance_lux\":%.1f", m->illuminance_lux);
     }
+    return has_measurement;
+}
 
-    written += snprintf(payload + written, sizeof(payload) - written, "}");
+// One reading is sent flat, as before; several go in a "readings" array and
+// samples without any values are skipped. Health comes from the newest one.
+static int build_body(char *buf, size_t cap, const cellar_measurement_t *measurements,
+                      size_t count, size_t *out_sent) {
+    const cellar_measurement_t *newest = &measurements[count - 1];
+    const char *device_id = measurements[0].device_id ? measurements[0].device_id : DEVICE_ID;
+    int written = 0;
+    size_t sent = 0;
+    append(buf, cap, &written, "{\"device_id\":\"%s\"", device_id);
 
-    if (!has_measurement) {
-        ESP_LOGE(TAG, "No valid measurements to send");
-        return ESP_FAIL;
+    if (count == 1) {
+        if (append_fields(buf, cap, &written, &measurements[0])) sent = 1;
+    } else {
+        append(buf, cap, &written, ",\"readings\":[");
+        for (size_t i = 0; i < count && written >= 0 && written < (int)cap; ++i) {
+            int start = written + (sent > 0 ? 1 : 0);
+            int end = start;
+            if (!append_fields(buf, cap, &end, &measurements[i])) continue;
+            if (end < 0 || end >= (int)cap) {
+                written = end;
+                break;
+            }
+            if (sent > 0) buf[written] = ',';
+            buf[start] = '{';  // replaces the first field's leading comma
+            written = end;
+            append(buf, cap, &written, "}");
+            sent++;
+        }
+        append(buf, cap, &written, "]");
+    }
+    if (newest->health_json && newest->health_json[0] != '\0') {
+        append(buf, cap, &written, ",\"health\":%s", newest->health_json);
+    }
+    append(buf, cap, &written, "}");
+    *out_sent = sent;
+    return written;
+}
+
+int cellar_http_format_reading(char *buf, size_t cap, const cellar_measurement_t *m) {
+    if (!buf || !m || cap == 0) return -1;
+    int written = 0;
+    if (!append_fields(buf, cap, &written, m)) return -1;
+    if (m->health_json && m->health_json[0] != '\0') {
+        append(buf, cap, &written, ",\"health\":%s", m->health_json);
     }
-    if (written < 0 || written >= (int)sizeof(payload)) {
+    append(buf, cap, &written, "}");
+    if (written < 0 || written >= (int)cap) return -1;
+    buf[0] = '{';  // replaces the first field's leading comma
+    return written;
+}
+
+// The request body for a batch: JSON, gzipped when that is smaller. *body
+// points into *payload or *gz, both netbuf slots; the caller gives both back
+// (either may be NULL).
+static esp_err_t encode_batch(const cellar_measurement_t *measurements, size_t count,
+                              char **payload, uint8_t **gz,
+                              const char **body, size_t *body_len, const char **encoding) {
+    *gz = NULL;
+    *encoding = NULL;
+    size_t cap = count * READING_JSON_MAX + ENVELOPE_JSON_MAX;
+    *payload = cellar_netbuf_take(cap);
+    if (!*payload) return ESP_ERR_NO_MEM;
+    cap = cellar_netbuf_slot_size(cap);
+
+    size_t sent = 0;
+    int written = build_body(*payload, cap, measurements, count, &sent);
+    if (written < 0 || written >= (int)cap) {
         ESP_LOGE(TAG, "Payload buffer too small");
-        return ESP_FAIL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (sent == 0) {
+        ESP_LOGE(TAG, "No valid measurements to send");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    esp_http_client_config_t config = {
-        .url = POST_URL,
-        .event_handler = http_event_handler,
-        .timeout_ms = 8000,
-#if CELLAR_API_USE_HTTPS
-        .cert_pem = server_root_cert_pem_start,
+    *body = *payload;
+    *body_len = (size_t)written;
+#if CELLAR_HTTP_GZIP
+    if (*body_len >= CELLAR_HTTP_GZIP_MIN_BYTES) {
+        // Output no smaller than the JSON is not worth sending, so the slot
+        // only needs body_len bytes and compression gives up at that point.
+        *gz = cellar_netbuf_take(*body_len);
+        size_t gz_len = *gz ? cellar_gzip_compress((const uint8_t *)*payload, *body_len, *gz, *body_len) : 0;
+        if (gz_len > 0 && gz_len < *body_len) {
+            ESP_LOGD(TAG, "gzip %u -> %u bytes", (unsigned)*body_len, (unsigned)gz_len);
+            *body = (const char *)*gz;
+            *body_len = gz_len;
+            *encoding = "gzip";
+        }
+    }
 #endif
-    };
+    return ESP_OK;
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        ESP_LOGE(TAG, "Failed to init HTTP client");
-        return ESP_FAIL;
+esp_err_t cellar_http_post_batch(const cellar_measurement_t *measurements,
+                                 size_t count,
+                                 cellar_http_result_t *result_out) {
+    if (result_out) {
+        result_out->status_code = -1;
+        result_out->err = ESP_FAIL;
     }
+    if (!measurements || count == 0) return ESP_ERR_INVALID_ARG;
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    const char *access = cellar_auth_access_token();
-    if (!access) {
-        ESP_LOGE(TAG, "No access token available");
-        esp_http_client_cleanup(client);
-        return ESP_FAIL;
+    char *payload = NULL;
+    uint8_t *gz = NULL;
+    const char *body = NULL;
+    size_t body_len = 0;
+    const char *encoding = NULL;
+    esp_err_t encoded = encode_batch(measurements, count, &payload, &gz, &body, &body_len, &encoding);
+    if (encoded != ESP_OK) {
+        cellar_netbuf_give(gz);
+        cellar_netbuf_give(payload);
+        return encoded;
     }
-    char auth_header[900];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", access);
-    esp_http_client_set_header(client, "Authorization", auth_header);
-    esp_http_client_set_post_field(client, payload, written);
 
-    ESP_LOGI(TAG, "POST %s", POST_URL);
-    esp_err_t err = esp_http_client_perform(client);
+    char *auth_header = cellar_netbuf_take(AUTH_HEADER_MAX);
+    esp_err_t err = ESP_FAIL;
     int status = -1;
-    if (err == ESP_OK) {
-        status = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "POST status=%d, content_length=%lld", status, esp_http_client_get_content_length(client));
+    if (!auth_header) {
+        err = ESP_ERR_NO_MEM;
+    } else if (!cellar_auth_format_bearer(auth_header, AUTH_HEADER_MAX)) {
+        ESP_LOGE(TAG, "No access token available");
     } else {
-        ESP_LOGE(TAG, "HTTP POST failed: %s", esp_err_to_name(err));
+        cellar_power_acquire(CELLAR_POWER_NET);
+        err = post_body("/sensor-readings", body, body_len, encoding, auth_header, 0, NULL, 0, &status);
+        cellar_power_release(CELLAR_POWER_NET);
     }
+    cellar_netbuf_give(auth_header);
+    cellar_netbuf_give(gz);
+    cellar_netbuf_give(payload);
 
     if (result_out) {
         result_out->status_code = status;
         result_out->err = err;
     }
-
-    esp_http_client_cleanup(client);
     return err;
 }
+
+esp_err_t cellar_http_post(const cellar_measurement_t *measurement, cellar_http_result_t *result_out) {
+    return cellar_http_post_batch(measurement, 1, result_out);
+}
@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "esp_err.h"
 
@@ -16,8 +17,9 @@ typedef struct {
     float pressure_hpa;
     float humidity_pct;
     float illuminance_lux;
-    const char *timestamp_iso8601;  // optional
+    int64_t measured_at_ms;         // UTC epoch ms; 0 lets the server stamp it
     const char *device_id;          // optional, falls back to DEVICE_ID macro
+    const char *health_json;        // optional pre-formatted JSON object
 } cellar_measurement_t;
 
 typedef struct {
@@ -25,6 +27,41 @@ typedef struct {
     esp_err_t err;    // esp_err_t from esp_http_client_perform
 } cellar_http_result_t;
 
-// POST the given measurement JSON to CELLAR_API_URL.
-// Skips NaN fields; returns ESP_FAIL if no measurement fields are present.
+// Create the lock guarding the shared keep-alive client. Safe to call twice.
+esp_err_t cellar_http_init(void);
+
+// POST a JSON body to CELLAR_API_BASE + path over the shared connection.
+// bearer is the full Authorization value ("Bearer ...") or NULL; timeout_ms
+// of 0 uses the default. The response body is copied (truncated,
+// NUL-terminated) into resp_buf when given.
+// Returns ESP_OK whenever the server answered; check out_status.
+esp_err_t cellar_http_post_json(const char *path,
+                                const char *json_body,
+                                const char *bearer,
+                                int timeout_ms,
+                                char *resp_buf,
+                                size_t resp_buf_len,
+                                int *out_status);
+
+// Cheap reachability check: resolve the API host and open (then close) a TCP
+// connection to it, without TLS or HTTP. ESP_OK means the server port accepted
+// the connection within timeout_ms.
+esp_err_t cellar_http_probe(int timeout_ms);
+
+// POST measurements to CELLAR_API_BASE/sensor-readings in one request: a
+// single one as a flat body, several as a "readings" array. Bodies of at
+// least CELLAR_HTTP_GZIP_MIN_BYTES go out gzip-encoded. Skips NaN fields and
+// empty samples; returns ESP_ERR_INVALID_ARG if nothing is left to send and
+// ESP_ERR_INVALID_SIZE if the payload does not fit.
+esp_err_t cellar_http_post_batch(const cellar_measurement_t *measurements,
+                                 size_t count,
+                                 cellar_http_result_t *result_out);
+
+// Format one reading as a standalone JSON object with the same field names as
+// the HTTP body but no device_id (for transports that carry it elsewhere, such
+// as the MQTT topic). Returns the length, or -1 if the reading has no values
+// or does not fit in cap.
+int cellar_http_format_reading(char *buf, size_t cap, const cellar_measurement_t *m);
+
+// Single-measurement form of cellar_http_post_batch.
 esp_err_t cellar_http_post(const cellar_measurement_t *measurement, cellar_http_result_t *result_out);
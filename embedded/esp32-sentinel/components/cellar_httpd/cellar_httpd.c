@@ -0,0 +1,396 @@
+#include "cellar_httpd.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cellar_binlog.h"
+#include "cellar_power.h"
+#include "cellar_queue.h"
+#include "cellar_tasks.h"
+#include "cellar_time.h"
+#include "cellar_tsdb.h"
+#include "cellar_wifi.h"
+#include "config.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef CELLAR_HTTPD_PORT
+#define CELLAR_HTTPD_PORT 80
+#endif
+// RAM cost is about sizeof(cellar_sample_t) (~180 B) per entry.
+#ifndef CELLAR_HTTPD_HISTORY_LEN
+#define CELLAR_HTTPD_HISTORY_LEN 60
+#endif
+#define HTTPD_STACK_SIZE 6144
+#define SAMPLE_JSON_MAX 640
+#define METRIC_LINE_MAX 160
+
+static const char *TAG = "cellar_httpd";
+
+static const cellar_httpd_sources_t *s_sources = NULL;
+static httpd_handle_t s_server = NULL;
+
+// History ring. s_history_total counts every recorded sample, so entry n
+// lives at n % LEN while n >= total - LEN.
+static cellar_sample_t s_history[CELLAR_HTTPD_HISTORY_LEN];
+static uint32_t s_history_total = 0;
+static portMUX_TYPE s_history_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const ACTIVITY_NAMES[CELLAR_ACTIVITY_COUNT] = {
+    [CELLAR_ACTIVITY_WIFI_ASSOC] = "wifi_assoc",
+    [CELLAR_ACTIVITY_TLS_CONNECT] = "tls_connect",
+    [CELLAR_ACTIVITY_HTTP] = "http",
+    [CELLAR_ACTIVITY_SENSORS] = "sensors",
+};
+
+void cellar_httpd_record(const cellar_sample_t *sample) {
+    portENTER_CRITICAL(&s_history_mux);
+    memcpy(&s_history[s_history_total % CELLAR_HTTPD_HISTORY_LEN], sample, sizeof(*sample));
+    s_history_total++;
+    portEXIT_CRITICAL(&s_history_mux);
+}
+
+// Copy history entry n; false once it has been overwritten.
+static bool history_get(uint32_t n, cellar_sample_t *out) {
+    bool ok = false;
+    portENTER_CRITICAL(&s_history_mux);
+    if (n < s_history_total && s_history_total - n <= CELLAR_HTTPD_HISTORY_LEN) {
+        memcpy(out, &s_history[n % CELLAR_HTTPD_HISTORY_LEN], sizeof(*out));
+        ok = true;
+    }
+    portEXIT_CRITICAL(&s_history_mux);
+    return ok;
+}
+
+static esp_err_t latest_handler(httpd_req_t *req) {
+    cellar_sample_t sample;
+    char body[SAMPLE_JSON_MAX];
+    int len = -1;
+    if (s_sources->latest(&sample)) {
+        len = s_sources->format_sample(&sample, body, sizeof(body));
+    }
+    if (len < 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_sendstr(req, "{\"error\":\"no sample yet\"}");
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, body, len);
+}
+
+// Format one line of a chunked response. Lines longer than METRIC_LINE_MAX
+// are truncated, which never happens for the fixed metric set below.
+static esp_err_t send_line(httpd_req_t *req, const char *fmt, ...) {
+    char line[METRIC_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0) return ESP_FAIL;
+    if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+    return httpd_resp_send_chunk(req, line, n);
+}
+
+// One cellar_power-shaped histogram; labels is "" or e.g. activity="http".
+static esp_err_t send_histogram(httpd_req_t *req, const char *metric, const char *labels,
+                                const cellar_activity_stats_t *stats) {
+    const char *sep = labels[0] ? "," : "";
+    const char *open = labels[0] ? "{" : "";
+    const char *close = labels[0] ? "}" : "";
+    // Bucket 0 is <1 ms, bucket k is [2^(k-1), 2^k) ms, the last is open-ended.
+    uint32_t cumulative = 0;
+    esp_err_t err = ESP_OK;
+    for (int k = 0; k < CELLAR_ACTIVITY_HIST_BUCKETS - 1 && err == ESP_OK; k++) {
+        cumulative += stats->hist[k];
+        err = send_line(req, "%s_bucket{%s%sle=\"%g\"} %" PRIu32 "\n",
+                        metric, labels, sep, (double)(1u << k) / 1000.0, cumulative);
+    }
+    if (err == ESP_OK) {
+        err = send_line(req, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu32 "\n", metric, labels, sep, stats->count);
+    }
+    if (err == ESP_OK) {
+        err = send_line(req, "%s_sum%s%s%s %.6f\n", metric, open, labels, close, (double)stats->total_us / 1e6);
+    }
+    if (err == ESP_OK) {
+        err = send_line(req, "%s_count%s%s%s %" PRIu32 "\n", metric, open, labels, close, stats->count);
+    }
+    return err;
+}
+
+static esp_err_t send_activity_histogram(httpd_req_t *req, cellar_activity_t activity) {
+    cellar_activity_stats_t stats;
+    cellar_power_get_activity(activity, &stats);
+    char labels[40];
+    snprintf(labels, sizeof(labels), "activity=\"%s\"", ACTIVITY_NAMES[activity]);
+    return send_histogram(req, "cellar_activity_seconds", labels, &stats);
+}
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+} task_ctx_t;
+
+static bool send_task_cpu(const cellar_tasks_stat_t *t, void *arg) {
+    task_ctx_t *ctx = arg;
+    char core[4];
+    snprintf(core, sizeof(core), "%d", t->core);
+    ctx->err = send_line(ctx->req, "cellar_task_cpu_percent{task=\"%s\",core=\"%s\"} %.1f\n",
+                         t->name, t->core < 0 ? "any" : core, (double)t->cpu_pct);
+    return ctx->err == ESP_OK;
+}
+
+static bool send_task_stack(const cellar_tasks_stat_t *t, void *arg) {
+    task_ctx_t *ctx = arg;
+    ctx->err = send_line(ctx->req, "cellar_task_stack_free_bytes{task=\"%s\"} %" PRIu32 "\n",
+                         t->name, t->stack_free);
+    return ctx->err == ESP_OK;
+}
+
+// The run-time table (cellar_tasks_log_stats) as two gauge families.
+static esp_err_t send_task_stats(httpd_req_t *req) {
+    task_ctx_t ctx = {.req = req};
+    ctx.err = send_line(req, "# TYPE cellar_task_cpu_percent gauge\n");
+    if (ctx.err == ESP_OK) cellar_tasks_foreach(send_task_cpu, &ctx);
+    if (ctx.err == ESP_OK) ctx.err = send_line(req, "# TYPE cellar_task_stack_free_bytes gauge\n");
+    if (ctx.err == ESP_OK) cellar_tasks_foreach(send_task_stack, &ctx);
+    return ctx.err;
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+    cellar_httpd_counters_t counters = {.last_http_status = -1};
+    if (s_sources->counters) {
+        s_sources->counters(&counters);
+    }
+    cellar_power_stats_t power;
+    cellar_power_get_stats(&power);
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t err = send_line(req,
+        "# TYPE cellar_uptime_seconds gauge\ncellar_uptime_seconds %lld\n",
+        (long long)(esp_timer_get_time() / 1000000));
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_samples_acquired_total counter\ncellar_samples_acquired_total %" PRIu32 "\n",
+        counters.samples_acquired);
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_samples_queued_total counter\ncellar_samples_queued_total %" PRIu32 "\n",
+        counters.samples_queued);
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_uplink_sends_total counter\n"
+        "cellar_uplink_sends_total{result=\"ok\"} %" PRIu32 "\n"
+        "cellar_uplink_sends_total{result=\"error\"} %" PRIu32 "\n",
+        counters.sends_ok, counters.sends_failed);
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_uplink_last_status gauge\ncellar_uplink_last_status %d\n",
+        counters.last_http_status);
+    if (err == ESP_OK) err = send_line(req, "# TYPE cellar_uplink_post_seconds histogram\n");
+    if (err == ESP_OK) err = send_histogram(req, "cellar_uplink_post_seconds", "", &counters.post_latency);
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_queue_depth gauge\ncellar_queue_depth %u\n"
+        "# TYPE cellar_queue_capacity gauge\ncellar_queue_capacity %u\n",
+        (unsigned)cellar_queue_count(), (unsigned)cellar_queue_capacity());
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_queue_dropped_total counter\ncellar_queue_dropped_total %" PRIu32 "\n",
+        cellar_queue_dropped());
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_heap_free_bytes gauge\ncellar_heap_free_bytes %" PRIu32 "\n"
+        "# TYPE cellar_heap_min_free_bytes gauge\ncellar_heap_min_free_bytes %" PRIu32 "\n",
+        esp_get_free_heap_size(), esp_get_minimum_free_heap_size());
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_heap_largest_free_block_bytes gauge\n"
+        "cellar_heap_largest_free_block_bytes %u\n",
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    int rssi = 0;
+    if (err == ESP_OK && cellar_wifi_rssi(&rssi)) {
+        err = send_line(req, "# TYPE cellar_wifi_rssi_dbm gauge\ncellar_wifi_rssi_dbm %d\n", rssi);
+    }
+    if (err == ESP_OK) err = send_line(req,
+        "# TYPE cellar_power_seconds_total counter\n"
+        "cellar_power_seconds_total{state=\"active\"} %.3f\n"
+        "cellar_power_seconds_total{state=\"idle\"} %.3f\n",
+        (double)power.active_us / 1e6, (double)power.idle_us / 1e6);
+    if (err == ESP_OK) err = send_line(req,
+        "cellar_power_seconds_total{state=\"light_sleep\"} %.3f\n",
+        (double)power.light_sleep_us / 1e6);
+    cellar_tsdb_stats_t tsdb;
+    cellar_tsdb_get_stats(&tsdb);
+    if (err == ESP_OK && tsdb.sectors > 0) err = send_line(req,
+        "# TYPE cellar_history_samples gauge\n"
+        "cellar_history_samples{where=\"flash\"} %" PRIu32 "\n"
+        "cellar_history_samples{where=\"ram\"} %" PRIu32 "\n",
+        tsdb.samples_on_flash, tsdb.samples_in_ram);
+    if (err == ESP_OK && tsdb.sectors > 0) err = send_line(req,
+        "# TYPE cellar_history_sectors_used gauge\ncellar_history_sectors_used %" PRIu32 "\n"
+        "# TYPE cellar_history_sectors gauge\ncellar_history_sectors %" PRIu32 "\n",
+        tsdb.sectors_used, tsdb.sectors);
+    if (err == ESP_OK) err = send_task_stats(req);
+    if (err == ESP_OK) err = send_line(req, "# TYPE cellar_activity_seconds histogram\n");
+    for (int a = 0; a < CELLAR_ACTIVITY_COUNT && err == ESP_OK; a++) {
+        err = send_activity_histogram(req, (cellar_activity_t)a);
+    }
+    if (err != ESP_OK) return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Parse an optional epoch-ms query parameter; missing or malformed is "no bound".
+static int64_t query_ms(const char *query, const char *key, int64_t fallback) {
+    char value[24];
+    if (!query || httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) return fallback;
+    char *end = NULL;
+    long long ms = strtoll(value, &end, 10);
+    return (end && end != value && *end == '\0') ? (int64_t)ms : fallback;
+}
+
+// Points are gathered into chunks of about this size rather than written one
+// by one.
+#define SERIES_CHUNK_MAX 1024
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    bool first;
+    size_t len;
+    char buf[SERIES_CHUNK_MAX];
+} series_ctx_t;
+
+static bool send_point(int64_t ts_ms, float value, void *arg) {
+    series_ctx_t *ctx = arg;
+    char point[48];
+    int n = snprintf(point, sizeof(point), "%s[%lld,%g]", ctx->first ? "" : ",", (long long)ts_ms, value);
+    ctx->first = false;
+    if (ctx->len + n > sizeof(ctx->buf)) {
+        ctx->err = httpd_resp_send_chunk(ctx->req, ctx->buf, ctx->len);
+        ctx->len = 0;
+        if (ctx->err != ESP_OK) return false;
+    }
+    memcpy(ctx->buf + ctx->len, point, n);
+    ctx->len += n;
+    return true;
+}
+
+// One channel from the flash history as [[ts_ms,value],...]. The scan holds
+// no lock while points are sent, so a slow client cannot stall the sampler.
+static esp_err_t series_handler(httpd_req_t *req, const char *channel, int64_t from_ms, int64_t to_ms) {
+    // Off the stack: a chunk buffer would take a sixth of the server task's.
+    series_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "out of memory");
+    }
+    httpd_resp_set_type(req, "application/json");
+    ctx->req = req;
+    ctx->first = true;
+    ctx->buf[ctx->len++] = '[';
+    esp_err_t err = cellar_tsdb_scan(channel, from_ms, to_ms, send_point, ctx);
+    if (ctx->err == ESP_OK && err != ESP_OK) {
+        // Headers are gone already; end the array and log instead.
+        ESP_LOGW(TAG, "History scan of %s failed: %s", channel, esp_err_to_name(err));
+    }
+    err = ctx->err;
+    if (err == ESP_OK) {
+        ctx->buf[ctx->len++] = ']';
+        err = httpd_resp_send_chunk(req, ctx->buf, ctx->len);
+    }
+    free(ctx);
+    if (err != ESP_OK) return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t history_handler(httpd_req_t *req) {
+    char query[128];
+    bool has_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+    int64_t from_ms = query_ms(has_query ? query : NULL, "from", INT64_MIN);
+    int64_t to_ms = query_ms(has_query ? query : NULL, "to", INT64_MAX);
+    bool bounded = from_ms != INT64_MIN || to_ms != INT64_MAX;
+
+    char channel[CELLAR_SENSOR_ID_LEN];
+    if (has_query && httpd_query_key_value(query, "channel", channel, sizeof(channel)) == ESP_OK) {
+        cellar_tsdb_stats_t stats;
+        cellar_tsdb_get_stats(&stats);
+        if (stats.sectors == 0) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            httpd_resp_set_type(req, "application/json");
+            return httpd_resp_sendstr(req, "{\"error\":\"no history partition\"}");
+        }
+        return series_handler(req, channel, from_ms, to_ms);
+    }
+
+    portENTER_CRITICAL(&s_history_mux);
+    uint32_t end = s_history_total;
+    portEXIT_CRITICAL(&s_history_mux);
+    uint32_t start = end > CELLAR_HTTPD_HISTORY_LEN ? end - CELLAR_HTTPD_HISTORY_LEN : 0;
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send_chunk(req, "[", 1);
+    bool first = true;
+    char body[SAMPLE_JSON_MAX + 1];
+    for (uint32_t n = start; n < end && err == ESP_OK; n++) {
+        cellar_sample_t sample;
+        if (!history_get(n, &sample)) continue;  // overwritten while we were sending
+        if (bounded) {
+            // Samples from before the first time sync have no wall-clock stamp.
+            int64_t utc_ms = cellar_time_mono_to_utc_ms(sample.mono_ms);
+            if (utc_ms == 0 || utc_ms < from_ms || utc_ms > to_ms) continue;
+        }
+        int len = s_sources->format_sample(&sample, body + 1, sizeof(body) - 1);
+        if (len < 0) continue;
+        body[0] = ',';
+        err = first ? httpd_resp_send_chunk(req, body + 1, len) : httpd_resp_send_chunk(req, body, len + 1);
+        first = false;
+    }
+    if (err == ESP_OK) err = httpd_resp_send_chunk(req, "]", 1);
+    if (err != ESP_OK) return err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// The recent deferred log records, raw; tools/binlog_decode.py formats them.
+static esp_err_t log_handler(httpd_req_t *req) {
+    size_t cap = cellar_binlog_dump_max();
+    uint8_t *dump = malloc(cap);
+    if (!dump) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "out of memory");
+    }
+    size_t len = cellar_binlog_dump(dump, cap);
+    httpd_resp_set_type(req, "application/octet-stream");
+    esp_err_t err = httpd_resp_send(req, (const char *)dump, (ssize_t)len);
+    free(dump);
+    return err;
+}
+
+esp_err_t cellar_httpd_start(const cellar_httpd_sources_t *sources) {
+    if (s_server) return ESP_OK;
+    if (!sources || !sources->latest || !sources->format_sample) return ESP_ERR_INVALID_ARG;
+    s_sources = sources;
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = CELLAR_HTTPD_PORT;
+    config.stack_size = HTTPD_STACK_SIZE;
+    config.task_priority = CELLAR_PRIO_HTTPD;
+    config.core_id = CELLAR_CORE_NET;
+    config.max_open_sockets = 3;
+    config.lru_purge_enable = true;
+    esp_err_t err = httpd_start(&s_server, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start server: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    static const httpd_uri_t uris[] = {
+        {.uri = "/latest", .method = HTTP_GET, .handler = latest_handler},
+        {.uri = "/metrics", .method = HTTP_GET, .handler = metrics_handler},
+        {.uri = "/history", .method = HTTP_GET, .handler = history_handler},
+        {.uri = "/log", .method = HTTP_GET, .handler = log_handler},
+    };
+    for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
+        httpd_register_uri_handler(s_server, &uris[i]);
+    }
+    ESP_LOGI(TAG, "Serving /latest, /metrics, /history and /log on port %d", CELLAR_HTTPD_PORT);
+    return ESP_OK;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cellar_power.h"
+#include "cellar_sensors.h"
+#include "esp_err.h"
+
+// Counters owned by the application, exported on /metrics.
+typedef struct {
+    uint32_t samples_acquired;  // sensor rounds that read at least one sensor
+    uint32_t samples_queued;    // samples handed to the uplink
+    uint32_t sends_ok;          // uplink requests/publishes that succeeded
+    uint32_t sends_failed;
+    int last_http_status;       // -1 before the first response
+    // Each uplink send (one HTTP batch post or one round of MQTT publishes),
+    // from the call to its result, whatever the outcome.
+    cellar_activity_stats_t post_latency;
+} cellar_httpd_counters_t;
+
+// Where the endpoint gets its data. All callbacks run on the server task.
+typedef struct {
+    // Copy the newest sample into out. Returns false if there is none yet.
+    bool (*latest)(cellar_sample_t *out);
+    // Format a sample as one JSON object, the same reading format the uplink
+    // sends. Returns the length, or -1 if it has no values or does not fit.
+    int (*format_sample)(const cellar_sample_t *sample, char *buf, size_t cap);
+    void (*counters)(cellar_httpd_counters_t *out);
+} cellar_httpd_sources_t;
+
+// Serve on CELLAR_HTTPD_PORT (default 80):
+//   GET /latest                 newest sample as JSON (503 before the first)
+//   GET /metrics                Prometheus text format
+//   GET /history?from=&to=      recorded samples as a JSON array; from/to are
+//                               optional UTC epoch ms bounds (inclusive)
+//   GET /history?channel=&from=&to=
+//                               one channel from the flash history
+//                               (cellar_tsdb) as [[ts_ms,value],...]
+//   GET /log                    recent deferred log records, raw
+//                               (cellar_binlog; tools/binlog_decode.py)
+// sources must outlive the server.
+esp_err_t cellar_httpd_start(const cellar_httpd_sources_t *sources);
+
+// Keep a sample for /history. The most recent CELLAR_HTTPD_HISTORY_LEN
+// samples are kept in RAM. Safe to call before cellar_httpd_start.
+void cellar_httpd_record(const cellar_sample_t *sample);
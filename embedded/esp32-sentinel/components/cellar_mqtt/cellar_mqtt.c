@@ -0,0 +1,175 @@
+#include "cellar_mqtt.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cellar_power.h"
+#include "cellar_tasks.h"
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+
+// The bridge takes the device id from the topic, so the broker has to know
+// who is publishing: TLS and a per-device password are required, and the
+// username is the device id (what the broker's ACL matches topics against).
+#ifndef CELLAR_MQTT_URI
+#define CELLAR_MQTT_URI "mqtts://192.168.1.10:8883"
+#endif
+#ifndef CELLAR_MQTT_TOPIC_PREFIX
+#define CELLAR_MQTT_TOPIC_PREFIX "cellar"
+#endif
+// Long keepalive: the radio sleeps between beacons, and every ping wakes it.
+#ifndef CELLAR_MQTT_KEEPALIVE_S
+#define CELLAR_MQTT_KEEPALIVE_S 120
+#endif
+
+#define CONNECTED_BIT BIT0
+#define ACK_QUEUE_LEN 8
+
+static const char *TAG = "cellar_mqtt";
+
+static esp_mqtt_client_handle_t s_client = NULL;
+static EventGroupHandle_t s_events = NULL;
+static QueueHandle_t s_acks = NULL;  // msg_ids from MQTT_EVENT_PUBLISHED
+static cellar_mqtt_command_cb_t s_on_command = NULL;
+static char s_client_id[64];
+static char s_readings_topic[96];
+static char s_cmd_topic[96];
+static char s_status_topic[96];
+
+// Same CA the HTTPS uplink uses (embedded by main); only mqtts:// and wss://
+// URIs look at it.
+extern const char server_root_cert_pem_start[] asm("_binary_server_root_cert_pem_start");
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Connected (session %s)", event->session_present ? "resumed" : "new");
+            xEventGroupSetBits(s_events, CONNECTED_BIT);
+            // A resumed session keeps the subscription; subscribing again is harmless.
+            esp_mqtt_client_subscribe(s_client, s_cmd_topic, 1);
+            esp_mqtt_client_publish(s_client, s_status_topic, "online", 0, 1, 1);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "Disconnected");
+            xEventGroupClearBits(s_events, CONNECTED_BIT);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            xQueueSend(s_acks, &event->msg_id, 0);
+            break;
+        case MQTT_EVENT_DATA:
+            // Commands are small; ignore anything split across several events.
+            if (event->current_data_offset != 0 || event->data_len != event->total_data_len) break;
+            if (event->topic_len == (int)strlen(s_cmd_topic) &&
+                strncmp(event->topic, s_cmd_topic, event->topic_len) == 0 && s_on_command) {
+                s_on_command(event->data, (size_t)event->data_len);
+            }
+            break;
+        case MQTT_EVENT_ERROR:
+            ESP_LOGW(TAG, "MQTT error (type %d)", event->error_handle ? (int)event->error_handle->error_type : -1);
+            break;
+        default:
+            break;
+    }
+}
+
+esp_err_t cellar_mqtt_start(const char *device_id, cellar_mqtt_command_cb_t on_command) {
+    if (s_client) return ESP_OK;
+    if (!device_id) return ESP_ERR_INVALID_ARG;
+#ifndef CELLAR_MQTT_PASSWORD
+    ESP_LOGE(TAG, "CELLAR_MQTT_PASSWORD is not set; not connecting to the broker");
+    return ESP_ERR_INVALID_STATE;
+#else
+    if (strncmp(CELLAR_MQTT_URI, "mqtts://", 8) != 0 && strncmp(CELLAR_MQTT_URI, "wss://", 6) != 0) {
+        ESP_LOGE(TAG, "%s is not mqtts:// or wss://; not sending the password in the clear", CELLAR_MQTT_URI);
+        return ESP_ERR_INVALID_ARG;
+    }
+#endif
+
+    s_on_command = on_command;
+    snprintf(s_client_id, sizeof(s_client_id), "%s", device_id);
+    snprintf(s_readings_topic, sizeof(s_readings_topic), "%s/%s/readings", CELLAR_MQTT_TOPIC_PREFIX, device_id);
+    snprintf(s_cmd_topic, sizeof(s_cmd_topic), "%s/%s/cmd", CELLAR_MQTT_TOPIC_PREFIX, device_id);
+    snprintf(s_status_topic, sizeof(s_status_topic), "%s/%s/status", CELLAR_MQTT_TOPIC_PREFIX, device_id);
+
+    s_events = xEventGroupCreate();
+    s_acks = xQueueCreate(ACK_QUEUE_LEN, sizeof(int));
+    if (!s_events || !s_acks) return ESP_ERR_NO_MEM;
+
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = CELLAR_MQTT_URI,
+        .broker.verification.certificate = server_root_cert_pem_start,
+        .credentials.client_id = s_client_id,
+        .credentials.username = s_client_id,
+#ifdef CELLAR_MQTT_PASSWORD
+        .credentials.authentication.password = CELLAR_MQTT_PASSWORD,
+#endif
+        // Persistent session: the broker keeps our subscription and queued
+        // commands across reconnects, and in-flight QoS 1 publishes resume.
+        .task.priority = CELLAR_PRIO_MQTT,  // core: CONFIG_MQTT_USE_CORE_0
+        .session.disable_clean_session = true,
+        .session.keepalive = CELLAR_MQTT_KEEPALIVE_S,
+        .session.last_will = {
+            .topic = s_status_topic,
+            .msg = "offline",
+            .qos = 1,
+            .retain = 1,
+        },
+    };
+    s_client = esp_mqtt_client_init(&config);
+    if (!s_client) {
+        ESP_LOGE(TAG, "Failed to init MQTT client");
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    esp_err_t err = esp_mqtt_client_start(s_client);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Connecting to %s as %s", CELLAR_MQTT_URI, s_client_id);
+    }
+    return err;
+}
+
+bool cellar_mqtt_connected(void) {
+    return s_events && (xEventGroupGetBits(s_events) & CONNECTED_BIT);
+}
+
+esp_err_t cellar_mqtt_publish_reading(const char *json, size_t len, int timeout_ms) {
+    if (!json) return ESP_ERR_INVALID_ARG;
+    if (!cellar_mqtt_connected()) return ESP_ERR_INVALID_STATE;
+
+    // Acks left over from publishes that already timed out.
+    int stale;
+    while (xQueueReceive(s_acks, &stale, 0) == pdTRUE) {
+    }
+
+    cellar_power_acquire(CELLAR_POWER_NET);
+    int msg_id = esp_mqtt_client_publish(s_client, s_readings_topic, json, (int)len, 1, 0);
+    esp_err_t err = ESP_FAIL;
+    if (msg_id >= 0) {
+        TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+        err = ESP_ERR_TIMEOUT;
+        int acked;
+        while (true) {
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(deadline - now) <= 0) break;
+            if (xQueueReceive(s_acks, &acked, deadline - now) != pdTRUE) break;
+            if (acked == msg_id) {
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    cellar_power_release(CELLAR_POWER_NET);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Publish %d to %s failed: %s", msg_id, s_readings_topic, esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Published %u B to %s", (unsigned)len, s_readings_topic);
+    }
+    return err;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// Called from the MQTT task with the raw payload of a message on the
+// command topic. Keep it short; hand real work to another task.
+typedef void (*cellar_mqtt_command_cb_t)(const char *data, size_t len);
+
+// Connect to CELLAR_MQTT_URI with a persistent session (clean session off),
+// subscribe to <prefix>/<device_id>/cmd and publish a retained "online" to
+// <prefix>/<device_id>/status ("offline" is the last will). The client
+// reconnects by itself. device_id must outlive the client.
+esp_err_t cellar_mqtt_start(const char *device_id, cellar_mqtt_command_cb_t on_command);
+
+bool cellar_mqtt_connected(void);
+
+// Publish one reading to <prefix>/<device_id>/readings with QoS 1 and wait
+// up to timeout_ms for the broker's PUBACK. Returns ESP_ERR_INVALID_STATE
+// while disconnected and ESP_ERR_TIMEOUT if no PUBACK arrived (the client
+// may still redeliver it, so the bridge must tolerate duplicates).
+esp_err_t cellar_mqtt_publish_reading(const char *json, size_t len, int timeout_ms);
@@ -0,0 +1,131 @@
+#include "cellar_netbuf.h"
+
+#include <stdbool.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+// Small slots: the uplink's health block and bearer header, and at most four
+// at once for the auth task (a token response, the access token copied out
+// of it, and the JWT segment and claims decoded from that); one spare. 1 KiB
+// holds the largest of these, the refresh response.
+#ifndef CELLAR_NETBUF_SMALL_SIZE
+#define CELLAR_NETBUF_SMALL_SIZE 1024
+#endif
+#ifndef CELLAR_NETBUF_SMALL_COUNT
+#define CELLAR_NETBUF_SMALL_COUNT 7
+#endif
+// Large slots: one telemetry batch and its gzip output. A batch of
+// UPLINK_BATCH_MAX readings needs 640 B each plus 512 B of envelope.
+#ifndef CELLAR_NETBUF_LARGE_SIZE
+#define CELLAR_NETBUF_LARGE_SIZE 8192
+#endif
+#ifndef CELLAR_NETBUF_LARGE_COUNT
+#define CELLAR_NETBUF_LARGE_COUNT 2
+#endif
+
+#if CELLAR_NETBUF_SMALL_COUNT > 32 || CELLAR_NETBUF_LARGE_COUNT > 32
+#error "cellar_netbuf tracks at most 32 slots per class"
+#endif
+
+static const char *TAG = "cellar_netbuf";
+
+static uint8_t s_small[CELLAR_NETBUF_SMALL_COUNT][CELLAR_NETBUF_SMALL_SIZE] __attribute__((aligned(4)));
+static uint8_t s_large[CELLAR_NETBUF_LARGE_COUNT][CELLAR_NETBUF_LARGE_SIZE] __attribute__((aligned(4)));
+
+typedef struct {
+    uint8_t *base;
+    size_t slot_size;
+    uint32_t slots;
+    uint32_t busy;  // bit i set while slot i is out
+    cellar_netbuf_stats_t stats;
+} pool_t;
+
+static pool_t s_pools[CELLAR_NETBUF_CLASS_COUNT] = {
+    [CELLAR_NETBUF_SMALL] = {&s_small[0][0], CELLAR_NETBUF_SMALL_SIZE, CELLAR_NETBUF_SMALL_COUNT},
+    [CELLAR_NETBUF_LARGE] = {&s_large[0][0], CELLAR_NETBUF_LARGE_SIZE, CELLAR_NETBUF_LARGE_COUNT},
+};
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static pool_t *pool_for(size_t size) {
+    for (int i = 0; i < CELLAR_NETBUF_CLASS_COUNT; ++i) {
+        if (size <= s_pools[i].slot_size) return &s_pools[i];
+    }
+    return NULL;
+}
+
+void *cellar_netbuf_take(size_t size) {
+    pool_t *pool = pool_for(size);
+    if (!pool) {
+        ESP_LOGE(TAG, "No slot holds %u bytes", (unsigned)size);
+        return NULL;
+    }
+    void *buf = NULL;
+    portENTER_CRITICAL(&s_lock);
+    cellar_netbuf_stats_t *st = &pool->stats;
+    st->takes++;
+    if (size > st->largest_request) st->largest_request = size;
+    for (uint32_t i = 0; i < pool->slots; ++i) {
+        if (pool->busy & (1u << i)) continue;
+        pool->busy |= 1u << i;
+        buf = pool->base + i * pool->slot_size;
+        if (++st->in_use > st->high_water) st->high_water = st->in_use;
+        break;
+    }
+    if (!buf) st->exhausted++;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!buf) {
+        ESP_LOGW(TAG, "All %u-byte slots busy", (unsigned)pool->slot_size);
+    }
+    return buf;
+}
+
+void cellar_netbuf_give(void *buf) {
+    if (!buf) return;
+    for (int i = 0; i < CELLAR_NETBUF_CLASS_COUNT; ++i) {
+        pool_t *pool = &s_pools[i];
+        uint8_t *p = buf;
+        if (p < pool->base || p >= pool->base + pool->slots * pool->slot_size) continue;
+        uint32_t slot = (uint32_t)((p - pool->base) / pool->slot_size);
+        bool was_busy;
+        portENTER_CRITICAL(&s_lock);
+        was_busy = pool->busy & (1u << slot);
+        if (was_busy) {
+            pool->busy &= ~(1u << slot);
+            pool->stats.in_use--;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        if (!was_busy) ESP_LOGE(TAG, "Slot %p given back twice", buf);
+        return;
+    }
+    ESP_LOGE(TAG, "%p is not a netbuf slot", buf);
+}
+
+size_t cellar_netbuf_slot_size(size_t size) {
+    pool_t *pool = pool_for(size);
+    return pool ? pool->slot_size : 0;
+}
+
+void cellar_netbuf_get_stats(cellar_netbuf_class_t cls, cellar_netbuf_stats_t *out) {
+    if (!out || cls < 0 || cls >= CELLAR_NETBUF_CLASS_COUNT) return;
+    pool_t *pool = &s_pools[cls];
+    portENTER_CRITICAL(&s_lock);
+    *out = pool->stats;
+    portEXIT_CRITICAL(&s_lock);
+    out->slot_size = pool->slot_size;
+    out->slots = pool->slots;
+}
+
+void cellar_netbuf_log_stats(void) {
+    static const char *const names[] = {"small", "large"};
+    for (int i = 0; i < CELLAR_NETBUF_CLASS_COUNT; ++i) {
+        cellar_netbuf_stats_t st;
+        cellar_netbuf_get_stats(i, &st);
+        ESP_LOGI(TAG, "%s %ux%u B: %lu in use, high water %lu, largest %u B, %lu takes, %lu exhausted",
+                 names[i], (unsigned)st.slots, (unsigned)st.slot_size, (unsigned long)st.in_use,
+                 (unsigned long)st.high_water, (unsigned)st.largest_request, (unsigned long)st.takes,
+                 (unsigned long)st.exhausted);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Statically allocated buffers for the network path: telemetry bodies and
+// their gzip output, bearer headers, and the auth requests and responses.
+// Two classes of fixed-size slots replace per-post malloc/free and the large
+// arrays the uplink and auth tasks kept on their stacks, so the heap does not
+// fragment around posts and the memory the network path can use is fixed at
+// link time. Slot sizes and counts come from config.h (CELLAR_NETBUF_*).
+
+typedef enum {
+    CELLAR_NETBUF_SMALL = 0,  // headers, auth bodies and responses, JWT claims
+    CELLAR_NETBUF_LARGE,      // telemetry batches and their gzip output
+    CELLAR_NETBUF_CLASS_COUNT,
+} cellar_netbuf_class_t;
+
+typedef struct {
+    size_t slot_size;
+    uint32_t slots;
+    uint32_t in_use;
+    uint32_t high_water;     // most slots in use at once since boot
+    size_t largest_request;  // biggest size asked of this class
+    uint32_t takes;
+    uint32_t exhausted;      // takes that found every slot busy
+} cellar_netbuf_stats_t;
+
+// A slot from the smallest class whose slots hold `size` bytes, or NULL if
+// every slot of that class is busy or `size` exceeds the large slots. Never
+// blocks and never falls back to another class.
+void *cellar_netbuf_take(size_t size);
+
+// Return a slot from cellar_netbuf_take. NULL is ignored.
+void cellar_netbuf_give(void *buf);
+
+// Bytes a slot taken for `size` can hold, or 0 if no class fits.
+size_t cellar_netbuf_slot_size(size_t size);
+
+void cellar_netbuf_get_stats(cellar_netbuf_class_t cls, cellar_netbuf_stats_t *out);
+
+// One line per class: slots in use, high-water mark and exhaustion count.
+void cellar_netbuf_log_stats(void);
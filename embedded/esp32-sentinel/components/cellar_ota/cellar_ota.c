@@ -0,0 +1,468 @@
+#include "cellar_ota.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cellar_auth.h"
+#include "cellar_delta.h"
+#include "cellar_power.h"
+#include "cellar_tasks.h"
+#include "cellar_tsdb.h"
+#include "cellar_wifi.h"
+#include "config.h"
+#include "esp_app_desc.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include "miniz.h"  // ROM inflater (tinfl)
+
+#ifndef CELLAR_API_BASE
+#error "CELLAR_API_BASE must be defined in config.h (e.g. http://host:3000/api)"
+#endif
+
+// First check shortly after boot, then at this interval.
+#ifndef CELLAR_OTA_FIRST_CHECK_MS
+#define CELLAR_OTA_FIRST_CHECK_MS (2 * 60 * 1000)
+#endif
+#ifndef CELLAR_OTA_CHECK_INTERVAL_MS
+#define CELLAR_OTA_CHECK_INTERVAL_MS (6 * 60 * 60 * 1000)
+#endif
+// A new image that has not delivered a reading by then is rolled back.
+#ifndef CELLAR_OTA_CONFIRM_TIMEOUT_MS
+#define CELLAR_OTA_CONFIRM_TIMEOUT_MS (10 * 60 * 1000)
+#endif
+
+#define OTA_RETRY_MS (30 * 60 * 1000)
+#define OTA_NOT_READY_RETRY_MS (60 * 1000)
+#define OTA_HTTP_TIMEOUT_MS 15000
+// As for the uplink: an esp_http_client TLS handshake plus the manifest buffer.
+// The restart log reports the headroom left; perf_harness.py --ota records it.
+#define OTA_TASK_STACK 7168
+#define OTA_PROGRESS_LOG_BYTES (64 * 1024)
+#define MANIFEST_MAX 512
+
+static const char *TAG = "cellar_ota";
+
+extern const char server_root_cert_pem_start[] asm("_binary_server_root_cert_pem_start");
+
+typedef struct {
+    char version[32];
+    char image_path[128];
+    uint32_t image_size;
+    char image_sha256[65];
+    char delta_path[128];
+    uint32_t delta_size;
+} manifest_t;
+
+// One update in progress. The delta path adds ~43 KiB of heap (the inflate
+// window and decompressor) for the length of the download only.
+typedef struct {
+    const esp_partition_t *running;
+    const esp_partition_t *target;
+    esp_ota_handle_t handle;
+    mbedtls_sha256_context sha;
+    uint32_t written;
+    // Delta only
+    uint8_t header_buf[CELLAR_DELTA_HEADER_SIZE];
+    size_t header_len;
+    cellar_delta_header_t header;
+    cellar_delta_t *delta;
+    tinfl_decompressor *inflator;
+    uint8_t *dict;
+    size_t dict_ofs;
+    bool patched;
+} update_t;
+
+static TaskHandle_t s_task = NULL;
+static esp_timer_handle_t s_confirm_timer = NULL;
+static volatile bool s_pending_verify = false;
+static manifest_t s_manifest;
+static update_t s_update;
+static char s_bearer[900];
+static uint8_t s_net_buf[1024];
+
+// Same minimal "key":value scanning as cellar_auth; the manifest is flat.
+static bool json_get_string(const char *body, const char *key, char *out, size_t out_len) {
+    char quoted[32];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    const char *found = strstr(body, quoted);
+    if (!found) return false;
+    const char *start = strchr(found + strlen(quoted), ':');
+    if (!start) return false;
+    start++;
+    while (*start == ' ' || *start == '"') start++;
+    const char *end = start;
+    while (*end && *end != '"' && *end != ',' && *end != '}') end++;
+    if (end <= start || (size_t)(end - start) >= out_len) return false;
+    memcpy(out, start, (size_t)(end - start));
+    out[end - start] = '\0';
+    return true;
+}
+
+static bool json_get_u32(const char *body, const char *key, uint32_t *out) {
+    char text[16];
+    if (!json_get_string(body, key, text, sizeof(text))) return false;
+    char *end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text) return false;
+    *out = (uint32_t)value;
+    return true;
+}
+
+// Open a GET on CELLAR_API_BASE + path with the device token. A separate
+// client from cellar_http's shared one, which a long download would
+// otherwise hold for its whole length.
+static esp_http_client_handle_t open_get(const char *path, int *out_status, int64_t *out_length) {
+    char url[200];
+    int url_len = snprintf(url, sizeof(url), "%s%s", CELLAR_API_BASE, path);
+    if (url_len < 0 || url_len >= (int)sizeof(url)) return NULL;
+    if (!cellar_auth_format_bearer(s_bearer, sizeof(s_bearer))) return NULL;
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = OTA_HTTP_TIMEOUT_MS,
+        .buffer_size = 1024,
+        .buffer_size_tx = 1024,  // Authorization header carries the JWT
+        .disable_auto_redirect = true,
+#if CELLAR_API_USE_HTTPS
+        // esp-tls's defaults, not the cellar_tls profile: OTA is how a bad
+        // profile gets fixed, so it must not depend on it.
+        .cert_pem = server_root_cert_pem_start,
+#endif
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client) return NULL;
+    esp_http_client_set_header(client, "Authorization", s_bearer);
+    esp_http_client_set_header(client, "Accept-Encoding", "identity");
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "GET %s failed: %s", path, esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return NULL;
+    }
+    *out_length = esp_http_client_fetch_headers(client);
+    *out_status = esp_http_client_get_status_code(client);
+    return client;
+}
+
+static void close_get(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+}
+
+// ESP_OK with a manifest to apply, ESP_ERR_NOT_FOUND when up to date.
+static esp_err_t fetch_manifest(manifest_t *out) {
+    char elf_sha[65];
+    esp_app_get_elf_sha256(elf_sha, sizeof(elf_sha));
+    char path[160];
+    snprintf(path, sizeof(path), "/device-firmware?version=%s&elf_sha256=%s",
+             cellar_ota_version(), elf_sha);
+
+    int status = -1;
+    int64_t length = 0;
+    cellar_power_acquire(CELLAR_POWER_NET);
+    esp_http_client_handle_t client = open_get(path, &status, &length);
+    char body[MANIFEST_MAX];
+    int body_len = 0;
+    if (client) {
+        while (body_len < (int)sizeof(body) - 1) {
+            int n = esp_http_client_read(client, body + body_len, sizeof(body) - 1 - body_len);
+            if (n <= 0) break;
+            body_len += n;
+        }
+        close_get(client);
+    }
+    cellar_power_release(CELLAR_POWER_NET);
+    body[body_len] = '\0';
+
+    if (!client) return ESP_FAIL;
+    if (status == 204) return ESP_ERR_NOT_FOUND;
+    if (status != 200) {
+        ESP_LOGW(TAG, "Firmware check returned status %d", status);
+        return ESP_FAIL;
+    }
+    memset(out, 0, sizeof(*out));
+    if (!json_get_string(body, "version", out->version, sizeof(out->version)) ||
+        !json_get_string(body, "image_path", out->image_path, sizeof(out->image_path)) ||
+        !json_get_u32(body, "image_size", &out->image_size) ||
+        !json_get_string(body, "image_sha256", out->image_sha256, sizeof(out->image_sha256))) {
+        ESP_LOGW(TAG, "Unusable firmware manifest: %s", body);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (json_get_string(body, "delta_path", out->delta_path, sizeof(out->delta_path))) {
+        json_get_u32(body, "delta_size", &out->delta_size);
+    }
+    return ESP_OK;
+}
+
+static int write_new(void *ctx, const uint8_t *buf, size_t len) {
+    update_t *u = ctx;
+    if (esp_ota_write(u->handle, buf, len) != ESP_OK) return -1;
+    mbedtls_sha256_update(&u->sha, buf, len);
+    u->written += (uint32_t)len;
+    return 0;
+}
+
+static int read_old(void *ctx, uint32_t offset, uint8_t *buf, size_t len) {
+    update_t *u = ctx;
+    return esp_partition_read(u->running, offset, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static esp_err_t start_delta(update_t *u) {
+    if (!cellar_delta_parse_header(u->header_buf, sizeof(u->header_buf), &u->header)) {
+        ESP_LOGW(TAG, "Not a delta patch");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    const esp_app_desc_t *app = esp_app_get_description();
+    if (memcmp(u->header.old_elf_sha256, app->app_elf_sha256, sizeof(app->app_elf_sha256)) != 0 ||
+        u->header.old_size > u->running->size) {
+        ESP_LOGW(TAG, "Delta was made for a different base image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (u->header.new_size > u->target->size) return ESP_ERR_INVALID_SIZE;
+    u->delta = malloc(sizeof(*u->delta));
+    u->inflator = malloc(sizeof(*u->inflator));
+    u->dict = malloc(TINFL_LZ_DICT_SIZE);
+    if (!u->delta || !u->inflator || !u->dict) return ESP_ERR_NO_MEM;
+    tinfl_init(u->inflator);
+    cellar_delta_init(u->delta, &u->header, read_old, write_new, u);
+    return ESP_OK;
+}
+
+// Inflate one network chunk of the patch body into the circular window and
+// hand what comes out to the applier.
+static esp_err_t feed_delta(update_t *u, const uint8_t *in, size_t in_len) {
+    while (true) {
+        size_t in_bytes = in_len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - u->dict_ofs;
+        tinfl_status st = tinfl_decompress(u->inflator, in, &in_bytes, u->dict, u->dict + u->dict_ofs,
+                                           &out_bytes, TINFL_FLAG_HAS_MORE_INPUT);
+        in += in_bytes;
+        in_len -= in_bytes;
+        if (out_bytes > 0) {
+            cellar_delta_status_t ds = cellar_delta_feed(u->delta, u->dict + u->dict_ofs, out_bytes);
+            u->dict_ofs = (u->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+            if (ds < 0) {
+                ESP_LOGW(TAG, "Delta apply failed (%d) at %lu B", ds, (unsigned long)u->written);
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            if (ds == CELLAR_DELTA_DONE) u->patched = true;
+        }
+        if (st < 0) {
+            ESP_LOGW(TAG, "Inflate failed (%d)", st);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (st == TINFL_STATUS_DONE || (st == TINFL_STATUS_NEEDS_MORE_INPUT && in_len == 0)) {
+            return ESP_OK;
+        }
+    }
+}
+
+static esp_err_t feed(update_t *u, bool delta, const uint8_t *data, size_t len) {
+    if (!delta) return write_new(u, data, len) == 0 ? ESP_OK : ESP_FAIL;
+    if (u->header_len < sizeof(u->header_buf)) {
+        size_t take = sizeof(u->header_buf) - u->header_len;
+        if (take > len) take = len;
+        memcpy(u->header_buf + u->header_len, data, take);
+        u->header_len += take;
+        data += take;
+        len -= take;
+        if (u->header_len < sizeof(u->header_buf)) return ESP_OK;
+        esp_err_t err = start_delta(u);
+        if (err != ESP_OK) return err;
+    }
+    return len > 0 ? feed_delta(u, data, len) : ESP_OK;
+}
+
+static void release_update(update_t *u) {
+    free(u->delta);
+    free(u->inflator);
+    free(u->dict);
+    mbedtls_sha256_free(&u->sha);
+    memset(u, 0, sizeof(*u));
+}
+
+static void hex_encode(const uint8_t *bytes, size_t len, char *out) {
+    for (size_t i = 0; i < len; ++i) sprintf(out + 2 * i, "%02x", bytes[i]);
+}
+
+// Download path into the inactive slot and make it the boot partition.
+static esp_err_t download(const char *path, bool delta) {
+    update_t *u = &s_update;
+    memset(u, 0, sizeof(*u));
+    u->running = esp_ota_get_running_partition();
+    u->target = esp_ota_get_next_update_partition(NULL);
+    if (!u->target) {
+        ESP_LOGE(TAG, "No OTA slot in the partition table; flash partitions.csv over USB once");
+        return ESP_ERR_NOT_FOUND;
+    }
+    mbedtls_sha256_init(&u->sha);
+    mbedtls_sha256_starts(&u->sha, 0);
+    esp_err_t err = esp_ota_begin(u->target, OTA_WITH_SEQUENTIAL_WRITES, &u->handle);
+    if (err != ESP_OK) {
+        release_update(u);
+        return err;
+    }
+
+    int64_t started_us = esp_timer_get_time();
+    int status = -1;
+    int64_t length = 0;
+    uint32_t received = 0;
+    cellar_power_acquire(CELLAR_POWER_NET);
+    esp_http_client_handle_t client = open_get(path, &status, &length);
+    if (!client) {
+        err = ESP_FAIL;
+    } else if (status != 200) {
+        ESP_LOGW(TAG, "GET %s returned status %d", path, status);
+        err = ESP_FAIL;
+    } else {
+        ESP_LOGI(TAG, "Downloading %s (%lld B, %s)", path, (long long)length, delta ? "delta" : "full image");
+        while (err == ESP_OK) {
+            int n = esp_http_client_read(client, (char *)s_net_buf, sizeof(s_net_buf));
+            if (n < 0) {
+                err = ESP_FAIL;
+            } else if (n == 0) {
+                if (!esp_http_client_is_complete_data_received(client)) err = ESP_FAIL;
+                break;
+            } else {
+                if (received / OTA_PROGRESS_LOG_BYTES != (received + n) / OTA_PROGRESS_LOG_BYTES) {
+                    ESP_LOGI(TAG, "%lu B received, %lu B written", (unsigned long)(received + n),
+                             (unsigned long)u->written);
+                }
+                received += (uint32_t)n;
+                err = feed(u, delta, s_net_buf, (size_t)n);
+            }
+        }
+    }
+    if (client) close_get(client);
+    cellar_power_release(CELLAR_POWER_NET);
+
+    uint8_t digest[32];
+    char digest_hex[65];
+    mbedtls_sha256_finish(&u->sha, digest);
+    hex_encode(digest, sizeof(digest), digest_hex);
+    if (err == ESP_OK && delta && !u->patched) {
+        ESP_LOGW(TAG, "Delta ended early (%lu of %lu B)", (unsigned long)u->written,
+                 (unsigned long)u->header.new_size);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    const char *want_hex = s_manifest.image_sha256;
+    char header_hex[65];
+    if (delta && u->patched) {
+        hex_encode(u->header.new_sha256, sizeof(u->header.new_sha256), header_hex);
+        want_hex = header_hex;
+    }
+    if (err == ESP_OK && strcmp(digest_hex, want_hex) != 0) {
+        ESP_LOGW(TAG, "Image SHA-256 mismatch: got %s", digest_hex);
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err == ESP_OK) {
+        err = esp_ota_end(u->handle);  // also validates the image format
+    } else {
+        esp_ota_abort(u->handle);
+    }
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(u->target);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Wrote %lu B to %s from %lu B downloaded in %lld ms", (unsigned long)u->written,
+                 u->target->label, (unsigned long)received, (esp_timer_get_time() - started_us) / 1000);
+    }
+    release_update(u);
+    return err;
+}
+
+static esp_err_t apply_update(const manifest_t *m) {
+    ESP_LOGI(TAG, "Update %s -> %s available (image %lu B%s)", cellar_ota_version(), m->version,
+             (unsigned long)m->image_size, m->delta_path[0] ? ", delta offered" : "");
+    if (m->delta_path[0]) {
+        esp_err_t err = download(m->delta_path, true);
+        if (err == ESP_OK || err == ESP_ERR_NOT_FOUND) return err;
+        ESP_LOGW(TAG, "Delta update failed (%s); fetching the full image", esp_err_to_name(err));
+    }
+    return download(m->image_path, false);
+}
+
+static void ota_task(void *arg) {
+    uint32_t wait_ms = CELLAR_OTA_FIRST_CHECK_MS;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+        wait_ms = CELLAR_OTA_CHECK_INTERVAL_MS;
+        if (s_pending_verify) continue;  // this image has to prove itself first
+        if (!cellar_wifi_is_connected() || cellar_auth_ensure_access_token() != ESP_OK) {
+            wait_ms = OTA_NOT_READY_RETRY_MS;
+            continue;
+        }
+        esp_err_t err = fetch_manifest(&s_manifest);
+        if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGI(TAG, "Firmware %s is current", cellar_ota_version());
+            continue;
+        }
+        if (err == ESP_OK) {
+            err = apply_update(&s_manifest);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Update check failed (%s); retrying in %d min", esp_err_to_name(err),
+                     OTA_RETRY_MS / 60000);
+            wait_ms = OTA_RETRY_MS;
+            continue;
+        }
+        ESP_LOGW(TAG, "Restarting into %s (stack %u B free)", s_manifest.version,
+                 (unsigned)uxTaskGetStackHighWaterMark(NULL));
+        cellar_tsdb_flush();
+        esp_restart();
+    }
+}
+
+static void confirm_timeout(void *arg) {
+    ESP_LOGE(TAG, "Image %s never delivered a reading; rolling back", cellar_ota_version());
+    cellar_tsdb_flush();
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+esp_err_t cellar_ota_start(void) {
+    if (s_task) return ESP_OK;
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        const esp_timer_create_args_t args = {.callback = confirm_timeout, .name = "ota_confirm"};
+        esp_err_t err = esp_timer_create(&args, &s_confirm_timer);
+        if (err != ESP_OK) return err;
+        s_pending_verify = true;
+        esp_timer_start_once(s_confirm_timer, (uint64_t)CELLAR_OTA_CONFIRM_TIMEOUT_MS * 1000);
+        ESP_LOGW(TAG, "First boot of %s from %s; it rolls back unless a reading is delivered within %ds",
+                 cellar_ota_version(), running->label, CELLAR_OTA_CONFIRM_TIMEOUT_MS / 1000);
+    } else {
+        ESP_LOGI(TAG, "Running %s from %s", cellar_ota_version(), running->label);
+    }
+    BaseType_t created = xTaskCreatePinnedToCore(ota_task, "ota", OTA_TASK_STACK, NULL, CELLAR_PRIO_OTA, &s_task,
+                                                 CELLAR_CORE_NET);
+    return created == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void cellar_ota_confirm(void) {
+    if (!s_pending_verify) return;
+    s_pending_verify = false;
+    esp_timer_stop(s_confirm_timer);
+    esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Image %s confirmed", cellar_ota_version());
+    } else {
+        ESP_LOGE(TAG, "Could not confirm image: %s", esp_err_to_name(err));
+    }
+}
+
+void cellar_ota_check_now(void) {
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+const char *cellar_ota_version(void) {
+    return esp_app_get_description()->version;
+}
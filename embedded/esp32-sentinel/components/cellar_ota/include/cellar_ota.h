@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+// Firmware updates served by the backend (GET /device-firmware). An update is
+// written to the inactive OTA slot, either as a binary delta against the
+// running image (components/cellar_delta, tools/mkdelta.py) or as the full
+// image, checked against the manifest's SHA-256 and then booted. The new
+// image must prove itself before it is kept: see cellar_ota_confirm.
+
+// Start the update task. On the first boot of a new image, also arm the
+// rollback timer: unless cellar_ota_confirm is called within
+// CELLAR_OTA_CONFIRM_TIMEOUT_MS, the device restarts into the previous image.
+// A crash before then has the same effect through the bootloader.
+esp_err_t cellar_ota_start(void);
+
+// Mark the running image good (call once a reading has been delivered).
+// Does nothing unless the image is waiting for confirmation.
+void cellar_ota_confirm(void);
+
+// Check for an update now rather than at the next interval.
+void cellar_ota_check_now(void);
+
+// Version string of the running image (esp_app_desc_t.version).
+const char *cellar_ota_version(void);
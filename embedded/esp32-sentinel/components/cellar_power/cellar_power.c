@@ -0,0 +1,319 @@
+#include "cellar_power.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cellar_binlog.h"
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+// DFS range. The low end is the XTAL clock; Wi-Fi raises APB itself while the
+// radio is busy.
+#ifndef CELLAR_PM_MAX_FREQ_MHZ
+#define CELLAR_PM_MAX_FREQ_MHZ CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#endif
+#ifndef CELLAR_PM_MIN_FREQ_MHZ
+#define CELLAR_PM_MIN_FREQ_MHZ 40
+#endif
+#ifndef CELLAR_PM_LIGHT_SLEEP
+#define CELLAR_PM_LIGHT_SLEEP 1
+#endif
+
+// Current model for the charge estimate (mA). Defaults are ESP32-WROOM
+// ballpark figures; measure the real board and override them in config.h.
+#ifndef CELLAR_CURRENT_RADIO_MA
+#define CELLAR_CURRENT_RADIO_MA 120.0f  // Wi-Fi associating or exchanging data
+#endif
+#ifndef CELLAR_CURRENT_CPU_MA
+#define CELLAR_CURRENT_CPU_MA 40.0f     // CPU at max clock, radio in modem sleep
+#endif
+#ifndef CELLAR_CURRENT_IDLE_MA
+#define CELLAR_CURRENT_IDLE_MA 15.0f    // awake at min clock, radio in modem sleep
+#endif
+#ifndef CELLAR_CURRENT_SLEEP_MA
+#define CELLAR_CURRENT_SLEEP_MA 2.0f    // light sleep, averaged over beacon wake-ups
+#endif
+
+static const char *TAG = "cellar_power";
+
+static const char *const s_domain_names[CELLAR_POWER_DOMAIN_COUNT] = {
+    [CELLAR_POWER_SENSORS] = "sensors",
+    [CELLAR_POWER_NET] = "net",
+};
+
+static const char *const s_activity_names[CELLAR_ACTIVITY_COUNT] = {
+    [CELLAR_ACTIVITY_WIFI_ASSOC] = "wifi_assoc",
+    [CELLAR_ACTIVITY_TLS_CONNECT] = "tls_connect",
+    [CELLAR_ACTIVITY_HTTP] = "http",
+    [CELLAR_ACTIVITY_SENSORS] = "sensors",
+};
+
+static const cellar_activity_t s_domain_activity[CELLAR_POWER_DOMAIN_COUNT] = {
+    [CELLAR_POWER_SENSORS] = CELLAR_ACTIVITY_SENSORS,
+    [CELLAR_POWER_NET] = CELLAR_ACTIVITY_HTTP,
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_pm_lock_handle_t s_pm_locks[CELLAR_POWER_DOMAIN_COUNT];
+static int s_held[CELLAR_POWER_DOMAIN_COUNT];
+static int64_t s_domain_since_us[CELLAR_POWER_DOMAIN_COUNT];
+static int64_t s_domain_us[CELLAR_POWER_DOMAIN_COUNT];
+static int s_active_count = 0;
+static int64_t s_active_since_us = 0;
+static int64_t s_active_us = 0;
+static int64_t s_started_us = 0;
+
+static portMUX_TYPE s_sleep_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_sleep_us = 0;
+static uint32_t s_sleep_count = 0;
+
+// Guarded by s_lock.
+static cellar_activity_stats_t s_activity[CELLAR_ACTIVITY_COUNT];
+static int64_t s_cycle_activity_us[CELLAR_ACTIVITY_COUNT];
+static int64_t s_cycle_started_us = 0;
+static int64_t s_cycle_sleep_base_us = 0;
+static cellar_power_cycle_t s_last_cycle;
+static bool s_have_last_cycle = false;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Runs from the idle task with interrupts off, right after waking.
+static IRAM_ATTR esp_err_t light_sleep_exit_cb(int64_t sleep_time_us, void *arg) {
+    portENTER_CRITICAL_ISR(&s_sleep_lock);
+    s_sleep_us += sleep_time_us;
+    s_sleep_count++;
+    portEXIT_CRITICAL_ISR(&s_sleep_lock);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t cellar_power_init(void) {
+    s_started_us = esp_timer_get_time();
+    s_cycle_started_us = s_started_us;
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CELLAR_PM_MAX_FREQ_MHZ,
+        .min_freq_mhz = CELLAR_PM_MIN_FREQ_MHZ,
+        .light_sleep_enable = CELLAR_PM_LIGHT_SLEEP,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Power management unavailable (%s); running at full clock",
+                 esp_err_to_name(err));
+        return err;
+    }
+
+    for (int i = 0; i < CELLAR_POWER_DOMAIN_COUNT; ++i) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, s_domain_names[i], &s_pm_locks[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create %s lock: %s", s_domain_names[i], esp_err_to_name(err));
+            return err;
+        }
+    }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = light_sleep_exit_cb,
+    };
+    esp_pm_light_sleep_register_cbs(&cbs);
+#endif
+
+    ESP_LOGI(TAG, "DFS %d-%d MHz, light sleep %s",
+             CELLAR_PM_MIN_FREQ_MHZ, CELLAR_PM_MAX_FREQ_MHZ,
+             CELLAR_PM_LIGHT_SLEEP ? "on" : "off");
+    return ESP_OK;
+}
+
+void cellar_power_acquire(cellar_power_domain_t domain) {
+    if (domain >= CELLAR_POWER_DOMAIN_COUNT) return;
+    if (s_pm_locks[domain]) {
+        esp_pm_lock_acquire(s_pm_locks[domain]);
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (s_held[domain]++ == 0) {
+        s_domain_since_us[domain] = now;
+    }
+    if (s_active_count++ == 0) {
+        s_active_since_us = now;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void cellar_power_release(cellar_power_domain_t domain) {
+    if (domain >= CELLAR_POWER_DOMAIN_COUNT) return;
+    int64_t now = esp_timer_get_time();
+    int64_t held_us = -1;
+    portENTER_CRITICAL(&s_lock);
+    if (s_held[domain] > 0 && --s_held[domain] == 0) {
+        held_us = now - s_domain_since_us[domain];
+        s_domain_us[domain] += held_us;
+    }
+    if (s_active_count > 0 && --s_active_count == 0) {
+        s_active_us += now - s_active_since_us;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (s_pm_locks[domain]) {
+        esp_pm_lock_release(s_pm_locks[domain]);
+    }
+    if (held_us >= 0) {
+        cellar_power_record(s_domain_activity[domain], held_us);
+    }
+}
+
+static int hist_bucket(int64_t duration_us) {
+    int64_t ms = duration_us / 1000;
+    int bucket = 0;
+    while (ms > 0 && bucket < CELLAR_ACTIVITY_HIST_BUCKETS - 1) {
+        ms >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void cellar_power_hist_add(cellar_activity_stats_t *stats, int64_t duration_us) {
+    if (duration_us < 0) return;
+    stats->count++;
+    stats->total_us += duration_us;
+    if (duration_us > stats->max_us) stats->max_us = duration_us;
+    stats->hist[hist_bucket(duration_us)]++;
+}
+
+void cellar_power_record(cellar_activity_t activity, int64_t duration_us) {
+    if (activity >= CELLAR_ACTIVITY_COUNT || duration_us < 0) return;
+    portENTER_CRITICAL(&s_lock);
+    cellar_power_hist_add(&s_activity[activity], duration_us);
+    s_cycle_activity_us[activity] += duration_us;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void cellar_power_get_activity(cellar_activity_t activity, cellar_activity_stats_t *out) {
+    if (!out || activity >= CELLAR_ACTIVITY_COUNT) return;
+    portENTER_CRITICAL(&s_lock);
+    memcpy(out, &s_activity[activity], sizeof(*out));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static int64_t sleep_total_us(void) {
+    portENTER_CRITICAL(&s_sleep_lock);
+    int64_t total = s_sleep_us;
+    portEXIT_CRITICAL(&s_sleep_lock);
+    return total;
+}
+
+// Radio time is association plus HTTP (the handshake is inside HTTP); sensor
+// transactions run the CPU at full clock; the rest is idle or light sleep.
+static void estimate_charge(cellar_power_cycle_t *cycle) {
+    int64_t radio_us = cycle->activity_us[CELLAR_ACTIVITY_WIFI_ASSOC] +
+                       cycle->activity_us[CELLAR_ACTIVITY_HTTP];
+    int64_t cpu_us = cycle->activity_us[CELLAR_ACTIVITY_SENSORS];
+    int64_t idle_us = cycle->cycle_us - radio_us - cpu_us - cycle->light_sleep_us;
+    if (idle_us < 0) idle_us = 0;
+    float ma_us = (float)radio_us * CELLAR_CURRENT_RADIO_MA +
+                  (float)cpu_us * CELLAR_CURRENT_CPU_MA +
+                  (float)idle_us * CELLAR_CURRENT_IDLE_MA +
+                  (float)cycle->light_sleep_us * CELLAR_CURRENT_SLEEP_MA;
+    cycle->charge_uah = ma_us / 3.6e6f;  // mA*us -> uAh
+    cycle->avg_ma = cycle->cycle_us > 0 ? ma_us / (float)cycle->cycle_us : 0.0f;
+}
+
+void cellar_power_end_cycle(cellar_power_cycle_t *out) {
+    cellar_power_cycle_t cycle = {0};
+    int64_t now = esp_timer_get_time();
+    int64_t sleep_now = sleep_total_us();
+
+    portENTER_CRITICAL(&s_lock);
+    cycle.cycle_us = now - s_cycle_started_us;
+    memcpy(cycle.activity_us, s_cycle_activity_us, sizeof(cycle.activity_us));
+    memset(s_cycle_activity_us, 0, sizeof(s_cycle_activity_us));
+    s_cycle_started_us = now;
+    cycle.light_sleep_us = sleep_now - s_cycle_sleep_base_us;
+    s_cycle_sleep_base_us = sleep_now;
+    portEXIT_CRITICAL(&s_lock);
+
+    estimate_charge(&cycle);
+
+    portENTER_CRITICAL(&s_lock);
+    s_last_cycle = cycle;
+    s_have_last_cycle = true;
+    portEXIT_CRITICAL(&s_lock);
+
+    // Deferred: ints, not long long, so the line fits one binlog record.
+    CELLAR_BLOGI(TAG, "Cycle %ds: assoc %dms, http %dms (tls %dms), sensors %dms, "
+                      "sleep %dms -> %.2fuAh (avg %.2fmA)",
+                 (int)(cycle.cycle_us / 1000000),
+                 (int)(cycle.activity_us[CELLAR_ACTIVITY_WIFI_ASSOC] / 1000),
+                 (int)(cycle.activity_us[CELLAR_ACTIVITY_HTTP] / 1000),
+                 (int)(cycle.activity_us[CELLAR_ACTIVITY_TLS_CONNECT] / 1000),
+                 (int)(cycle.activity_us[CELLAR_ACTIVITY_SENSORS] / 1000),
+                 (int)(cycle.light_sleep_us / 1000),
+                 cycle.charge_uah, cycle.avg_ma);
+    if (out) *out = cycle;
+}
+
+bool cellar_power_last_cycle(cellar_power_cycle_t *out) {
+    portENTER_CRITICAL(&s_lock);
+    bool have = s_have_last_cycle;
+    if (have && out) *out = s_last_cycle;
+    portEXIT_CRITICAL(&s_lock);
+    return have;
+}
+
+void cellar_power_get_stats(cellar_power_stats_t *out) {
+    if (!out) return;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    out->total_us = now - s_started_us;
+    out->active_us = s_active_us + (s_active_count > 0 ? now - s_active_since_us : 0);
+    for (int i = 0; i < CELLAR_POWER_DOMAIN_COUNT; ++i) {
+        out->domain_us[i] = s_domain_us[i] + (s_held[i] > 0 ? now - s_domain_since_us[i] : 0);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    portENTER_CRITICAL(&s_sleep_lock);
+    out->light_sleep_us = s_sleep_us;
+    out->light_sleep_count = s_sleep_count;
+    portEXIT_CRITICAL(&s_sleep_lock);
+
+    int64_t idle = out->total_us - out->active_us - out->light_sleep_us;
+    out->idle_us = idle > 0 ? idle : 0;
+}
+
+static unsigned permille(int64_t part, int64_t total) {
+    return total > 0 ? (unsigned)(part * 1000 / total) : 0;
+}
+
+void cellar_power_log_stats(void) {
+    cellar_power_stats_t stats;
+    cellar_power_get_stats(&stats);
+    ESP_LOGI(TAG, "Power over %llds: active %u.%u%% (sensors %lldms, net %lldms), idle %u.%u%%, "
+                  "light sleep %u.%u%% (%lu entries)",
+             (long long)(stats.total_us / 1000000),
+             permille(stats.active_us, stats.total_us) / 10, permille(stats.active_us, stats.total_us) % 10,
+             (long long)(stats.domain_us[CELLAR_POWER_SENSORS] / 1000),
+             (long long)(stats.domain_us[CELLAR_POWER_NET] / 1000),
+             permille(stats.idle_us, stats.total_us) / 10, permille(stats.idle_us, stats.total_us) % 10,
+             permille(stats.light_sleep_us, stats.total_us) / 10,
+             permille(stats.light_sleep_us, stats.total_us) % 10,
+             (unsigned long)stats.light_sleep_count);
+
+    for (int i = 0; i < CELLAR_ACTIVITY_COUNT; ++i) {
+        cellar_activity_stats_t act;
+        cellar_power_get_activity((cellar_activity_t)i, &act);
+        if (act.count == 0) continue;
+        char hist[CELLAR_ACTIVITY_HIST_BUCKETS * 6];
+        int written = 0;
+        for (int b = 0; b < CELLAR_ACTIVITY_HIST_BUCKETS && written < (int)sizeof(hist); ++b) {
+            written += snprintf(hist + written, sizeof(hist) - written, "%s%lu",
+                                b > 0 ? " " : "", (unsigned long)act.hist[b]);
+        }
+        ESP_LOGI(TAG, "%s n=%lu avg=%lldms max=%lldms hist[<1ms..>=1s]=%s",
+                 s_activity_names[i], (unsigned long)act.count,
+                 (long long)(act.total_us / act.count / 1000),
+                 (long long)(act.max_us / 1000), hist);
+    }
+}
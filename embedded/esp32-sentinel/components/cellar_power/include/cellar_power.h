@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Work that needs the CPU at full clock. While any domain is held the chip
+// stays out of light sleep; otherwise it idles at the low DFS frequency and
+// sleeps automatically whenever every task is blocked.
+typedef enum {
+    CELLAR_POWER_SENSORS = 0,  // I2C / 1-Wire transactions
+    CELLAR_POWER_NET,          // HTTP requests
+    CELLAR_POWER_DOMAIN_COUNT,
+} cellar_power_domain_t;
+
+// Time spent in each power state since cellar_power_init, in microseconds.
+typedef struct {
+    int64_t total_us;
+    int64_t active_us;       // at least one domain held (CPU at max clock)
+    int64_t idle_us;         // awake with no domain held (CPU at min clock)
+    int64_t light_sleep_us;  // in automatic light sleep
+    uint32_t light_sleep_count;
+    int64_t domain_us[CELLAR_POWER_DOMAIN_COUNT];
+} cellar_power_stats_t;
+
+// Timed activities for energy accounting. HTTP and SENSORS are recorded
+// automatically whenever the matching domain is released.
+typedef enum {
+    CELLAR_ACTIVITY_WIFI_ASSOC = 0,  // esp_wifi_connect until IP or failure
+    CELLAR_ACTIVITY_TLS_CONNECT,     // TCP + TLS handshake (part of HTTP)
+    CELLAR_ACTIVITY_HTTP,            // request/response under the net domain
+    CELLAR_ACTIVITY_SENSORS,         // bus transactions under the sensors domain
+    CELLAR_ACTIVITY_COUNT,
+} cellar_activity_t;
+
+// Duration histogram buckets: <1ms, then [2^(k-1), 2^k) ms up to >=1024ms.
+#define CELLAR_ACTIVITY_HIST_BUCKETS 12
+
+typedef struct {
+    uint32_t count;
+    int64_t total_us;
+    int64_t max_us;
+    uint32_t hist[CELLAR_ACTIVITY_HIST_BUCKETS];
+} cellar_activity_stats_t;
+
+// One telemetry cycle (the time between two cellar_power_end_cycle calls)
+// and its estimated charge from the current model in config.h.
+typedef struct {
+    int64_t cycle_us;
+    int64_t activity_us[CELLAR_ACTIVITY_COUNT];
+    int64_t light_sleep_us;
+    float charge_uah;
+    float avg_ma;
+} cellar_power_cycle_t;
+
+// Configure DFS and automatic light sleep and create the domain locks.
+// Returns ESP_ERR_NOT_SUPPORTED (accounting still works) when the build has
+// CONFIG_PM_ENABLE off.
+esp_err_t cellar_power_init(void);
+
+// Hold the CPU at full clock for the given domain. Calls nest.
+void cellar_power_acquire(cellar_power_domain_t domain);
+void cellar_power_release(cellar_power_domain_t domain);
+
+void cellar_power_get_stats(cellar_power_stats_t *out);
+
+// Add one timed activity to its histogram and to the current cycle.
+void cellar_power_record(cellar_activity_t activity, int64_t duration_us);
+
+// Add one duration to a histogram of the same shape, for timings kept outside
+// this component. The caller serialises access to stats.
+void cellar_power_hist_add(cellar_activity_stats_t *stats, int64_t duration_us);
+
+// Lifetime histogram for one activity.
+void cellar_power_get_activity(cellar_activity_t activity, cellar_activity_stats_t *out);
+
+// Close the current cycle, log its radio/CPU time and charge, and start the
+// next one. out may be NULL.
+void cellar_power_end_cycle(cellar_power_cycle_t *out);
+
+// Most recently closed cycle. Returns false before the first one closes.
+bool cellar_power_last_cycle(cellar_power_cycle_t *out);
+
+// Log the share of time in each state plus one histogram line per activity.
+void cellar_power_log_stats(void);
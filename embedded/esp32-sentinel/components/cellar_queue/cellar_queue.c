@@ -0,0 +1,159 @@
+#include "cellar_queue.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// 60 samples = 30 minutes of backlog at the default 30 s post interval.
+#ifndef CELLAR_QUEUE_CAPACITY
+#define CELLAR_QUEUE_CAPACITY 60
+#endif
+
+static const char *TAG = "cellar_queue";
+
+static cellar_sample_t s_ring[CELLAR_QUEUE_CAPACITY];
+static size_t s_head = 0;  // oldest sample
+static size_t s_count = 0;
+static uint32_t s_head_seq = 0;  // sequence number of the sample at s_head
+static uint32_t s_dropped = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_not_empty = NULL;
+static cellar_sample_t s_priority;
+static bool s_priority_pending = false;
+static SemaphoreHandle_t s_priority_ready = NULL;
+
+esp_err_t cellar_queue_init(void) {
+    if (s_not_empty) return ESP_OK;
+    s_not_empty = xSemaphoreCreateBinary();
+    s_priority_ready = xSemaphoreCreateBinary();
+    return s_not_empty && s_priority_ready ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool cellar_queue_push(const cellar_sample_t *sample) {
+    bool kept_all = true;
+    portENTER_CRITICAL(&s_lock);
+    if (s_count == CELLAR_QUEUE_CAPACITY) {
+        s_head = (s_head + 1) % CELLAR_QUEUE_CAPACITY;
+        s_count--;
+        s_head_seq++;
+        s_dropped++;
+        kept_all = false;
+    }
+    memcpy(&s_ring[(s_head + s_count) % CELLAR_QUEUE_CAPACITY], sample, sizeof(*sample));
+    s_count++;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!kept_all) {
+        ESP_LOGW(TAG, "Queue full; dropped oldest sample (%lu total)", (unsigned long)s_dropped);
+    }
+    if (s_not_empty) {
+        xSemaphoreGive(s_not_empty);
+    }
+    return kept_all;
+}
+
+size_t cellar_queue_peek(cellar_sample_t *out, size_t max, uint32_t *first_seq) {
+    portENTER_CRITICAL(&s_lock);
+    size_t n = s_count < max ? s_count : max;
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(&out[i], &s_ring[(s_head + i) % CELLAR_QUEUE_CAPACITY], sizeof(out[i]));
+    }
+    if (first_seq) *first_seq = s_head_seq;
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+void cellar_queue_pop(uint32_t first_seq, size_t n) {
+    portENTER_CRITICAL(&s_lock);
+    // Samples overwritten while the batch was in flight already left the head.
+    int32_t advance = (int32_t)(first_seq + (uint32_t)n - s_head_seq);
+    if (advance > (int32_t)s_count) advance = (int32_t)s_count;
+    if (advance > 0) {
+        s_head = (s_head + (size_t)advance) % CELLAR_QUEUE_CAPACITY;
+        s_count -= (size_t)advance;
+        s_head_seq += (uint32_t)advance;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void cellar_queue_push_priority(const cellar_sample_t *sample) {
+    cellar_sample_t displaced;
+    portENTER_CRITICAL(&s_lock);
+    bool had_pending = s_priority_pending;
+    if (had_pending) {
+        memcpy(&displaced, &s_priority, sizeof(displaced));
+    }
+    memcpy(&s_priority, sample, sizeof(s_priority));
+    s_priority_pending = true;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (had_pending) {
+        cellar_queue_push(&displaced);
+    }
+    if (s_priority_ready) {
+        xSemaphoreGive(s_priority_ready);
+    }
+    if (s_not_empty) {
+        xSemaphoreGive(s_not_empty);
+    }
+}
+
+bool cellar_queue_take_priority(cellar_sample_t *out) {
+    portENTER_CRITICAL(&s_lock);
+    bool taken = s_priority_pending;
+    if (taken) {
+        memcpy(out, &s_priority, sizeof(*out));
+        s_priority_pending = false;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return taken;
+}
+
+static bool priority_pending(void) {
+    portENTER_CRITICAL(&s_lock);
+    bool pending = s_priority_pending;
+    portEXIT_CRITICAL(&s_lock);
+    return pending;
+}
+
+bool cellar_queue_wait_priority(TickType_t timeout) {
+    if (!s_priority_ready) {
+        vTaskDelay(timeout);
+        return priority_pending();
+    }
+    // The semaphore may still hold a give for a sample that was already
+    // taken; keep waiting out the rest of the timeout in that case.
+    TickType_t start = xTaskGetTickCount();
+    while (!priority_pending()) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) return false;
+        xSemaphoreTake(s_priority_ready, timeout - elapsed);
+    }
+    return true;
+}
+
+bool cellar_queue_wait(TickType_t timeout) {
+    if (cellar_queue_count() > 0 || priority_pending()) return true;
+    if (s_not_empty) {
+        xSemaphoreTake(s_not_empty, timeout);
+    }
+    return cellar_queue_count() > 0 || priority_pending();
+}
+
+size_t cellar_queue_count(void) {
+    portENTER_CRITICAL(&s_lock);
+    size_t count = s_count;
+    portEXIT_CRITICAL(&s_lock);
+    return count;
+}
+
+size_t cellar_queue_capacity(void) {
+    return CELLAR_QUEUE_CAPACITY;
+}
+
+uint32_t cellar_queue_dropped(void) {
+    return s_dropped;
+}
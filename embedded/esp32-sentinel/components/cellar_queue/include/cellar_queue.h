@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cellar_sensors.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Fixed-capacity RAM ring of samples waiting for upload. When full, the
+// oldest sample is overwritten. Safe to use from the sampler and uplink tasks.
+esp_err_t cellar_queue_init(void);
+
+// Append a sample. Returns false if it displaced the oldest queued sample.
+bool cellar_queue_push(const cellar_sample_t *sample);
+
+// Copy up to max of the oldest samples without removing them. first_seq
+// identifies the first copied sample for cellar_queue_pop. Returns the count.
+size_t cellar_queue_peek(cellar_sample_t *out, size_t max, uint32_t *first_seq);
+
+// Remove n delivered samples starting at first_seq. Any of them that were
+// overwritten in the meantime are skipped, so newer samples are never lost.
+void cellar_queue_pop(uint32_t first_seq, size_t n);
+
+// Priority lane: a single slot the uplink sends ahead of the backlog, used for
+// alarm samples. A sample still waiting there when the next one arrives moves
+// to the back of the regular queue, so nothing is lost.
+void cellar_queue_push_priority(const cellar_sample_t *sample);
+
+// Take the waiting priority sample, if any.
+bool cellar_queue_take_priority(cellar_sample_t *out);
+
+// Block until a priority sample is waiting or the timeout expires. The
+// uplink's backoff sleeps use this, so an alarm cuts them short.
+bool cellar_queue_wait_priority(TickType_t timeout);
+
+// Block until at least one sample is queued (in either lane) or the timeout
+// expires.
+bool cellar_queue_wait(TickType_t timeout);
+
+size_t cellar_queue_count(void);
+size_t cellar_queue_capacity(void);
+uint32_t cellar_queue_dropped(void);
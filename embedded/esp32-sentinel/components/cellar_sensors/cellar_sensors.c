@@ -0,0 +1,334 @@
+#include "cellar_sensors.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cellar_power.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sensor_drivers.h"
+
+// Sensors due within this window are started together with the current round
+// rather than waking the caller again a few milliseconds later.
+#define SCHEDULE_SLACK_MS 100
+
+// A sensor that keeps failing is retried less often, so a dead part costs the
+// round one timeout every few periods instead of every round.
+#ifndef CELLAR_SENSOR_BACKOFF_AFTER
+#define CELLAR_SENSOR_BACKOFF_AFTER 3  // consecutive failures
+#endif
+#ifndef CELLAR_SENSOR_BACKOFF_MAX
+#define CELLAR_SENSOR_BACKOFF_MAX 8  // periods between retries, at most
+#endif
+
+static const char *TAG = "cellar_sensors";
+
+typedef struct {
+    const cellar_sensor_driver_t *driver;
+    bool ready;          // probed + initialised
+    bool pending;        // conversion started, result not collected yet
+    volatile bool recover_pending;  // run driver->recover before the next start
+    int64_t warm_at_ms;  // earliest time the first read is valid
+    int64_t ready_at_ms; // when the pending conversion completes
+    int64_t next_due_ms;
+    cellar_sensor_stats_t stats;
+} sensor_entry_t;
+
+static sensor_entry_t s_entries[CELLAR_SENSORS_MAX];
+static int s_entry_count = 0;
+static uint32_t s_rounds = 0;
+static uint32_t s_worst_round_ms = 0;
+static uint32_t s_worst_round_bus_ms = 0;
+static cellar_sensor_bus_t s_bus;
+// The driver call in progress, for stall reports from other tasks.
+static sensor_entry_t *volatile s_busy = NULL;
+static const char *volatile s_busy_call = NULL;
+static volatile int64_t s_busy_since_ms = 0;
+static cellar_sample_t s_sample = {
+    .temp_count = 0,
+    .pressure_hpa = NAN,
+    .humidity_pct = NAN,
+    .opt3001_lux = NAN,
+    .veml7700_lux = NAN,
+};
+
+static inline int64_t now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+esp_err_t cellar_sensors_register(const cellar_sensor_driver_t *driver) {
+    if (!driver || !driver->init || !driver->read) return ESP_ERR_INVALID_ARG;
+    if (s_entry_count >= CELLAR_SENSORS_MAX) {
+        ESP_LOGE(TAG, "Registry full; dropping %s", driver->name);
+        return ESP_ERR_NO_MEM;
+    }
+    s_entries[s_entry_count++] = (sensor_entry_t){.driver = driver, .stats.name = driver->name};
+    return ESP_OK;
+}
+
+void cellar_sensors_register_builtin(void) {
+    // Registration order is the order temperatures appear in the payload.
+    cellar_sensors_register(&cellar_sensor_ds18b20);
+    cellar_sensors_register(&cellar_sensor_bme280);
+    cellar_sensors_register(&cellar_sensor_opt3001);
+    cellar_sensors_register(&cellar_sensor_veml7700);
+}
+
+int cellar_sensors_init(const cellar_sensor_bus_t *bus) {
+    s_bus = *bus;
+    int ready = 0;
+    for (int i = 0; i < s_entry_count; ++i) {
+        sensor_entry_t *entry = &s_entries[i];
+        const cellar_sensor_driver_t *drv = entry->driver;
+        if (entry->ready) {
+            ready++;
+            continue;
+        }
+        if (drv->probe && drv->probe(bus) != ESP_OK) {
+            ESP_LOGD(TAG, "%s not found", drv->name);
+            continue;
+        }
+        esp_err_t err = drv->init(bus);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "%s init failed: %s", drv->name, esp_err_to_name(err));
+            continue;
+        }
+        int64_t now = now_ms();
+        entry->ready = true;
+        entry->warm_at_ms = now + drv->warmup_ms;
+        entry->next_due_ms = now;
+        ready++;
+        ESP_LOGI(TAG, "%s ready (warm-up %lums, period %lums)",
+                 drv->name, (unsigned long)drv->warmup_ms, (unsigned long)drv->period_ms);
+    }
+    return ready;
+}
+
+static void mark_failed(sensor_entry_t *entry, const char *what, esp_err_t err) {
+    ESP_LOGE(TAG, "%s %s failed: %s", entry->driver->name, what, esp_err_to_name(err));
+    if (entry->driver->invalidate) {
+        entry->driver->invalidate(&s_sample);
+    }
+    cellar_sensor_stats_t *stats = &entry->stats;
+    stats->failures++;
+    if (++stats->failing < CELLAR_SENSOR_BACKOFF_AFTER) return;
+    if (entry->driver->recover) entry->recover_pending = true;
+    uint32_t periods = 1;
+    for (uint32_t n = stats->failing; n >= CELLAR_SENSOR_BACKOFF_AFTER && periods < CELLAR_SENSOR_BACKOFF_MAX; --n) {
+        periods *= 2;
+    }
+    if (periods > CELLAR_SENSOR_BACKOFF_MAX) periods = CELLAR_SENSOR_BACKOFF_MAX;
+    entry->next_due_ms = now_ms() + (int64_t)periods * entry->driver->period_ms;
+    ESP_LOGW(TAG, "%s failed %lu times in a row; next try in %lu periods", entry->driver->name,
+             (unsigned long)stats->failing, (unsigned long)periods);
+}
+
+static void mark_ok(sensor_entry_t *entry) {
+    if (entry->stats.failing >= CELLAR_SENSOR_BACKOFF_AFTER) {
+        ESP_LOGI(TAG, "%s recovered", entry->driver->name);
+    }
+    entry->stats.failing = 0;
+}
+
+static void begin_call(sensor_entry_t *entry, const char *call) {
+    s_busy_since_ms = now_ms();
+    s_busy_call = call;
+    s_busy = entry;
+}
+
+// Time one driver call (bus traffic only, never a conversion wait).
+static void account_call(sensor_entry_t *entry, int64_t started_us, int64_t *round_bus_us) {
+    s_busy = NULL;
+    int64_t took_us = esp_timer_get_time() - started_us;
+    *round_bus_us += took_us;
+    uint32_t took_ms = (uint32_t)(took_us / 1000);
+    if (took_ms > entry->stats.worst_call_ms) entry->stats.worst_call_ms = took_ms;
+}
+
+int cellar_sensors_acquire(cellar_sample_t *out) {
+    int64_t round_started_us = esp_timer_get_time();
+    int64_t round_bus_us = 0;
+    int started = 0;
+    int64_t now = now_ms();
+
+    // Start every due conversion up front.
+    for (int i = 0; i < s_entry_count; ++i) {
+        sensor_entry_t *entry = &s_entries[i];
+        const cellar_sensor_driver_t *drv = entry->driver;
+        if (!entry->ready || entry->pending || now + SCHEDULE_SLACK_MS < entry->next_due_ms) continue;
+
+        entry->next_due_ms = now + drv->period_ms;
+        started++;
+        if (entry->recover_pending) {
+            entry->recover_pending = false;
+            int64_t call_started_us = esp_timer_get_time();
+            begin_call(entry, "recover");
+            cellar_power_acquire(CELLAR_POWER_SENSORS);
+            esp_err_t err = drv->recover(&s_bus);
+            cellar_power_release(CELLAR_POWER_SENSORS);
+            account_call(entry, call_started_us, &round_bus_us);
+            ESP_LOGW(TAG, "%s recovery %s", drv->name, err == ESP_OK ? "done" : esp_err_to_name(err));
+        }
+        if (drv->start_conversion) {
+            int64_t call_started_us = esp_timer_get_time();
+            begin_call(entry, "start");
+            cellar_power_acquire(CELLAR_POWER_SENSORS);
+            esp_err_t err = drv->start_conversion();
+            cellar_power_release(CELLAR_POWER_SENSORS);
+            account_call(entry, call_started_us, &round_bus_us);
+            if (err != ESP_OK) {
+                mark_failed(entry, "start", err);
+                continue;
+            }
+        }
+        int64_t ready_at = now + drv->conversion_ms;
+        entry->ready_at_ms = ready_at > entry->warm_at_ms ? ready_at : entry->warm_at_ms;
+        entry->pending = true;
+    }
+
+    // Collect results in completion order.
+    int read_count = 0;
+    while (true) {
+        sensor_entry_t *next = NULL;
+        for (int i = 0; i < s_entry_count; ++i) {
+            sensor_entry_t *entry = &s_entries[i];
+            if (entry->pending && (!next || entry->ready_at_ms < next->ready_at_ms)) {
+                next = entry;
+            }
+        }
+        if (!next) break;
+
+        now = now_ms();
+        if (next->ready_at_ms > now) {
+            vTaskDelay(pdMS_TO_TICKS(next->ready_at_ms - now) + 1);
+        }
+        next->pending = false;
+        // Only the bus transaction holds the clock up; conversion waits may sleep.
+        int64_t call_started_us = esp_timer_get_time();
+        begin_call(next, "read");
+        cellar_power_acquire(CELLAR_POWER_SENSORS);
+        esp_err_t err = next->driver->read(&s_sample);
+        cellar_power_release(CELLAR_POWER_SENSORS);
+        account_call(next, call_started_us, &round_bus_us);
+        next->stats.reads++;
+        if (err != ESP_OK) {
+            mark_failed(next, "read", err);
+        } else {
+            mark_ok(next);
+            read_count++;
+        }
+    }
+
+    if (started > 0) {
+        uint32_t round_ms = (uint32_t)((esp_timer_get_time() - round_started_us) / 1000);
+        s_rounds++;
+        if (round_ms > s_worst_round_ms) s_worst_round_ms = round_ms;
+        if (round_bus_us / 1000 > s_worst_round_bus_ms) s_worst_round_bus_ms = (uint32_t)(round_bus_us / 1000);
+    }
+
+    // Stamped with the latest successful read, so values that were only
+    // carried over keep the time they were measured.
+    if (read_count > 0) s_sample.mono_ms = now_ms();
+    if (out) {
+        memcpy(out, &s_sample, sizeof(*out));
+    }
+    return read_count;
+}
+
+bool cellar_sensors_busy(const char **sensor, const char **call, uint32_t *for_ms) {
+    sensor_entry_t *entry = s_busy;
+    if (!entry) return false;
+    if (sensor) *sensor = entry->driver->name;
+    if (call) *call = s_busy_call;
+    if (for_ms) *for_ms = (uint32_t)(now_ms() - s_busy_since_ms);
+    return true;
+}
+
+bool cellar_sensors_recover_stalled(void) {
+    sensor_entry_t *entry = s_busy;
+    if (!entry) return false;
+    if (entry->driver->i2c) {
+        esp_err_t err = cellar_sensors_reset_i2c(&s_bus);
+        ESP_LOGW(TAG, "I2C bus reset under %s: %s", entry->driver->name, esp_err_to_name(err));
+    }
+    if (entry->driver->recover) entry->recover_pending = true;
+    return true;
+}
+
+esp_err_t cellar_sensors_reset_i2c(const cellar_sensor_bus_t *bus) {
+    if (!bus->i2c_bus) return ESP_ERR_INVALID_STATE;
+    return i2c_master_bus_reset(bus->i2c_bus);
+}
+
+void cellar_sensors_due_now(void) {
+    int64_t now = now_ms();
+    for (int i = 0; i < s_entry_count; ++i) {
+        sensor_entry_t *entry = &s_entries[i];
+        if (!entry->ready || entry->pending || entry->stats.failing >= CELLAR_SENSOR_BACKOFF_AFTER) continue;
+        if (entry->next_due_ms > now) entry->next_due_ms = now;
+    }
+}
+
+uint32_t cellar_sensors_ms_until_due(void) {
+    int64_t now = now_ms();
+    int64_t soonest = -1;
+    for (int i = 0; i < s_entry_count; ++i) {
+        const sensor_entry_t *entry = &s_entries[i];
+        if (!entry->ready) continue;
+        if (soonest < 0 || entry->next_due_ms < soonest) {
+            soonest = entry->next_due_ms;
+        }
+    }
+    if (soonest < 0) return UINT32_MAX;
+    return soonest > now + SCHEDULE_SLACK_MS ? (uint32_t)(soonest - now) : 0;
+}
+
+void cellar_sensors_get_stats(cellar_sensors_stats_t *out) {
+    out->rounds = s_rounds;
+    out->worst_round_ms = s_worst_round_ms;
+    out->worst_round_bus_ms = s_worst_round_bus_ms;
+    out->sensor_count = 0;
+    for (int i = 0; i < s_entry_count; ++i) {
+        if (s_entries[i].ready) out->sensors[out->sensor_count++] = s_entries[i].stats;
+    }
+}
+
+void cellar_sensors_log_stats(void) {
+    cellar_sensors_stats_t stats;
+    cellar_sensors_get_stats(&stats);
+    ESP_LOGI(TAG, "%lu rounds, worst %lums (%lums on the bus)", (unsigned long)stats.rounds,
+             (unsigned long)stats.worst_round_ms, (unsigned long)stats.worst_round_bus_ms);
+    for (int i = 0; i < stats.sensor_count; ++i) {
+        const cellar_sensor_stats_t *sensor = &stats.sensors[i];
+        ESP_LOGI(TAG, "%s reads=%lu failures=%lu worst call=%lums", sensor->name, (unsigned long)sensor->reads,
+                 (unsigned long)sensor->failures, (unsigned long)sensor->worst_call_ms);
+    }
+}
+
+void cellar_sample_set_temp(cellar_sample_t *sample, const char *id, float value_c) {
+    for (int i = 0; i < sample->temp_count; ++i) {
+        if (strcmp(sample->temps[i].id, id) == 0) {
+            sample->temps[i].value_c = value_c;
+            return;
+        }
+    }
+    if (sample->temp_count >= CELLAR_SAMPLE_MAX_TEMPS) return;
+    cellar_temp_reading_t *slot = &sample->temps[sample->temp_count++];
+    snprintf(slot->id, sizeof(slot->id), "%s", id);
+    slot->value_c = value_c;
+}
+
+void cellar_sample_clear_temp(cellar_sample_t *sample, const char *id) {
+    for (int i = 0; i < sample->temp_count; ++i) {
+        if (strcmp(sample->temps[i].id, id) == 0) {
+            memmove(&sample->temps[i], &sample->temps[i + 1],
+                    (size_t)(sample->temp_count - i - 1) * sizeof(sample->temps[0]));
+            sample->temp_count--;
+            return;
+        }
+    }
+}
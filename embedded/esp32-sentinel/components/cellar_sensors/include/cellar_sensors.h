@@ -0,0 +1,131 @@
+#pragma once
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "i2c_bus.h"
+
+#define CELLAR_SAMPLE_MAX_TEMPS 6
+#define CELLAR_SENSOR_ID_LEN 17
+#define CELLAR_SENSORS_MAX 8
+
+typedef struct {
+    char id[CELLAR_SENSOR_ID_LEN];  // JSON key: DS18B20 ROM id or "bme280"
+    float value_c;
+} cellar_temp_reading_t;
+
+// Latest value of every channel. Fields owned by a sensor that is missing or
+// whose last read failed are NaN (temperatures are simply absent).
+typedef struct {
+    cellar_temp_reading_t temps[CELLAR_SAMPLE_MAX_TEMPS];
+    int temp_count;
+    float pressure_hpa;      // station pressure (not sea-level corrected)
+    float humidity_pct;
+    float opt3001_lux;
+    float veml7700_lux;
+    int64_t mono_ms;         // esp_timer milliseconds of the latest successful read
+} cellar_sample_t;
+
+// Buses shared by the built-in drivers.
+typedef struct {
+    i2c_bus_handle_t i2c_bus_handle;  // i2c_bus wrapper (BME280 component)
+    i2c_master_bus_handle_t i2c_bus;  // native handle (OPT3001/VEML7700)
+    int onewire_gpio;
+} cellar_sensor_bus_t;
+
+// A sensor driver. Drivers keep their own device state; the registry only
+// sequences the callbacks.
+typedef struct {
+    const char *name;
+    // Cheap presence check (e.g. I2C address ACK). NULL: always try init.
+    esp_err_t (*probe)(const cellar_sensor_bus_t *bus);
+    esp_err_t (*init)(const cellar_sensor_bus_t *bus);
+    // Kick off a conversion. NULL for free-running sensors.
+    esp_err_t (*start_conversion)(void);
+    // Collect the result into the sample, conversion_ms after start.
+    esp_err_t (*read)(cellar_sample_t *sample);
+    // Clear this sensor's fields after a failed start or read.
+    void (*invalidate)(cellar_sample_t *sample);
+    // Bring the bus or part back after a stall or CELLAR_SENSOR_BACKOFF_AFTER
+    // failures in a row. Runs before the sensor's next start. NULL: retry as is.
+    esp_err_t (*recover)(const cellar_sensor_bus_t *bus);
+    bool i2c;                // on the shared I2C bus, which a stall resets at once
+    uint32_t warmup_ms;      // settle time after init before the first read
+    uint32_t conversion_ms;  // start_conversion -> result ready
+    uint32_t period_ms;      // preferred sample period
+} cellar_sensor_driver_t;
+
+// Counters for one registered driver.
+typedef struct {
+    const char *name;
+    uint32_t reads;          // read callbacks run
+    uint32_t failures;       // failed starts and reads
+    uint32_t failing;        // consecutive failures; backs off at CELLAR_SENSOR_BACKOFF_AFTER
+    uint32_t worst_call_ms;  // slowest single start or read (bus time, no conversion wait)
+} cellar_sensor_stats_t;
+
+typedef struct {
+    uint32_t rounds;              // acquire calls that started at least one sensor
+    uint32_t worst_round_ms;      // longest such call, conversion waits included
+    uint32_t worst_round_bus_ms;  // most time a round spent inside driver calls
+    int sensor_count;             // ready drivers, in registration order
+    cellar_sensor_stats_t sensors[CELLAR_SENSORS_MAX];
+} cellar_sensors_stats_t;
+
+// Add a driver to the registry. Call before cellar_sensors_init.
+esp_err_t cellar_sensors_register(const cellar_sensor_driver_t *driver);
+
+// Register BME280, DS18B20, OPT3001 and VEML7700.
+void cellar_sensors_register_builtin(void);
+
+// Probe and init every registered driver. Returns the number that are ready.
+int cellar_sensors_init(const cellar_sensor_bus_t *bus);
+
+// Start a conversion on every sensor whose period has elapsed, then collect
+// results as each becomes ready, so a round costs the slowest sensor rather
+// than the sum. Sensors that were not due keep their previous values.
+// Returns the number of sensors read successfully this round; with none,
+// the sample (and its mono_ms) is the previous one.
+int cellar_sensors_acquire(cellar_sample_t *out);
+
+// Which driver call the sampler is inside, if any: the driver name and
+// "start" or "read". Safe from any task.
+bool cellar_sensors_busy(const char **sensor, const char **call, uint32_t *for_ms);
+
+// The sampler has stalled inside a driver call. Resets the I2C bus now if
+// that driver is on it, which fails the hung transfer, and runs the driver's
+// recover hook before its next start. Safe from any task; false if no call
+// was in progress.
+bool cellar_sensors_recover_stalled(void);
+
+// recover hook for the I2C drivers: clock the bus free and reset the
+// controller.
+esp_err_t cellar_sensors_reset_i2c(const cellar_sensor_bus_t *bus);
+
+// Make every sensor due at the next acquire, except those backing off after
+// failures.
+void cellar_sensors_due_now(void);
+
+// Milliseconds until the next sensor is due (0 if one is due now).
+uint32_t cellar_sensors_ms_until_due(void);
+
+// Round and per-driver timing since boot, for the worst-case sampling cycle.
+// Updated without a lock by the task that calls cellar_sensors_acquire.
+void cellar_sensors_get_stats(cellar_sensors_stats_t *out);
+void cellar_sensors_log_stats(void);
+
+// Helpers for drivers that publish temperatures.
+void cellar_sample_set_temp(cellar_sample_t *sample, const char *id, float value_c);
+void cellar_sample_clear_temp(cellar_sample_t *sample, const char *id);
+
+// OPT3001 is preferred; VEML7700 is secondary when both are present.
+static inline float cellar_sample_lux_primary(const cellar_sample_t *sample) {
+    return !isnan(sample->opt3001_lux) ? sample->opt3001_lux : sample->veml7700_lux;
+}
+
+static inline float cellar_sample_lux_secondary(const cellar_sample_t *sample) {
+    return !isnan(sample->opt3001_lux) ? sample->veml7700_lux : NAN;
+}
@@ -0,0 +1,79 @@
+#include <math.h>
+
+#include "bme280.h"
+#include "cellar_binlog.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sensor_drivers.h"
+
+// Default to standard BME280 address if not in config
+#ifndef BME280_ADDRESS
+#define BME280_ADDRESS BME280_I2C_ADDRESS_DEFAULT
+#endif
+
+static const char *TAG = "sensor_bme280";
+static bme280_handle_t s_bme280;
+
+static esp_err_t bme280_sensor_probe(const cellar_sensor_bus_t *bus) {
+    if (!bus->i2c_bus) return ESP_ERR_INVALID_STATE;
+    return i2c_master_probe(bus->i2c_bus, BME280_ADDRESS, 50);
+}
+
+static esp_err_t bme280_sensor_init(const cellar_sensor_bus_t *bus) {
+    ESP_LOGI(TAG, "Found BME280 at 0x%02X, initializing...", BME280_ADDRESS);
+    s_bme280 = bme280_create(bus->i2c_bus_handle, BME280_ADDRESS);
+    if (!s_bme280) {
+        return ESP_FAIL;
+    }
+    return bme280_default_init(s_bme280);
+}
+
+static esp_err_t read_all(float *temp, float *pressure, float *humidity) {
+    esp_err_t err = bme280_read_temperature(s_bme280, temp);
+    if (err == ESP_OK) err = bme280_read_pressure(s_bme280, pressure);
+    if (err == ESP_OK) err = bme280_read_humidity(s_bme280, humidity);
+    return err;
+}
+
+static void bme280_sensor_invalidate(cellar_sample_t *sample) {
+    cellar_sample_clear_temp(sample, "bme280");
+    sample->pressure_hpa = NAN;
+    sample->humidity_pct = NAN;
+}
+
+static esp_err_t bme280_sensor_read(cellar_sample_t *sample) {
+    float temp = NAN;
+    float pressure = NAN;
+    float humidity = NAN;
+    esp_err_t err = read_all(&temp, &pressure, &humidity);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "BME280 read failed, retrying...");
+        vTaskDelay(pdMS_TO_TICKS(100));
+        err = read_all(&temp, &pressure, &humidity);
+    }
+    if (err != ESP_OK) return err;
+
+    CELLAR_BLOGI(TAG, "BME280: T=%.2fC P=%.2fhPa H=%.1f%%", temp, pressure, humidity);
+    cellar_sample_set_temp(sample, "bme280", temp);
+    sample->pressure_hpa = pressure;
+    sample->humidity_pct = humidity;
+    return ESP_OK;
+}
+
+// The component configures normal (free-running) mode, so a read always
+// returns the latest completed measurement.
+const cellar_sensor_driver_t cellar_sensor_bme280 = {
+    .name = "BME280",
+    .probe = bme280_sensor_probe,
+    .init = bme280_sensor_init,
+    .start_conversion = NULL,
+    .read = bme280_sensor_read,
+    .invalidate = bme280_sensor_invalidate,
+    .recover = cellar_sensors_reset_i2c,
+    .i2c = true,
+    .warmup_ms = 100,
+    .conversion_ms = 0,
+    .period_ms = SENSOR_PERIOD_BME280_MS,
+};
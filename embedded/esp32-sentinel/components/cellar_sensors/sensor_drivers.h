@@ -0,0 +1,31 @@
+#pragma once
+
+#include "cellar_sensors.h"
+#include "config.h"
+
+// Per-sensor sample periods default to the telemetry interval; override any of
+// them in config.h to sample a channel faster or slower than it is posted.
+#ifndef SENSOR_DEFAULT_PERIOD_MS
+#ifdef POST_INTERVAL_MS
+#define SENSOR_DEFAULT_PERIOD_MS POST_INTERVAL_MS
+#else
+#define SENSOR_DEFAULT_PERIOD_MS (30 * 1000)
+#endif
+#endif
+#ifndef SENSOR_PERIOD_BME280_MS
+#define SENSOR_PERIOD_BME280_MS SENSOR_DEFAULT_PERIOD_MS
+#endif
+#ifndef SENSOR_PERIOD_DS18B20_MS
+#define SENSOR_PERIOD_DS18B20_MS SENSOR_DEFAULT_PERIOD_MS
+#endif
+#ifndef SENSOR_PERIOD_OPT3001_MS
+#define SENSOR_PERIOD_OPT3001_MS SENSOR_DEFAULT_PERIOD_MS
+#endif
+#ifndef SENSOR_PERIOD_VEML7700_MS
+#define SENSOR_PERIOD_VEML7700_MS SENSOR_DEFAULT_PERIOD_MS
+#endif
+
+extern const cellar_sensor_driver_t cellar_sensor_bme280;
+extern const cellar_sensor_driver_t cellar_sensor_ds18b20;
+extern const cellar_sensor_driver_t cellar_sensor_opt3001;
+extern const cellar_sensor_driver_t cellar_sensor_veml7700;
@@ -0,0 +1,131 @@
+#include <stdio.h>
+
+#include "ds18b20.h"
+#include "cellar_binlog.h"
+#include "esp_log.h"
+#include "onewire_bus.h"
+
+#include "sensor_drivers.h"
+
+#define DS18B20_MAX_DEVICES 4
+
+static const char *TAG = "sensor_ds18b20";
+static onewire_bus_handle_t s_bus = NULL;
+static ds18b20_device_handle_t s_devices[DS18B20_MAX_DEVICES];
+static char s_ids[DS18B20_MAX_DEVICES][CELLAR_SENSOR_ID_LEN];
+static int s_count = 0;
+
+static esp_err_t ds18b20_sensor_init(const cellar_sensor_bus_t *bus) {
+    onewire_bus_config_t bus_config = {
+        .bus_gpio_num = bus->onewire_gpio,
+        .flags.en_pull_up = true, // Enables the ESP32 internal ~45k pull-up
+    };
+    onewire_bus_rmt_config_t rmt_config = {
+        .max_rx_bytes = 10,
+    };
+    esp_err_t err = onewire_new_bus_rmt(&bus_config, &rmt_config, &s_bus);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create 1-Wire bus RMT");
+        return err;
+    }
+
+    onewire_device_iter_handle_t iter = NULL;
+    err = onewire_new_device_iter(s_bus, &iter);
+    if (err != ESP_OK) return err;
+
+    ESP_LOGI(TAG, "Scanning 1-Wire bus on GPIO %d...", bus->onewire_gpio);
+    onewire_device_t next_onewire_device;
+    esp_err_t search_result;
+    do {
+        search_result = onewire_device_iter_get_next(iter, &next_onewire_device);
+        if (search_result == ESP_OK) {
+            ds18b20_config_t ds_cfg = {};
+            ds18b20_device_handle_t dev = NULL;
+            if (ds18b20_new_device_from_enumeration(&next_onewire_device, &ds_cfg, &dev) == ESP_OK) {
+                ds18b20_set_resolution(dev, DS18B20_RESOLUTION_12B);
+                s_devices[s_count] = dev;
+                snprintf(s_ids[s_count], sizeof(s_ids[s_count]), "%012llX",
+                         (unsigned long long)next_onewire_device.address);
+                s_count++;
+                ESP_LOGI(TAG, "DS18B20[%d] init success (addr: %016llX)",
+                         s_count - 1, (unsigned long long)next_onewire_device.address);
+            } else {
+                ESP_LOGW(TAG, "1-Wire device at %016llX is not a DS18B20",
+                         (unsigned long long)next_onewire_device.address);
+            }
+        }
+    } while (search_result == ESP_OK && s_count < DS18B20_MAX_DEVICES);
+    onewire_del_device_iter(iter);
+
+    if (s_count == 0) {
+        ESP_LOGW(TAG, "No DS18B20 devices found on 1-Wire bus");
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGI(TAG, "Found %d DS18B20 device(s)", s_count);
+    return ESP_OK;
+}
+
+// Tear down the RMT channels and enumerate again, which also picks up a
+// probe that was swapped or reseated.
+static esp_err_t ds18b20_sensor_recover(const cellar_sensor_bus_t *bus) {
+    for (int i = 0; i < s_count; i++) {
+        ds18b20_del_device(s_devices[i]);
+        s_devices[i] = NULL;
+    }
+    s_count = 0;
+    if (s_bus) {
+        onewire_bus_del(s_bus);
+        s_bus = NULL;
+    }
+    return ds18b20_sensor_init(bus);
+}
+
+static esp_err_t ds18b20_sensor_start(void) {
+    int started = 0;
+    for (int i = 0; i < s_count; i++) {
+        esp_err_t err = ds18b20_trigger_temperature_conversion(s_devices[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "DS18B20[%d] trigger failed: %s", i, esp_err_to_name(err));
+        } else {
+            started++;
+        }
+    }
+    return started > 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t ds18b20_sensor_read(cellar_sample_t *sample) {
+    int ok = 0;
+    for (int i = 0; i < s_count; i++) {
+        float t = 0.0f;
+        esp_err_t err = ds18b20_get_temperature(s_devices[i], &t);
+        if (err == ESP_OK) {
+            CELLAR_BLOGI(TAG, "DS18B20[%d]: T=%.2fC", i, t);
+            cellar_sample_set_temp(sample, s_ids[i], t);
+            ok++;
+        } else {
+            ESP_LOGE(TAG, "DS18B20[%d] read failed: %s", i, esp_err_to_name(err));
+            cellar_sample_clear_temp(sample, s_ids[i]);
+        }
+    }
+    return ok > 0 ? ESP_OK : ESP_FAIL;
+}
+
+static void ds18b20_sensor_invalidate(cellar_sample_t *sample) {
+    for (int i = 0; i < s_count; i++) {
+        cellar_sample_clear_temp(sample, s_ids[i]);
+    }
+}
+
+// Enumeration doubles as the probe, so there is no separate probe callback.
+const cellar_sensor_driver_t cellar_sensor_ds18b20 = {
+    .name = "DS18B20",
+    .probe = NULL,
+    .init = ds18b20_sensor_init,
+    .start_conversion = ds18b20_sensor_start,
+    .read = ds18b20_sensor_read,
+    .invalidate = ds18b20_sensor_invalidate,
+    .recover = ds18b20_sensor_recover,
+    .warmup_ms = 0,
+    .conversion_ms = 800, // 12-bit conversion time
+    .period_ms = SENSOR_PERIOD_DS18B20_MS,
+};
@@ -0,0 +1,48 @@
+#include <math.h>
+
+#include "cellar_binlog.h"
+#include "esp_log.h"
+#include "opt3001.h"
+
+#include "sensor_drivers.h"
+
+static const char *TAG = "sensor_opt3001";
+static opt3001_handle_t s_opt3001;
+
+static esp_err_t opt3001_sensor_probe(const cellar_sensor_bus_t *bus) {
+    if (!bus->i2c_bus) return ESP_ERR_INVALID_STATE;
+    return i2c_master_probe(bus->i2c_bus, OPT3001_I2C_ADDR_DEFAULT, 50);
+}
+
+static esp_err_t opt3001_sensor_init(const cellar_sensor_bus_t *bus) {
+    ESP_LOGI(TAG, "Found OPT3001 at 0x%02X, initializing...", OPT3001_I2C_ADDR_DEFAULT);
+    return opt3001_init(bus->i2c_bus, OPT3001_I2C_ADDR_DEFAULT, &s_opt3001);
+}
+
+static esp_err_t opt3001_sensor_read(cellar_sample_t *sample) {
+    float lux = NAN;
+    esp_err_t err = opt3001_read_lux(&s_opt3001, &lux);
+    if (err != ESP_OK) return err;
+    CELLAR_BLOGI(TAG, "OPT3001: Lux=%.2f", lux);
+    sample->opt3001_lux = lux;
+    return ESP_OK;
+}
+
+static void opt3001_sensor_invalidate(cellar_sample_t *sample) {
+    sample->opt3001_lux = NAN;
+}
+
+// Continuous mode with 800 ms integration: only the first result needs a wait.
+const cellar_sensor_driver_t cellar_sensor_opt3001 = {
+    .name = "OPT3001",
+    .probe = opt3001_sensor_probe,
+    .init = opt3001_sensor_init,
+    .start_conversion = NULL,
+    .read = opt3001_sensor_read,
+    .invalidate = opt3001_sensor_invalidate,
+    .recover = cellar_sensors_reset_i2c,
+    .i2c = true,
+    .warmup_ms = OPT3001_FIRST_CONVERSION_MS,
+    .conversion_ms = 0,
+    .period_ms = SENSOR_PERIOD_OPT3001_MS,
+};
@@ -0,0 +1,48 @@
+#include <math.h>
+
+#include "cellar_binlog.h"
+#include "esp_log.h"
+#include "veml7700.h"
+
+#include "sensor_drivers.h"
+
+static const char *TAG = "sensor_veml7700";
+static veml7700_handle_t s_veml7700;
+
+static esp_err_t veml7700_sensor_probe(const cellar_sensor_bus_t *bus) {
+    if (!bus->i2c_bus) return ESP_ERR_INVALID_STATE;
+    return i2c_master_probe(bus->i2c_bus, VEML7700_I2C_ADDR_DEFAULT, 50);
+}
+
+static esp_err_t veml7700_sensor_init(const cellar_sensor_bus_t *bus) {
+    ESP_LOGI(TAG, "Found VEML7700 at 0x%02X, initializing...", VEML7700_I2C_ADDR_DEFAULT);
+    return veml7700_init(bus->i2c_bus, VEML7700_I2C_ADDR_DEFAULT, &s_veml7700);
+}
+
+static esp_err_t veml7700_sensor_read(cellar_sample_t *sample) {
+    float lux = NAN;
+    esp_err_t err = veml7700_read_lux(&s_veml7700, &lux);
+    if (err != ESP_OK) return err;
+    CELLAR_BLOGI(TAG, "VEML7700: Lux=%.2f", lux);
+    sample->veml7700_lux = lux;
+    return ESP_OK;
+}
+
+static void veml7700_sensor_invalidate(cellar_sample_t *sample) {
+    sample->veml7700_lux = NAN;
+}
+
+// Free-running at 100 ms integration; wait out the first integration only.
+const cellar_sensor_driver_t cellar_sensor_veml7700 = {
+    .name = "VEML7700",
+    .probe = veml7700_sensor_probe,
+    .init = veml7700_sensor_init,
+    .start_conversion = NULL,
+    .read = veml7700_sensor_read,
+    .invalidate = veml7700_sensor_invalidate,
+    .recover = cellar_sensors_reset_i2c,
+    .i2c = true,
+    .warmup_ms = 110,
+    .conversion_ms = 0,
+    .period_ms = SENSOR_PERIOD_VEML7700_MS,
+};
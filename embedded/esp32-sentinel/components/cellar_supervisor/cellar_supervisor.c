@@ -0,0 +1,180 @@
+#include "cellar_supervisor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cellar_tasks.h"
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Only the supervisor feeds the task watchdog; it wakes at least twice per
+// period, and otherwise only when the next deadline expires.
+#ifndef CELLAR_SUPERVISOR_WDT_MS
+#define CELLAR_SUPERVISOR_WDT_MS (60 * 1000)
+#endif
+#define SUPERVISOR_TASK_STACK 3072
+#define REBOOT_NOTE_MAGIC 0x53555056u  // "SUPV"
+
+static const char *TAG = "cellar_supervisor";
+
+typedef struct {
+    cellar_supervisor_config_t config;
+    int64_t due_ms;      // esp_timer ms by which the next check-in is due
+    const char *op;
+    int attempts;        // recoveries since the last check-in
+    int64_t stalled_ms;  // when the missed deadline was; 0 while healthy
+} watched_t;
+
+static watched_t s_watched[CELLAR_SUPERVISOR_MAX];
+static int s_count = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static cellar_supervisor_stats_t s_stats;
+static TaskHandle_t s_task = NULL;
+static int64_t s_wake_ms = INT64_MAX;  // when the supervisor next looks
+
+// Survive esp_restart (not a power cycle): which stall restarted the device.
+static RTC_NOINIT_ATTR uint32_t s_note_magic;
+static RTC_NOINIT_ATTR char s_note[sizeof(s_stats.last)];
+
+static inline int64_t now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+static bool valid(cellar_supervisor_id_t id) {
+    return id >= 0 && id < s_count;
+}
+
+cellar_supervisor_id_t cellar_supervisor_add(const cellar_supervisor_config_t *config) {
+    if (!config || !config->name || config->period_ms == 0) return -1;
+    cellar_supervisor_id_t id = -1;
+    portENTER_CRITICAL(&s_lock);
+    if (s_count < CELLAR_SUPERVISOR_MAX) {
+        id = s_count;
+        s_watched[id] = (watched_t){.config = *config, .due_ms = now_ms() + config->period_ms};
+        s_count++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (id < 0) ESP_LOGE(TAG, "Table full; %s is not supervised", config->name);
+    return id;
+}
+
+static void checkin(cellar_supervisor_id_t id, uint32_t within_ms) {
+    if (!valid(id)) return;
+    watched_t *w = &s_watched[id];
+    int64_t now = now_ms();
+    portENTER_CRITICAL(&s_lock);
+    int64_t stalled_ms = w->stalled_ms;
+    w->due_ms = now + within_ms;
+    w->attempts = 0;
+    w->stalled_ms = 0;
+    bool sooner = w->due_ms + w->config.timeout_ms < s_wake_ms;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (stalled_ms) {
+        ESP_LOGW(TAG, "%s is back after %lld ms", w->config.name, (long long)(now - stalled_ms));
+    }
+    if (sooner && s_task) xTaskNotifyGive(s_task);
+}
+
+void cellar_supervisor_checkin(cellar_supervisor_id_t id) {
+    if (valid(id)) checkin(id, s_watched[id].config.period_ms);
+}
+
+void cellar_supervisor_checkin_within(cellar_supervisor_id_t id, uint32_t wait_ms) {
+    if (valid(id)) checkin(id, wait_ms + s_watched[id].config.period_ms);
+}
+
+void cellar_supervisor_op(cellar_supervisor_id_t id, const char *op) {
+    if (valid(id)) s_watched[id].op = op;
+}
+
+void cellar_supervisor_get_stats(cellar_supervisor_stats_t *out) {
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void __attribute__((noreturn)) restart_device(const char *why) {
+    snprintf(s_note, sizeof(s_note), "%s", why);
+    s_note_magic = REBOOT_NOTE_MAGIC;
+    ESP_LOGE(TAG, "No recovery left for %s; restarting", why);
+    esp_restart();
+}
+
+static void handle_stall(watched_t *w, int attempt, const char *op, int64_t overdue_ms) {
+    char what[sizeof(s_stats.last)];
+    snprintf(what, sizeof(what), "%s: %s", w->config.name, op ? op : "idle");
+    if (attempt == 1) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.stalls++;
+        memcpy(s_stats.last, what, sizeof(what));
+        portEXIT_CRITICAL(&s_lock);
+    }
+    ESP_LOGE(TAG, "%s stalled (%lld ms past its check-in), recovery %d", what, (long long)overdue_ms, attempt);
+    if (!w->config.recover || !w->config.recover(attempt, op)) restart_device(what);
+    portENTER_CRITICAL(&s_lock);
+    s_stats.recoveries++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void supervisor_task(void *arg) {
+    esp_task_wdt_add(NULL);
+    while (true) {
+        esp_task_wdt_reset();
+        int64_t now = now_ms();
+        int64_t wake = now + CELLAR_SUPERVISOR_WDT_MS / 2;
+        for (int i = 0; i < s_count; i++) {
+            watched_t *w = &s_watched[i];
+            portENTER_CRITICAL(&s_lock);
+            int64_t deadline = w->due_ms + w->config.timeout_ms;
+            bool stalled = now >= deadline;
+            int attempt = 0;
+            int64_t overdue = 0;
+            const char *op = w->op;
+            if (stalled) {
+                if (!w->stalled_ms) w->stalled_ms = w->due_ms;
+                overdue = now - w->stalled_ms;
+                attempt = ++w->attempts;
+                // Give the remedy a full timeout before the next one.
+                w->due_ms = now;
+                deadline = now + w->config.timeout_ms;
+            }
+            if (deadline < wake) wake = deadline;
+            portEXIT_CRITICAL(&s_lock);
+            if (stalled) handle_stall(w, attempt, op, overdue);
+        }
+        portENTER_CRITICAL(&s_lock);
+        s_wake_ms = wake;
+        portEXIT_CRITICAL(&s_lock);
+        int64_t wait_ms = wake - now_ms();
+        ulTaskNotifyTake(pdTRUE, wait_ms > 0 ? pdMS_TO_TICKS(wait_ms) + 1 : 0);
+    }
+}
+
+esp_err_t cellar_supervisor_start(void) {
+    if (s_task) return ESP_OK;
+    if (s_note_magic == REBOOT_NOTE_MAGIC && esp_reset_reason() == ESP_RST_SW) {
+        s_note[sizeof(s_note) - 1] = '\0';
+        ESP_LOGW(TAG, "Restarted after a stall in %s", s_note);
+        memcpy(s_stats.last, s_note, sizeof(s_note));
+    }
+    s_note_magic = 0;
+
+    esp_task_wdt_config_t wdt = {
+        .timeout_ms = CELLAR_SUPERVISOR_WDT_MS,
+        .idle_core_mask = 0,
+        .trigger_panic = true,
+    };
+    esp_err_t err = esp_task_wdt_init(&wdt);
+    if (err == ESP_ERR_INVALID_STATE) err = esp_task_wdt_reconfigure(&wdt);
+    if (err != ESP_OK) return err;
+    BaseType_t created = xTaskCreatePinnedToCore(supervisor_task, "supervisor", SUPERVISOR_TASK_STACK, NULL,
+                                                 CELLAR_PRIO_SUPERVISOR, &s_task, CELLAR_CORE_APP);
+    return created == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Per-task liveness. Each supervised task checks in at least every
+// period_ms, or announces a longer wait first. A task that misses its
+// deadline by timeout_ms has stalled. The supervisor logs what it was doing
+// and calls its recover hook once per timeout_ms: reset a bus, restart the
+// task. When the hook runs out of remedies the device restarts, and the
+// stall is logged again after boot. The supervisor task itself is the only
+// task on the task watchdog.
+
+#define CELLAR_SUPERVISOR_MAX 8
+
+typedef int cellar_supervisor_id_t;  // -1: not supervised; every call ignores it
+
+typedef struct {
+    const char *name;
+    uint32_t period_ms;   // longest gap between check-ins while busy
+    uint32_t timeout_ms;  // grace past a missed check-in, and between recoveries
+    // Runs on the supervisor task. attempt is 1 for the first try since
+    // the task last checked in; op is what it said it was doing (or NULL).
+    // Return false when there is nothing (left) to try. NULL: restart the
+    // device at once.
+    bool (*recover)(int attempt, const char *op);
+} cellar_supervisor_config_t;
+
+typedef struct {
+    uint32_t stalls;      // missed deadlines, all tasks
+    uint32_t recoveries;  // recover hooks that reported success
+    char last[64];        // "task: op", newest stall
+} cellar_supervisor_stats_t;
+
+// Start supervising a task; the first check-in is due within period_ms.
+// Returns -1 if the table is full.
+cellar_supervisor_id_t cellar_supervisor_add(const cellar_supervisor_config_t *config);
+
+// The task is alive; the next check-in is due within period_ms.
+void cellar_supervisor_checkin(cellar_supervisor_id_t id);
+
+// The task is alive and about to block for up to wait_ms (a sleep, a
+// long-poll); the next check-in is due after that.
+void cellar_supervisor_checkin_within(cellar_supervisor_id_t id, uint32_t wait_ms);
+
+// What the task is doing, for stall reports ("http post", "render"). A
+// string literal or other static string; NULL when idle.
+void cellar_supervisor_op(cellar_supervisor_id_t id, const char *op);
+
+// Start the supervisor task and put it on the task watchdog (panic after
+// CELLAR_SUPERVISOR_WDT_MS).
+esp_err_t cellar_supervisor_start(void);
+
+void cellar_supervisor_get_stats(cellar_supervisor_stats_t *out);
@@ -0,0 +1,69 @@
+#include "cellar_tasks.h"
+
+#include "esp_log.h"
+#include "freertos/task.h"
+
+// Room for every task on a device with all features on (IDF's own plus ours).
+#define CELLAR_TASKS_MAX 24
+
+static const char *TAG = "cellar_tasks";
+
+bool cellar_tasks_cpu_load(cellar_tasks_window_t *window, uint8_t load_pct[CELLAR_TASKS_CORES]) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    cellar_tasks_window_t now = {.total = (uint64_t)portGET_RUN_TIME_COUNTER_VALUE()};
+    for (int core = 0; core < CELLAR_TASKS_CORES; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+        if (!idle) return false;
+        now.idle[core] = ulTaskGetRunTimeCounter(idle);
+    }
+    bool started = window->total != 0;
+    uint64_t elapsed = now.total - window->total;
+    if (started && elapsed > 0) {
+        for (int core = 0; core < CELLAR_TASKS_CORES; core++) {
+            uint64_t idle = now.idle[core] - window->idle[core];
+            load_pct[core] = idle >= elapsed ? 0 : (uint8_t)(100 - idle * 100 / elapsed);
+        }
+    }
+    *window = now;
+    return started && elapsed > 0;
+#else
+    return false;
+#endif
+}
+
+bool cellar_tasks_foreach(bool (*fn)(const cellar_tasks_stat_t *stat, void *arg), void *arg) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    TaskStatus_t tasks[CELLAR_TASKS_MAX];
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, CELLAR_TASKS_MAX, &total);
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks; no run-time table", CELLAR_TASKS_MAX);
+        return false;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *t = &tasks[i];
+        cellar_tasks_stat_t stat = {
+            .name = t->pcTaskName,
+            .core = t->xCoreID == tskNO_AFFINITY ? -1 : (int)t->xCoreID,
+            .priority = (unsigned)t->uxCurrentPriority,
+            .cpu_pct = total ? (float)((double)t->ulRunTimeCounter * 100.0 / (double)total) : 0.0f,
+            .stack_free = (uint32_t)t->usStackHighWaterMark,
+        };
+        if (!fn(&stat, arg)) break;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+static bool log_stat(const cellar_tasks_stat_t *t, void *arg) {
+    char core = t->core < 0 ? '-' : (char)('0' + t->core);
+    ESP_LOGI(TAG, "%-14s core %c prio %2u  %5.1f%% cpu  %5u B stack free", t->name, core, t->priority,
+             (double)t->cpu_pct, (unsigned)t->stack_free);
+    return true;
+}
+
+void cellar_tasks_log_stats(void) {
+    cellar_tasks_foreach(log_stat, NULL);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+// Where each firmware task runs. On the dual-core ESP32, core 0 (PRO_CPU) is
+// the protocol core: Wi-Fi, lwIP (tiT), the default event loop and esp_timer
+// are pinned there (sdkconfig.defaults), and the network-facing tasks join
+// them, so a TLS handshake only competes with other network work. Core 1
+// (APP_CPU) runs the sampler, which is the main task
+// (CONFIG_ESP_MAIN_TASK_AFFINITY_CPU1), and the display. The I2C and 1-Wire
+// drivers are installed from the sampler, so their interrupts land on core 1
+// as well. A single-core build puts everything on core 0, and then only the
+// priorities matter.
+#if CONFIG_FREERTOS_UNICORE
+#define CELLAR_CORE_NET 0
+#define CELLAR_CORE_APP 0
+#else
+#define CELLAR_CORE_NET PRO_CPU_NUM
+#define CELLAR_CORE_APP APP_CPU_NUM
+#endif
+
+// Priorities, highest first. All of them sit below IDF's own tasks (Wi-Fi
+// 23, event loop 20, lwIP 18). On each core the time-critical task preempts
+// the rest: a frame render never delays a sensor read, and a token refresh
+// yields to a telemetry post.
+#define CELLAR_PRIO_SUPERVISOR 7  // app core; never starved by a spinning sampler
+#define CELLAR_PRIO_SAMPLER 6     // app core; raised from the main task's 1 in app_main
+#define CELLAR_PRIO_UPLINK 5   // protocol core
+#define CELLAR_PRIO_MQTT 5     // protocol core (CONFIG_MQTT_USE_CORE_0)
+#define CELLAR_PRIO_AUTH 4     // protocol core
+#define CELLAR_PRIO_DISPLAY 3  // app core
+#define CELLAR_PRIO_HTTPD 3    // protocol core
+#define CELLAR_PRIO_OTA 2      // protocol core
+#define CELLAR_PRIO_LOG 1      // app core; binlog drain, below everything but idle
+
+#define CELLAR_TASKS_CORES portNUM_PROCESSORS
+
+// Run-time counters at the start of a load window. Zero-initialise; the
+// first cellar_tasks_cpu_load call only fills it in.
+typedef struct {
+    uint64_t total;
+    uint64_t idle[CELLAR_TASKS_CORES];
+} cellar_tasks_window_t;
+
+// Each core's load since the window started, in percent: 100 minus the share
+// its idle task ran. Starts a new window. Returns false for the first window,
+// or without CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS or idle tasks (the host
+// simulation).
+bool cellar_tasks_cpu_load(cellar_tasks_window_t *window, uint8_t load_pct[CELLAR_TASKS_CORES]);
+
+// One row of the vTaskGetRunTimeStats table.
+typedef struct {
+    const char *name;
+    int core;             // -1 if the task is not pinned
+    unsigned priority;
+    float cpu_pct;        // share of a core since boot
+    uint32_t stack_free;  // bytes; the lowest it has been
+} cellar_tasks_stat_t;
+
+// Call fn for each task until it returns false. Returns false without
+// CONFIG_FREERTOS_USE_TRACE_FACILITY and run-time stats (the host
+// simulation) or with more tasks than the table holds.
+bool cellar_tasks_foreach(bool (*fn)(const cellar_tasks_stat_t *stat, void *arg), void *arg);
+
+// The vTaskGetRunTimeStats table as log lines: each task's share of a core
+// since boot, with its core, priority and free stack.
+void cellar_tasks_log_stats(void);
@@ -0,0 +1,112 @@
+#include "cellar_time.h"
+
+#include <sys/time.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef CELLAR_SNTP_SERVER
+#define CELLAR_SNTP_SERVER "pool.ntp.org"
+#endif
+
+// Resync every hour by default; the RTC crystal drifts a few seconds per day.
+#ifndef CELLAR_SNTP_RESYNC_MS
+#define CELLAR_SNTP_RESYNC_MS (60 * 60 * 1000)
+#endif
+
+// Corrections larger than this are stepped; smaller ones are slewed.
+#define STEP_THRESHOLD_MS 1000
+// Slew at 1 ms per 2 s (500 ppm), the same rate adjtime() uses.
+#define SLEW_DIVISOR 2000
+
+static const char *TAG = "cellar_time";
+
+// UTC = mono + s_offset_ms + (portion of s_slew_ms applied so far)
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_synced = false;
+static int64_t s_offset_ms = 0;
+static int64_t s_slew_ms = 0;
+static int64_t s_slew_start_ms = 0;
+static uint32_t s_sync_count = 0;
+
+int64_t cellar_time_mono_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+// Caller holds s_lock.
+static int64_t slew_applied(int64_t mono_ms) {
+    int64_t elapsed = mono_ms - s_slew_start_ms;
+    if (elapsed <= 0 || s_slew_ms == 0) return 0;
+    int64_t step = elapsed / SLEW_DIVISOR;
+    if (s_slew_ms > 0) return step < s_slew_ms ? step : s_slew_ms;
+    return -step > s_slew_ms ? -step : s_slew_ms;
+}
+
+static void on_time_sync(struct timeval *tv) {
+    int64_t mono = cellar_time_mono_ms();
+    int64_t utc = (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+    int64_t target = utc - mono;
+    int64_t correction;
+    bool stepped;
+
+    portENTER_CRITICAL(&s_lock);
+    s_offset_ms += slew_applied(mono);
+    correction = target - s_offset_ms;
+    stepped = !s_synced || correction > STEP_THRESHOLD_MS || correction < -STEP_THRESHOLD_MS;
+    if (stepped) {
+        s_offset_ms = target;
+        s_slew_ms = 0;
+    } else {
+        s_slew_ms = correction;
+    }
+    s_slew_start_ms = mono;
+    s_synced = true;
+    s_sync_count++;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "SNTP sync #%lu: epoch=%lld, %s %lldms",
+             (unsigned long)s_sync_count, (long long)(utc / 1000),
+             stepped ? "stepped" : "slewing", (long long)correction);
+}
+
+esp_err_t cellar_time_start(void) {
+    if (esp_sntp_enabled()) {
+        return ESP_OK;
+    }
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CELLAR_SNTP_SERVER);
+    config.smooth_sync = true;     // adjtime() the system clock after the first sync
+    config.wait_for_sync = false;  // nobody blocks on esp_netif_sntp_sync_wait
+    config.sync_cb = on_time_sync;
+    sntp_set_sync_interval(CELLAR_SNTP_RESYNC_MS);
+
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init SNTP: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "SNTP started (%s, resync every %lus)",
+             CELLAR_SNTP_SERVER, (unsigned long)(CELLAR_SNTP_RESYNC_MS / 1000));
+    return ESP_OK;
+}
+
+bool cellar_time_synced(void) {
+    return s_synced;
+}
+
+int64_t cellar_time_mono_to_utc_ms(int64_t mono_ms) {
+    int64_t utc = 0;
+    portENTER_CRITICAL(&s_lock);
+    if (s_synced) {
+        utc = mono_ms + s_offset_ms + slew_applied(mono_ms);
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return utc;
+}
+
+int64_t cellar_time_now_ms(void) {
+    return cellar_time_mono_to_utc_ms(cellar_time_mono_ms());
+}
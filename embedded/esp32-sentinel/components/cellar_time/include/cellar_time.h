@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Start background SNTP. Returns immediately; the first sync and every
+// periodic resync arrive through a callback. Call once the network is up.
+esp_err_t cellar_time_start(void);
+
+// True once at least one SNTP sync has completed.
+bool cellar_time_synced(void);
+
+// Monotonic milliseconds since boot (esp_timer based; never jumps).
+int64_t cellar_time_mono_ms(void);
+
+// Map a monotonic timestamp to UTC epoch milliseconds, or 0 if time has
+// never been synced. Samples taken before the first sync can be mapped later.
+int64_t cellar_time_mono_to_utc_ms(int64_t mono_ms);
+
+// Current UTC epoch milliseconds, or 0 if time has never been synced.
+int64_t cellar_time_now_ms(void);
@@ -0,0 +1,100 @@
+#include "cellar_tls.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "config.h"
+#include "esp_log.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "sdkconfig.h"
+
+// 0 leaves the connection to esp-tls's defaults, for before/after runs.
+#ifndef CELLAR_TLS_PROFILE
+#define CELLAR_TLS_PROFILE 1
+#endif
+// 1 drops the ECDHE-RSA fallback, once the server is known to present an
+// ECDSA certificate.
+#ifndef CELLAR_TLS_ECDSA_ONLY
+#define CELLAR_TLS_ECDSA_ONLY 0
+#endif
+// esp-tls only calls crt_bundle_attach with the bundle support built in.
+#define USE_PROFILE (CELLAR_TLS_PROFILE && CONFIG_MBEDTLS_CERTIFICATE_BUNDLE)
+
+extern const char server_root_cert_pem_start[] asm("_binary_server_root_cert_pem_start");
+
+#if USE_PROFILE
+static const char *TAG = "cellar_tls";
+
+static mbedtls_x509_crt s_anchors;
+static bool s_ready = false;
+
+// In preference order: ECDSA first, ECDHE-RSA for a server whose
+// certificate is RSA. AES-GCM runs on the AES peripheral and SHA-256 on the
+// SHA one.
+static const int s_suites[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+#if !CELLAR_TLS_ECDSA_ONLY
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+#endif
+    0,
+};
+
+// The key exchange uses P-256. mbedTLS also checks an EC certificate key
+// against this list, so P-384 stays for a P-384 leaf.
+static const uint16_t s_groups[] = {
+    MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1,
+    MBEDTLS_SSL_IANA_TLS_GROUP_SECP384R1,
+    MBEDTLS_SSL_IANA_TLS_GROUP_NONE,
+};
+#endif
+
+esp_err_t cellar_tls_init(void) {
+#if USE_PROFILE
+    if (s_ready) return ESP_OK;
+    mbedtls_x509_crt_init(&s_anchors);
+    // PEM input must include the terminating NUL.
+    int ret = mbedtls_x509_crt_parse(&s_anchors, (const unsigned char *)server_root_cert_pem_start,
+                                     strlen(server_root_cert_pem_start) + 1);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to parse server_root_cert.pem (-0x%04x); using esp-tls defaults",
+                 (unsigned)-ret);
+        mbedtls_x509_crt_free(&s_anchors);
+        return ESP_FAIL;
+    }
+    s_ready = true;
+#endif
+    return ESP_OK;
+}
+
+#if USE_PROFILE
+// Called by esp-tls with each new connection's mbedtls_ssl_config, in the
+// slot meant for esp_crt_bundle_attach; esp-tls has already required
+// verification. Without anchors the handshake fails verification.
+static esp_err_t attach_profile(void *conf) {
+    mbedtls_ssl_config *ssl_conf = (mbedtls_ssl_config *)conf;
+    if (!s_ready) {
+        ESP_LOGE(TAG, "Trust anchors not loaded");
+        return ESP_ERR_INVALID_STATE;
+    }
+    mbedtls_ssl_conf_ca_chain(ssl_conf, &s_anchors, NULL);
+    mbedtls_ssl_conf_ciphersuites(ssl_conf, s_suites);
+    mbedtls_ssl_conf_groups(ssl_conf, s_groups);
+    return ESP_OK;
+}
+#endif
+
+void cellar_tls_configure(esp_http_client_config_t *config) {
+#if USE_PROFILE
+    if (s_ready) {
+        config->crt_bundle_attach = attach_profile;
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        config->save_client_session = true;
+#endif
+        return;
+    }
+#endif
+    config->cert_pem = server_root_cert_pem_start;
+}
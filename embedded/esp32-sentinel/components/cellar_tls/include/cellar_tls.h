@@ -0,0 +1,25 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+// TLS profile for the API client's connections to the backend. esp-tls on
+// its own parses the embedded server_root_cert.pem on every connection and
+// offers every suite and curve mbedTLS was built with. With the profile
+// (CELLAR_TLS_PROFILE, default 1):
+// - the trust anchors are parsed once by cellar_tls_init and stay resident;
+// - the client offers ECDHE-ECDSA with AES-GCM first, then ECDHE-RSA for a
+//   server with an RSA certificate (CELLAR_TLS_ECDSA_ONLY 1 drops those),
+//   and P-256 for the key exchange, on the ESP32's bignum and SHA hardware;
+// - the session is kept for resumption by ticket, so a reconnect skips the
+//   key exchange and the certificate chain.
+// OTA keeps esp-tls's defaults. The trimmed mbedTLS build that goes with the
+// profile is in sdkconfig.defaults.
+
+// Parse the embedded trust anchors. Call once before the first connection.
+// On failure the profile stays off and connections use esp-tls's defaults.
+esp_err_t cellar_tls_init(void);
+
+// Point an https client config at the server's trust anchors, through the
+// profile or (CELLAR_TLS_PROFILE 0) through esp-tls's defaults.
+void cellar_tls_configure(esp_http_client_config_t *config);
@@ -0,0 +1,381 @@
+#include "cellar_tsdb.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cellar_gorilla.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#ifndef CELLAR_TSDB_PARTITION
+#define CELLAR_TSDB_PARTITION "tsdb"
+#endif
+// A 512 B block holds ~170 (humidity) to ~1700 (steady temperature) samples;
+// see host/bench_tsdb.
+#ifndef CELLAR_TSDB_BLOCK_SIZE
+#define CELLAR_TSDB_BLOCK_SIZE 512
+#endif
+// cellar_tsdb_append_sample rounds timestamps to this. Sampler jitter of a
+// few ms would otherwise cost ~9 bits per sample in delta-of-delta buckets.
+#ifndef CELLAR_TSDB_TS_RESOLUTION_MS
+#define CELLAR_TSDB_TS_RESOLUTION_MS 1000
+#endif
+// Open blocks held in RAM (one per channel).
+#ifndef CELLAR_TSDB_MAX_CHANNELS
+#define CELLAR_TSDB_MAX_CHANNELS 10
+#endif
+
+#define SECTOR_SIZE 4096
+#define BLOCKS_PER_SECTOR (SECTOR_SIZE / CELLAR_TSDB_BLOCK_SIZE)
+#define BLOCK_MAGIC 0x7D5Bu
+
+_Static_assert(SECTOR_SIZE % CELLAR_TSDB_BLOCK_SIZE == 0, "blocks must tile a sector");
+
+static const char *TAG = "cellar_tsdb";
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;  // BLOCK_MAGIC; 0xFFFF marks the first unwritten block
+    uint16_t count;
+    uint32_t seq;    // global write order
+    int64_t first_ms;
+    int64_t last_ms;
+    uint16_t payload_len;
+    uint32_t payload_crc;
+    char channel[CELLAR_SENSOR_ID_LEN];
+    uint8_t reserved[1];
+} block_header_t;
+
+_Static_assert(sizeof(block_header_t) == 48, "header layout is part of the flash format");
+
+#define PAYLOAD_SIZE (CELLAR_TSDB_BLOCK_SIZE - sizeof(block_header_t))
+
+typedef struct {
+    bool in_use;
+    char channel[CELLAR_SENSOR_ID_LEN];
+    cellar_gorilla_enc_t enc;
+    int64_t first_ms;
+    int64_t last_ms;
+    uint8_t payload[PAYLOAD_SIZE];
+} open_block_t;
+
+typedef struct {
+    uint8_t blocks;  // written blocks, from the start of the sector
+    uint32_t first_seq;
+    uint32_t samples;
+    int64_t min_ms;
+    int64_t max_ms;
+} sector_summary_t;
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static sector_summary_t *s_sectors = NULL;
+static uint32_t s_sector_count = 0;
+static uint32_t s_cursor_sector = 0;  // sector holding the newest block
+static uint32_t s_cursor_block = 0;   // next free block in it
+static uint32_t s_next_seq = 0;
+static open_block_t s_open[CELLAR_TSDB_MAX_CHANNELS];
+static uint8_t s_scratch[CELLAR_TSDB_BLOCK_SIZE];
+// Scans read flash and call the visitor without s_lock, so a slow reader
+// never holds up the sampler's appends. s_scan_lock serialises scans over
+// these buffers.
+static SemaphoreHandle_t s_scan_lock = NULL;
+static uint8_t s_scan_payload[PAYLOAD_SIZE];
+static open_block_t s_scan_open;
+
+static size_t block_offset(uint32_t sector, uint32_t block) {
+    return (size_t)sector * SECTOR_SIZE + (size_t)block * CELLAR_TSDB_BLOCK_SIZE;
+}
+
+static void summary_add(sector_summary_t *summary, const block_header_t *hdr) {
+    if (summary->blocks == 0) {
+        summary->first_seq = hdr->seq;
+        summary->min_ms = hdr->first_ms;
+        summary->max_ms = hdr->last_ms;
+    } else {
+        if (hdr->first_ms < summary->min_ms) summary->min_ms = hdr->first_ms;
+        if (hdr->last_ms > summary->max_ms) summary->max_ms = hdr->last_ms;
+    }
+    summary->blocks++;
+    summary->samples += hdr->count;
+}
+
+esp_err_t cellar_tsdb_init(void) {
+    if (s_part) return ESP_OK;
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_ANY,
+                                                           CELLAR_TSDB_PARTITION);
+    if (!part) {
+        ESP_LOGW(TAG, "No \"%s\" partition; history disabled", CELLAR_TSDB_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t sectors = part->size / SECTOR_SIZE;
+    if (sectors < 2) return ESP_ERR_INVALID_SIZE;
+    s_sectors = calloc(sectors, sizeof(*s_sectors));
+    s_lock = xSemaphoreCreateMutex();
+    s_scan_lock = xSemaphoreCreateMutex();
+    if (!s_sectors || !s_lock || !s_scan_lock) return ESP_ERR_NO_MEM;
+
+    // Blocks are written front to back, so each sector's written blocks end at
+    // the first erased header.
+    bool any = false;
+    uint32_t newest_seq = 0;
+    for (uint32_t s = 0; s < sectors; ++s) {
+        for (uint32_t b = 0; b < BLOCKS_PER_SECTOR; ++b) {
+            block_header_t hdr;
+            if (esp_partition_read(part, block_offset(s, b), &hdr, sizeof(hdr)) != ESP_OK) break;
+            if (hdr.magic != BLOCK_MAGIC || hdr.payload_len > PAYLOAD_SIZE) break;
+            summary_add(&s_sectors[s], &hdr);
+            if (!any || hdr.seq > newest_seq) {
+                any = true;
+                newest_seq = hdr.seq;
+                s_cursor_sector = s;
+                s_cursor_block = b + 1;
+            }
+        }
+    }
+    s_sector_count = sectors;
+    s_next_seq = any ? newest_seq + 1 : 0;
+    s_part = part;
+
+    uint32_t used = 0;
+    for (uint32_t s = 0; s < sectors; ++s) used += s_sectors[s].blocks > 0;
+    ESP_LOGI(TAG, "Mounted %s: %lu KiB, %lu/%lu sectors used, %u B blocks",
+             CELLAR_TSDB_PARTITION, (unsigned long)(part->size / 1024), (unsigned long)used,
+             (unsigned long)sectors, (unsigned)CELLAR_TSDB_BLOCK_SIZE);
+    return ESP_OK;
+}
+
+// Append one block at the cursor, erasing the next (oldest) sector when the
+// current one is full. Called with the lock held.
+static esp_err_t write_block(open_block_t *ob) {
+    if (s_cursor_block >= BLOCKS_PER_SECTOR) {
+        s_cursor_sector = (s_cursor_sector + 1) % s_sector_count;
+        s_cursor_block = 0;
+    }
+    if (s_cursor_block == 0) {
+        esp_err_t err = esp_partition_erase_range(s_part, block_offset(s_cursor_sector, 0), SECTOR_SIZE);
+        if (err != ESP_OK) return err;
+        if (s_sectors[s_cursor_sector].blocks > 0) {
+            ESP_LOGI(TAG, "Recycled sector %lu (%lu samples)", (unsigned long)s_cursor_sector,
+                     (unsigned long)s_sectors[s_cursor_sector].samples);
+        }
+        memset(&s_sectors[s_cursor_sector], 0, sizeof(s_sectors[0]));
+    }
+
+    size_t len = cellar_gorilla_enc_bytes(&ob->enc);
+    block_header_t hdr = {
+        .magic = BLOCK_MAGIC,
+        .count = ob->enc.count,
+        .seq = s_next_seq,
+        .first_ms = ob->first_ms,
+        .last_ms = ob->last_ms,
+        .payload_len = (uint16_t)len,
+        .payload_crc = esp_rom_crc32_le(0, ob->payload, len),
+    };
+    memcpy(hdr.channel, ob->channel, sizeof(hdr.channel));
+    memset(s_scratch, 0xFF, sizeof(s_scratch));
+    memcpy(s_scratch, &hdr, sizeof(hdr));
+    memcpy(s_scratch + sizeof(hdr), ob->payload, len);
+
+    esp_err_t err = esp_partition_write(s_part, block_offset(s_cursor_sector, s_cursor_block),
+                                        s_scratch, sizeof(s_scratch));
+    if (err != ESP_OK) return err;
+    summary_add(&s_sectors[s_cursor_sector], &hdr);
+    s_cursor_block++;
+    s_next_seq++;
+    return ESP_OK;
+}
+
+static void reset_block(open_block_t *ob) {
+    cellar_gorilla_enc_init(&ob->enc, ob->payload, sizeof(ob->payload));
+    ob->first_ms = 0;
+    ob->last_ms = 0;
+}
+
+static open_block_t *find_open(const char *channel, bool create) {
+    open_block_t *free_slot = NULL;
+    for (int i = 0; i < CELLAR_TSDB_MAX_CHANNELS; ++i) {
+        if (s_open[i].in_use && strcmp(s_open[i].channel, channel) == 0) return &s_open[i];
+        if (!s_open[i].in_use && !free_slot) free_slot = &s_open[i];
+    }
+    if (!create || !free_slot) return NULL;
+    free_slot->in_use = true;
+    snprintf(free_slot->channel, sizeof(free_slot->channel), "%s", channel);
+    reset_block(free_slot);
+    return free_slot;
+}
+
+esp_err_t cellar_tsdb_append(const char *channel, int64_t ts_ms, float value) {
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+    if (!channel || channel[0] == '\0' || isnan(value)) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    open_block_t *ob = find_open(channel, true);
+    if (!ob) {
+        err = ESP_ERR_NO_MEM;
+    } else if (ob->enc.count > 0 && ts_ms < ob->last_ms) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (!cellar_gorilla_enc_append(&ob->enc, ts_ms, value)) {
+        err = write_block(ob);
+        reset_block(ob);
+        if (err == ESP_OK && !cellar_gorilla_enc_append(&ob->enc, ts_ms, value)) {
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (ob && ob->enc.count > 0) {
+        if (ob->enc.count == 1) ob->first_ms = ts_ms;
+        ob->last_ms = ts_ms;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_ERR_NO_MEM) {
+        ESP_LOGW(TAG, "No free channel slot for %s", channel);
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Append to %s failed: %s", channel, esp_err_to_name(err));
+    }
+    return err;
+}
+
+static float quantize(float value, float step) {
+    return roundf(value / step) * step;
+}
+
+esp_err_t cellar_tsdb_append_sample(const cellar_sample_t *sample, int64_t ts_ms) {
+    if (!sample) return ESP_ERR_INVALID_ARG;
+    ts_ms = (ts_ms + CELLAR_TSDB_TS_RESOLUTION_MS / 2) / CELLAR_TSDB_TS_RESOLUTION_MS * CELLAR_TSDB_TS_RESOLUTION_MS;
+    esp_err_t first_err = ESP_OK;
+#define APPEND(name, value, step)                                           \
+    do {                                                                    \
+        if (!isnan(value)) {                                                \
+            esp_err_t e = cellar_tsdb_append(name, ts_ms, quantize(value, step)); \
+            if (e != ESP_OK && first_err == ESP_OK) first_err = e;          \
+        }                                                                   \
+    } while (0)
+    for (int i = 0; i < sample->temp_count; ++i) {
+        APPEND(sample->temps[i].id, sample->temps[i].value_c, 0.01f);
+    }
+    APPEND("pressure_hpa", sample->pressure_hpa, 0.01f);
+    APPEND("humidity_pct", sample->humidity_pct, 0.1f);
+    APPEND("opt3001_lux", sample->opt3001_lux, 0.1f);
+    APPEND("veml7700_lux", sample->veml7700_lux, 0.1f);
+#undef APPEND
+    return first_err;
+}
+
+esp_err_t cellar_tsdb_flush(void) {
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < CELLAR_TSDB_MAX_CHANNELS && err == ESP_OK; ++i) {
+        open_block_t *ob = &s_open[i];
+        if (!ob->in_use || ob->enc.count == 0) continue;
+        err = write_block(ob);
+        if (err == ESP_OK) reset_block(ob);
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+// Decode one block, calling visit for values in range. Returns false if the
+// visitor asked to stop.
+static bool visit_block(const uint8_t *payload, size_t len, uint16_t count, int64_t from_ms,
+                        int64_t to_ms, cellar_tsdb_visit_t visit, void *ctx) {
+    cellar_gorilla_dec_t dec;
+    cellar_gorilla_dec_init(&dec, payload, len, count);
+    int64_t ts;
+    float value;
+    while (cellar_gorilla_dec_next(&dec, &ts, &value)) {
+        if (ts > to_ms) break;
+        if (ts >= from_ms && !visit(ts, value, ctx)) return false;
+    }
+    return true;
+}
+
+esp_err_t cellar_tsdb_scan(const char *channel, int64_t from_ms, int64_t to_ms,
+                           cellar_tsdb_visit_t visit, void *ctx) {
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+    if (!channel || !visit || from_ms > to_ms) return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+    // The scan sees the store as it is now: blocks written before end_seq,
+    // then a copy of the channel's open block. Blocks written meanwhile hold
+    // samples that are in that copy already.
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t cursor = s_cursor_sector;
+    uint32_t end_seq = s_next_seq;
+    const open_block_t *ob = find_open(channel, false);
+    bool have_open = ob && ob->enc.count > 0 && ob->last_ms >= from_ms && ob->first_ms <= to_ms;
+    if (have_open) memcpy(&s_scan_open, ob, sizeof(s_scan_open));
+    xSemaphoreGive(s_lock);
+
+    esp_err_t err = ESP_OK;
+    bool more = true;
+    // Oldest sector first: the one after the cursor, wrapping round to it.
+    for (uint32_t i = 1; i <= s_sector_count && more && err == ESP_OK; ++i) {
+        uint32_t s = (cursor + i) % s_sector_count;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        sector_summary_t summary = s_sectors[s];
+        xSemaphoreGive(s_lock);
+        // Empty, out of range, or recycled since the scan began.
+        if (summary.blocks == 0 || summary.first_seq >= end_seq) continue;
+        if (summary.max_ms < from_ms || summary.min_ms > to_ms) continue;
+        for (uint32_t b = 0; b < summary.blocks && more; ++b) {
+            block_header_t hdr;
+            err = esp_partition_read(s_part, block_offset(s, b), &hdr, sizeof(hdr));
+            if (err != ESP_OK) break;
+            // The sector was erased or rewritten under us: the rest of it is
+            // gone or newer than the scan.
+            if (hdr.magic != BLOCK_MAGIC || hdr.seq < summary.first_seq || hdr.seq >= end_seq ||
+                hdr.payload_len > PAYLOAD_SIZE) {
+                break;
+            }
+            if (strncmp(hdr.channel, channel, sizeof(hdr.channel)) != 0) continue;
+            if (hdr.last_ms < from_ms || hdr.first_ms > to_ms) continue;
+            err = esp_partition_read(s_part, block_offset(s, b) + sizeof(hdr), s_scan_payload, hdr.payload_len);
+            if (err != ESP_OK) break;
+            // Also catches a payload erased between the two reads.
+            if (esp_rom_crc32_le(0, s_scan_payload, hdr.payload_len) != hdr.payload_crc) {
+                ESP_LOGW(TAG, "Skipping corrupt block %lu/%lu", (unsigned long)s, (unsigned long)b);
+                continue;
+            }
+            more = visit_block(s_scan_payload, hdr.payload_len, hdr.count, from_ms, to_ms, visit, ctx);
+        }
+    }
+    // Then what was still in RAM.
+    if (err == ESP_OK && more && have_open) {
+        visit_block(s_scan_open.payload, cellar_gorilla_enc_bytes(&s_scan_open.enc), s_scan_open.enc.count,
+                    from_ms, to_ms, visit, ctx);
+    }
+    xSemaphoreGive(s_scan_lock);
+    return err;
+}
+
+void cellar_tsdb_get_stats(cellar_tsdb_stats_t *out) {
+    *out = (cellar_tsdb_stats_t){0};
+    if (!s_part) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    out->sectors = s_sector_count;
+    for (uint32_t s = 0; s < s_sector_count; ++s) {
+        const sector_summary_t *summary = &s_sectors[s];
+        if (summary->blocks == 0) continue;
+        out->sectors_used++;
+        out->blocks_written += summary->blocks;
+        out->samples_on_flash += summary->samples;
+        if (out->oldest_ms == 0 || summary->min_ms < out->oldest_ms) out->oldest_ms = summary->min_ms;
+    }
+    for (int i = 0; i < CELLAR_TSDB_MAX_CHANNELS; ++i) {
+        if (!s_open[i].in_use) continue;
+        out->samples_in_ram += s_open[i].enc.count;
+        if (s_open[i].enc.count > 0 && (out->oldest_ms == 0 || s_open[i].first_ms < out->oldest_ms)) {
+            out->oldest_ms = s_open[i].first_ms;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
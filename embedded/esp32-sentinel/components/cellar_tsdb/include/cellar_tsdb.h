@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cellar_sensors.h"
+#include "esp_err.h"
+
+// Compressed on-flash history, one series per channel (a temperature sensor
+// id, "pressure_hpa", "humidity_pct", "opt3001_lux" or "veml7700_lux").
+//
+// Each channel fills a CELLAR_TSDB_BLOCK_SIZE block in RAM with Gorilla
+// encoding (components/cellar_gorilla). Full blocks are appended to the "tsdb"
+// data partition, which is used as a ring of 4 KiB sectors: once the
+// partition is full, the oldest sector is erased. Every block header records
+// its channel and time span, and RAM keeps one summary per sector, so a range
+// scan only reads the sectors and blocks that overlap the range.
+//
+// Open blocks live in RAM until they fill. Call cellar_tsdb_flush before a
+// planned restart to keep them.
+
+// Mount the partition and find the write position. Returns ESP_ERR_NOT_FOUND
+// if the partition table has no "tsdb" partition; the other calls then fail
+// with ESP_ERR_INVALID_STATE.
+esp_err_t cellar_tsdb_init(void);
+
+// Append one value. Timestamps are UTC epoch ms and must not go backwards
+// within a channel.
+esp_err_t cellar_tsdb_append(const char *channel, int64_t ts_ms, float value);
+
+// Append every valid channel of a sample, rounded to the precision the
+// uplink reports (0.01 °C and hPa, 0.1 % and lux) so repeats encode as one bit.
+// The timestamp is rounded to CELLAR_TSDB_TS_RESOLUTION_MS (default 1 s).
+esp_err_t cellar_tsdb_append_sample(const cellar_sample_t *sample, int64_t ts_ms);
+
+// Write every open block to flash (partially filled blocks waste the rest of
+// their space).
+esp_err_t cellar_tsdb_flush(void);
+
+// Called for each stored value in [from_ms, to_ms], oldest first. Return
+// false to stop. Appends carry on while it runs, so it may be slow (e.g. a
+// network write); the scan sees the store as it was when it started, minus
+// any sector recycled before the scan reached it. One scan runs at a time:
+// do not call cellar_tsdb_scan from it.
+typedef bool (*cellar_tsdb_visit_t)(int64_t ts_ms, float value, void *ctx);
+
+esp_err_t cellar_tsdb_scan(const char *channel, int64_t from_ms, int64_t to_ms,
+                           cellar_tsdb_visit_t visit, void *ctx);
+
+typedef struct {
+    uint32_t sectors;
+    uint32_t sectors_used;
+    uint32_t blocks_written;   // blocks currently on flash
+    uint32_t samples_on_flash;
+    uint32_t samples_in_ram;   // in open blocks
+    int64_t oldest_ms;         // 0 when empty
+} cellar_tsdb_stats_t;
+
+void cellar_tsdb_get_stats(cellar_tsdb_stats_t *out);
@@ -0,0 +1,379 @@
+#include "cellar_wifi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cellar_power.h"
+#include "config.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/event_groups.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#ifdef CONFIG_ETH_USE_OPENETH
+#include "esp_eth.h"
+#endif
+
+#ifndef WIFI_SSID
+#error "WIFI_SSID must be defined in config.h"
+#endif
+
+#ifndef WIFI_PASS
+#error "WIFI_PASS must be defined in config.h"
+#endif
+
+#ifndef WIFI_STARTUP_MAX_RETRY
+#define WIFI_STARTUP_MAX_RETRY 5
+#endif
+
+// Reconnect backoff: base * 2^attempt, capped, with "equal jitter" so a
+// fleet knocked off by the same AP reboot does not reassociate in lockstep.
+#ifndef WIFI_BACKOFF_BASE_MS
+#define WIFI_BACKOFF_BASE_MS 500
+#endif
+#ifndef WIFI_BACKOFF_MAX_MS
+#define WIFI_BACKOFF_MAX_MS (60 * 1000)
+#endif
+
+#if defined(CELLAR_STATIC_IP) && !defined(CELLAR_STATIC_GATEWAY)
+#error "CELLAR_STATIC_GATEWAY must be defined with CELLAR_STATIC_IP"
+#endif
+#ifndef CELLAR_STATIC_NETMASK
+#define CELLAR_STATIC_NETMASK "255.255.255.0"
+#endif
+
+// Modem sleep between beacons. MAX_MODEM wakes every CELLAR_WIFI_LISTEN_INTERVAL
+// beacons instead of every DTIM; the AP buffers frames meanwhile.
+#ifndef CELLAR_WIFI_PS_MODE
+#define CELLAR_WIFI_PS_MODE WIFI_PS_MAX_MODEM
+#endif
+#ifndef CELLAR_WIFI_LISTEN_INTERVAL
+#define CELLAR_WIFI_LISTEN_INTERVAL 3
+#endif
+
+#define WIFI_CONNECTED_BIT BIT0
+#define WIFI_FAIL_BIT BIT1
+#define AP_CACHE_VERSION 1
+
+static const char *TAG = "cellar_wifi";
+static const char *NVS_NAMESPACE = "wifi";
+static const char *KEY_AP = "ap";
+
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint32_t ssid_hash;  // invalidates the cache when WIFI_SSID changes
+} wifi_ap_cache_t;
+
+static EventGroupHandle_t s_wifi_event_group;
+static esp_netif_t *s_netif = NULL;
+static esp_timer_handle_t s_retry_timer = NULL;
+static wifi_ap_cache_t s_cache = {0};
+static bool s_using_cache = false;
+static bool s_attempt_got_ip = false;  // the current association reached GOT_IP
+static bool s_ever_connected = false;
+static int s_retry_num = 0;
+static int64_t s_connect_started_us = 0;
+static bool s_connecting = false;
+static char s_ip_str[16] = "0.0.0.0";
+
+static uint32_t ssid_hash(void) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char *p = WIFI_SSID; *p; ++p) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return hash;
+}
+
+static bool load_ap_cache(void) {
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return false;
+    size_t len = sizeof(s_cache);
+    esp_err_t err = nvs_get_blob(nvs, KEY_AP, &s_cache, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(s_cache) && s_cache.version == AP_CACHE_VERSION &&
+           s_cache.ssid_hash == ssid_hash() && s_cache.channel != 0;
+}
+
+static void save_ap_cache(const wifi_ap_cache_t *cache) {
+    // Only write when the AP changed, to spare the flash.
+    if (memcmp(cache, &s_cache, sizeof(*cache)) == 0) return;
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) return;
+    if (nvs_set_blob(nvs, KEY_AP, cache, sizeof(*cache)) == ESP_OK) {
+        nvs_commit(nvs);
+        s_cache = *cache;
+    }
+    nvs_close(nvs);
+}
+
+static void erase_ap_cache(void) {
+    memset(&s_cache, 0, sizeof(s_cache));
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) return;
+    nvs_erase_key(nvs, KEY_AP);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+static void apply_sta_config(bool use_cache) {
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .password = WIFI_PASS,
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .scan_method = WIFI_ALL_CHANNEL_SCAN,
+            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
+            .listen_interval = CELLAR_WIFI_LISTEN_INTERVAL,
+        },
+    };
+    if (use_cache) {
+        // Associate straight to the known AP: no scan across 13 channels.
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        wifi_config.sta.channel = s_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    }
+    s_using_cache = use_cache;
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+}
+
+static void connect_now(void) {
+    s_connect_started_us = esp_timer_get_time();
+    s_connecting = true;
+    s_attempt_got_ip = false;
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(err));
+    }
+}
+
+// Charge each association attempt, good or bad, to the radio budget.
+static void record_assoc_time(void) {
+    if (!s_connecting) return;
+    s_connecting = false;
+    cellar_power_record(CELLAR_ACTIVITY_WIFI_ASSOC, esp_timer_get_time() - s_connect_started_us);
+}
+
+static void retry_timer_cb(void *arg) {
+    connect_now();
+}
+
+static uint32_t backoff_ms(int attempt) {
+    int shift = attempt < 8 ? attempt : 8;
+    uint32_t delay = (uint32_t)WIFI_BACKOFF_BASE_MS << shift;
+    if (delay > WIFI_BACKOFF_MAX_MS) delay = WIFI_BACKOFF_MAX_MS;
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+#ifdef CELLAR_STATIC_IP
+static void apply_static_ip(void) {
+    esp_netif_ip_info_t ip_info = {0};
+    esp_netif_str_to_ip4(CELLAR_STATIC_IP, &ip_info.ip);
+    esp_netif_str_to_ip4(CELLAR_STATIC_GATEWAY, &ip_info.gw);
+    esp_netif_str_to_ip4(CELLAR_STATIC_NETMASK, &ip_info.netmask);
+    esp_netif_dhcpc_stop(s_netif);
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(s_netif, &ip_info));
+
+    esp_netif_dns_info_t dns = {0};
+#ifdef CELLAR_STATIC_DNS
+    esp_netif_str_to_ip4(CELLAR_STATIC_DNS, &dns.ip.u_addr.ip4);
+#else
+    dns.ip.u_addr.ip4.addr = ip_info.gw.addr;
+#endif
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    esp_netif_set_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns);
+    ESP_LOGI(TAG, "Using static IP %s", CELLAR_STATIC_IP);
+}
+#endif
+
+static void wifi_event_handler(void *arg,
+                               esp_event_base_t event_base,
+                               int32_t event_id,
+                               void *event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        connect_now();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        record_assoc_time();
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        snprintf(s_ip_str, sizeof(s_ip_str), "0.0.0.0");
+        s_retry_num++;
+
+        if (s_using_cache && !s_attempt_got_ip) {
+            // The cached AP is gone or moved channel: scan properly, right away.
+            ESP_LOGW(TAG, "Cached AP failed (reason %d); falling back to a full scan", event->reason);
+            erase_ap_cache();
+            apply_sta_config(false);
+            connect_now();
+        } else {
+            // A link that was up (e.g. beacon loss) goes back to the AP it
+            // was on; only an attempt on the cache that never got an IP
+            // condemns it.
+            if (s_attempt_got_ip && !s_using_cache && s_cache.channel != 0) {
+                apply_sta_config(true);
+            }
+            uint32_t delay = backoff_ms(s_retry_num - 1);
+            ESP_LOGW(TAG, "Wi-Fi disconnected (reason %d), reconnecting in %lums (attempt %d)",
+                     event->reason, (unsigned long)delay, s_retry_num);
+            esp_timer_stop(s_retry_timer);
+            esp_timer_start_once(s_retry_timer, (uint64_t)delay * 1000);
+        }
+        if (!s_ever_connected && s_retry_num >= WIFI_STARTUP_MAX_RETRY) {
+            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        }
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        record_assoc_time();
+        esp_ip4addr_ntoa(&event->ip_info.ip, s_ip_str, sizeof(s_ip_str));
+        ESP_LOGI(TAG, "Got IP %s in %lldms (attempt %d, %s)",
+                 s_ip_str, (long long)((esp_timer_get_time() - s_connect_started_us) / 1000),
+                 s_retry_num + 1, s_using_cache ? "cached AP" : "scanned");
+        s_retry_num = 0;
+        s_ever_connected = true;
+        s_attempt_got_ip = true;
+
+        wifi_ap_record_t ap;
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+            wifi_ap_cache_t cache = {
+                .version = AP_CACHE_VERSION,
+                .channel = ap.primary,
+                .ssid_hash = ssid_hash(),
+            };
+            memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+            save_ap_cache(&cache);
+        }
+        xEventGroupClearBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    }
+}
+
+#ifdef CONFIG_ETH_USE_OPENETH
+// QEMU emulates no Wi-Fi: under CONFIG_ETH_USE_OPENETH (qemu/ project) the
+// station is replaced by QEMU's OpenCores Ethernet on user-mode networking,
+// behind the same connected bit and IP string.
+static void eth_event_handler(void *arg,
+                              esp_event_base_t event_base,
+                              int32_t event_id,
+                              void *event_data) {
+    if (event_base == ETH_EVENT && event_id == ETHERNET_EVENT_DISCONNECTED) {
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        snprintf(s_ip_str, sizeof(s_ip_str), "0.0.0.0");
+        ESP_LOGW(TAG, "Ethernet link down");
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_ETH_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        esp_ip4addr_ntoa(&event->ip_info.ip, s_ip_str, sizeof(s_ip_str));
+        ESP_LOGI(TAG, "Got IP %s on OpenETH", s_ip_str);
+        s_ever_connected = true;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    }
+}
+
+static esp_err_t start_openeth(void) {
+    esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_ETH();
+    s_netif = esp_netif_new(&netif_config);
+#ifdef CELLAR_STATIC_IP
+    apply_static_ip();
+#endif
+
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.autonego_timeout_ms = 100;  // the emulated PHY has no link partner to wait for
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_config);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_config);
+    esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(mac, phy);
+    esp_eth_handle_t eth = NULL;
+    ESP_ERROR_CHECK(esp_eth_driver_install(&eth_config, &eth));
+    ESP_ERROR_CHECK(esp_netif_attach(s_netif, esp_eth_new_netif_glue(eth)));
+
+    ESP_ERROR_CHECK(esp_event_handler_register(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &eth_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &eth_event_handler, NULL));
+    return esp_eth_start(eth);
+}
+#endif
+
+esp_err_t cellar_wifi_start(void) {
+    s_wifi_event_group = xEventGroupCreate();
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+#ifdef CONFIG_ETH_USE_OPENETH
+    return start_openeth();
+#endif
+    s_netif = esp_netif_create_default_wifi_sta();
+#ifdef CELLAR_STATIC_IP
+    apply_static_ip();
+#endif
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_retry_timer));
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        &instance_any_id));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        &instance_got_ip));
+
+    bool have_cache = load_ap_cache();
+    if (have_cache) {
+        ESP_LOGI(TAG, "Reconnecting to cached AP %02X:%02X:%02X:%02X:%02X:%02X on channel %d",
+                 s_cache.bssid[0], s_cache.bssid[1], s_cache.bssid[2],
+                 s_cache.bssid[3], s_cache.bssid[4], s_cache.bssid[5], s_cache.channel);
+    } else {
+        memset(&s_cache, 0, sizeof(s_cache));
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    apply_sta_config(have_cache);
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_ps(CELLAR_WIFI_PS_MODE));
+    return ESP_OK;
+}
+
+esp_err_t cellar_wifi_wait_connected(TickType_t timeout) {
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
+                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+                                           pdFALSE,
+                                           pdFALSE,
+                                           timeout);
+    if (bits & WIFI_CONNECTED_BIT) return ESP_OK;
+    if (bits & WIFI_FAIL_BIT) return ESP_FAIL;
+    return ESP_ERR_TIMEOUT;
+}
+
+bool cellar_wifi_is_connected(void) {
+    return s_wifi_event_group && (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT);
+}
+
+const char *cellar_wifi_ip(void) {
+    return s_ip_str;
+}
+
+bool cellar_wifi_rssi(int *out_dbm) {
+#ifdef CONFIG_ETH_USE_OPENETH
+    return false;
+#else
+    wifi_ap_record_t ap;
+    if (!cellar_wifi_is_connected() || esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return false;
+    *out_dbm = ap.rssi;
+    return true;
+#endif
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Bring up the station interface and start connecting in the background.
+// The last good BSSID/channel (NVS) lets reconnects skip the scan; reconnects
+// after a drop use jittered exponential backoff. Requires nvs_flash_init.
+esp_err_t cellar_wifi_start(void);
+
+// Wait for an IP. Returns ESP_OK once connected, ESP_FAIL if the first
+// connection failed WIFI_STARTUP_MAX_RETRY times, or ESP_ERR_TIMEOUT.
+// Reconnect attempts continue in the background after ESP_FAIL.
+esp_err_t cellar_wifi_wait_connected(TickType_t timeout);
+
+bool cellar_wifi_is_connected(void);
+
+// Current IPv4 address as text ("0.0.0.0" while disconnected).
+const char *cellar_wifi_ip(void);
+
+// Signal strength of the current AP. Returns false while disconnected.
+bool cellar_wifi_rssi(int *out_dbm);
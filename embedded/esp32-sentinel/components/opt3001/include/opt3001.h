@@ -9,12 +9,22 @@ extern "C" {
 
 #define OPT3001_I2C_ADDR_DEFAULT 0x44
 
+// Time from configuration to the first valid result (800 ms integration + margin)
+#define OPT3001_FIRST_CONVERSION_MS 1000
+
+// Per-transfer timeout. A register access takes well under a millisecond; a
+// hung bus or a part stretching SCL fails the read instead of blocking.
+#define OPT3001_I2C_TIMEOUT_MS 50
+
 typedef struct {
     i2c_master_dev_handle_t i2c_dev;
 } opt3001_handle_t;
 
 /**
  * @brief Initialize OPT3001 sensor
+ *
+ * Does not wait for the first conversion; callers must allow
+ * OPT3001_FIRST_CONVERSION_MS before the first read.
  * 
  * @param bus_handle Handle to the I2C master bus
  * @param address I2C address (usually 0x44)
@@ -32,6 +42,14 @@ esp_err_t opt3001_init(i2c_master_bus_handle_t bus_handle, uint8_t address, opt3
  */
 esp_err_t opt3001_read_lux(opt3001_handle_t *handle, float *lux);
 
+/**
+ * @brief Convert a result register value to lux
+ *
+ * @param raw Result register: 4-bit exponent, 12-bit mantissa
+ * @return float Illuminance in lux
+ */
+float opt3001_raw_to_lux(uint16_t raw);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,8 +1,6 @@
 #include "opt3001.h"
 #include "esp_log.h"
 #include <math.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 
 static const char *TAG = "opt3001";
 
@@ -20,13 +18,13 @@ static esp_err_t write_register(opt3001_handle_t *handle, uint8_t reg, uint16_t
     data[0] = reg;
     data[1] = (value >> 8) & 0xFF; // MSB
     data[2] = value & 0xFF;        // LSB
-    return i2c_master_transmit(handle->i2c_dev, data, 3, -1);
+    return i2c_master_transmit(handle->i2c_dev, data, 3, OPT3001_I2C_TIMEOUT_MS);
 }
 
 static esp_err_t read_register(opt3001_handle_t *handle, uint8_t reg, uint16_t *value) {
     uint8_t tx = reg;
     uint8_t rx[2];
-    esp_err_t err = i2c_master_transmit_receive(handle->i2c_dev, &tx, 1, rx, 2, -1);
+    esp_err_t err = i2c_master_transmit_receive(handle->i2c_dev, &tx, 1, rx, 2, OPT3001_I2C_TIMEOUT_MS);
     if (err == ESP_OK) {
         *value = (rx[0] << 8) | rx[1];
     }
@@ -76,22 +74,23 @@ esp_err_t opt3001_init(i2c_master_bus_handle_t bus_handle, uint8_t address, opt3
         ESP_LOGE(TAG, "Failed to configure OPT3001");
         return err;
     }
-    
-    // Give the sensor time to complete its first conversion (800ms config)
-    vTaskDelay(pdMS_TO_TICKS(1000));
 
     ESP_LOGI(TAG, "OPT3001 initialized at 0x%02X", address);
     return ESP_OK;
 }
 
+float opt3001_raw_to_lux(uint16_t raw) {
+    uint16_t exponent = (raw >> 12) & 0x0F;
+    uint16_t mantissa = raw & 0x0FFF;
+
+    return 0.01f * powf(2, exponent) * mantissa;
+}
+
 esp_err_t opt3001_read_lux(opt3001_handle_t *handle, float *lux) {
     uint16_t raw;
     esp_err_t err = read_register(handle, OPT3001_REG_RESULT, &raw);
     if (err != ESP_OK) return err;
 
-    uint16_t exponent = (raw >> 12) & 0x0F;
-    uint16_t mantissa = raw & 0x0FFF;
-
-    *lux = 0.01f * powf(2, exponent) * mantissa;
+    *lux = opt3001_raw_to_lux(raw);
     return ESP_OK;
 }
@@ -9,6 +9,9 @@ extern "C" {
 
 #define VEML7700_I2C_ADDR_DEFAULT 0x10
 
+// Register access timeout, so a wedged bus cannot block the caller for good.
+#define VEML7700_I2C_TIMEOUT_MS 50
+
 typedef struct {
     i2c_master_dev_handle_t i2c_dev;
     float resolution; // Lux per bit, depends on gain/integration time
@@ -33,6 +36,15 @@ esp_err_t veml7700_init(i2c_master_bus_handle_t bus_handle, uint8_t address, vem
  */
 esp_err_t veml7700_read_lux(veml7700_handle_t *handle, float *lux);
 
+/**
+ * @brief Convert an ALS count to lux at the handle's gain and integration time
+ *
+ * @param handle Sensor handle
+ * @param raw ALS register value
+ * @return float Illuminance in lux
+ */
+float veml7700_raw_to_lux(const veml7700_handle_t *handle, uint16_t raw);
+
 #ifdef __cplusplus
 }
 #endif
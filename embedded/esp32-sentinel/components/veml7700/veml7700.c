@@ -19,13 +19,13 @@ static esp_err_t write_register(veml7700_handle_t *handle, uint8_t reg, uint16_t
     data[0] = reg;
     data[1] = value & 0xFF;        // LSB
     data[2] = (value >> 8) & 0xFF; // MSB
-    return i2c_master_transmit(handle->i2c_dev, data, 3, -1);
+    return i2c_master_transmit(handle->i2c_dev, data, 3, VEML7700_I2C_TIMEOUT_MS);
 }
 
 static esp_err_t read_register(veml7700_handle_t *handle, uint8_t reg, uint16_t *value) {
     uint8_t tx = reg;
     uint8_t rx[2];
-    esp_err_t err = i2c_master_transmit_receive(handle->i2c_dev, &tx, 1, rx, 2, -1);
+    esp_err_t err = i2c_master_transmit_receive(handle->i2c_dev, &tx, 1, rx, 2, VEML7700_I2C_TIMEOUT_MS);
     if (err == ESP_OK) {
         *value = rx[0] | (rx[1] << 8); // LSB first
     }
@@ -60,12 +60,16 @@ esp_err_t veml7700_init(i2c_master_bus_handle_t bus_handle, uint8_t address, vem
     return ESP_OK;
 }
 
+float veml7700_raw_to_lux(const veml7700_handle_t *handle, uint16_t raw) {
+    return (float)raw * handle->resolution;
+}
+
 esp_err_t veml7700_read_lux(veml7700_handle_t *handle, float *lux) {
     uint16_t raw;
     esp_err_t err = read_register(handle, VEML7700_REG_ALS, &raw);
     if (err != ESP_OK) return err;
 
-    *lux = (float)raw * handle->resolution;
+    *lux = veml7700_raw_to_lux(handle, raw);
     
     // Simple overflow check (if raw is max 16-bit)
     if (raw == 0xFFFF) {
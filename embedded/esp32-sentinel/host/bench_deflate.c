@@ -0,0 +1,119 @@
+// Compression ratio and CPU cost of cellar_gzip_compress on telemetry bodies
+// shaped like the sentinel's batched uploads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cellar_deflate.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define BODY_MAX 32768
+
+static const char *const s_rom_ids[] = {
+    "3C01F0956A28", "3C01F09571AB", "3C01F0953D4C", "3C01F0960F12",
+};
+
+static unsigned s_rng = 12345;
+
+static float jitter(float base, float spread) {
+    s_rng = s_rng * 1103515245u + 12345u;
+    return base + spread * ((float)((s_rng >> 16) & 0x7FFF) / 32767.0f - 0.5f);
+}
+
+// Same field order and precision as cellar_http.
+static size_t build_body(char *buf, size_t cap, int readings) {
+    int n = snprintf(buf, cap, "{\"device_id\":\"esp32-sentinel-a1b2c3\"");
+    if (readings > 1) n += snprintf(buf + n, cap - n, ",\"readings\":[");
+    for (int r = 0; r < readings; ++r) {
+        n += snprintf(buf + n, cap - n, "%s", readings > 1 ? (r > 0 ? ",{" : "{") : ",");
+        n += snprintf(buf + n, cap - n, "\"measured_at\":%lld,\"temperatures\":{",
+                      1760000000000LL + (long long)r * 30000);
+        for (size_t t = 0; t < sizeof(s_rom_ids) / sizeof(s_rom_ids[0]); ++t) {
+            n += snprintf(buf + n, cap - n, "%s\"%s\":%.2f", t > 0 ? "," : "",
+                          s_rom_ids[t], jitter(12.5f, 0.4f));
+        }
+        n += snprintf(buf + n, cap - n, ",\"bme280\":%.2f}", jitter(12.8f, 0.3f));
+        n += snprintf(buf + n, cap - n, ",\"pressure_hpa\":%.2f,\"humidity_pct\":%.1f,\"illuminance_lux\":%.1f",
+                      jitter(1013.2f, 1.0f), jitter(68.0f, 2.0f), jitter(3.0f, 2.0f));
+        if (readings > 1) n += snprintf(buf + n, cap - n, "}");
+    }
+    if (readings > 1) n += snprintf(buf + n, cap - n, "]");
+    n += snprintf(buf + n, cap - n, ",\"health\":{\"uptime_s\":86400,\"queued\":%d,\"dropped\":0}}", readings);
+    return (size_t)n;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+#ifdef HAVE_ZLIB
+static int verify(const uint8_t *gz, size_t gz_len, const char *orig, size_t orig_len) {
+    static uint8_t plain[BODY_MAX];
+    z_stream zs = {0};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) return 0;
+    zs.next_in = (Bytef *)gz;
+    zs.avail_in = (uInt)gz_len;
+    zs.next_out = plain;
+    zs.avail_out = sizeof(plain);
+    int rc = inflate(&zs, Z_FINISH);
+    size_t out = zs.total_out;
+    inflateEnd(&zs);
+    return rc == Z_STREAM_END && out == orig_len && memcmp(plain, orig, orig_len) == 0;
+}
+
+static size_t zlib_size(const char *body, size_t len, int level) {
+    static uint8_t out[BODY_MAX + 64];
+    z_stream zs = {0};
+    if (deflateInit2(&zs, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+    zs.next_in = (Bytef *)body;
+    zs.avail_in = (uInt)len;
+    zs.next_out = out;
+    zs.avail_out = sizeof(out);
+    deflate(&zs, Z_FINISH);
+    size_t n = zs.total_out;
+    deflateEnd(&zs);
+    return n;
+}
+#endif
+
+int main(void) {
+    static char body[BODY_MAX];
+    static uint8_t gz[CELLAR_GZIP_BOUND(BODY_MAX)];
+    const int batches[] = {1, 5, 10, 30, 60};
+    int failures = 0;
+
+    printf("window=%u hash=%u stack=%u B\n", 1u << CELLAR_DEFLATE_WINDOW_BITS,
+           1u << CELLAR_DEFLATE_HASH_BITS, (unsigned)(2u << CELLAR_DEFLATE_HASH_BITS));
+    printf("%8s %8s %8s %7s %10s %9s", "readings", "json_B", "gzip_B", "ratio", "us/body", "MB/s");
+#ifdef HAVE_ZLIB
+    printf(" %9s %9s %6s", "zlib1_B", "zlib6_B", "check");
+#endif
+    printf("\n");
+
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); ++b) {
+        size_t len = build_body(body, sizeof(body), batches[b]);
+        size_t gz_len = 0;
+        int iters = (int)(4000000 / len) + 10;
+        double start = now_us();
+        for (int i = 0; i < iters; ++i) {
+            gz_len = cellar_gzip_compress((const uint8_t *)body, len, gz, sizeof(gz));
+        }
+        double per_us = (now_us() - start) / iters;
+        printf("%8d %8zu %8zu %6.2fx %10.1f %9.1f", batches[b], len, gz_len,
+               gz_len ? (double)len / gz_len : 0.0, per_us, len / per_us);
+#ifdef HAVE_ZLIB
+        int ok = verify(gz, gz_len, body, len);
+        failures += !ok;
+        printf(" %9zu %9zu %6s", zlib_size(body, len, 1), zlib_size(body, len, 6), ok ? "ok" : "FAIL");
+#endif
+        printf("\n");
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,483 @@
+// Time and allocations per call of the firmware's hot paths, built from the
+// same sources as sentinel_sim (static functions via bench_hooks/).
+//
+//   ./build-host/bench_firmware                 table on stdout
+//   ./build-host/bench_firmware --json > a.json one JSON document, for
+//                                               tools/bench_compare.py
+//   ./build-host/bench_firmware -f http -t 0.5  only names containing "http",
+//                                               0.5 s per repetition
+//
+// Each benchmark is calibrated to run at least -t seconds, then repeated -r
+// times; ns/op is the fastest repetition (the least disturbed), and the
+// median is reported alongside. Allocations are counted by interposing
+// malloc/calloc/realloc (glibc only; -1 elsewhere).
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench_hooks.h"
+#include "cellar_binlog.h"
+#include "opt3001.h"
+#include "sim.h"
+#include "veml7700.h"
+
+#define DEFAULT_MIN_TIME_S 0.2
+#define DEFAULT_REPS 5
+#define MAX_REPS 31
+#define RAW_TABLE_LEN 256
+#define BATCH_READINGS 10
+
+// --- allocation counting ---------------------------------------------------
+
+#if defined(__GLIBC__)
+#define HAVE_ALLOC_COUNT 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static __thread bool t_counting;
+static __thread uint64_t t_allocs;
+static __thread uint64_t t_alloc_bytes;
+
+void *malloc(size_t size) {
+    if (t_counting) {
+        t_allocs++;
+        t_alloc_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    if (t_counting) {
+        t_allocs++;
+        t_alloc_bytes += n * size;
+    }
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (t_counting) {
+        t_allocs++;
+        t_alloc_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+static void alloc_count_start(void) {
+    t_allocs = 0;
+    t_alloc_bytes = 0;
+    t_counting = true;
+}
+
+static void alloc_count_stop(uint64_t *allocs, uint64_t *bytes) {
+    t_counting = false;
+    *allocs = t_allocs;
+    *bytes = t_alloc_bytes;
+}
+#else
+#define HAVE_ALLOC_COUNT 0
+static void alloc_count_start(void) {
+}
+
+static void alloc_count_stop(uint64_t *allocs, uint64_t *bytes) {
+    *allocs = 0;
+    *bytes = 0;
+}
+#endif
+
+// --- fixtures ----------------------------------------------------------------
+
+static volatile float s_sink_f;
+static volatile int s_sink_i;
+
+static cellar_sample_t s_sample2;
+static cellar_sample_t s_sample6;
+static cellar_measurement_t s_batch[BATCH_READINGS];
+static char s_batch_temps[BATCH_READINGS][256];
+static char s_token_response[1024];
+static cellar_display_status_t s_display;
+static cellar_display_status_t s_display_alarm;
+static uint16_t s_opt3001_raw[RAW_TABLE_LEN];
+static uint16_t s_veml7700_raw[RAW_TABLE_LEN];
+static veml7700_handle_t s_veml7700 = {.resolution = 0.0576f};
+
+static const char HEALTH_JSON[] =
+    "{\"fw\":\"1.4.2\",\"uptime_s\":86400,\"queued\":0,\"dropped\":0,\"cycle_ms\":30000,"
+    "\"radio_ms\":412,\"tls_ms\":0,\"sensors_ms\":96,\"sleep_ms\":29310,\"charge_uah\":512.40,"
+    "\"avg_ma\":61.488}";
+
+static unsigned s_rng = 12345;
+
+static unsigned rng(void) {
+    s_rng = s_rng * 1103515245u + 12345u;
+    return s_rng >> 8;
+}
+
+static void fill_sample(cellar_sample_t *sample, int probes) {
+    memset(sample, 0, sizeof(*sample));
+    for (int i = 0; i < probes - 1; ++i) {
+        snprintf(sample->temps[i].id, sizeof(sample->temps[i].id), "28%02X%06X%06X", i, rng() & 0xFFFFFF,
+                 rng() & 0xFFFFFF);
+        sample->temps[i].value_c = 12.5f + 0.0625f * (float)(rng() % 16);
+    }
+    snprintf(sample->temps[probes - 1].id, sizeof(sample->temps[probes - 1].id), "bme280");
+    sample->temps[probes - 1].value_c = 12.81f;
+    sample->temp_count = probes;
+    sample->pressure_hpa = 985.43f;
+    sample->humidity_pct = 67.4f;
+    sample->opt3001_lux = 0.41f;
+    sample->veml7700_lux = 0.29f;
+    sample->mono_ms = 86400000;
+}
+
+static void setup_fixtures(void) {
+    fill_sample(&s_sample2, 2);
+    fill_sample(&s_sample6, CELLAR_SAMPLE_MAX_TEMPS);
+
+    for (int i = 0; i < BATCH_READINGS; ++i) {
+        cellar_sample_t sample;
+        fill_sample(&sample, 3);
+        sample.mono_ms += i * 30000;
+        bench_sample_to_measurement(&sample, s_batch_temps[i], sizeof(s_batch_temps[i]), &s_batch[i]);
+        s_batch[i].measured_at_ms = 1760000000000LL + i * 30000;
+    }
+    s_batch[BATCH_READINGS - 1].health_json = HEALTH_JSON;
+
+    // A /device-token response: a ~500 character JWT, then the rest.
+    char jwt[560];
+    size_t n = (size_t)snprintf(jwt, sizeof(jwt), "eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.");
+    while (n < 500) jwt[n++] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"[rng() % 64];
+    jwt[n] = '\0';
+    snprintf(s_token_response, sizeof(s_token_response),
+             "{\"device_id\":\"esp32-sentinel-a1b2c3\",\"access_token\":\"%s\","
+             "\"access_expires_at\":\"2026-10-18T12:15:00Z\","
+             "\"refresh_token\":\"Qm9vdHN0cmFwLXJlZnJlc2gtdG9rZW4tZm9yLWJlbmNo\"}",
+             jwt);
+
+    s_display = (cellar_display_status_t){
+        .temps = {12.75f, 12.56f, 12.81f},
+        .temp_labels = {"Rack top", "Rack bottom", "Air"},
+        .temp_count = 3,
+        .lux_primary = 0.4f,
+        .lux_secondary = 0.3f,
+        .pressure_hpa = 1016.2f,
+        .humidity_pct = 67.4f,
+        .http_status = 201,
+        .post_err = ESP_OK,
+        .ip_address = "192.168.1.42",
+    };
+    s_display_alarm = s_display;
+    snprintf(s_display_alarm.alarm_line, sizeof(s_display_alarm.alarm_line), "TEMP HIGH 18.2C");
+
+    // Dark cellar most of the time, lights now and then.
+    for (int i = 0; i < RAW_TABLE_LEN; ++i) {
+        bool lit = rng() % 8 == 0;
+        s_opt3001_raw[i] = lit ? (uint16_t)(0x6000 | (0x460 + rng() % 64)) : (uint16_t)(rng() % 64);
+        s_veml7700_raw[i] = lit ? (uint16_t)(3100 + rng() % 200) : (uint16_t)(rng() % 8);
+    }
+}
+
+// --- benchmarks ----------------------------------------------------------------
+
+static void run_pressure_to_sea_level(uint64_t iters) {
+    float acc = 0.0f;
+    for (uint64_t i = 0; i < iters; ++i) {
+        acc += bench_pressure_to_sea_level(980.0f + (float)(i & 63) * 0.5f, 250.0f);
+    }
+    s_sink_f = acc;
+}
+
+static void run_opt3001_raw_to_lux(uint64_t iters) {
+    float acc = 0.0f;
+    for (uint64_t i = 0; i < iters; ++i) {
+        acc += opt3001_raw_to_lux(s_opt3001_raw[i % RAW_TABLE_LEN]);
+    }
+    s_sink_f = acc;
+}
+
+static void run_veml7700_raw_to_lux(uint64_t iters) {
+    float acc = 0.0f;
+    for (uint64_t i = 0; i < iters; ++i) {
+        acc += veml7700_raw_to_lux(&s_veml7700, s_veml7700_raw[i % RAW_TABLE_LEN]);
+    }
+    s_sink_f = acc;
+}
+
+static void run_temps_json(const cellar_sample_t *sample, uint64_t iters) {
+    char temps_json[256];
+    cellar_measurement_t m;
+    for (uint64_t i = 0; i < iters; ++i) {
+        bench_sample_to_measurement(sample, temps_json, sizeof(temps_json), &m);
+    }
+    s_sink_i = temps_json[1];
+}
+
+static void run_temps_json_2(uint64_t iters) {
+    run_temps_json(&s_sample2, iters);
+}
+
+static void run_temps_json_6(uint64_t iters) {
+    run_temps_json(&s_sample6, iters);
+}
+
+static void run_http_body(size_t count, uint64_t iters) {
+    int len = 0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        len += bench_http_encode_batch(&s_batch[BATCH_READINGS - count], count, NULL);
+    }
+    s_sink_i = len;
+}
+
+static void run_http_body_1(uint64_t iters) {
+    run_http_body(1, iters);
+}
+
+static void run_http_body_10(uint64_t iters) {
+    run_http_body(BATCH_READINGS, iters);
+}
+
+static void run_json_get_string(const char *key, uint64_t iters) {
+    char out[600];
+    int found = 0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        found += bench_json_get_string(s_token_response, key, out, sizeof(out));
+    }
+    s_sink_i = found + out[0];
+}
+
+static void run_json_access_token(uint64_t iters) {
+    run_json_get_string("access_token", iters);
+}
+
+static void run_json_refresh_token(uint64_t iters) {
+    run_json_get_string("refresh_token", iters);
+}
+
+static void run_json_missing(uint64_t iters) {
+    run_json_get_string("status", iters);
+}
+
+static void run_render(const cellar_display_status_t *status, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; ++i) {
+        bench_render_status_page(status, (int)(i % 6), i & 1);
+    }
+    size_t len;
+    s_sink_i = bench_framebuffer(&len)[len / 2];
+}
+
+static void run_render_status_page(uint64_t iters) {
+    run_render(&s_display, iters);
+}
+
+static void run_render_status_page_alarm(uint64_t iters) {
+    run_render(&s_display_alarm, iters);
+}
+
+static void run_draw_char_scaled(int scale, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; ++i) {
+        bench_draw_char_scaled((int)(i % 8) * 6 * scale, 0, (char)('0' + i % 10), scale, false);
+    }
+    size_t len;
+    s_sink_i = bench_framebuffer(&len)[0];
+}
+
+static void run_draw_char_scaled_1(uint64_t iters) {
+    run_draw_char_scaled(1, iters);
+}
+
+static void run_draw_char_scaled_2(uint64_t iters) {
+    run_draw_char_scaled(2, iters);
+}
+
+// The sampler's BME280 line: what a deferred write costs the caller (plus
+// the pop that frees the slot), what the drain task spends formatting it,
+// and the snprintf ESP_LOGI does before the UART write it no longer waits on.
+#define BENCH_LOG_FMT "BME280: T=%.2fC P=%.2fhPa H=%.1f%%"
+
+static void run_log_binlog_write(uint64_t iters) {
+    cellar_binlog_record_t record;
+    int popped = 0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        cellar_binlog_write(ESP_LOG_INFO, "sensor_bme280", BENCH_LOG_FMT, 13.4 + (double)(i & 7), 1016.52,
+                            63.4);
+        popped += cellar_binlog_pop(&record);
+    }
+    s_sink_i = popped;
+}
+
+static void run_log_binlog_format(uint64_t iters) {
+    cellar_binlog_record_t record;
+    cellar_binlog_write(ESP_LOG_INFO, "sensor_bme280", BENCH_LOG_FMT, 13.4, 1016.52, 63.4);
+    cellar_binlog_pop(&record);
+    char line[128];
+    int len = 0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        len += cellar_binlog_format(&record, line, sizeof(line));
+    }
+    s_sink_i = len;
+}
+
+static void run_log_snprintf(uint64_t iters) {
+    char line[128];
+    int len = 0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        len += snprintf(line, sizeof(line), BENCH_LOG_FMT, 13.4 + (double)(i & 7), 1016.52, 63.4);
+    }
+    s_sink_i = len;
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(uint64_t iters);
+} bench_t;
+
+static const bench_t BENCHES[] = {
+    {"pressure_to_sea_level", run_pressure_to_sea_level},
+    {"opt3001_raw_to_lux", run_opt3001_raw_to_lux},
+    {"veml7700_raw_to_lux", run_veml7700_raw_to_lux},
+    {"temps_json/2_probes", run_temps_json_2},
+    {"temps_json/6_probes", run_temps_json_6},
+    {"http_body/1_reading", run_http_body_1},
+    {"http_body/10_readings_gzip", run_http_body_10},
+    {"json_get_string/access_token", run_json_access_token},
+    {"json_get_string/refresh_token", run_json_refresh_token},
+    {"json_get_string/missing", run_json_missing},
+    {"render_status_page", run_render_status_page},
+    {"render_status_page/alarm", run_render_status_page_alarm},
+    {"draw_char_scaled/x1", run_draw_char_scaled_1},
+    {"draw_char_scaled/x2", run_draw_char_scaled_2},
+    {"log/binlog_write", run_log_binlog_write},
+    {"log/binlog_format", run_log_binlog_format},
+    {"log/snprintf", run_log_snprintf},
+};
+
+// --- harness ---------------------------------------------------------------------
+
+typedef struct {
+    uint64_t iterations;
+    double ns_per_op;
+    double ns_per_op_median;
+    double allocs_per_op;
+    double bytes_per_op;
+} result_t;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_run(const bench_t *bench, uint64_t iters) {
+    double start = now_ns();
+    bench->run(iters);
+    return now_ns() - start;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static result_t measure(const bench_t *bench, double min_time_s, int reps) {
+    // Grow the count until one run takes a tenth of the budget, then scale.
+    uint64_t iters = 1;
+    double elapsed = time_run(bench, iters);
+    while (elapsed < min_time_s * 1e8 && iters < (1ULL << 40)) {
+        iters *= 10;
+        elapsed = time_run(bench, iters);
+    }
+    iters = (uint64_t)ceil(iters * (min_time_s * 1e9 / (elapsed > 0 ? elapsed : 1)));
+    if (iters == 0) iters = 1;
+
+    double per_op[MAX_REPS];
+    for (int r = 0; r < reps; ++r) {
+        per_op[r] = time_run(bench, iters) / iters;
+    }
+    qsort(per_op, reps, sizeof(per_op[0]), compare_double);
+
+    uint64_t allocs;
+    uint64_t bytes;
+    alloc_count_start();
+    bench->run(iters);
+    alloc_count_stop(&allocs, &bytes);
+
+    return (result_t){
+        .iterations = iters,
+        .ns_per_op = per_op[0],
+        .ns_per_op_median = per_op[reps / 2],
+        .allocs_per_op = HAVE_ALLOC_COUNT ? (double)allocs / iters : -1.0,
+        .bytes_per_op = HAVE_ALLOC_COUNT ? (double)bytes / iters : -1.0,
+    };
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--json] [-f SUBSTRING] [-t MIN_SECONDS] [-r REPS] [-l]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    bool list = false;
+    const char *filter = NULL;
+    double min_time_s = DEFAULT_MIN_TIME_S;
+    int reps = DEFAULT_REPS;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            list = true;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            min_time_s = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    if (min_time_s <= 0) min_time_s = DEFAULT_MIN_TIME_S;
+
+    setenv("SIM_LOG", "none", 0);
+    setenv("SIM_SEED", "1", 0);
+    sim_system_init(argv);
+    setup_fixtures();
+
+    if (json) {
+        printf("{\"suite\":\"bench_firmware\",\"min_time_s\":%g,\"reps\":%d,\"alloc_counting\":%s,\"results\":[",
+               min_time_s, reps, HAVE_ALLOC_COUNT ? "true" : "false");
+    } else if (!list) {
+        printf("%-32s %12s %10s %10s %9s %9s\n", "benchmark", "iterations", "ns/op", "median", "B/op",
+               "allocs/op");
+    }
+    bool first = true;
+    for (size_t b = 0; b < sizeof(BENCHES) / sizeof(BENCHES[0]); ++b) {
+        const bench_t *bench = &BENCHES[b];
+        if (filter && !strstr(bench->name, filter)) continue;
+        if (list) {
+            printf("%s\n", bench->name);
+            continue;
+        }
+        result_t r = measure(bench, min_time_s, reps);
+        if (json) {
+            printf("%s\n {\"name\":\"%s\",\"iterations\":%" PRIu64
+                   ",\"ns_per_op\":%.3f,\"ns_per_op_median\":%.3f,\"bytes_per_op\":%.1f,\"allocs_per_op\":%.3f}",
+                   first ? "" : ",", bench->name, r.iterations, r.ns_per_op, r.ns_per_op_median, r.bytes_per_op,
+                   r.allocs_per_op);
+        } else {
+            printf("%-32s %12" PRIu64 " %10.1f %10.1f %9.1f %9.2f\n", bench->name, r.iterations, r.ns_per_op,
+                   r.ns_per_op_median, r.bytes_per_op, r.allocs_per_op);
+        }
+        first = false;
+    }
+    if (json) printf("\n]}\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+// Entry points into firmware functions that are static in their own files.
+// Each hook_*.c includes one firmware source and wraps what bench_firmware
+// measures, so the code under test is the code that ships.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cellar_display.h"
+#include "cellar_http.h"
+#include "cellar_sensors.h"
+#include "esp_err.h"
+
+// main/main.c
+float bench_pressure_to_sea_level(float station_hpa, float altitude_m);
+void bench_sample_to_measurement(const cellar_sample_t *sample, char *temps_json, size_t temps_len,
+                                 cellar_measurement_t *out);
+
+// components/cellar_http/cellar_http.c: the body cellar_http_post_batch
+// sends, gzipped past CELLAR_HTTP_GZIP_MIN_BYTES. Returns its length, or -1.
+int bench_http_encode_batch(const cellar_measurement_t *measurements, size_t count, bool *gzipped);
+
+// components/cellar_http/cellar_auth.c
+bool bench_json_get_string(const char *body, const char *key, char *out, size_t out_len);
+
+// components/cellar_display/cellar_display.c; draws into the framebuffer only.
+void bench_render_status_page(const cellar_display_status_t *status, int page, bool blink_on);
+void bench_draw_char_scaled(int x, int y, char c, int scale, bool invert);
+const uint8_t *bench_framebuffer(size_t *len);
@@ -0,0 +1,7 @@
+#include "cellar_auth.c"
+
+#include "bench_hooks.h"
+
+bool bench_json_get_string(const char *body, const char *key, char *out, size_t out_len) {
+    return json_get_string(body, key, out, out_len);
+}
@@ -0,0 +1,16 @@
+#include "cellar_display.c"
+
+#include "bench_hooks.h"
+
+void bench_render_status_page(const cellar_display_status_t *status, int page, bool blink_on) {
+    render_status_page(status, page, blink_on);
+}
+
+void bench_draw_char_scaled(int x, int y, char c, int scale, bool invert) {
+    draw_char_scaled(x, y, c, scale, invert);
+}
+
+const uint8_t *bench_framebuffer(size_t *len) {
+    *len = sizeof(s_framebuffer);
+    return s_framebuffer;
+}
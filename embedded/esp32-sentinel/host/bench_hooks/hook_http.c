@@ -0,0 +1,16 @@
+#include "cellar_http.c"
+
+#include "bench_hooks.h"
+
+int bench_http_encode_batch(const cellar_measurement_t *measurements, size_t count, bool *gzipped) {
+    char *payload = NULL;
+    uint8_t *gz = NULL;
+    const char *body = NULL;
+    size_t body_len = 0;
+    const char *encoding = NULL;
+    esp_err_t err = encode_batch(measurements, count, &payload, &gz, &body, &body_len, &encoding);
+    cellar_netbuf_give(gz);
+    cellar_netbuf_give(payload);
+    if (gzipped) *gzipped = encoding != NULL;
+    return err == ESP_OK ? (int)body_len : -1;
+}
@@ -0,0 +1,13 @@
+// The sim build's copy of main/main.c, see host/CMakeLists.txt.
+#include "main.c"
+
+#include "bench_hooks.h"
+
+float bench_pressure_to_sea_level(float station_hpa, float altitude_m) {
+    return pressure_to_sea_level(station_hpa, altitude_m);
+}
+
+void bench_sample_to_measurement(const cellar_sample_t *sample, char *temps_json, size_t temps_len,
+                                 cellar_measurement_t *out) {
+    sample_to_measurement(sample, temps_json, temps_len, out);
+}
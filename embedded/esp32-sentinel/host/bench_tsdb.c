@@ -0,0 +1,214 @@
+// Bytes per sample and encode/decode throughput of cellar_gorilla on cellar
+// traces, packed into blocks the way cellar_tsdb stores them.
+//
+//   ./build-host/bench_tsdb                    synthetic 7-day trace
+//   ./build-host/bench_tsdb -ms                same, millisecond timestamps
+//   ./build-host/bench_tsdb a.csv b.csv ...    recorded traces, one channel
+//                                              per file, "epoch_ms,value" lines
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cellar_gorilla.h"
+
+// Mirrors cellar_tsdb.c.
+#define BLOCK_SIZE 512
+#define HEADER_SIZE 48
+#define PAYLOAD_SIZE (BLOCK_SIZE - HEADER_SIZE)
+
+#define MAX_SAMPLES (1 << 20)
+#define SYNTH_DAYS 7
+#define SYNTH_INTERVAL_MS 30000
+#define TS_RESOLUTION_MS 1000  // CELLAR_TSDB_TS_RESOLUTION_MS
+
+typedef struct {
+    char name[64];
+    size_t count;
+    int64_t *ts;
+    float *values;
+} trace_t;
+
+static unsigned s_rng = 12345;
+
+static float uniform(void) {
+    s_rng = s_rng * 1103515245u + 12345u;
+    return (float)((s_rng >> 16) & 0x7FFF) / 32767.0f;
+}
+
+static float gaussian(void) {
+    float u1 = uniform() + 1e-6f;
+    float u2 = uniform();
+    return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+static float quantize(float value, float step) {
+    return roundf(value / step) * step;
+}
+
+static trace_t trace_alloc(const char *name, size_t count) {
+    trace_t t = {.count = count};
+    snprintf(t.name, sizeof(t.name), "%s", name);
+    t.ts = malloc(count * sizeof(*t.ts));
+    t.values = malloc(count * sizeof(*t.values));
+    if (!t.ts || !t.values) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return t;
+}
+
+// A cellar over a week: a small daily swing, slow drift, sensor noise, and
+// lights that are off except for a short visit most evenings. Values are
+// rounded as cellar_tsdb_append_sample rounds them, and so are timestamps
+// (pass -ms to keep the sampler's millisecond jitter). DS18B20 readings are
+// already multiples of 1/16 °C at 12-bit resolution.
+static int synth_traces(trace_t *out, int64_t ts_resolution_ms) {
+    size_t n = (size_t)SYNTH_DAYS * 86400000 / SYNTH_INTERVAL_MS;
+    const char *names[] = {"ds18b20", "bme280", "humidity_pct", "pressure_hpa", "lux"};
+    for (int c = 0; c < 5; ++c) out[c] = trace_alloc(names[c], n);
+
+    float drift = 0.0f;
+    float pressure = 1013.0f;
+    int64_t t = 1760000000000LL;
+    for (size_t i = 0; i < n; ++i) {
+        t += SYNTH_INTERVAL_MS + (int64_t)(gaussian() * 3.0f);  // scheduler jitter
+        float day = (float)(i % (86400000 / SYNTH_INTERVAL_MS)) / (86400000.0f / SYNTH_INTERVAL_MS);
+        drift += gaussian() * 0.002f;
+        float cellar_c = 12.5f + 0.3f * sinf(6.2831853f * day) + drift;
+        pressure += gaussian() * 0.03f;
+        bool lights = day > 0.79f && day < 0.80f && (i / 2880) % 3 != 0;
+
+        int64_t stored = (t + ts_resolution_ms / 2) / ts_resolution_ms * ts_resolution_ms;
+        for (int c = 0; c < 5; ++c) out[c].ts[i] = stored;
+        out[0].values[i] = quantize(cellar_c + gaussian() * 0.02f, 0.0625f);
+        out[1].values[i] = quantize(cellar_c + 0.3f + gaussian() * 0.01f, 0.01f);
+        out[2].values[i] = quantize(68.0f - 2.0f * sinf(6.2831853f * day) + gaussian() * 0.3f, 0.1f);
+        out[3].values[i] = quantize(pressure, 0.01f);
+        out[4].values[i] = lights ? quantize(180.0f + gaussian() * 2.0f, 0.1f) : 0.0f;
+    }
+    return 5;
+}
+
+static int load_trace(const char *path, trace_t *out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    *out = trace_alloc(path, MAX_SAMPLES);
+    size_t n = 0;
+    char line[128];
+    while (n < MAX_SAMPLES && fgets(line, sizeof(line), f)) {
+        long long ts;
+        float value;
+        if (sscanf(line, "%lld,%f", &ts, &value) == 2) {
+            out->ts[n] = ts;
+            out->values[n] = value;
+            n++;
+        }
+    }
+    fclose(f);
+    out->count = n;
+    return n > 0;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+typedef struct {
+    size_t blocks;
+    size_t payload_bytes;
+    uint8_t *store;     // blocks * PAYLOAD_SIZE
+    uint16_t *counts;   // samples per block
+} encoded_t;
+
+static encoded_t encode(const trace_t *t) {
+    encoded_t e = {0};
+    e.store = calloc(t->count + 1, PAYLOAD_SIZE);  // never more blocks than samples
+    e.counts = calloc(t->count + 1, sizeof(*e.counts));
+    cellar_gorilla_enc_t enc;
+    cellar_gorilla_enc_init(&enc, e.store, PAYLOAD_SIZE);
+    for (size_t i = 0; i < t->count; ++i) {
+        if (!cellar_gorilla_enc_append(&enc, t->ts[i], t->values[i])) {
+            e.counts[e.blocks] = enc.count;
+            e.payload_bytes += cellar_gorilla_enc_bytes(&enc);
+            e.blocks++;
+            cellar_gorilla_enc_init(&enc, e.store + e.blocks * PAYLOAD_SIZE, PAYLOAD_SIZE);
+            cellar_gorilla_enc_append(&enc, t->ts[i], t->values[i]);
+        }
+    }
+    if (enc.count > 0) {
+        e.counts[e.blocks] = enc.count;
+        e.payload_bytes += cellar_gorilla_enc_bytes(&enc);
+        e.blocks++;
+    }
+    return e;
+}
+
+static size_t decode_check(const trace_t *t, const encoded_t *e) {
+    size_t i = 0;
+    size_t mismatches = 0;
+    for (size_t b = 0; b < e->blocks; ++b) {
+        cellar_gorilla_dec_t dec;
+        cellar_gorilla_dec_init(&dec, e->store + b * PAYLOAD_SIZE, PAYLOAD_SIZE, e->counts[b]);
+        int64_t ts;
+        float value;
+        while (cellar_gorilla_dec_next(&dec, &ts, &value)) {
+            if (i >= t->count || ts != t->ts[i] || memcmp(&value, &t->values[i], sizeof(value)) != 0) {
+                mismatches++;
+            }
+            i++;
+        }
+    }
+    return mismatches + (i != t->count ? t->count : 0);
+}
+
+int main(int argc, char **argv) {
+    static trace_t traces[64];
+    int count = 0;
+    if (argc > 1 && strcmp(argv[1], "-ms") != 0) {
+        for (int a = 1; a < argc && count < 64; ++a) {
+            count += load_trace(argv[a], &traces[count]);
+        }
+    } else {
+        int64_t resolution = argc > 1 ? 1 : TS_RESOLUTION_MS;
+        count = synth_traces(traces, resolution);
+        printf("synthetic trace: %d days at %d s, timestamps rounded to %lld ms\n", SYNTH_DAYS,
+               SYNTH_INTERVAL_MS / 1000, (long long)resolution);
+    }
+
+    printf("%-14s %8s %6s %9s %9s %8s %9s %9s %6s\n", "channel", "samples", "blocks", "bits/smp",
+           "B/smp", "days/MiB", "enc_Ms/s", "dec_Ms/s", "check");
+    int failures = 0;
+    for (int c = 0; c < count; ++c) {
+        const trace_t *t = &traces[c];
+        double start = now_us();
+        encoded_t e = encode(t);
+        double enc_us = now_us() - start;
+
+        int iters = 5;
+        start = now_us();
+        size_t bad = 0;
+        for (int k = 0; k < iters; ++k) bad = decode_check(t, &e);
+        double dec_us = (now_us() - start) / iters;
+        failures += bad != 0;
+
+        // Flash cost counts whole blocks, headers and unused tails included.
+        double bytes_per_sample = (double)e.blocks * BLOCK_SIZE / t->count;
+        double span_days = t->count > 1 ? (t->ts[t->count - 1] - t->ts[0]) / 86400000.0 : 0.0;
+        double days_per_mib = span_days > 0 ? span_days * (1024.0 * 1024.0) / (e.blocks * BLOCK_SIZE) : 0.0;
+        printf("%-14.14s %8zu %6zu %9.2f %9.2f %8.1f %9.1f %9.1f %6s\n", t->name, t->count, e.blocks,
+               8.0 * e.payload_bytes / t->count, bytes_per_sample, days_per_mib,
+               t->count / enc_us, t->count / dec_us, bad ? "FAIL" : "ok");
+        free(e.store);
+        free(e.counts);
+    }
+    printf("raw (int64 ts + float32) = 12.00 B/smp\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
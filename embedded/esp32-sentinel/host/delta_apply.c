@@ -0,0 +1,120 @@
+// Applies a tools/mkdelta.py patch with the device's applier
+// (components/cellar_delta), inflating in the same 32 KiB-window streaming
+// steps as cellar_ota, and reports the RAM it needed.
+//
+//   ./build-host/delta_apply OLD.bin PATCH.cdp OUT.bin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "cellar_delta.h"
+
+#define NET_CHUNK 1024    // HTTP read size on the device
+#define WINDOW 32768      // TINFL_LZ_DICT_SIZE
+
+typedef struct {
+    const uint8_t *old;
+    size_t old_len;
+    FILE *out;
+    size_t max_write;
+} io_t;
+
+static int read_old(void *ctx, uint32_t offset, uint8_t *buf, size_t len) {
+    io_t *io = ctx;
+    if (offset + len > io->old_len) return -1;
+    memcpy(buf, io->old + offset, len);
+    return 0;
+}
+
+static int write_new(void *ctx, const uint8_t *buf, size_t len) {
+    io_t *io = ctx;
+    if (len > io->max_write) io->max_write = len;
+    return fwrite(buf, 1, len, io->out) == len ? 0 : -1;
+}
+
+static uint8_t *slurp(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(size > 0 ? (size_t)size : 1);
+    if (!buf || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        fclose(f);
+        free(buf);
+        return NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s OLD.bin PATCH.cdp OUT.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    size_t old_len = 0, patch_len = 0;
+    uint8_t *old = slurp(argv[1], &old_len);
+    uint8_t *patch = slurp(argv[2], &patch_len);
+    if (!old || !patch) return EXIT_FAILURE;
+
+    cellar_delta_header_t header;
+    if (!cellar_delta_parse_header(patch, patch_len, &header) || header.old_size != old_len) {
+        fprintf(stderr, "bad patch header or wrong base image\n");
+        return EXIT_FAILURE;
+    }
+    io_t io = {.old = old, .old_len = old_len, .out = fopen(argv[3], "wb")};
+    if (!io.out) {
+        perror(argv[3]);
+        return EXIT_FAILURE;
+    }
+    static cellar_delta_t delta;
+    cellar_delta_init(&delta, &header, read_old, write_new, &io);
+
+    z_stream zs = {0};
+    inflateInit2(&zs, -15);
+    static uint8_t window[WINDOW];
+    size_t window_pos = 0;
+    cellar_delta_status_t st = CELLAR_DELTA_OK;
+    clock_t start = clock();
+    for (size_t off = CELLAR_DELTA_HEADER_SIZE; off < patch_len && st == CELLAR_DELTA_OK; off += NET_CHUNK) {
+        zs.next_in = patch + off;
+        zs.avail_in = (uInt)(patch_len - off < NET_CHUNK ? patch_len - off : NET_CHUNK);
+        while (st == CELLAR_DELTA_OK && zs.avail_in > 0) {
+            zs.next_out = window + window_pos;
+            zs.avail_out = (uInt)(WINDOW - window_pos);
+            int zr = inflate(&zs, Z_NO_FLUSH);
+            size_t produced = WINDOW - window_pos - zs.avail_out;
+            if (produced > 0) st = cellar_delta_feed(&delta, window + window_pos, produced);
+            window_pos = (window_pos + produced) % WINDOW;
+            if (zr == Z_STREAM_END) break;
+            if (zr != Z_OK && zr != Z_BUF_ERROR) {
+                fprintf(stderr, "inflate: %d\n", zr);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    double ms = 1000.0 * (double)(clock() - start) / CLOCKS_PER_SEC;
+    inflateEnd(&zs);
+    fclose(io.out);
+
+    if (st != CELLAR_DELTA_DONE) {
+        fprintf(stderr, "patch did not complete (status %d, %u of %u B)\n", st,
+                (unsigned)delta.written, (unsigned)header.new_size);
+        return EXIT_FAILURE;
+    }
+    printf("%s: %u B from a %zu B patch in %.1f ms\n", argv[3], (unsigned)header.new_size,
+           patch_len, ms);
+    printf("applier state %zu B + inflate window %d B; largest write %zu B\n",
+           sizeof(cellar_delta_t), WINDOW, io.max_write);
+    free(old);
+    free(patch);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+// sentinel_fleet: N virtual sentinels, one process each, running the
+// firmware's claim, token refresh and telemetry code against an API.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLEET_BATCH_MAX 30
+
+typedef struct {
+    int devices;
+    double duration_s;
+    double post_interval_s;
+    int batch;                  // readings per post
+    double refresh_interval_s;  // 0: refresh ahead of expiry, as the firmware does
+    double jitter;              // +/- fraction applied to every interval
+    double ramp_s;              // devices start spread over this long
+    bool reclaim;               // drop stored tokens and claim from scratch
+    const char *state_dir;      // per-device NVS files, so tokens survive runs
+    const char *log_level;      // SIM_LOG for the devices
+} fleet_config_t;
+
+typedef enum {
+    FLEET_OP_CLAIM,
+    FLEET_OP_POLL,
+    FLEET_OP_REFRESH,
+    FLEET_OP_POST,
+    FLEET_OP_COUNT,
+} fleet_op_t;
+
+// One request, written by a device to the shared pipe. Smaller than
+// PIPE_BUF, so writes from all devices arrive whole.
+typedef struct {
+    uint32_t device;
+    uint16_t op;          // fleet_op_t
+    int16_t status;       // HTTP status, -1 without a response
+    uint32_t latency_us;  // whole firmware call: build, gzip, request, parse
+    uint32_t readings;    // delivered by a successful post
+} fleet_event_t;
+
+// Runs device `index` until the process is killed; events go to events_fd.
+// Call on a FreeRTOS task after sim_system_init and sim_net_init.
+void fleet_device_run(const fleet_config_t *config, int index, int events_fd);
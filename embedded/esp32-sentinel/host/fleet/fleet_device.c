@@ -0,0 +1,180 @@
+// One virtual sentinel. cellar_auth.c is compiled into this file so the
+// device can drive the firmware's own claim, poll and refresh steps inline
+// (the firmware runs them on its auth task) and time each request.
+#include "cellar_auth.c"
+
+#include <unistd.h>
+
+#include "cellar_http.h"
+#include "cellar_wifi.h"
+#include "esp_timer.h"
+#include "fleet.h"
+#include "nvs_flash.h"
+#include "sim.h"
+
+#define FLEET_TEMP_JSON_MAX 128
+
+static const fleet_config_t *s_config;
+static int s_events_fd = -1;
+static int s_index;
+
+static int64_t jittered_ms(double seconds) {
+    double spread = s_config->jitter * ((double)esp_random() / 4294967295.0 * 2.0 - 1.0);
+    int64_t ms = (int64_t)(seconds * 1000.0 * (1.0 + spread));
+    return ms > 0 ? ms : 0;
+}
+
+static void emit(fleet_op_t op, int status, int64_t started_us, uint32_t readings) {
+    fleet_event_t event = {
+        .device = (uint32_t)s_index,
+        .op = (uint16_t)op,
+        .status = (int16_t)status,
+        .latency_us = (uint32_t)(esp_timer_get_time() - started_us),
+        .readings = readings,
+    };
+    if (write(s_events_fd, &event, sizeof(event)) != sizeof(event)) {
+        _exit(EXIT_FAILURE);  // the controller has gone
+    }
+}
+
+// Status of the request the last firmware call made, if it made one.
+static bool request_made(uint32_t requests_before, int *status) {
+    sim_http_stats_t stats;
+    sim_http_get_stats(&stats);
+    *status = stats.last_status;
+    return stats.requests != requests_before;
+}
+
+static uint32_t requests_so_far(void) {
+    sim_http_stats_t stats;
+    sim_http_get_stats(&stats);
+    return stats.requests;
+}
+
+// One step of the auth state machine, as auth_task runs it.
+static uint32_t auth_step(void) {
+    fleet_op_t op = s_state == AUTH_STATE_CLAIM            ? FLEET_OP_CLAIM
+                    : s_state == AUTH_STATE_AWAIT_APPROVAL ? FLEET_OP_POLL
+                                                           : FLEET_OP_REFRESH;
+    uint32_t before = requests_so_far();
+    int64_t started = esp_timer_get_time();
+    uint32_t wait_ms = 0;
+    switch (s_state) {
+        case AUTH_STATE_ACTIVE:
+            wait_ms = step_active();
+            break;
+        case AUTH_STATE_CLAIM:
+            wait_ms = step_claim();
+            break;
+        case AUTH_STATE_AWAIT_APPROVAL:
+            wait_ms = step_await_approval();
+            break;
+    }
+    int status;
+    if (request_made(before, &status)) emit(op, status, started, 0);
+    return wait_ms;
+}
+
+// --refresh-interval: refresh on a fixed cadence instead of near expiry.
+static void forced_refresh(void) {
+    if (s_state != AUTH_STATE_ACTIVE || s_refresh_token[0] == '\0') return;
+    uint32_t before = requests_so_far();
+    int64_t started = esp_timer_get_time();
+    esp_err_t err = refresh_tokens();
+    int status;
+    if (request_made(before, &status)) emit(FLEET_OP_REFRESH, status, started, 0);
+    if (err == ESP_ERR_NOT_ALLOWED) {
+        cellar_auth_clear();
+        s_state = AUTH_STATE_CLAIM;
+    }
+}
+
+// A batch shaped like the firmware's: two probes and the BME280, the climate
+// channels, and health on the newest reading.
+static void post_readings(void) {
+    static char temps[FLEET_BATCH_MAX][FLEET_TEMP_JSON_MAX];
+    static cellar_measurement_t batch[FLEET_BATCH_MAX];
+    char health[96];
+    int count = s_config->batch;
+    int64_t now_ms = cellar_time_now_ms();
+    for (int i = 0; i < count; ++i) {
+        float base = 12.5f + (float)(esp_random() % 100) / 100.0f;
+        snprintf(temps[i], sizeof(temps[i]), "{\"28FF%06X0001%02X\":%.2f,\"28FF%06X0002%02X\":%.2f,\"bme280\":%.2f}",
+                 s_index, i, base, s_index, i, base - 0.19f, base + 0.31f);
+        int64_t age_ms = (int64_t)((count - 1 - i) * s_config->post_interval_s * 1000.0);
+        batch[i] = (cellar_measurement_t){
+            .temperatures_json = temps[i],
+            .pressure_hpa = 1013.0f + (float)(esp_random() % 80) / 10.0f,
+            .humidity_pct = 64.0f + (float)(esp_random() % 40) / 10.0f,
+            .illuminance_lux = 0.3f,
+            .measured_at_ms = now_ms > 0 ? now_ms - age_ms : 0,
+            .device_id = cellar_auth_device_id(),
+        };
+    }
+    snprintf(health, sizeof(health), "{\"fw\":\"fleet\",\"uptime_s\":%lld,\"queued\":%d,\"dropped\":0}",
+             (long long)(esp_timer_get_time() / 1000000), count);
+    batch[count - 1].health_json = health;
+
+    int64_t started = esp_timer_get_time();
+    cellar_http_result_t result;
+    esp_err_t err = cellar_http_post_batch(batch, (size_t)count, &result);
+    emit(FLEET_OP_POST, result.status_code, started,
+         err == ESP_OK && result.status_code >= 200 && result.status_code < 300 ? (uint32_t)count : 0);
+    // As post_sensor_readings does: a rejected token sends the device back to claiming.
+    if (result.status_code == 401 || result.status_code == 403) {
+        cellar_auth_clear();
+    }
+}
+
+static int64_t min_of(int64_t a, int64_t b) {
+    return a < b ? a : b;
+}
+
+void fleet_device_run(const fleet_config_t *config, int index, int events_fd) {
+    s_config = config;
+    s_index = index;
+    s_events_fd = events_fd;
+
+    if (config->reclaim) nvs_flash_erase();
+    nvs_flash_init();
+    ESP_ERROR_CHECK(cellar_wifi_start());
+    cellar_wifi_wait_connected(portMAX_DELAY);
+    cellar_http_init();
+    cellar_auth_init();
+    cellar_time_start();
+    s_state = (s_access_token[0] || s_refresh_token[0]) ? AUTH_STATE_ACTIVE : AUTH_STATE_CLAIM;
+
+    // Spread the fleet's first requests over the ramp, then keep each
+    // device's own cadence (open loop: failures are not retried early).
+    int64_t start_ms = cellar_time_mono_ms();
+    if (config->devices > 1) start_ms += (int64_t)(config->ramp_s * 1000.0 * index / config->devices);
+    int64_t next_auth_ms = start_ms;
+    int64_t next_post_ms = start_ms + jittered_ms(config->post_interval_s) / 10;
+    int64_t next_refresh_ms = config->refresh_interval_s > 0 ? start_ms + jittered_ms(config->refresh_interval_s)
+                                                             : INT64_MAX;
+    while (true) {
+        int64_t now_ms = cellar_time_mono_ms();
+        if (now_ms >= next_auth_ms) {
+            uint32_t wait_ms = auth_step();
+            next_auth_ms = cellar_time_mono_ms() + wait_ms;
+            continue;
+        }
+        if (now_ms >= next_refresh_ms) {
+            forced_refresh();
+            next_refresh_ms += jittered_ms(config->refresh_interval_s);
+            next_auth_ms = cellar_time_mono_ms();
+            continue;
+        }
+        if (now_ms >= next_post_ms) {
+            if (s_state == AUTH_STATE_ACTIVE && access_valid()) {
+                post_readings();
+                if (s_access_token[0] == '\0') next_auth_ms = cellar_time_mono_ms();
+            }
+            next_post_ms += jittered_ms(config->post_interval_s);
+            if (next_post_ms < now_ms) next_post_ms = now_ms;  // fell behind: don't burst
+            continue;
+        }
+        int64_t wake_ms = min_of(min_of(next_auth_ms, next_post_ms), next_refresh_ms);
+        vTaskDelay(pdMS_TO_TICKS(wake_ms - now_ms) + 1);
+    }
+}
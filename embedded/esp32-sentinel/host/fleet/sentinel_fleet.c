@@ -0,0 +1,362 @@
+// Load generator for the device API: forks one process per virtual sentinel
+// (the firmware keeps its tokens and HTTP connection in file-level state) and
+// collects the latency and status of every claim, poll, refresh and post.
+//
+//   SIM_API_BASE=http://127.0.0.1:3000/api ./build-host/sentinel_fleet -n 200 -d 300
+//
+// Progress goes to stderr every --report seconds; the summary (or --json)
+// goes to stdout when the run ends or on Ctrl+C.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fleet.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+#define DEVICE_TASK_STACK 8192
+#define DEVICE_TASK_PRIORITY 5
+
+static const char *OP_NAMES[FLEET_OP_COUNT] = {"claim", "poll", "refresh", "post"};
+
+typedef struct {
+    uint32_t *latency_us;
+    size_t count;
+    size_t cap;
+    size_t window_start;  // first sample of the current progress window
+    uint32_t window_errors;  // errors before it
+    uint32_t ok;          // 2xx
+    uint32_t client_err;  // 4xx
+    uint32_t server_err;  // 5xx
+    uint32_t transport;   // no response
+    uint64_t readings;
+} op_stats_t;
+
+static op_stats_t s_ops[FLEET_OP_COUNT];
+static uint8_t *s_posted;  // per device: has delivered a reading
+static int s_posting;
+
+// --- child -------------------------------------------------------------------
+
+typedef struct {
+    const fleet_config_t *config;
+    int index;
+    int fd;
+} device_args_t;
+
+static void device_task(void *arg) {
+    device_args_t *args = arg;
+    fleet_device_run(args->config, args->index, args->fd);
+}
+
+static void run_device(const fleet_config_t *config, int index, int fd, char **argv, const sigset_t *stop) {
+    char value[128];
+    // Locally administered MACs; the firmware derives the device id from the last three bytes.
+    snprintf(value, sizeof(value), "02:fe:00:%02x:%02x:%02x", (index >> 16) & 0xFF, (index >> 8) & 0xFF,
+             index & 0xFF);
+    setenv("SIM_MAC", value, 1);
+    snprintf(value, sizeof(value), "%s/device-%05d.nvs", config->state_dir, index);
+    setenv("SIM_NVS", value, 1);
+    snprintf(value, sizeof(value), "%d", index + 1);
+    setenv("SIM_SEED", value, 1);
+    setenv("SIM_LOG", config->log_level, 1);
+
+    sim_system_init(argv);
+    sim_net_init();
+    static device_args_t args;
+    args = (device_args_t){.config = config, .index = index, .fd = fd};
+    xTaskCreate(device_task, "fleet", DEVICE_TASK_STACK, &args, DEVICE_TASK_PRIORITY, NULL);
+    int sig;
+    sigwait(stop, &sig);
+    _exit(EXIT_SUCCESS);
+}
+
+// --- statistics ----------------------------------------------------------------
+
+static void record(const fleet_event_t *event, int devices) {
+    if (event->op >= FLEET_OP_COUNT) return;
+    op_stats_t *op = &s_ops[event->op];
+    if (op->count == op->cap) {
+        op->cap = op->cap ? op->cap * 2 : 1024;
+        op->latency_us = realloc(op->latency_us, op->cap * sizeof(*op->latency_us));
+        if (!op->latency_us) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    op->latency_us[op->count++] = event->latency_us;
+    if (event->status < 0) {
+        op->transport++;
+    } else if (event->status >= 500) {
+        op->server_err++;
+    } else if (event->status >= 400) {
+        op->client_err++;
+    } else if (event->status >= 200 && event->status < 300) {
+        op->ok++;
+    }
+    op->readings += event->readings;
+    if (event->readings > 0 && event->device < (uint32_t)devices && !s_posted[event->device]) {
+        s_posted[event->device] = 1;
+        s_posting++;
+    }
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    double p50, p90, p99, p999, max, mean;
+} latency_summary_t;
+
+// Nearest-rank percentiles in milliseconds.
+static latency_summary_t summarize(const uint32_t *samples, size_t n) {
+    latency_summary_t s = {0};
+    if (n == 0) return s;
+    uint32_t *sorted = malloc(n * sizeof(*sorted));
+    if (!sorted) return s;
+    memcpy(sorted, samples, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), compare_u32);
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += sorted[i];
+#define RANK(q) (sorted[(size_t)((q) * (n - 1) + 0.5)] / 1000.0)
+    s = (latency_summary_t){RANK(0.50), RANK(0.90), RANK(0.99), RANK(0.999), sorted[n - 1] / 1000.0, sum / n / 1000.0};
+#undef RANK
+    free(sorted);
+    return s;
+}
+
+static uint32_t errors(const op_stats_t *op) {
+    return op->client_err + op->server_err + op->transport;
+}
+
+static void print_progress(double elapsed_s, double window_s, int devices) {
+    op_stats_t *post = &s_ops[FLEET_OP_POST];
+    size_t window = post->count - post->window_start;
+    latency_summary_t l = summarize(post->latency_us + post->window_start, window);
+    fprintf(stderr, "[%6.0fs] %d/%d posting  posts %5zu %7.1f/s  p50 %6.1f ms  p99 %7.1f ms  errors %u",
+            elapsed_s, s_posting, devices, window, window / window_s, l.p50, l.p99,
+            errors(post) - post->window_errors);
+    for (int op = 0; op < FLEET_OP_POST; ++op) {
+        fprintf(stderr, "  %s %zu", OP_NAMES[op], s_ops[op].count - s_ops[op].window_start);
+        s_ops[op].window_start = s_ops[op].count;
+    }
+    fprintf(stderr, "\n");
+    post->window_start = post->count;
+    post->window_errors = errors(post);
+}
+
+static void print_summary(const fleet_config_t *config, double elapsed_s) {
+    printf("\n--- sentinel_fleet: %d devices, %.1f s, %s ---\n", config->devices, elapsed_s, sim_api_base());
+    printf("%-8s %8s %8s %6s %6s %6s %9s %8s %8s %8s %8s %8s %8s\n", "op", "requests", "ok", "4xx", "5xx",
+           "conn", "req/s", "mean ms", "p50", "p90", "p99", "p99.9", "max");
+    for (int i = 0; i < FLEET_OP_COUNT; ++i) {
+        const op_stats_t *op = &s_ops[i];
+        latency_summary_t l = summarize(op->latency_us, op->count);
+        printf("%-8s %8zu %8u %6u %6u %6u %9.2f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", OP_NAMES[i], op->count,
+               op->ok, op->client_err, op->server_err, op->transport, op->count / elapsed_s, l.mean, l.p50, l.p90,
+               l.p99, l.p999, l.max);
+    }
+    const op_stats_t *post = &s_ops[FLEET_OP_POST];
+    printf("readings %llu delivered, %.1f/s; %d of %d devices posted; post error rate %.2f%%\n",
+           (unsigned long long)post->readings, post->readings / elapsed_s, s_posting, config->devices,
+           post->count ? 100.0 * errors(post) / post->count : 0.0);
+}
+
+static void print_json(const fleet_config_t *config, double elapsed_s) {
+    printf("{\"devices\":%d,\"duration_s\":%.3f,\"post_interval_s\":%g,\"batch\":%d,\"refresh_interval_s\":%g,"
+           "\"jitter\":%g,\"api\":\"%s\",\"devices_posted\":%d,\"ops\":{",
+           config->devices, elapsed_s, config->post_interval_s, config->batch, config->refresh_interval_s,
+           config->jitter, sim_api_base(), s_posting);
+    for (int i = 0; i < FLEET_OP_COUNT; ++i) {
+        const op_stats_t *op = &s_ops[i];
+        latency_summary_t l = summarize(op->latency_us, op->count);
+        printf("%s\n \"%s\":{\"requests\":%zu,\"ok\":%u,\"client_errors\":%u,\"server_errors\":%u,"
+               "\"transport_errors\":%u,\"error_rate\":%.5f,\"per_s\":%.3f,\"readings\":%llu,"
+               "\"latency_ms\":{\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f}}",
+               i ? "," : "", OP_NAMES[i], op->count, op->ok, op->client_err, op->server_err, op->transport,
+               op->count ? (double)errors(op) / op->count : 0.0, op->count / elapsed_s,
+               (unsigned long long)op->readings, l.mean, l.p50, l.p90, l.p99, l.p999, l.max);
+    }
+    printf("\n}}\n");
+}
+
+// --- controller ------------------------------------------------------------------
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [options]   (API from SIM_API_BASE, default http://127.0.0.1:3000/api)\n"
+            "  -n DEVICES         virtual sentinels (default 10)\n"
+            "  -d SECONDS         run time (default 60; Ctrl+C ends early)\n"
+            "  --post SECONDS     post interval per device (default 30)\n"
+            "  --batch N          readings per post, 1-%d (default 1)\n"
+            "  --refresh SECONDS  refresh tokens this often (default: ahead of expiry)\n"
+            "  --jitter FRACTION  +/- spread of every interval (default 0.1)\n"
+            "  --ramp SECONDS     stagger device start-up (default: one post interval)\n"
+            "  --reclaim          forget stored tokens and claim again\n"
+            "  --state DIR        per-device token storage (default fleet-state)\n"
+            "  --report SECONDS   progress interval on stderr (default 10)\n"
+            "  --log LEVEL        device log level (default none)\n"
+            "  --json             summary as JSON\n",
+            argv0, FLEET_BATCH_MAX);
+}
+
+int main(int argc, char **argv) {
+    fleet_config_t config = {
+        .devices = 10,
+        .duration_s = 60,
+        .post_interval_s = 30,
+        .batch = 1,
+        .refresh_interval_s = 0,
+        .jitter = 0.1,
+        .ramp_s = -1,
+        .state_dir = "fleet-state",
+        .log_level = "none",
+    };
+    double report_s = 10;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--reclaim") == 0) {
+            config.reclaim = true;
+        } else if (strcmp(arg, "--json") == 0) {
+            json = true;
+        } else if (next && strcmp(arg, "-n") == 0) {
+            config.devices = atoi(next), ++i;
+        } else if (next && strcmp(arg, "-d") == 0) {
+            config.duration_s = atof(next), ++i;
+        } else if (next && strcmp(arg, "--post") == 0) {
+            config.post_interval_s = atof(next), ++i;
+        } else if (next && strcmp(arg, "--batch") == 0) {
+            config.batch = atoi(next), ++i;
+        } else if (next && strcmp(arg, "--refresh") == 0) {
+            config.refresh_interval_s = atof(next), ++i;
+        } else if (next && strcmp(arg, "--jitter") == 0) {
+            config.jitter = atof(next), ++i;
+        } else if (next && strcmp(arg, "--ramp") == 0) {
+            config.ramp_s = atof(next), ++i;
+        } else if (next && strcmp(arg, "--state") == 0) {
+            config.state_dir = next, ++i;
+        } else if (next && strcmp(arg, "--report") == 0) {
+            report_s = atof(next), ++i;
+        } else if (next && strcmp(arg, "--log") == 0) {
+            config.log_level = next, ++i;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.devices < 1 || config.devices > 0xFFFFFF || config.batch < 1 || config.batch > FLEET_BATCH_MAX ||
+        config.post_interval_s <= 0 || config.jitter < 0 || config.jitter >= 1 || report_s <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (config.ramp_s < 0) config.ramp_s = config.post_interval_s;
+    if (mkdir(config.state_dir, 0755) != 0 && errno != EEXIST) {
+        perror(config.state_dir);
+        return EXIT_FAILURE;
+    }
+    s_posted = calloc((size_t)config.devices, 1);
+
+    // Devices inherit the blocked set and wait for SIGTERM (or the
+    // terminal's SIGINT) on their main thread, as sentinel_sim does.
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop, NULL);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+    pid_t *pids = calloc((size_t)config.devices, sizeof(*pids));
+    for (int i = 0; i < config.devices; ++i) {
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            config.devices = i;
+            break;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            run_device(&config, i, fds[1], argv, &stop);
+        }
+        pids[i] = pid;
+    }
+    close(fds[1]);
+    fprintf(stderr, "%d devices against %s, posting every %gs, %d reading(s) each\n", config.devices,
+            sim_api_base(), config.post_interval_s, config.batch);
+
+    double started = now_s();
+    double stopped = 0;
+    double next_report = started + report_s;
+    double last_report = started;
+    uint8_t buf[64 * sizeof(fleet_event_t)];
+    size_t have = 0;
+    bool draining = false;
+    while (true) {
+        double now = now_s();
+        if (!draining) {
+            struct timespec zero = {0};
+            if (now - started >= config.duration_s || sigtimedwait(&stop, NULL, &zero) > 0) {
+                // Stop the devices; their pipe ends close as they exit.
+                for (int i = 0; i < config.devices; ++i) kill(pids[i], SIGTERM);
+                draining = true;
+                stopped = now;
+            } else if (now >= next_report) {
+                print_progress(now - started, now - last_report, config.devices);
+                last_report = now;
+                next_report += report_s;
+            }
+        }
+        struct pollfd pfd = {.fd = fds[0], .events = POLLIN};
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        ssize_t n = read(fds[0], buf + have, sizeof(buf) - have);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            break;
+        }
+        have += (size_t)n;
+        size_t whole = have / sizeof(fleet_event_t) * sizeof(fleet_event_t);
+        for (size_t off = 0; off < whole; off += sizeof(fleet_event_t)) {
+            fleet_event_t event;
+            memcpy(&event, buf + off, sizeof(event));
+            record(&event, config.devices);
+        }
+        memmove(buf, buf + whole, have - whole);
+        have -= whole;
+    }
+    double elapsed = (draining ? stopped : now_s()) - started;
+    for (int i = 0; i < config.devices; ++i) waitpid(pids[i], NULL, 0);
+
+    if (json) {
+        print_json(&config, elapsed);
+    } else {
+        print_summary(&config, elapsed);
+    }
+    return EXIT_SUCCESS;
+}
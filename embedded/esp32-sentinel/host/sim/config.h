@@ -0,0 +1,38 @@
+#pragma once
+
+// config.h for the host simulation (see main/config.example.h for the full
+// list). The API base comes from SIM_API_BASE at run time so several
+// simulated devices can point at different servers; bus faults come from
+// SIM_FAULTS the same way.
+const char *sim_api_base(void);
+const char *sim_faults(void);
+
+#define WIFI_SSID "sim-cellar"
+#define WIFI_PASS "sim-cellar-pass"
+#define CELLAR_API_BASE sim_api_base()
+#define CELLAR_FAULTS sim_faults()
+#define CELLAR_API_USE_HTTPS 0
+#define DEVICE_ID "sim-sentinel"
+#define CLAIM_CODE "sim-claim"
+
+#define I2C_SDA 21
+#define I2C_SCL 22
+#define I2C_FREQ_HZ 100000
+#define ONEWIRE_BUS_GPIO 4
+#define BME280_ADDRESS 0x76
+#define OLED_ADDRESS 0x3C
+#define OLED_WIDTH 128
+#define OLED_HEIGHT 64
+
+// A faster cadence than the bench default so a short run covers many cycles.
+#define POST_INTERVAL_MS (10 * 1000)
+#define SENSOR_PERIOD_DS18B20_MS (5 * 1000)
+
+// Not part of the host build: OTA needs the ota partitions, and MQTT and the
+// local endpoint need their IDF clients.
+#define CELLAR_OTA 0
+#define CELLAR_UPLINK_MQTT 0
+#define CELLAR_LOCAL_HTTPD 0
+
+// PERF records for tools/perf_harness.py --target sim.
+#define CELLAR_PERF_LOG 1
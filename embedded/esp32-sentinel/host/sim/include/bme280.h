@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esp_err.h"
+#include "i2c_bus.h"
+
+#define BME280_I2C_ADDRESS_DEFAULT 0x76
+
+typedef void *bme280_handle_t;
+
+// The espressif/bme280 component API, driven over the simulated bus so the
+// sensor model sees the same register traffic the real driver produces.
+bme280_handle_t bme280_create(i2c_bus_handle_t bus, uint8_t dev_addr);
+esp_err_t bme280_delete(bme280_handle_t *sensor);
+esp_err_t bme280_default_init(bme280_handle_t sensor);
+esp_err_t bme280_read_temperature(bme280_handle_t sensor, float *temperature);
+esp_err_t bme280_read_pressure(bme280_handle_t sensor, float *pressure);
+esp_err_t bme280_read_humidity(bme280_handle_t sensor, float *humidity);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+typedef struct {
+    uint32_t dev_addr;
+    void *on_color_trans_done;
+    void *user_ctx;
+    size_t control_phase_bytes;
+    unsigned int dc_bit_offset;
+    int lcd_cmd_bits;
+    int lcd_param_bits;
+    struct {
+        unsigned int dc_low_on_data : 1;
+        unsigned int disable_control_phase : 1;
+    } flags;
+    uint32_t scl_speed_hz;
+} esp_lcd_panel_io_i2c_config_t;
+
+// Commands and pixel data are framed as the target's panel IO frames them
+// (a control byte with the D/C bit, then the payload) and sent over the
+// simulated I2C bus to the SSD1306 model.
+esp_err_t esp_lcd_new_panel_io_i2c(i2c_master_bus_handle_t bus, const esp_lcd_panel_io_i2c_config_t *io_config,
+                                   esp_lcd_panel_io_handle_t *ret_io);
+esp_err_t esp_lcd_panel_io_tx_param(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *param,
+                                    size_t param_size);
+esp_err_t esp_lcd_panel_io_tx_color(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *color,
+                                    size_t color_size);
+esp_err_t esp_lcd_panel_io_del(esp_lcd_panel_io_handle_t io);
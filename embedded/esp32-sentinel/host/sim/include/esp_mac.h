@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+// SIM_MAC ("aa:bb:cc:dd:ee:ff") picks the address; each simulated device in a
+// fleet needs its own so claim codes and device ids differ.
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
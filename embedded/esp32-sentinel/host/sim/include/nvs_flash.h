@@ -0,0 +1,9 @@
+#pragma once
+
+#include "esp_err.h"
+#include "nvs.h"
+
+// The store lives in a file (SIM_NVS, default sim-nvs.bin) so tokens and the
+// claim code survive a restart of the simulator, as they survive a reboot.
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct onewire_bus_t *onewire_bus_handle_t;
+typedef struct onewire_device_iter_t *onewire_device_iter_handle_t;
+
+typedef struct {
+    onewire_bus_handle_t bus;
+    uint64_t address;
+} onewire_device_t;
+
+typedef struct {
+    int bus_gpio_num;
+    struct {
+        uint32_t en_pull_up : 1;
+    } flags;
+} onewire_bus_config_t;
+
+typedef struct {
+    uint32_t max_rx_bytes;
+} onewire_bus_rmt_config_t;
+
+#define ONEWIRE_CMD_MATCH_ROM 0x55
+#define ONEWIRE_CMD_SKIP_ROM 0xCC
+
+// The bus carries the DS18B20 models listed in SIM_DEVICES. Reset returns
+// ESP_ERR_NOT_FOUND when no device answers with a presence pulse.
+esp_err_t onewire_new_bus_rmt(const onewire_bus_config_t *bus_config,
+                              const onewire_bus_rmt_config_t *rmt_config, onewire_bus_handle_t *ret_bus);
+esp_err_t onewire_bus_del(onewire_bus_handle_t bus);
+esp_err_t onewire_bus_reset(onewire_bus_handle_t bus);
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t bus, const uint8_t *tx_data, uint8_t tx_data_size);
+esp_err_t onewire_bus_read_bytes(onewire_bus_handle_t bus, uint8_t *rx_buf, size_t rx_buf_size);
+esp_err_t onewire_new_device_iter(onewire_bus_handle_t bus, onewire_device_iter_handle_t *ret_iter);
+esp_err_t onewire_del_device_iter(onewire_device_iter_handle_t iter);
+esp_err_t onewire_device_iter_get_next(onewire_device_iter_handle_t iter, onewire_device_t *dev);
+uint8_t onewire_crc8(uint8_t init_crc, uint8_t *input, size_t input_size);
@@ -0,0 +1,10 @@
+#pragma once
+
+// The subset of the target's sdkconfig the firmware reads.
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+#define CONFIG_PM_ENABLE 1
+#define CONFIG_PM_LIGHT_SLEEP_CALLBACKS 1
@@ -0,0 +1,107 @@
+#pragma once
+
+// Internals shared by the host simulation: time, configuration from the
+// environment, the simulated buses and the device models on them.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Monotonic microseconds since sim_system_init.
+int64_t sim_now_us(void);
+void sim_sleep_us(int64_t us);
+// Absolute CLOCK_MONOTONIC deadline for a FreeRTOS timeout; false for
+// portMAX_DELAY (wait forever).
+bool sim_deadline(TickType_t ticks, struct timespec *out);
+
+// SIM_* settings from the environment.
+const char *sim_env_str(const char *name, const char *fallback);
+long sim_env_long(const char *name, long fallback);
+double sim_env_double(const char *name, double fallback);
+// Whether SIM_DEVICES lists `name`; *count gets its ":N" suffix (default 1).
+bool sim_device_enabled(const char *name, int *count);
+
+// CELLAR_API_BASE for the simulated firmware (SIM_API_BASE).
+const char *sim_api_base(void);
+// CELLAR_FAULTS for the simulated firmware (SIM_FAULTS).
+const char *sim_faults(void);
+
+// Start-up, in order: clock, RNG, log level and reset reason; then the
+// event loop, Wi-Fi and SNTP.
+void sim_system_init(char **argv);
+void sim_net_init(void);
+void sim_print_stats(void);
+
+// Wi-Fi: drop or restore the simulated link. Dropping it posts
+// WIFI_EVENT_STA_DISCONNECTED; the firmware's own reconnect logic brings it
+// back once the link is up again.
+void sim_wifi_set_link(bool up);
+bool sim_wifi_link_up(void);
+// Associated with an IP: what sockets need to get anywhere.
+bool sim_wifi_connected(void);
+// Changes whenever the station disconnects; TCP connections from an earlier
+// epoch are treated as reset, as they would be after a real drop.
+uint32_t sim_wifi_link_epoch(void);
+
+// An I2C target. write gets the bytes of a write transaction (for register
+// devices, the register pointer first); read fills the bytes of a read
+// transaction. Either may return an error to NACK the transfer.
+typedef struct {
+    const char *name;
+    uint16_t addr;
+    esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len);
+    esp_err_t (*read)(void *ctx, uint8_t *data, size_t len);
+    void *ctx;
+} sim_i2c_device_t;
+
+esp_err_t sim_i2c_attach(const sim_i2c_device_t *device);
+// SCL rate an i2c_bus wrapper handle was created with.
+uint32_t sim_i2c_bus_clk_speed(void *bus_handle);
+
+typedef struct {
+    uint32_t transfers;
+    uint32_t nacks;
+    uint64_t bytes;
+    int64_t wire_us;  // time the bus spent clocking bytes at scl_speed_hz
+} sim_i2c_stats_t;
+
+void sim_i2c_get_stats(sim_i2c_stats_t *out);
+
+// Device models. Each attaches itself to its bus at the given address.
+void sim_bme280_attach(uint8_t addr);
+void sim_opt3001_attach(uint8_t addr);
+void sim_veml7700_attach(uint8_t addr);
+void sim_ssd1306_attach(uint8_t addr);
+void sim_ds18b20_attach(int count);
+
+// The simulated cellar. SIM_ENV_SPEEDUP compresses the daily cycle so a few
+// minutes of simulation cover a day of climate.
+typedef struct {
+    double temp_c;
+    double humidity_pct;
+    double pressure_hpa;
+    double lux;
+} sim_env_t;
+
+void sim_env_read(sim_env_t *out);
+// Temperature at the DS18B20 probe `index` (bottles lag the air).
+double sim_env_probe_temp_c(int index);
+
+typedef struct {
+    uint32_t requests;
+    uint32_t failures;
+    uint32_t connects;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    int64_t total_us;
+    int64_t max_us;
+    int last_status;  // of the most recent request; -1 if it got no response
+    int64_t last_us;
+} sim_http_stats_t;
+
+void sim_http_get_stats(sim_http_stats_t *out);
+uint32_t sim_display_frames(void);
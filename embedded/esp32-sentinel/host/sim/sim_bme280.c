@@ -0,0 +1,359 @@
+// BME280 register model and the espressif/bme280 driver API on top of the
+// simulated bus. The model reports the simulated cellar through the same
+// integer compensation the driver applies, with typical calibration words.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bme280.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+static const char *TAG = "sim_bme280";
+
+#define REG_CALIB_T_P 0x88
+#define REG_CALIB_H1 0xA1
+#define REG_CHIP_ID 0xD0
+#define REG_RESET 0xE0
+#define REG_CALIB_H2 0xE1
+#define REG_CTRL_HUM 0xF2
+#define REG_STATUS 0xF3
+#define REG_CTRL_MEAS 0xF4
+#define REG_CONFIG 0xF5
+#define REG_PRESS_MSB 0xF7
+#define REG_TEMP_MSB 0xFA
+#define REG_HUM_MSB 0xFD
+
+#define CHIP_ID 0x60
+#define RESET_WORD 0xB6
+#define MODE_SLEEP 0x00
+#define MODE_NORMAL 0x03
+
+typedef struct {
+    uint16_t t1;
+    int16_t t2, t3;
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+    uint8_t h1;
+    int16_t h2;
+    uint8_t h3;
+    int16_t h4, h5;
+    int8_t h6;
+} calib_t;
+
+static const calib_t s_typical = {
+    .t1 = 27504, .t2 = 26435, .t3 = -1000,
+    .p1 = 36477, .p2 = -10685, .p3 = 3024, .p4 = 2855, .p5 = 140,
+    .p6 = -7, .p7 = 15500, .p8 = -14600, .p9 = 6000,
+    .h1 = 75, .h2 = 362, .h3 = 0, .h4 = 324, .h5 = 50, .h6 = 30,
+};
+
+// Bosch reference compensation (BME280 datasheet, section 4.2.3).
+static int32_t compensate_t(const calib_t *c, int32_t adc_t, int32_t *t_fine) {
+    int32_t var1 = ((((adc_t >> 3) - ((int32_t)c->t1 << 1))) * ((int32_t)c->t2)) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - ((int32_t)c->t1)) * ((adc_t >> 4) - ((int32_t)c->t1))) >> 12) *
+                    ((int32_t)c->t3)) >> 14;
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+static uint32_t compensate_p(const calib_t *c, int32_t adc_p, int32_t t_fine) {
+    int64_t var1 = ((int64_t)t_fine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t)c->p6;
+    var2 = var2 + ((var1 * (int64_t)c->p5) << 17);
+    var2 = var2 + (((int64_t)c->p4) << 35);
+    var1 = ((var1 * var1 * (int64_t)c->p3) >> 8) + ((var1 * (int64_t)c->p2) << 12);
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)c->p1) >> 33;
+    if (var1 == 0) return 0;
+    int64_t p = 1048576 - adc_p;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t)c->p9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)c->p8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)c->p7) << 4);
+    return (uint32_t)p;
+}
+
+static uint32_t compensate_h(const calib_t *c, int32_t adc_h, int32_t t_fine) {
+    int32_t v = t_fine - ((int32_t)76800);
+    v = (((((adc_h << 14) - (((int32_t)c->h4) << 20) - (((int32_t)c->h5) * v)) + ((int32_t)16384)) >> 15) *
+         (((((((v * ((int32_t)c->h6)) >> 10) * (((v * ((int32_t)c->h3)) >> 11) + ((int32_t)32768))) >> 10) +
+            ((int32_t)2097152)) * ((int32_t)c->h2) + 8192) >> 14));
+    v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)c->h1)) >> 4));
+    v = v < 0 ? 0 : v;
+    v = v > 419430400 ? 419430400 : v;
+    return (uint32_t)(v >> 12);
+}
+
+// ---------------------------------------------------------------------------
+// Register model
+
+typedef struct {
+    uint8_t regs[256];
+    uint8_t ptr;
+    int64_t measuring_since_us;  // first conversion after leaving sleep
+} bme280_model_t;
+
+static bme280_model_t s_model;
+
+static void put_u16le(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void model_reset(bme280_model_t *m) {
+    memset(m->regs, 0, sizeof(m->regs));
+    const calib_t *c = &s_typical;
+    uint8_t *r = &m->regs[REG_CALIB_T_P];
+    const uint16_t words[] = {c->t1, (uint16_t)c->t2, (uint16_t)c->t3, c->p1, (uint16_t)c->p2, (uint16_t)c->p3,
+                              (uint16_t)c->p4, (uint16_t)c->p5, (uint16_t)c->p6, (uint16_t)c->p7,
+                              (uint16_t)c->p8, (uint16_t)c->p9};
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) put_u16le(r + 2 * i, words[i]);
+    m->regs[REG_CALIB_H1] = c->h1;
+    put_u16le(&m->regs[REG_CALIB_H2], (uint16_t)c->h2);
+    m->regs[0xE3] = c->h3;
+    m->regs[0xE4] = (uint8_t)(c->h4 >> 4);
+    m->regs[0xE5] = (uint8_t)((c->h4 & 0x0F) | ((c->h5 & 0x0F) << 4));
+    m->regs[0xE6] = (uint8_t)(c->h5 >> 4);
+    m->regs[0xE7] = (uint8_t)c->h6;
+    m->regs[REG_CHIP_ID] = CHIP_ID;
+    // Data registers hold the "skipped" pattern until the first conversion.
+    m->regs[REG_PRESS_MSB] = 0x80;
+    m->regs[REG_TEMP_MSB] = 0x80;
+    m->regs[REG_HUM_MSB] = 0x80;
+    m->measuring_since_us = -1;
+}
+
+// Raw ADC words that compensate to the simulated climate, found by bisection
+// (temperature and humidity rise with their ADC word, pressure falls).
+static void model_convert(bme280_model_t *m) {
+    sim_env_t env;
+    sim_env_read(&env);
+    const calib_t *c = &s_typical;
+    int32_t t_fine = 0;
+    int32_t target_t = (int32_t)(env.temp_c * 100.0);
+    int32_t lo = 0, hi = 0xFFFFF;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (compensate_t(c, mid, &t_fine) < target_t) lo = mid + 1; else hi = mid;
+    }
+    int32_t adc_t = lo;
+    compensate_t(c, adc_t, &t_fine);
+
+    uint32_t target_p = (uint32_t)(env.pressure_hpa * 100.0 * 256.0);
+    lo = 0;
+    hi = 0xFFFFF;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (compensate_p(c, mid, t_fine) > target_p) lo = mid + 1; else hi = mid;
+    }
+    int32_t adc_p = lo;
+
+    uint32_t target_h = (uint32_t)(env.humidity_pct * 1024.0);
+    lo = 0;
+    hi = 0xFFFF;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (compensate_h(c, mid, t_fine) < target_h) lo = mid + 1; else hi = mid;
+    }
+    int32_t adc_h = lo;
+
+    uint8_t *r = &m->regs[REG_PRESS_MSB];
+    r[0] = (uint8_t)(adc_p >> 12);
+    r[1] = (uint8_t)(adc_p >> 4);
+    r[2] = (uint8_t)((adc_p & 0x0F) << 4);
+    r[3] = (uint8_t)(adc_t >> 12);
+    r[4] = (uint8_t)(adc_t >> 4);
+    r[5] = (uint8_t)((adc_t & 0x0F) << 4);
+    r[6] = (uint8_t)(adc_h >> 8);
+    r[7] = (uint8_t)adc_h;
+}
+
+// Conversion time for the ctrl_hum/ctrl_meas oversampling (datasheet 9.1).
+static int64_t measurement_us(const bme280_model_t *m) {
+    static const int osrs[] = {0, 1, 2, 4, 8, 16, 16, 16};
+    int t = osrs[(m->regs[REG_CTRL_MEAS] >> 5) & 7];
+    int p = osrs[(m->regs[REG_CTRL_MEAS] >> 2) & 7];
+    int h = osrs[m->regs[REG_CTRL_HUM] & 7];
+    return 1250 + 2300 * t + (p ? 2300 * p + 575 : 0) + (h ? 2300 * h + 575 : 0);
+}
+
+static esp_err_t model_write(void *ctx, const uint8_t *data, size_t len) {
+    bme280_model_t *m = ctx;
+    if (len == 1) {
+        m->ptr = data[0];
+        return ESP_OK;
+    }
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        uint8_t reg = data[i], value = data[i + 1];
+        if (reg == REG_RESET) {
+            if (value == RESET_WORD) model_reset(m);
+        } else if (reg == REG_CTRL_HUM || reg == REG_CONFIG) {
+            m->regs[reg] = value;
+        } else if (reg == REG_CTRL_MEAS) {
+            bool was_sleeping = (m->regs[REG_CTRL_MEAS] & 3) == MODE_SLEEP;
+            m->regs[reg] = value;
+            if (was_sleeping && (value & 3) != MODE_SLEEP) m->measuring_since_us = sim_now_us();
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t model_read(void *ctx, uint8_t *data, size_t len) {
+    bme280_model_t *m = ctx;
+    uint8_t mode = m->regs[REG_CTRL_MEAS] & 3;
+    if (m->ptr <= REG_HUM_MSB + 1 && m->ptr + len > REG_PRESS_MSB && mode != MODE_SLEEP &&
+        m->measuring_since_us >= 0 && sim_now_us() - m->measuring_since_us >= measurement_us(m)) {
+        model_convert(m);
+        // Forced mode converts once and returns to sleep.
+        if (mode != MODE_NORMAL) m->regs[REG_CTRL_MEAS] &= ~3;
+    }
+    for (size_t i = 0; i < len; ++i) data[i] = m->regs[(uint8_t)(m->ptr + i)];
+    m->ptr += (uint8_t)len;
+    return ESP_OK;
+}
+
+void sim_bme280_attach(uint8_t addr) {
+    model_reset(&s_model);
+    sim_i2c_device_t dev = {
+        .name = "BME280",
+        .addr = addr,
+        .write = model_write,
+        .read = model_read,
+        .ctx = &s_model,
+    };
+    sim_i2c_attach(&dev);
+}
+
+// ---------------------------------------------------------------------------
+// espressif/bme280 driver API
+
+typedef struct {
+    i2c_master_dev_handle_t dev;
+    calib_t calib;
+    int32_t t_fine;
+} bme280_dev_t;
+
+static esp_err_t write_reg(bme280_dev_t *d, uint8_t reg, uint8_t value) {
+    uint8_t buf[2] = {reg, value};
+    return i2c_master_transmit(d->dev, buf, sizeof(buf), 100);
+}
+
+static esp_err_t read_regs(bme280_dev_t *d, uint8_t reg, uint8_t *out, size_t len) {
+    return i2c_master_transmit_receive(d->dev, &reg, 1, out, len, 100);
+}
+
+bme280_handle_t bme280_create(i2c_bus_handle_t bus, uint8_t dev_addr) {
+    i2c_master_bus_handle_t master = i2c_bus_get_internal_bus_handle(bus);
+    if (!master) return NULL;
+    bme280_dev_t *d = calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    i2c_device_config_t cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = dev_addr,
+        .scl_speed_hz = sim_i2c_bus_clk_speed(bus),
+    };
+    if (i2c_master_bus_add_device(master, &cfg, &d->dev) != ESP_OK) {
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+esp_err_t bme280_delete(bme280_handle_t *sensor) {
+    if (!sensor || !*sensor) return ESP_ERR_INVALID_ARG;
+    bme280_dev_t *d = *sensor;
+    i2c_master_bus_rm_device(d->dev);
+    free(d);
+    *sensor = NULL;
+    return ESP_OK;
+}
+
+static int16_t s16le(const uint8_t *p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+// Normal mode, x16 oversampling on all channels, IIR filter 16, 0.5 ms standby.
+esp_err_t bme280_default_init(bme280_handle_t sensor) {
+    bme280_dev_t *d = sensor;
+    uint8_t id = 0;
+    esp_err_t err = read_regs(d, REG_CHIP_ID, &id, 1);
+    if (err != ESP_OK) return err;
+    if (id != CHIP_ID) {
+        ESP_LOGE(TAG, "Unexpected chip id 0x%02X", id);
+        return ESP_FAIL;
+    }
+    if ((err = write_reg(d, REG_RESET, RESET_WORD)) != ESP_OK) return err;
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    uint8_t tp[24], h1, h[7];
+    if ((err = read_regs(d, REG_CALIB_T_P, tp, sizeof(tp))) != ESP_OK) return err;
+    if ((err = read_regs(d, REG_CALIB_H1, &h1, 1)) != ESP_OK) return err;
+    if ((err = read_regs(d, REG_CALIB_H2, h, sizeof(h))) != ESP_OK) return err;
+    calib_t *c = &d->calib;
+    c->t1 = (uint16_t)s16le(&tp[0]);
+    c->t2 = s16le(&tp[2]);
+    c->t3 = s16le(&tp[4]);
+    c->p1 = (uint16_t)s16le(&tp[6]);
+    c->p2 = s16le(&tp[8]);
+    c->p3 = s16le(&tp[10]);
+    c->p4 = s16le(&tp[12]);
+    c->p5 = s16le(&tp[14]);
+    c->p6 = s16le(&tp[16]);
+    c->p7 = s16le(&tp[18]);
+    c->p8 = s16le(&tp[20]);
+    c->p9 = s16le(&tp[22]);
+    c->h1 = h1;
+    c->h2 = s16le(&h[0]);
+    c->h3 = h[2];
+    c->h4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0F));
+    c->h5 = (int16_t)((int8_t)h[5] * 16 | (h[4] >> 4));
+    c->h6 = (int8_t)h[6];
+
+    if ((err = write_reg(d, REG_CTRL_HUM, 0x05)) != ESP_OK) return err;
+    if ((err = write_reg(d, REG_CONFIG, 0x10)) != ESP_OK) return err;
+    return write_reg(d, REG_CTRL_MEAS, (0x05 << 5) | (0x05 << 2) | MODE_NORMAL);
+}
+
+static esp_err_t read_raw20(bme280_dev_t *d, uint8_t reg, int32_t *out) {
+    uint8_t b[3];
+    esp_err_t err = read_regs(d, reg, b, sizeof(b));
+    if (err != ESP_OK) return err;
+    *out = (int32_t)((b[0] << 12) | (b[1] << 4) | (b[2] >> 4));
+    // 0x80000 means the channel has not converted yet.
+    return *out == 0x80000 ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t bme280_read_temperature(bme280_handle_t sensor, float *temperature) {
+    bme280_dev_t *d = sensor;
+    int32_t adc_t;
+    esp_err_t err = read_raw20(d, REG_TEMP_MSB, &adc_t);
+    if (err != ESP_OK) return err;
+    *temperature = compensate_t(&d->calib, adc_t, &d->t_fine) / 100.0f;
+    return ESP_OK;
+}
+
+esp_err_t bme280_read_pressure(bme280_handle_t sensor, float *pressure) {
+    bme280_dev_t *d = sensor;
+    float t;
+    esp_err_t err = bme280_read_temperature(sensor, &t);
+    int32_t adc_p;
+    if (err == ESP_OK) err = read_raw20(d, REG_PRESS_MSB, &adc_p);
+    if (err != ESP_OK) return err;
+    *pressure = compensate_p(&d->calib, adc_p, d->t_fine) / 256.0f / 100.0f;
+    return ESP_OK;
+}
+
+esp_err_t bme280_read_humidity(bme280_handle_t sensor, float *humidity) {
+    bme280_dev_t *d = sensor;
+    float t;
+    esp_err_t err = bme280_read_temperature(sensor, &t);
+    uint8_t b[2];
+    if (err == ESP_OK) err = read_regs(d, REG_HUM_MSB, b, sizeof(b));
+    if (err != ESP_OK) return err;
+    int32_t adc_h = (b[0] << 8) | b[1];
+    if (adc_h == 0x8000) return ESP_ERR_INVALID_STATE;
+    *humidity = compensate_h(&d->calib, adc_h, d->t_fine) / 1024.0f;
+    return ESP_OK;
+}
@@ -0,0 +1,76 @@
+// The espressif/ds18b20 component API over the onewire_bus calls, in its own
+// file as on target so the fault shim's --wrap sees those calls.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds18b20.h"
+#include "onewire_bus.h"
+
+#define FAMILY_DS18B20 0x28
+
+#define CMD_CONVERT_T 0x44
+#define CMD_WRITE_SCRATCHPAD 0x4E
+#define CMD_READ_SCRATCHPAD 0xBE
+
+struct ds18b20_device_t {
+    onewire_bus_handle_t bus;
+    uint64_t addr;
+    ds18b20_resolution_t resolution;
+};
+
+esp_err_t ds18b20_new_device_from_enumeration(onewire_device_t *device, const ds18b20_config_t *config,
+                                              ds18b20_device_handle_t *ret_ds18b20) {
+    if (!device || !ret_ds18b20) return ESP_ERR_INVALID_ARG;
+    if ((device->address & 0xFF) != FAMILY_DS18B20) return ESP_ERR_NOT_SUPPORTED;
+    struct ds18b20_device_t *ds = calloc(1, sizeof(*ds));
+    if (!ds) return ESP_ERR_NO_MEM;
+    ds->bus = device->bus;
+    ds->addr = device->address;
+    ds->resolution = DS18B20_RESOLUTION_12B;
+    *ret_ds18b20 = ds;
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_del_device(ds18b20_device_handle_t ds18b20) {
+    free(ds18b20);
+    return ESP_OK;
+}
+
+static esp_err_t send_command(ds18b20_device_handle_t ds, uint8_t cmd) {
+    uint8_t tx[10] = {ONEWIRE_CMD_MATCH_ROM};
+    memcpy(&tx[1], &ds->addr, 8);
+    tx[9] = cmd;
+    esp_err_t err = onewire_bus_reset(ds->bus);
+    if (err == ESP_OK) err = onewire_bus_write_bytes(ds->bus, tx, sizeof(tx));
+    return err;
+}
+
+esp_err_t ds18b20_set_resolution(ds18b20_device_handle_t ds18b20, ds18b20_resolution_t resolution) {
+    if (!ds18b20) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = send_command(ds18b20, CMD_WRITE_SCRATCHPAD);
+    if (err != ESP_OK) return err;
+    // TH and TL are unused alarm bytes.
+    uint8_t payload[3] = {0, 0, (uint8_t)(resolution << 5) | 0x1F};
+    err = onewire_bus_write_bytes(ds18b20->bus, payload, sizeof(payload));
+    if (err == ESP_OK) ds18b20->resolution = resolution;
+    return err;
+}
+
+esp_err_t ds18b20_trigger_temperature_conversion(ds18b20_device_handle_t ds18b20) {
+    if (!ds18b20) return ESP_ERR_INVALID_ARG;
+    return send_command(ds18b20, CMD_CONVERT_T);
+}
+
+esp_err_t ds18b20_get_temperature(ds18b20_device_handle_t ds18b20, float *temperature) {
+    if (!ds18b20 || !temperature) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = send_command(ds18b20, CMD_READ_SCRATCHPAD);
+    uint8_t scratchpad[9];
+    if (err == ESP_OK) err = onewire_bus_read_bytes(ds18b20->bus, scratchpad, sizeof(scratchpad));
+    if (err != ESP_OK) return err;
+    if (onewire_crc8(0, scratchpad, 8) != scratchpad[8]) return ESP_ERR_INVALID_CRC;
+    static const uint8_t lsb_mask[] = {0x07, 0x03, 0x01, 0x00};
+    int16_t raw = (int16_t)(((scratchpad[1] << 8) | scratchpad[0]) & ~lsb_mask[ds18b20->resolution]);
+    *temperature = raw / 16.0f;
+    return ESP_OK;
+}
@@ -0,0 +1,72 @@
+// The simulated cellar: a slow daily swing in air temperature and humidity,
+// weather-scale pressure drift, and the lights going on for an hour in the
+// evening. Bottles follow the air through a first-order lag.
+//   SIM_ENV_TEMP_C     mean air temperature (default 13.0)
+//   SIM_ENV_RH         mean relative humidity (default 65)
+//   SIM_ENV_SPEEDUP    simulated seconds per real second (default 1)
+//   SIM_ENV_HOUR       time of day at start (default: local wall clock)
+
+#include <math.h>
+#include <time.h>
+
+#include "esp_random.h"
+#include "sim.h"
+
+#define DAY_S (24.0 * 3600.0)
+#define TEMP_SWING_C 0.8
+#define RH_SWING_PCT 3.0
+#define PRESSURE_SWING_HPA 4.0
+#define PRESSURE_PERIOD_S (3.0 * DAY_S)
+// Time constant of a bottle against the air around it.
+#define BOTTLE_TAU_S (2.0 * 3600.0)
+#define LIGHTS_ON_HOUR 18.0
+#define LIGHTS_OFF_HOUR 19.0
+#define LUX_DARK 0.3
+#define LUX_LIT 180.0
+
+static double noise(double amplitude) {
+    return amplitude * ((double)esp_random() / 4294967295.0 * 2.0 - 1.0);
+}
+
+static double start_hour(void) {
+    static double hour = -1.0;
+    if (hour < 0) {
+        time_t now = time(NULL);
+        struct tm local;
+        localtime_r(&now, &local);
+        hour = sim_env_double("SIM_ENV_HOUR", local.tm_hour + local.tm_min / 60.0);
+    }
+    return hour;
+}
+
+// Seconds since local midnight of the first simulated day.
+static double sim_seconds(void) {
+    return start_hour() * 3600.0 + sim_now_us() / 1e6 * sim_env_double("SIM_ENV_SPEEDUP", 1.0);
+}
+
+// Daily phase in radians, peaking mid-afternoon.
+static double daily_phase(double t) {
+    return 2.0 * M_PI * (t - 9.0 * 3600.0) / DAY_S;
+}
+
+void sim_env_read(sim_env_t *out) {
+    double t = sim_seconds();
+    double day = sin(daily_phase(t));
+    out->temp_c = sim_env_double("SIM_ENV_TEMP_C", 13.0) + TEMP_SWING_C * day + noise(0.02);
+    out->humidity_pct = sim_env_double("SIM_ENV_RH", 65.0) - RH_SWING_PCT * day + noise(0.3);
+    out->pressure_hpa = 1013.25 + PRESSURE_SWING_HPA * sin(2.0 * M_PI * t / PRESSURE_PERIOD_S) + noise(0.05);
+    double hour = fmod(t / 3600.0, 24.0);
+    bool lit = hour >= LIGHTS_ON_HOUR && hour < LIGHTS_OFF_HOUR;
+    out->lux = (lit ? LUX_LIT : LUX_DARK) * (1.0 + noise(0.02));
+}
+
+// Steady-state response of a first-order lag to the daily sine: attenuated
+// and delayed by atan(omega * tau). Lower probes sit a little cooler.
+double sim_env_probe_temp_c(int index) {
+    double t = sim_seconds();
+    double omega = 2.0 * M_PI / DAY_S;
+    double lag = atan(omega * BOTTLE_TAU_S);
+    double gain = 1.0 / sqrt(1.0 + omega * BOTTLE_TAU_S * omega * BOTTLE_TAU_S);
+    return sim_env_double("SIM_ENV_TEMP_C", 13.0) - 0.2 * index +
+           TEMP_SWING_C * gain * sin(daily_phase(t) - lag) + noise(0.01);
+}
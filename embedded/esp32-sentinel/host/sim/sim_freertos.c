@@ -0,0 +1,445 @@
+// FreeRTOS on pthreads: one thread per task, notifications, semaphores and
+// event groups on mutex/condition pairs, ticks from CLOCK_MONOTONIC.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+static const char *TAG = "sim_rtos";
+
+struct tskTaskControlBlock {
+    pthread_t thread;
+    char name[16];
+    UBaseType_t priority;
+    BaseType_t core;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+    bool notify_pending;
+    uint32_t stack_depth;
+    bool exited;  // its thread is gone; no CPU clock to read
+    struct tskTaskControlBlock *next;
+};
+
+static __thread struct tskTaskControlBlock *t_self = NULL;
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+// Every control block ever made, newest first, for xTaskGetHandle.
+static struct tskTaskControlBlock *s_tasks = NULL;
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Wait on cond until signalled or the deadline passes. Returns false on timeout.
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, bool bounded, const struct timespec *deadline) {
+    if (!bounded) return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct tskTaskControlBlock *new_tcb(const char *name, UBaseType_t priority, BaseType_t core) {
+    struct tskTaskControlBlock *tcb = calloc(1, sizeof(*tcb));
+    if (!tcb) return NULL;
+    snprintf(tcb->name, sizeof(tcb->name), "%s", name ? name : "");
+    tcb->priority = priority;
+    tcb->core = core;
+    pthread_mutex_init(&tcb->lock, NULL);
+    init_cond(&tcb->cond);
+    return tcb;
+}
+
+static void add_to_task_list(struct tskTaskControlBlock *tcb) {
+    pthread_mutex_lock(&s_tasks_lock);
+    tcb->next = s_tasks;
+    s_tasks = tcb;
+    pthread_mutex_unlock(&s_tasks_lock);
+}
+
+static void *task_entry(void *arg) {
+    struct tskTaskControlBlock *tcb = arg;
+    t_self = tcb;
+    pthread_setname_np(pthread_self(), tcb->name);
+    tcb->fn(tcb->arg);
+    ESP_LOGE(TAG, "Task %s returned from its function", tcb->name);
+    tcb->exited = true;
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *out_handle, BaseType_t core_id) {
+    struct tskTaskControlBlock *tcb = new_tcb(name, priority, core_id);
+    if (!tcb) return pdFAIL;
+    tcb->fn = fn;
+    tcb->arg = arg;
+    tcb->stack_depth = stack_depth;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // Host frames are larger than Xtensa ones; keep a generous floor.
+    size_t stack = (size_t)stack_depth * 4;
+    pthread_attr_setstacksize(&attr, stack < 256 * 1024 ? 256 * 1024 : stack);
+    int rc = pthread_create(&tcb->thread, &attr, task_entry, tcb);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        free(tcb);
+        return pdFAIL;
+    }
+    add_to_task_list(tcb);
+    if (out_handle) *out_handle = tcb;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *out_handle) {
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, out_handle, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (!t_self) {
+        // A thread the shim did not start (main, timer, event loop) gets a
+        // control block on first use so it can take notifications too.
+        char name[16] = "";
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        t_self = new_tcb(name, 1, tskNO_AFFINITY);
+        if (t_self) {
+            t_self->thread = pthread_self();
+            add_to_task_list(t_self);
+        }
+    }
+    return t_self;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == t_self) {
+        if (t_self) t_self->exited = true;
+        pthread_exit(NULL);
+    }
+    ESP_LOGW(TAG, "vTaskDelete of another task (%s) is not supported", task->name);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_sleep_us((int64_t)ticks * 1000000 / configTICK_RATE_HZ);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(sim_now_us() * configTICK_RATE_HZ / 1000000);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake, TickType_t increment) {
+    TickType_t wake = *previous_wake + increment;
+    TickType_t now = xTaskGetTickCount();
+    *previous_wake = wake;
+    if ((int32_t)(wake - now) <= 0) return pdFALSE;
+    vTaskDelay(wake - now);
+    return pdTRUE;
+}
+
+const char *pcTaskGetName(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->name : "";
+}
+
+TaskHandle_t xTaskGetHandle(const char *name) {
+    pthread_mutex_lock(&s_tasks_lock);
+    struct tskTaskControlBlock *tcb = s_tasks;
+    while (tcb && strcmp(tcb->name, name) != 0) tcb = tcb->next;
+    pthread_mutex_unlock(&s_tasks_lock);
+    return tcb;
+}
+
+// The whole declared stack; 0 for threads the shim did not start.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->stack_depth : 0;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->priority : 0;
+}
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->core : tskNO_AFFINITY;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    if (task) task->priority = priority;
+}
+
+uint64_t sim_run_time_counter(void) {
+    return (uint64_t)sim_now_us();
+}
+
+configRUN_TIME_COUNTER_TYPE ulTaskGetRunTimeCounter(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    clockid_t clock;
+    struct timespec ts;
+    if (!task || task->exited || pthread_getcpuclockid(task->thread, &clock) != 0 ||
+        clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core) {
+    return NULL;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *out, UBaseType_t max, configRUN_TIME_COUNTER_TYPE *total) {
+    UBaseType_t count = 0;
+    pthread_mutex_lock(&s_tasks_lock);
+    for (struct tskTaskControlBlock *tcb = s_tasks; tcb; tcb = tcb->next) {
+        if (tcb->exited) continue;
+        if (count == max) {
+            count = 0;  // as FreeRTOS: nothing if the array is too small
+            break;
+        }
+        out[count++] = (TaskStatus_t){
+            .xHandle = tcb,
+            .pcTaskName = tcb->name,
+            .xTaskNumber = count,
+            .eCurrentState = tcb == t_self ? eRunning : eBlocked,
+            .uxCurrentPriority = tcb->priority,
+            .uxBasePriority = tcb->priority,
+            .ulRunTimeCounter = ulTaskGetRunTimeCounter(tcb),
+            .usStackHighWaterMark = tcb->stack_depth,
+            .xCoreID = tcb->core,
+        };
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+    if (total) *total = sim_run_time_counter();
+    return count;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    if (!task) return pdFAIL;
+    BaseType_t ret = pdPASS;
+    pthread_mutex_lock(&task->lock);
+    switch (action) {
+        case eSetBits:
+            task->notify_value |= value;
+            break;
+        case eIncrement:
+            task->notify_value++;
+            break;
+        case eSetValueWithOverwrite:
+            task->notify_value = value;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (task->notify_pending) {
+                ret = pdFAIL;
+            } else {
+                task->notify_value = value;
+            }
+            break;
+        case eNoAction:
+            break;
+    }
+    task->notify_pending = true;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return ret;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct tskTaskControlBlock *self = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    bool bounded = sim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&self->lock);
+    while (self->notify_value == 0 && ticks_to_wait > 0) {
+        if (!wait_until(&self->cond, &self->lock, bounded, &deadline)) break;
+    }
+    uint32_t value = self->notify_value;
+    if (value > 0) {
+        self->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    self->notify_pending = false;
+    pthread_mutex_unlock(&self->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value,
+                           TickType_t ticks_to_wait) {
+    struct tskTaskControlBlock *self = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    bool bounded = sim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&self->lock);
+    if (!self->notify_pending) self->notify_value &= ~clear_on_entry;
+    while (!self->notify_pending && ticks_to_wait > 0) {
+        if (!wait_until(&self->cond, &self->lock, bounded, &deadline)) break;
+    }
+    BaseType_t got = self->notify_pending ? pdTRUE : pdFALSE;
+    if (value) *value = self->notify_value;
+    if (got) self->notify_value &= ~clear_on_exit;
+    self->notify_pending = false;
+    pthread_mutex_unlock(&self->lock);
+    return got;
+}
+
+static void init_critical(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux) {
+    pthread_once(&s_critical_once, init_critical);
+    pthread_mutex_lock(&s_critical);
+    mux->count++;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux) {
+    mux->count--;
+    pthread_mutex_unlock(&s_critical);
+}
+
+// Semaphores. A mutex is a binary semaphore that starts given; priority
+// inheritance has no meaning without a priority scheduler.
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+static SemaphoreHandle_t new_semaphore(UBaseType_t max, UBaseType_t initial) {
+    SemaphoreHandle_t sem = calloc(1, sizeof(*sem));
+    if (!sem) return NULL;
+    pthread_mutex_init(&sem->lock, NULL);
+    init_cond(&sem->cond);
+    sem->count = initial;
+    sem->max = max;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return new_semaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return new_semaphore(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    return new_semaphore(max_count, initial_count);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait) {
+    struct timespec deadline;
+    bool bounded = sim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0 && ticks_to_wait > 0) {
+        if (!wait_until(&sem->cond, &sem->lock, bounded, &deadline)) break;
+    }
+    BaseType_t taken = sem->count > 0 ? pdTRUE : pdFALSE;
+    if (taken) sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t given = sem->count < sem->max ? pdTRUE : pdFALSE;
+    if (given) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (!sem) return;
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+struct EventGroupDef_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    EventGroupHandle_t group = calloc(1, sizeof(*group));
+    if (!group) return NULL;
+    pthread_mutex_init(&group->lock, NULL);
+    init_cond(&group->cond);
+    return group;
+}
+
+static bool bits_satisfied(EventBits_t have, EventBits_t want, BaseType_t wait_for_all) {
+    return wait_for_all ? (have & want) == want : (have & want) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    struct timespec deadline;
+    bool bounded = sim_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&group->lock);
+    while (!bits_satisfied(group->bits, bits, wait_for_all) && ticks_to_wait > 0) {
+        if (!wait_until(&group->cond, &group->lock, bounded, &deadline)) break;
+    }
+    EventBits_t value = group->bits;
+    if (clear_on_exit && bits_satisfied(value, bits, wait_for_all)) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    if (!group) return;
+    pthread_cond_destroy(&group->cond);
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+}
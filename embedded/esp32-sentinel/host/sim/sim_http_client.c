@@ -0,0 +1,544 @@
+// esp_http_client over plain TCP: HTTP/1.1 with keep-alive, Content-Length
+// and chunked bodies, and the events cellar_http relies on. No TLS.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "sim.h"
+
+static const char *TAG = "sim_http";
+
+#define MAX_HEADERS 16
+#define RX_BUF_SIZE 4096
+
+// The target build embeds main/server_root_cert.pem; plain http needs none.
+const char sim_root_cert_start[] asm("_binary_server_root_cert_pem_start") = "";
+const char sim_root_cert_end[] asm("_binary_server_root_cert_pem_end") = "";
+
+typedef struct {
+    char *key;
+    char *value;
+} header_t;
+
+struct esp_http_client {
+    http_event_handle_cb event_handler;
+    void *user_data;
+    int timeout_ms;
+    bool keep_alive;
+    esp_http_client_method_t method;
+
+    bool https;
+    char host[128];
+    char port[8];
+    char path[512];
+    header_t headers[MAX_HEADERS];
+    const char *post_data;
+    int post_len;
+
+    int sock;
+    char sock_host[128];
+    char sock_port[8];
+    uint32_t sock_epoch;
+    bool reused;  // the current request went out on an existing connection
+
+    int status;
+    int64_t content_length;
+    int64_t body_remaining;
+    int64_t chunk_remaining;
+    bool chunked;
+    bool server_close;
+    bool complete;
+    char rx[RX_BUF_SIZE];
+    size_t rx_start;
+    size_t rx_len;
+};
+
+static pthread_mutex_t s_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_http_stats_t s_stats;
+
+void sim_http_get_stats(sim_http_stats_t *out) {
+    pthread_mutex_lock(&s_stats_lock);
+    *out = s_stats;
+    pthread_mutex_unlock(&s_stats_lock);
+}
+
+static void count(uint64_t *field, uint64_t n) {
+    pthread_mutex_lock(&s_stats_lock);
+    *field += n;
+    pthread_mutex_unlock(&s_stats_lock);
+}
+
+static void emit(esp_http_client_handle_t c, esp_http_client_event_id_t id, void *data, int len) {
+    if (!c->event_handler) return;
+    esp_http_client_event_t evt = {
+        .event_id = id,
+        .client = c,
+        .data = data,
+        .data_len = len,
+        .user_data = c->user_data,
+    };
+    c->event_handler(&evt);
+}
+
+static esp_err_t parse_url(esp_http_client_handle_t c, const char *url) {
+    const char *p = strstr(url, "://");
+    if (!p) return ESP_ERR_INVALID_ARG;
+    c->https = strncasecmp(url, "https", 5) == 0;
+    p += 3;
+    size_t host_len = strcspn(p, ":/?");
+    if (host_len == 0 || host_len >= sizeof(c->host)) return ESP_ERR_INVALID_ARG;
+    memcpy(c->host, p, host_len);
+    c->host[host_len] = '\0';
+    p += host_len;
+    if (*p == ':') {
+        size_t port_len = strcspn(++p, "/?");
+        if (port_len == 0 || port_len >= sizeof(c->port)) return ESP_ERR_INVALID_ARG;
+        memcpy(c->port, p, port_len);
+        c->port[port_len] = '\0';
+        p += port_len;
+    } else {
+        snprintf(c->port, sizeof(c->port), "%s", c->https ? "443" : "80");
+    }
+    snprintf(c->path, sizeof(c->path), "%s%s", *p == '/' ? "" : "/", p);
+    return ESP_OK;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    esp_http_client_handle_t c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->event_handler = config->event_handler;
+    c->user_data = config->user_data;
+    c->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : 5000;
+    c->keep_alive = config->keep_alive_enable;
+    c->method = config->method;
+    c->sock = -1;
+    c->status = -1;
+    if (!config->url || parse_url(c, config->url) != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid URL: %s", config->url ? config->url : "(null)");
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void close_socket(esp_http_client_handle_t c) {
+    if (c->sock < 0) return;
+    close(c->sock);
+    c->sock = -1;
+    c->rx_start = c->rx_len = 0;
+    emit(c, HTTP_EVENT_DISCONNECTED, NULL, 0);
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t c) {
+    close_socket(c);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t c) {
+    if (!c) return ESP_ERR_INVALID_ARG;
+    close_socket(c);
+    for (int i = 0; i < MAX_HEADERS; ++i) {
+        free(c->headers[i].key);
+        free(c->headers[i].value);
+    }
+    free(c);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t c, const char *url) {
+    return parse_url(c, url);
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t c, esp_http_client_method_t method) {
+    c->method = method;
+    return ESP_OK;
+}
+
+static header_t *find_header(esp_http_client_handle_t c, const char *key) {
+    for (int i = 0; i < MAX_HEADERS; ++i) {
+        if (c->headers[i].key && strcasecmp(c->headers[i].key, key) == 0) return &c->headers[i];
+    }
+    return NULL;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t c, const char *key, const char *value) {
+    header_t *h = find_header(c, key);
+    if (!h) {
+        for (int i = 0; i < MAX_HEADERS && !h; ++i) {
+            if (!c->headers[i].key) h = &c->headers[i];
+        }
+        if (!h) return ESP_ERR_NO_MEM;
+        h->key = strdup(key);
+    }
+    free(h->value);
+    h->value = strdup(value);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_get_header(esp_http_client_handle_t c, const char *key, char **value) {
+    header_t *h = find_header(c, key);
+    *value = h ? h->value : NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t c, const char *key) {
+    header_t *h = find_header(c, key);
+    if (h) {
+        free(h->key);
+        free(h->value);
+        h->key = h->value = NULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t c, const char *data, int len) {
+    c->post_data = data;
+    c->post_len = data ? len : 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_timeout_ms(esp_http_client_handle_t c, int timeout_ms) {
+    c->timeout_ms = timeout_ms;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_user_data(esp_http_client_handle_t c, void *data) {
+    c->user_data = data;
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t c) {
+    return c->status;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t c) {
+    return c->content_length;
+}
+
+static void set_timeouts(int sock, int timeout_ms) {
+    struct timeval tv = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static esp_err_t connect_socket(esp_http_client_handle_t c) {
+    if (c->sock >= 0 && c->sock_epoch != sim_wifi_link_epoch()) close_socket(c);
+    if (c->sock >= 0 && strcmp(c->sock_host, c->host) == 0 && strcmp(c->sock_port, c->port) == 0) {
+        c->reused = true;
+        set_timeouts(c->sock, c->timeout_ms);
+        return ESP_OK;
+    }
+    close_socket(c);
+    c->reused = false;
+    if (!sim_wifi_connected()) return ESP_ERR_HTTP_CONNECT;
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(c->host, c->port, &hints, &res) != 0 || !res) {
+        ESP_LOGE(TAG, "DNS lookup failed for %s", c->host);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock < 0) {
+        freeaddrinfo(res);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(sock, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc != 0 && errno == EINPROGRESS) {
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        FD_SET(sock, &wfds);
+        struct timeval tv = {.tv_sec = c->timeout_ms / 1000, .tv_usec = (c->timeout_ms % 1000) * 1000};
+        int so_err = ETIMEDOUT;
+        if (select(sock + 1, NULL, &wfds, NULL, &tv) > 0) {
+            socklen_t len = sizeof(so_err);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_err, &len);
+        }
+        rc = so_err == 0 ? 0 : -1;
+        errno = so_err;
+    }
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Connect to %s:%s failed: %s", c->host, c->port, strerror(errno));
+        close(sock);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    fcntl(sock, F_SETFL, flags);
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    set_timeouts(sock, c->timeout_ms);
+    c->sock = sock;
+    c->sock_epoch = sim_wifi_link_epoch();
+    snprintf(c->sock_host, sizeof(c->sock_host), "%s", c->host);
+    snprintf(c->sock_port, sizeof(c->sock_port), "%s", c->port);
+    pthread_mutex_lock(&s_stats_lock);
+    s_stats.connects++;
+    pthread_mutex_unlock(&s_stats_lock);
+    emit(c, HTTP_EVENT_ON_CONNECTED, NULL, 0);
+    return ESP_OK;
+}
+
+static bool send_all(esp_http_client_handle_t c, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(c->sock, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        count(&s_stats.bytes_sent, (uint64_t)n);
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static const char *method_name(esp_http_client_method_t method) {
+    static const char *names[] = {"GET", "POST", "PUT", "PATCH", "DELETE", "HEAD"};
+    return method <= HTTP_METHOD_HEAD ? names[method] : "GET";
+}
+
+static bool send_request_head(esp_http_client_handle_t c, int body_len) {
+    char head[2048];
+    int n = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n",
+                     method_name(c->method), c->path, c->host, c->port);
+    for (int i = 0; i < MAX_HEADERS && n < (int)sizeof(head); ++i) {
+        if (c->headers[i].key) {
+            n += snprintf(head + n, sizeof(head) - n, "%s: %s\r\n", c->headers[i].key, c->headers[i].value);
+        }
+    }
+    if (body_len > 0 || c->method == HTTP_METHOD_POST || c->method == HTTP_METHOD_PUT ||
+        c->method == HTTP_METHOD_PATCH) {
+        n += snprintf(head + n, sizeof(head) - n, "Content-Length: %d\r\n", body_len > 0 ? body_len : 0);
+    }
+    n += snprintf(head + n, sizeof(head) - n, "Connection: %s\r\n\r\n", c->keep_alive ? "keep-alive" : "close");
+    if (n >= (int)sizeof(head)) {
+        ESP_LOGE(TAG, "Request header too long");
+        return false;
+    }
+    return send_all(c, head, (size_t)n);
+}
+
+// Returns bytes buffered, 0 at EOF, -1 on error or timeout.
+static int fill(esp_http_client_handle_t c) {
+    if (c->rx_len > 0) return (int)c->rx_len;
+    ssize_t n;
+    do {
+        n = recv(c->sock, c->rx, sizeof(c->rx), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return n == 0 ? 0 : -1;
+    count(&s_stats.bytes_received, (uint64_t)n);
+    c->rx_start = 0;
+    c->rx_len = (size_t)n;
+    return (int)n;
+}
+
+static int take(esp_http_client_handle_t c, char *dst, size_t len) {
+    int avail = fill(c);
+    if (avail <= 0) return avail;
+    size_t n = len < (size_t)avail ? len : (size_t)avail;
+    memcpy(dst, c->rx + c->rx_start, n);
+    c->rx_start += n;
+    c->rx_len -= n;
+    return (int)n;
+}
+
+// Reads one CRLF-terminated line without the terminator.
+static bool read_line(esp_http_client_handle_t c, char *out, size_t cap) {
+    size_t n = 0;
+    while (true) {
+        char ch;
+        if (take(c, &ch, 1) != 1) return false;
+        if (ch == '\n') break;
+        if (ch != '\r' && n + 1 < cap) out[n++] = ch;
+    }
+    out[n] = '\0';
+    return true;
+}
+
+static esp_err_t read_response_head(esp_http_client_handle_t c) {
+    char line[1024];
+    if (!read_line(c, line, sizeof(line))) return ESP_ERR_HTTP_FETCH_HEADER;
+    int major = 0, minor = 0, status = 0;
+    if (sscanf(line, "HTTP/%d.%d %d", &major, &minor, &status) != 3) return ESP_ERR_HTTP_FETCH_HEADER;
+    c->status = status;
+    c->content_length = -1;
+    c->chunked = false;
+    c->chunk_remaining = 0;
+    c->server_close = major == 1 && minor == 0;
+    while (true) {
+        if (!read_line(c, line, sizeof(line))) return ESP_ERR_HTTP_FETCH_HEADER;
+        if (line[0] == '\0') break;
+        char *colon = strchr(line, ':');
+        if (!colon) continue;
+        *colon = '\0';
+        char *value = colon + 1;
+        while (*value == ' ') value++;
+        if (strcasecmp(line, "Content-Length") == 0) {
+            c->content_length = strtoll(value, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "chunked") == 0) {
+            c->chunked = true;
+        } else if (strcasecmp(line, "Connection") == 0) {
+            c->server_close = strcasecmp(value, "close") == 0;
+        }
+        if (c->event_handler) {
+            esp_http_client_event_t evt = {
+                .event_id = HTTP_EVENT_ON_HEADER,
+                .client = c,
+                .user_data = c->user_data,
+                .header_key = line,
+                .header_value = value,
+            };
+            c->event_handler(&evt);
+        }
+    }
+    bool no_body = c->method == HTTP_METHOD_HEAD || status == 204 || status == 304 || (status >= 100 && status < 200);
+    if (no_body) c->content_length = 0;
+    if (c->chunked) c->content_length = -1;
+    c->body_remaining = c->content_length;
+    c->complete = no_body || c->content_length == 0;
+    return ESP_OK;
+}
+
+// Reads body bytes according to the framing. Returns 0 once complete.
+static int read_body(esp_http_client_handle_t c, char *dst, int len) {
+    if (c->complete || len <= 0) return 0;
+    if (c->chunked) {
+        if (c->chunk_remaining == 0) {
+            char line[64];
+            if (!read_line(c, line, sizeof(line))) return -1;
+            c->chunk_remaining = strtoll(line, NULL, 16);
+            if (c->chunk_remaining == 0) {
+                while (read_line(c, line, sizeof(line)) && line[0] != '\0') {
+                }
+                c->complete = true;
+                return 0;
+            }
+        }
+        int want = (int64_t)len < c->chunk_remaining ? len : (int)c->chunk_remaining;
+        int n = take(c, dst, (size_t)want);
+        if (n <= 0) return -1;
+        c->chunk_remaining -= n;
+        if (c->chunk_remaining == 0) {
+            char crlf[4];
+            read_line(c, crlf, sizeof(crlf));
+        }
+        return n;
+    }
+    if (c->content_length >= 0) {
+        int want = (int64_t)len < c->body_remaining ? len : (int)c->body_remaining;
+        int n = take(c, dst, (size_t)want);
+        if (n <= 0) return -1;
+        c->body_remaining -= n;
+        if (c->body_remaining == 0) c->complete = true;
+        return n;
+    }
+    // No length and not chunked: the body runs to EOF.
+    int n = take(c, dst, (size_t)len);
+    if (n == 0) {
+        c->complete = true;
+        c->server_close = true;
+    }
+    return n;
+}
+
+static void record(int64_t started_us, int status) {
+    int64_t us = sim_now_us() - started_us;
+    pthread_mutex_lock(&s_stats_lock);
+    s_stats.requests++;
+    if (status < 0) s_stats.failures++;
+    s_stats.total_us += us;
+    if (us > s_stats.max_us) s_stats.max_us = us;
+    s_stats.last_status = status;
+    s_stats.last_us = us;
+    pthread_mutex_unlock(&s_stats_lock);
+}
+
+static esp_err_t fail(esp_http_client_handle_t c, esp_err_t err, int64_t started_us) {
+    emit(c, HTTP_EVENT_ERROR, NULL, 0);
+    close_socket(c);
+    record(started_us, -1);
+    return err;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t c) {
+    int64_t started_us = sim_now_us();
+    c->status = -1;
+    if (c->https) {
+        ESP_LOGE(TAG, "https is not available in the simulator; use an http:// SIM_API_BASE");
+        return fail(c, ESP_ERR_HTTP_INVALID_TRANSPORT, started_us);
+    }
+    // A kept-alive socket the server has since closed fails on first use;
+    // like the target client, reconnect once and resend.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        esp_err_t err = connect_socket(c);
+        if (err != ESP_OK) return fail(c, err, started_us);
+        bool sent = send_request_head(c, c->post_len) &&
+                    (c->post_len == 0 || send_all(c, c->post_data, (size_t)c->post_len));
+        if (sent) emit(c, HTTP_EVENT_HEADERS_SENT, NULL, 0);
+        err = sent ? read_response_head(c) : ESP_ERR_HTTP_WRITE_DATA;
+        if (err != ESP_OK && c->reused && attempt == 0) {
+            close_socket(c);
+            continue;
+        }
+        if (err != ESP_OK) return fail(c, err, started_us);
+        break;
+    }
+
+    char buf[1024];
+    int n;
+    while ((n = read_body(c, buf, sizeof(buf))) > 0) {
+        emit(c, HTTP_EVENT_ON_DATA, buf, n);
+    }
+    if (n < 0) return fail(c, ESP_ERR_HTTP_FETCH_HEADER, started_us);
+    emit(c, HTTP_EVENT_ON_FINISH, NULL, 0);
+    if (c->server_close || !c->keep_alive) close_socket(c);
+    record(started_us, c->status);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t c, int write_len) {
+    c->status = -1;
+    if (c->https) {
+        ESP_LOGE(TAG, "https is not available in the simulator; use an http:// SIM_API_BASE");
+        return ESP_ERR_HTTP_INVALID_TRANSPORT;
+    }
+    esp_err_t err = connect_socket(c);
+    if (err != ESP_OK) return err;
+    if (!send_request_head(c, write_len)) {
+        close_socket(c);
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t c, const char *buffer, int len) {
+    return send_all(c, buffer, (size_t)len) ? len : -1;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t c) {
+    if (read_response_head(c) != ESP_OK) return ESP_FAIL;
+    return c->content_length;
+}
+
+int esp_http_client_read(esp_http_client_handle_t c, char *buffer, int len) {
+    return read_body(c, buffer, len);
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t c) {
+    return c->complete;
+}
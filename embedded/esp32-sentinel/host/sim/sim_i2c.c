@@ -0,0 +1,200 @@
+// The I2C master driver and the espressif i2c_bus wrapper over one simulated
+// bus. Transfers are routed to the device models by address and take the
+// time the bytes would need on the wire at the device's scl_speed_hz.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/i2c_master.h"
+#include "esp_log.h"
+#include "i2c_bus.h"
+#include "sim.h"
+
+static const char *TAG = "sim_i2c";
+
+#define MAX_DEVICES 16
+#define DEFAULT_SCL_HZ 100000
+// Start, address byte with ACK, and stop per transaction.
+#define FRAME_OVERHEAD_BITS 11
+
+struct i2c_master_bus_t {
+    i2c_port_num_t port;
+};
+
+struct i2c_master_dev_t {
+    uint16_t addr;
+    uint32_t scl_speed_hz;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_i2c_device_t s_devices[MAX_DEVICES];
+static int s_device_count = 0;
+static sim_i2c_stats_t s_stats;
+static struct i2c_master_bus_t s_bus;
+static bool s_bus_created = false;
+
+esp_err_t sim_i2c_attach(const sim_i2c_device_t *device) {
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (s_device_count < MAX_DEVICES) {
+        s_devices[s_device_count++] = *device;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (err == ESP_OK) ESP_LOGI(TAG, "%s at 0x%02X", device->name, device->addr);
+    return err;
+}
+
+void sim_i2c_get_stats(sim_i2c_stats_t *out) {
+    pthread_mutex_lock(&s_lock);
+    *out = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+// Caller holds s_lock.
+static const sim_i2c_device_t *find_device(uint16_t addr) {
+    for (int i = 0; i < s_device_count; ++i) {
+        if (s_devices[i].addr == addr) return &s_devices[i];
+    }
+    return NULL;
+}
+
+// Caller holds s_lock, which keeps the bus busy for the wire time as the
+// hardware FSM would.
+static void clock_bytes(uint32_t scl_hz, size_t len) {
+    int64_t us = ((int64_t)FRAME_OVERHEAD_BITS + 9 * (int64_t)len) * 1000000 / (scl_hz ? scl_hz : DEFAULT_SCL_HZ);
+    s_stats.wire_us += us;
+    s_stats.bytes += len;
+    if (sim_env_long("SIM_I2C_REALTIME", 1)) sim_sleep_us(us);
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle) {
+    if (!bus_config || !ret_bus_handle) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (!s_bus_created) {
+        s_bus_created = true;
+        s_bus.port = bus_config->i2c_port;
+        *ret_bus_handle = &s_bus;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle) {
+    pthread_mutex_lock(&s_lock);
+    s_bus_created = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// Nine SCL pulses and a stop, as the driver clocks out to free SDA.
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle) {
+    if (!bus_handle) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    clock_bytes(DEFAULT_SCL_HZ, 1);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle) {
+    if (!bus_handle || !dev_config || !ret_handle) return ESP_ERR_INVALID_ARG;
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+    if (!dev) return ESP_ERR_NO_MEM;
+    dev->addr = dev_config->device_address;
+    dev->scl_speed_hz = dev_config->scl_speed_hz;
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle) {
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms) {
+    if (!bus_handle) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    bool present = find_device(address) != NULL;
+    clock_bytes(DEFAULT_SCL_HZ, 0);
+    s_stats.transfers++;
+    if (!present) s_stats.nacks++;
+    pthread_mutex_unlock(&s_lock);
+    return present ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t transfer(i2c_master_dev_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    if (!dev) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    const sim_i2c_device_t *target = find_device(dev->addr);
+    esp_err_t err = target ? ESP_OK : ESP_FAIL;
+    if (err == ESP_OK && tx_len > 0) {
+        clock_bytes(dev->scl_speed_hz, tx_len);
+        err = target->write ? target->write(target->ctx, tx, tx_len) : ESP_FAIL;
+    }
+    if (err == ESP_OK && rx_len > 0) {
+        clock_bytes(dev->scl_speed_hz, rx_len);
+        err = target->read ? target->read(target->ctx, rx, rx_len) : ESP_FAIL;
+    }
+    s_stats.transfers++;
+    if (err != ESP_OK) {
+        s_stats.nacks++;
+        err = ESP_FAIL;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms) {
+    return transfer(i2c_dev, write_buffer, write_size, NULL, 0);
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size,
+                             int xfer_timeout_ms) {
+    return transfer(i2c_dev, NULL, 0, read_buffer, read_size);
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer,
+                                      size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                      int xfer_timeout_ms) {
+    return transfer(i2c_dev, write_buffer, write_size, read_buffer, read_size);
+}
+
+// espressif/i2c_bus keeps its own handle around the master bus.
+typedef struct {
+    i2c_master_bus_handle_t bus;
+    uint32_t clk_speed;
+} sim_i2c_bus_wrapper_t;
+
+i2c_bus_handle_t i2c_bus_create(i2c_port_num_t port, const i2c_config_t *conf) {
+    sim_i2c_bus_wrapper_t *wrapper = calloc(1, sizeof(*wrapper));
+    if (!wrapper) return NULL;
+    i2c_master_bus_config_t bus_config = {.i2c_port = port};
+    if (i2c_new_master_bus(&bus_config, &wrapper->bus) != ESP_OK) {
+        free(wrapper);
+        return NULL;
+    }
+    wrapper->clk_speed = conf ? conf->master.clk_speed : DEFAULT_SCL_HZ;
+    return wrapper;
+}
+
+esp_err_t i2c_bus_delete(i2c_bus_handle_t *p_bus) {
+    if (!p_bus || !*p_bus) return ESP_ERR_INVALID_ARG;
+    sim_i2c_bus_wrapper_t *wrapper = *p_bus;
+    i2c_del_master_bus(wrapper->bus);
+    free(wrapper);
+    *p_bus = NULL;
+    return ESP_OK;
+}
+
+i2c_master_bus_handle_t i2c_bus_get_internal_bus_handle(i2c_bus_handle_t bus_handle) {
+    return bus_handle ? ((sim_i2c_bus_wrapper_t *)bus_handle)->bus : NULL;
+}
+
+uint32_t sim_i2c_bus_clk_speed(i2c_bus_handle_t bus_handle) {
+    return bus_handle ? ((sim_i2c_bus_wrapper_t *)bus_handle)->clk_speed : DEFAULT_SCL_HZ;
+}
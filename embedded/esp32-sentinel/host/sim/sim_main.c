@@ -0,0 +1,132 @@
+// Entry point of sentinel_sim: sets up the simulated chip, attaches the
+// devices named in SIM_DEVICES and runs the firmware's app_main on a "main"
+// task as the IDF startup code does. SIGINT/SIGTERM, or SIM_RUN_S seconds,
+// end the run with a summary of bus, HTTP and CPU use, sensor timing and any
+// faults SIM_FAULTS injected. The deferred log records it still holds go to
+// sim-binlog.bin for tools/binlog_decode.py.
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "cellar_binlog.h"
+#include "cellar_fault.h"
+#include "cellar_sensors.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+#include "config.h"
+
+static const char *TAG = "sim";
+
+#define MAIN_TASK_STACK 8192
+#define MAIN_TASK_PRIORITY 1
+// As CONFIG_ESP_MAIN_TASK_AFFINITY_CPU1 in sdkconfig.defaults.
+#define MAIN_TASK_CORE APP_CPU_NUM
+
+extern void app_main(void);
+
+static void main_task(void *arg) {
+    app_main();
+    vTaskDelete(NULL);
+}
+
+static void attach_devices(void) {
+    int count = 0;
+    if (sim_device_enabled("bme280", NULL)) sim_bme280_attach(BME280_ADDRESS);
+    if (sim_device_enabled("opt3001", NULL)) sim_opt3001_attach(0x44);
+    if (sim_device_enabled("veml7700", NULL)) sim_veml7700_attach(0x10);
+    if (sim_device_enabled("ssd1306", NULL)) sim_ssd1306_attach(OLED_ADDRESS);
+    if (sim_device_enabled("ds18b20", &count)) sim_ds18b20_attach(count);
+}
+
+static double timeval_s(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void sim_print_stats(void) {
+    double wall_s = sim_now_us() / 1e6;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sim_http_stats_t http;
+    sim_http_get_stats(&http);
+    sim_i2c_stats_t i2c;
+    sim_i2c_get_stats(&i2c);
+    printf("\n--- sentinel_sim: %.1f s ---\n", wall_s);
+    printf("cpu      user %.3f s, sys %.3f s, max rss %ld KiB\n", timeval_s(usage.ru_utime),
+           timeval_s(usage.ru_stime), usage.ru_maxrss);
+    printf("http     %u requests, %u failed, %u connects, %llu B out, %llu B in",
+           http.requests, http.failures, http.connects, (unsigned long long)http.bytes_sent,
+           (unsigned long long)http.bytes_received);
+    if (http.requests > 0) {
+        printf(", mean %.1f ms, max %.1f ms", http.total_us / 1e3 / http.requests, http.max_us / 1e3);
+    }
+    printf("\ni2c      %u transfers, %u NACKs, %llu B, %.1f ms on the wire\n", i2c.transfers, i2c.nacks,
+           (unsigned long long)i2c.bytes, i2c.wire_us / 1e3);
+    printf("display  %u frames\n", sim_display_frames());
+    cellar_sensors_stats_t sensors;
+    cellar_sensors_get_stats(&sensors);
+    printf("sensors  %u rounds, worst %u ms (%u ms on the bus)\n", sensors.rounds, sensors.worst_round_ms,
+           sensors.worst_round_bus_ms);
+    for (int i = 0; i < sensors.sensor_count; ++i) {
+        const cellar_sensor_stats_t *sensor = &sensors.sensors[i];
+        printf("  %-10s %u reads, %u failures, worst call %u ms\n", sensor->name, sensor->reads,
+               sensor->failures, sensor->worst_call_ms);
+    }
+    cellar_fault_stats_t faults;
+    cellar_fault_get_stats(&faults);
+    printf("faults   %u NACKs, %u stretched, %u stuck, %u timeouts, %u corrupted\n", faults.nacks,
+           faults.stretches, faults.stuck, faults.timeouts, faults.corrupted);
+    cellar_binlog_stats_t binlog;
+    cellar_binlog_get_stats(&binlog);
+    printf("binlog   %u records, %u dropped, %u waiting at most\n", binlog.written, binlog.dropped,
+           binlog.high_water);
+    fflush(stdout);
+}
+
+static void write_binlog_dump(const char *path) {
+    size_t cap = cellar_binlog_dump_max();
+    uint8_t *dump = malloc(cap);
+    if (!dump) return;
+    size_t len = cellar_binlog_dump(dump, cap);
+    FILE *f = fopen(path, "wb");
+    if (f) {
+        fwrite(dump, 1, len, f);
+        fclose(f);
+    }
+    free(dump);
+}
+
+int main(int argc, char **argv) {
+    // Block the stop signals before any task exists so only this thread sees them.
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, NULL);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    sim_system_init(argv);
+    sim_net_init();
+    attach_devices();
+    ESP_LOGI(TAG, "API %s, devices %s", sim_api_base(),
+             sim_env_str("SIM_DEVICES", "bme280,opt3001,veml7700,ssd1306,ds18b20:2"));
+    xTaskCreatePinnedToCore(main_task, "main", MAIN_TASK_STACK, NULL, MAIN_TASK_PRIORITY, NULL, MAIN_TASK_CORE);
+
+    long run_s = sim_env_long("SIM_RUN_S", 0);
+    if (run_s > 0) {
+        struct timespec timeout = {.tv_sec = run_s};
+        sigtimedwait(&stop, NULL, &timeout);
+    } else {
+        int sig;
+        sigwait(&stop, &sig);
+    }
+    sim_print_stats();
+    write_binlog_dump("sim-binlog.bin");
+    return 0;
+}
@@ -0,0 +1,438 @@
+// Default event loop, netif, Wi-Fi station and SNTP. The station
+// "associates" after a short delay and gets 127.0.0.1, so the firmware's
+// connect, backoff and AP-cache paths run as on the target. SIM_WIFI_OUTAGE
+// ("start_s+duration_s,...") drops the link on a schedule.
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_netif_sntp.h"
+#include "esp_random.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "sim.h"
+
+static const char *TAG = "sim_net";
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+// Event loop
+
+typedef struct handler {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t fn;
+    void *arg;
+    struct handler *next;
+} handler_t;
+
+typedef struct event {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+    struct event *next;
+} event_t;
+
+static pthread_mutex_t s_loop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_loop_cond = PTHREAD_COND_INITIALIZER;
+static handler_t *s_handlers = NULL;
+static event_t *s_events = NULL;
+static event_t **s_events_tail = &s_events;
+static bool s_loop_started = false;
+
+static void *event_loop(void *arg) {
+    pthread_setname_np(pthread_self(), "sys_evt");
+    while (true) {
+        pthread_mutex_lock(&s_loop_lock);
+        while (!s_events) pthread_cond_wait(&s_loop_cond, &s_loop_lock);
+        event_t *ev = s_events;
+        s_events = ev->next;
+        if (!s_events) s_events_tail = &s_events;
+        pthread_mutex_unlock(&s_loop_lock);
+
+        // Handlers are only ever added, so the list can be walked unlocked.
+        for (handler_t *h = s_handlers; h; h = h->next) {
+            if (h->fn && (h->base == ESP_EVENT_ANY_BASE || h->base == ev->base) &&
+                (h->id == ESP_EVENT_ANY_ID || h->id == ev->id)) {
+                h->fn(h->arg, ev->base, ev->id, ev->data);
+            }
+        }
+        free(ev->data);
+        free(ev);
+    }
+    return NULL;
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    pthread_mutex_lock(&s_loop_lock);
+    bool start = !s_loop_started;
+    s_loop_started = true;
+    pthread_mutex_unlock(&s_loop_lock);
+    if (!start) return ESP_ERR_INVALID_STATE;
+    pthread_t thread;
+    pthread_create(&thread, NULL, event_loop, NULL);
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t handler, void *handler_arg,
+                                              esp_event_handler_instance_t *instance) {
+    handler_t *h = calloc(1, sizeof(*h));
+    if (!h) return ESP_ERR_NO_MEM;
+    *h = (handler_t){.base = event_base, .id = event_id, .fn = handler, .arg = handler_arg};
+    // Appended, so handlers run in registration order as on the target.
+    pthread_mutex_lock(&s_loop_lock);
+    handler_t **tail = &s_handlers;
+    while (*tail) tail = &(*tail)->next;
+    *tail = h;
+    pthread_mutex_unlock(&s_loop_lock);
+    if (instance) *instance = h;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t handler, void *handler_arg) {
+    return esp_event_handler_instance_register(event_base, event_id, handler, handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+                                                esp_event_handler_instance_t instance) {
+    handler_t *h = instance;
+    if (!h) return ESP_ERR_INVALID_ARG;
+    h->fn = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait) {
+    event_t *ev = calloc(1, sizeof(*ev));
+    if (!ev) return ESP_ERR_NO_MEM;
+    ev->base = event_base;
+    ev->id = event_id;
+    if (event_data && event_data_size > 0) {
+        ev->data = malloc(event_data_size);
+        memcpy(ev->data, event_data, event_data_size);
+    }
+    pthread_mutex_lock(&s_loop_lock);
+    *s_events_tail = ev;
+    s_events_tail = &ev->next;
+    pthread_cond_signal(&s_loop_cond);
+    pthread_mutex_unlock(&s_loop_lock);
+    return ESP_OK;
+}
+
+// Netif
+
+struct esp_netif_obj {
+    esp_netif_ip_info_t ip_info;
+    bool static_ip;
+};
+
+static esp_netif_t s_sta_netif;
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+    return &s_sta_netif;
+}
+
+char *esp_ip4addr_ntoa(const esp_ip4_addr_t *addr, char *buf, int buflen) {
+    struct in_addr in = {.s_addr = addr->addr};
+    return inet_ntop(AF_INET, &in, buf, (socklen_t)buflen) ? buf : NULL;
+}
+
+esp_err_t esp_netif_str_to_ip4(const char *src, esp_ip4_addr_t *dst) {
+    struct in_addr in;
+    if (inet_pton(AF_INET, src, &in) != 1) return ESP_ERR_INVALID_ARG;
+    dst->addr = in.s_addr;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif) {
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info) {
+    netif->ip_info = *ip_info;
+    netif->static_ip = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns) {
+    return ESP_OK;
+}
+
+// Wi-Fi station
+
+#define SIM_BSSID {0x24, 0x0a, 0xc4, 0x5e, 0xa0, 0x01}
+#define SIM_CHANNEL 6
+
+typedef enum {
+    STA_IDLE,
+    STA_CONNECTING,
+    STA_CONNECTED,
+} sta_state_t;
+
+static pthread_mutex_t s_wifi_lock = PTHREAD_MUTEX_INITIALIZER;
+static wifi_config_t s_wifi_config;
+static sta_state_t s_sta_state = STA_IDLE;
+static bool s_link_up = true;
+// Bumped on every disconnect; sockets opened before it are dead.
+static uint32_t s_link_epoch = 0;
+static bool s_wifi_started = false;
+static esp_timer_handle_t s_assoc_timer = NULL;
+
+static void post_disconnected(uint8_t reason) {
+    pthread_mutex_lock(&s_wifi_lock);
+    s_link_epoch++;
+    pthread_mutex_unlock(&s_wifi_lock);
+    wifi_event_sta_disconnected_t ev = {.reason = reason, .rssi = -90};
+    size_t len = strnlen((const char *)s_wifi_config.sta.ssid, sizeof(s_wifi_config.sta.ssid));
+    memcpy(ev.ssid, s_wifi_config.sta.ssid, len);
+    ev.ssid_len = (uint8_t)len;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), portMAX_DELAY);
+}
+
+static void assoc_done(void *arg) {
+    pthread_mutex_lock(&s_wifi_lock);
+    bool up = s_link_up && s_sta_state == STA_CONNECTING;
+    s_sta_state = up ? STA_CONNECTED : STA_IDLE;
+    pthread_mutex_unlock(&s_wifi_lock);
+    if (!up) {
+        post_disconnected(WIFI_REASON_NO_AP_FOUND);
+        return;
+    }
+    wifi_event_sta_connected_t connected = {.channel = SIM_CHANNEL, .authmode = WIFI_AUTH_WPA2_PSK};
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &connected, sizeof(connected), portMAX_DELAY);
+
+    ip_event_got_ip_t got_ip = {.esp_netif = &s_sta_netif};
+    if (s_sta_netif.static_ip) {
+        got_ip.ip_info = s_sta_netif.ip_info;
+    } else {
+        esp_netif_str_to_ip4("127.0.0.1", &got_ip.ip_info.ip);
+        esp_netif_str_to_ip4("255.0.0.0", &got_ip.ip_info.netmask);
+        esp_netif_str_to_ip4("127.0.0.1", &got_ip.ip_info.gw);
+    }
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    const esp_timer_create_args_t args = {.callback = assoc_done, .name = "sim_assoc"};
+    return esp_timer_create(&args, &s_assoc_timer);
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    pthread_mutex_lock(&s_wifi_lock);
+    s_wifi_config = *conf;
+    pthread_mutex_unlock(&s_wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    s_wifi_started = true;
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_stop(void) {
+    s_wifi_started = false;
+    return esp_wifi_disconnect();
+}
+
+esp_err_t esp_wifi_connect(void) {
+    if (!s_wifi_started) return ESP_ERR_INVALID_STATE;
+    pthread_mutex_lock(&s_wifi_lock);
+    if (s_sta_state != STA_IDLE) {
+        pthread_mutex_unlock(&s_wifi_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_sta_state = STA_CONNECTING;
+    // A direct connect to a known BSSID skips the all-channel scan; without
+    // the link the attempt ends with "no AP found" after a full scan.
+    long delay_ms = s_wifi_config.sta.bssid_set ? sim_env_long("SIM_WIFI_ASSOC_CACHED_MS", 150)
+                                                : sim_env_long("SIM_WIFI_ASSOC_MS", 300);
+    if (!s_link_up) delay_ms = 2500;
+    pthread_mutex_unlock(&s_wifi_lock);
+    esp_timer_stop(s_assoc_timer);
+    return esp_timer_start_once(s_assoc_timer, (uint64_t)delay_ms * 1000);
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    pthread_mutex_lock(&s_wifi_lock);
+    bool was = s_sta_state != STA_IDLE;
+    s_sta_state = STA_IDLE;
+    pthread_mutex_unlock(&s_wifi_lock);
+    esp_timer_stop(s_assoc_timer);
+    if (was) post_disconnected(8);  // WIFI_REASON_ASSOC_LEAVE
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    pthread_mutex_lock(&s_wifi_lock);
+    bool connected = s_sta_state == STA_CONNECTED;
+    pthread_mutex_unlock(&s_wifi_lock);
+    if (!connected) return ESP_ERR_WIFI_BASE + 5;  // ESP_ERR_WIFI_NOT_CONNECT
+    *ap_info = (wifi_ap_record_t){
+        .bssid = SIM_BSSID,
+        .primary = SIM_CHANNEL,
+        .rssi = (int8_t)(-55 - (int)(esp_random() % 5)),
+        .authmode = WIFI_AUTH_WPA2_PSK,
+    };
+    memcpy(ap_info->ssid, s_wifi_config.sta.ssid, sizeof(s_wifi_config.sta.ssid));
+    return ESP_OK;
+}
+
+void sim_wifi_set_link(bool up) {
+    pthread_mutex_lock(&s_wifi_lock);
+    bool drop = s_link_up && !up && s_sta_state == STA_CONNECTED;
+    s_link_up = up;
+    if (drop) s_sta_state = STA_IDLE;
+    pthread_mutex_unlock(&s_wifi_lock);
+    ESP_LOGW(TAG, "Wi-Fi link %s", up ? "restored" : "lost");
+    if (drop) post_disconnected(WIFI_REASON_BEACON_TIMEOUT);
+}
+
+bool sim_wifi_link_up(void) {
+    pthread_mutex_lock(&s_wifi_lock);
+    bool up = s_link_up;
+    pthread_mutex_unlock(&s_wifi_lock);
+    return up;
+}
+
+uint32_t sim_wifi_link_epoch(void) {
+    pthread_mutex_lock(&s_wifi_lock);
+    uint32_t epoch = s_link_epoch;
+    pthread_mutex_unlock(&s_wifi_lock);
+    return epoch;
+}
+
+bool sim_wifi_connected(void) {
+    pthread_mutex_lock(&s_wifi_lock);
+    bool connected = s_sta_state == STA_CONNECTED;
+    pthread_mutex_unlock(&s_wifi_lock);
+    return connected;
+}
+
+static void outage_cb(void *arg) {
+    sim_wifi_set_link(arg == NULL);
+}
+
+// SIM_WIFI_OUTAGE="60+30,600+5": down at 60 s for 30 s, at 600 s for 5 s.
+static void schedule_outages(void) {
+    const char *spec = sim_env_str("SIM_WIFI_OUTAGE", NULL);
+    while (spec && *spec) {
+        char *end;
+        double start_s = strtod(spec, &end);
+        double duration_s = *end == '+' ? strtod(end + 1, &end) : 0;
+        if (duration_s > 0) {
+            esp_timer_handle_t down, up;
+            esp_timer_create(&(esp_timer_create_args_t){.callback = outage_cb, .arg = (void *)1, .name = "sim_down"},
+                             &down);
+            esp_timer_create(&(esp_timer_create_args_t){.callback = outage_cb, .arg = NULL, .name = "sim_up"}, &up);
+            esp_timer_start_once(down, (uint64_t)(start_s * 1e6));
+            esp_timer_start_once(up, (uint64_t)((start_s + duration_s) * 1e6));
+        }
+        spec = strchr(end, ',');
+        if (spec) spec++;
+    }
+}
+
+// SNTP: the host clock stands in for the NTP server.
+
+static pthread_mutex_t s_sntp_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_sntp_running = false;
+static bool s_sntp_synced = false;
+static uint32_t s_sntp_interval_ms = 60 * 60 * 1000;
+static esp_sntp_time_cb_t s_sntp_cb = NULL;
+
+static void *sntp_thread(void *arg) {
+    pthread_setname_np(pthread_self(), "sntp");
+    long first_delay_ms = sim_env_long("SIM_SNTP_DELAY_MS", 500);
+    while (true) {
+        while (!sim_wifi_connected()) sim_sleep_us(100 * 1000);
+        sim_sleep_us(first_delay_ms * 1000);
+        if (!sim_wifi_connected()) continue;
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        pthread_mutex_lock(&s_sntp_lock);
+        s_sntp_synced = true;
+        esp_sntp_time_cb_t cb = s_sntp_cb;
+        uint32_t interval_ms = s_sntp_interval_ms;
+        pthread_mutex_unlock(&s_sntp_lock);
+        if (cb) cb(&tv);
+        sim_sleep_us((int64_t)interval_ms * 1000);
+        first_delay_ms = 0;
+    }
+    return NULL;
+}
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config) {
+    pthread_mutex_lock(&s_sntp_lock);
+    bool start = !s_sntp_running;
+    s_sntp_running = true;
+    s_sntp_cb = config->sync_cb;
+    pthread_mutex_unlock(&s_sntp_lock);
+    if (start && config->start) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, sntp_thread, NULL);
+        pthread_detach(thread);
+    }
+    return ESP_OK;
+}
+
+void esp_netif_sntp_deinit(void) {
+    pthread_mutex_lock(&s_sntp_lock);
+    s_sntp_cb = NULL;
+    pthread_mutex_unlock(&s_sntp_lock);
+}
+
+esp_err_t esp_netif_sntp_sync_wait(TickType_t timeout) {
+    int64_t until = sim_now_us() + (int64_t)timeout * 1000000 / configTICK_RATE_HZ;
+    while (true) {
+        pthread_mutex_lock(&s_sntp_lock);
+        bool synced = s_sntp_synced;
+        pthread_mutex_unlock(&s_sntp_lock);
+        if (synced) return ESP_OK;
+        if (timeout != portMAX_DELAY && sim_now_us() >= until) return ESP_ERR_TIMEOUT;
+        sim_sleep_us(10 * 1000);
+    }
+}
+
+bool esp_sntp_enabled(void) {
+    pthread_mutex_lock(&s_sntp_lock);
+    bool running = s_sntp_running;
+    pthread_mutex_unlock(&s_sntp_lock);
+    return running;
+}
+
+void sntp_set_sync_interval(uint32_t interval_ms) {
+    pthread_mutex_lock(&s_sntp_lock);
+    s_sntp_interval_ms = interval_ms < 15000 ? 15000 : interval_ms;
+    pthread_mutex_unlock(&s_sntp_lock);
+}
+
+uint32_t sntp_get_sync_interval(void) {
+    return s_sntp_interval_ms;
+}
+
+void sim_net_init(void) {
+    schedule_outages();
+}
@@ -0,0 +1,266 @@
+// 1-Wire bus with DS18B20 models, and the onewire_bus component API on top
+// of it (sim_ds18b20.c has the ds18b20 one). The bus decodes ROM and
+// function commands byte by byte the way the RMT driver puts them on the
+// wire; each probe converts the simulated bottle temperature at its
+// configured resolution.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "onewire_bus.h"
+#include "sim.h"
+
+static const char *TAG = "sim_onewire";
+
+#define MAX_PROBES 8
+#define FAMILY_DS18B20 0x28
+
+#define CMD_CONVERT_T 0x44
+#define CMD_WRITE_SCRATCHPAD 0x4E
+#define CMD_READ_SCRATCHPAD 0xBE
+
+typedef struct {
+    uint64_t rom;
+    uint8_t scratchpad[9];
+    int64_t convert_started_us;  // -1 when no conversion is pending
+    int index;
+} ds18b20_model_t;
+
+typedef enum {
+    STATE_IDLE,
+    STATE_ROM_COMMAND,
+    STATE_MATCH_ROM,
+    STATE_FUNCTION,
+    STATE_WRITE_SCRATCHPAD,
+    STATE_READ_SCRATCHPAD,
+} bus_state_t;
+
+struct onewire_bus_t {
+    int gpio;
+};
+
+struct onewire_device_iter_t {
+    onewire_bus_handle_t bus;
+    int next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static ds18b20_model_t s_probes[MAX_PROBES];
+static int s_probe_count = 0;
+static bool s_selected[MAX_PROBES];
+static bus_state_t s_state = STATE_IDLE;
+static uint8_t s_rx[8];
+static int s_rx_len = 0;
+static int s_read_pos = 0;
+static struct onewire_bus_t s_bus;
+
+uint8_t onewire_crc8(uint8_t init_crc, uint8_t *input, size_t input_size) {
+    uint8_t crc = init_crc;
+    for (size_t i = 0; i < input_size; ++i) {
+        uint8_t byte = input[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            byte >>= 1;
+        }
+    }
+    return crc;
+}
+
+static void seal_scratchpad(ds18b20_model_t *p) {
+    p->scratchpad[8] = onewire_crc8(0, p->scratchpad, 8);
+}
+
+// Conversion time and the undefined low bits for the resolution in the
+// configuration register (datasheet table 2).
+static int resolution_bits(const ds18b20_model_t *p) {
+    return 9 + ((p->scratchpad[4] >> 5) & 3);
+}
+
+static int64_t conversion_us(const ds18b20_model_t *p) {
+    return 93750LL << (resolution_bits(p) - 9);
+}
+
+// Caller holds s_lock. The temperature register updates once the
+// conversion has had its full time; a read before then returns the old value.
+static void settle(ds18b20_model_t *p) {
+    if (p->convert_started_us < 0 || sim_now_us() - p->convert_started_us < conversion_us(p)) return;
+    p->convert_started_us = -1;
+    int16_t raw = (int16_t)(sim_env_probe_temp_c(p->index) * 16.0);
+    raw &= (int16_t)~((1 << (12 - resolution_bits(p))) - 1);
+    p->scratchpad[0] = (uint8_t)raw;
+    p->scratchpad[1] = (uint8_t)((uint16_t)raw >> 8);
+    seal_scratchpad(p);
+}
+
+void sim_ds18b20_attach(int count) {
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < count && s_probe_count < MAX_PROBES; ++i) {
+        ds18b20_model_t *p = &s_probes[s_probe_count];
+        uint8_t rom[8] = {FAMILY_DS18B20, (uint8_t)(0xA1 + s_probe_count), 0x5E, 0x11, 0x00, 0x00, 0x00, 0};
+        rom[7] = onewire_crc8(0, rom, 7);
+        p->rom = 0;
+        for (int b = 7; b >= 0; --b) p->rom = (p->rom << 8) | rom[b];
+        // Power-on scratchpad: 85 C, alarm bytes, 12-bit resolution.
+        const uint8_t power_on[8] = {0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10};
+        memcpy(p->scratchpad, power_on, sizeof(power_on));
+        seal_scratchpad(p);
+        p->convert_started_us = -1;
+        p->index = s_probe_count++;
+        ESP_LOGI(TAG, "DS18B20 %016llX", (unsigned long long)p->rom);
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t onewire_new_bus_rmt(const onewire_bus_config_t *bus_config, const onewire_bus_rmt_config_t *rmt_config,
+                              onewire_bus_handle_t *ret_bus) {
+    if (!bus_config || !ret_bus) return ESP_ERR_INVALID_ARG;
+    s_bus.gpio = bus_config->bus_gpio_num;
+    *ret_bus = &s_bus;
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_del(onewire_bus_handle_t bus) {
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_reset(onewire_bus_handle_t bus) {
+    pthread_mutex_lock(&s_lock);
+    s_state = STATE_ROM_COMMAND;
+    memset(s_selected, 0, sizeof(s_selected));
+    bool present = s_probe_count > 0;
+    pthread_mutex_unlock(&s_lock);
+    // Reset pulse plus presence window.
+    sim_sleep_us(960);
+    return present ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// Caller holds s_lock.
+static void function_command(uint8_t cmd) {
+    switch (cmd) {
+    case CMD_CONVERT_T:
+        for (int i = 0; i < s_probe_count; ++i) {
+            if (s_selected[i]) s_probes[i].convert_started_us = sim_now_us();
+        }
+        s_state = STATE_IDLE;
+        break;
+    case CMD_READ_SCRATCHPAD:
+        s_read_pos = 0;
+        s_state = STATE_READ_SCRATCHPAD;
+        break;
+    case CMD_WRITE_SCRATCHPAD:
+        s_rx_len = 0;
+        s_state = STATE_WRITE_SCRATCHPAD;
+        break;
+    default:
+        s_state = STATE_IDLE;
+        break;
+    }
+}
+
+// Caller holds s_lock.
+static void bus_byte(uint8_t byte) {
+    switch (s_state) {
+    case STATE_ROM_COMMAND:
+        if (byte == ONEWIRE_CMD_SKIP_ROM) {
+            for (int i = 0; i < s_probe_count; ++i) s_selected[i] = true;
+            s_state = STATE_FUNCTION;
+        } else if (byte == ONEWIRE_CMD_MATCH_ROM) {
+            s_rx_len = 0;
+            s_state = STATE_MATCH_ROM;
+        } else {
+            s_state = STATE_IDLE;
+        }
+        break;
+    case STATE_MATCH_ROM:
+        s_rx[s_rx_len++] = byte;
+        if (s_rx_len == 8) {
+            uint64_t rom = 0;
+            for (int b = 7; b >= 0; --b) rom = (rom << 8) | s_rx[b];
+            for (int i = 0; i < s_probe_count; ++i) s_selected[i] = s_probes[i].rom == rom;
+            s_state = STATE_FUNCTION;
+        }
+        break;
+    case STATE_FUNCTION:
+        function_command(byte);
+        break;
+    case STATE_WRITE_SCRATCHPAD:
+        s_rx[s_rx_len++] = byte;
+        if (s_rx_len == 3) {
+            for (int i = 0; i < s_probe_count; ++i) {
+                if (!s_selected[i]) continue;
+                // TH, TL and the configuration register (only R1:R0 are writable).
+                s_probes[i].scratchpad[2] = s_rx[0];
+                s_probes[i].scratchpad[3] = s_rx[1];
+                s_probes[i].scratchpad[4] = (uint8_t)((s_rx[2] & 0x60) | 0x1F);
+                seal_scratchpad(&s_probes[i]);
+            }
+            s_state = STATE_IDLE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t bus, const uint8_t *tx_data, uint8_t tx_data_size) {
+    pthread_mutex_lock(&s_lock);
+    for (uint8_t i = 0; i < tx_data_size; ++i) bus_byte(tx_data[i]);
+    pthread_mutex_unlock(&s_lock);
+    // About 70 us per bit slot.
+    sim_sleep_us(70LL * 8 * tx_data_size);
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_read_bytes(onewire_bus_handle_t bus, uint8_t *rx_buf, size_t rx_buf_size) {
+    pthread_mutex_lock(&s_lock);
+    for (size_t n = 0; n < rx_buf_size; ++n) {
+        // Open drain: every selected device pulls the line, so bytes AND.
+        uint8_t byte = 0xFF;
+        if (s_state == STATE_READ_SCRATCHPAD && s_read_pos < 9) {
+            for (int i = 0; i < s_probe_count; ++i) {
+                if (!s_selected[i]) continue;
+                settle(&s_probes[i]);
+                byte &= s_probes[i].scratchpad[s_read_pos];
+            }
+            s_read_pos++;
+        }
+        rx_buf[n] = byte;
+    }
+    pthread_mutex_unlock(&s_lock);
+    sim_sleep_us(70LL * 8 * (int64_t)rx_buf_size);
+    return ESP_OK;
+}
+
+// The ROM search is not bit-banged; the iterator walks the attached probes
+// in the order a search would find them.
+esp_err_t onewire_new_device_iter(onewire_bus_handle_t bus, onewire_device_iter_handle_t *ret_iter) {
+    if (!bus || !ret_iter) return ESP_ERR_INVALID_ARG;
+    struct onewire_device_iter_t *iter = calloc(1, sizeof(*iter));
+    if (!iter) return ESP_ERR_NO_MEM;
+    iter->bus = bus;
+    *ret_iter = iter;
+    return ESP_OK;
+}
+
+esp_err_t onewire_del_device_iter(onewire_device_iter_handle_t iter) {
+    free(iter);
+    return ESP_OK;
+}
+
+esp_err_t onewire_device_iter_get_next(onewire_device_iter_handle_t iter, onewire_device_t *dev) {
+    esp_err_t err = onewire_bus_reset(iter->bus);
+    if (err != ESP_OK) return err;
+    pthread_mutex_lock(&s_lock);
+    err = ESP_ERR_NOT_FOUND;
+    if (iter->next < s_probe_count) {
+        dev->bus = iter->bus;
+        dev->address = s_probes[iter->next++].rom;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
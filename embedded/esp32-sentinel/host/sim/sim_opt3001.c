@@ -0,0 +1,93 @@
+// OPT3001 ambient light sensor: identification registers, the configuration
+// register and an auto-ranged result register that follows the simulated
+// cellar lighting once a conversion has completed.
+
+#include <math.h>
+
+#include "sim.h"
+
+#define REG_RESULT 0x00
+#define REG_CONFIG 0x01
+#define REG_MANUFACTURER_ID 0x7E
+#define REG_DEVICE_ID 0x7F
+
+#define CONFIG_RESET 0xC810
+#define CONFIG_CT (1 << 11)         // 800 ms instead of 100 ms
+#define CONFIG_MODE_MASK (3 << 9)   // 00 shutdown, 01 single shot, 1x continuous
+#define CONFIG_CRF (1 << 7)         // conversion ready
+
+typedef struct {
+    uint8_t ptr;
+    uint16_t config;
+    int64_t started_us;
+} opt3001_model_t;
+
+static opt3001_model_t s_model;
+
+static int64_t conversion_us(const opt3001_model_t *m) {
+    return (m->config & CONFIG_CT) ? 800000 : 100000;
+}
+
+static bool converted(const opt3001_model_t *m) {
+    return (m->config & CONFIG_MODE_MASK) != 0 && sim_now_us() - m->started_us >= conversion_us(m);
+}
+
+// Auto-range picks the finest full-scale range that holds the reading:
+// lux = 0.01 * 2^exponent * mantissa with a 12-bit mantissa.
+static uint16_t encode_lux(double lux) {
+    if (lux < 0) lux = 0;
+    for (int exponent = 0; exponent <= 11; ++exponent) {
+        double mantissa = lux / (0.01 * (double)(1 << exponent));
+        if (mantissa <= 4095.0) return (uint16_t)((exponent << 12) | (uint16_t)lround(mantissa));
+    }
+    return (uint16_t)((11 << 12) | 0x0FFF);
+}
+
+static uint16_t read_register(opt3001_model_t *m, uint8_t reg) {
+    switch (reg) {
+    case REG_RESULT: {
+        if (!converted(m)) return 0;
+        sim_env_t env;
+        sim_env_read(&env);
+        return encode_lux(env.lux);
+    }
+    case REG_CONFIG:
+        return converted(m) ? (m->config | CONFIG_CRF) : m->config;
+    case REG_MANUFACTURER_ID:
+        return 0x5449;
+    case REG_DEVICE_ID:
+        return 0x3001;
+    default:
+        return 0;
+    }
+}
+
+static esp_err_t model_write(void *ctx, const uint8_t *data, size_t len) {
+    opt3001_model_t *m = ctx;
+    m->ptr = data[0];
+    if (len >= 3 && m->ptr == REG_CONFIG) {
+        // Read-only flags (overflow, ready, flag high/low) are not writable.
+        m->config = (uint16_t)((data[1] << 8) | data[2]) & 0xFE1F;
+        m->started_us = sim_now_us();
+    }
+    return ESP_OK;
+}
+
+static esp_err_t model_read(void *ctx, uint8_t *data, size_t len) {
+    opt3001_model_t *m = ctx;
+    uint16_t value = read_register(m, m->ptr);
+    for (size_t i = 0; i < len; ++i) data[i] = (i % 2 == 0) ? (uint8_t)(value >> 8) : (uint8_t)value;
+    return ESP_OK;
+}
+
+void sim_opt3001_attach(uint8_t addr) {
+    s_model = (opt3001_model_t){.config = CONFIG_RESET};
+    sim_i2c_device_t dev = {
+        .name = "OPT3001",
+        .addr = addr,
+        .write = model_write,
+        .read = model_read,
+        .ctx = &s_model,
+    };
+    sim_i2c_attach(&dev);
+}
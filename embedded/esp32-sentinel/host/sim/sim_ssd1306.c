@@ -0,0 +1,345 @@
+// SSD1306 controller model plus the esp_lcd I2C panel IO and SSD1306 panel
+// driver. The model decodes the command stream, keeps GDDRAM in horizontal
+// addressing mode and renders a frame after every pixel transfer:
+//   SIM_DISPLAY=pbm   write SIM_DISPLAY_FILE (default sim-display.pbm)
+//   SIM_DISPLAY=term  draw the panel in the terminal with half blocks
+//   SIM_DISPLAY=none  decode only
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_ssd1306.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+static const char *TAG = "sim_ssd1306";
+
+#define COLS 128
+#define PAGES 8
+#define CONTROL_DATA 0x40
+
+typedef enum {
+    RENDER_NONE,
+    RENDER_PBM,
+    RENDER_TERM,
+} render_mode_t;
+
+typedef struct {
+    uint8_t gddram[PAGES][COLS];
+    uint8_t col_start, col_end, col;
+    uint8_t page_start, page_end, page;
+    uint8_t addr_mode;
+    bool seg_remap;   // A1: column 127 is SEG0
+    bool com_remap;   // C8: scan from COM[N-1]
+    bool display_on;
+    uint8_t mux;
+    // Command bytes collected until the command's parameters are complete.
+    uint8_t pending[4];
+    int pending_len;
+    render_mode_t render;
+    const char *pbm_path;
+} ssd1306_model_t;
+
+static ssd1306_model_t s_model;
+static atomic_uint s_frames;
+
+uint32_t sim_display_frames(void) {
+    return atomic_load(&s_frames);
+}
+
+static int param_count(uint8_t cmd) {
+    switch (cmd) {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+    case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+        return 1;
+    case 0x21: case 0x22:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+static void run_command(ssd1306_model_t *m, const uint8_t *c) {
+    switch (c[0]) {
+    case 0x20: m->addr_mode = c[1] & 3; break;
+    case 0x21:
+        m->col_start = m->col = c[1] & 0x7F;
+        m->col_end = c[2] & 0x7F;
+        break;
+    case 0x22:
+        m->page_start = m->page = c[1] & 7;
+        m->page_end = c[2] & 7;
+        break;
+    case 0xA0: m->seg_remap = false; break;
+    case 0xA1: m->seg_remap = true; break;
+    case 0xC0: m->com_remap = false; break;
+    case 0xC8: m->com_remap = true; break;
+    case 0xA8: m->mux = c[1] & 0x3F; break;
+    case 0xAE: m->display_on = false; break;
+    case 0xAF: m->display_on = true; break;
+    default: break;  // contrast, clocks, charge pump: no visible effect here
+    }
+}
+
+static void write_pixels(ssd1306_model_t *m, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        m->gddram[m->page][m->col] = data[i];
+        if (m->col < m->col_end) {
+            m->col++;
+            continue;
+        }
+        m->col = m->col_start;
+        // Horizontal mode wraps to the next page; page mode stays on the page.
+        if (m->addr_mode == 0) m->page = m->page < m->page_end ? m->page + 1 : m->page_start;
+    }
+}
+
+static bool pixel(const ssd1306_model_t *m, int x, int y) {
+    if (!m->display_on) return false;
+    // A1 + C8 is how the module is mounted upright; A0/C0 flip the image.
+    int col = m->seg_remap ? x : COLS - 1 - x;
+    int row = m->com_remap ? y : (m->mux + 1) - 1 - y;
+    if (row < 0 || row >= PAGES * 8) return false;
+    return (m->gddram[row / 8][col] >> (row % 8)) & 1;
+}
+
+static void render_pbm(const ssd1306_model_t *m) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->pbm_path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return;
+    // P4 is 1 = black; lit pixels are drawn white as on the panel.
+    fprintf(f, "P4\n%d %d\n", COLS, PAGES * 8);
+    for (int y = 0; y < PAGES * 8; ++y) {
+        uint8_t row[COLS / 8];
+        for (int b = 0; b < COLS / 8; ++b) {
+            uint8_t bits = 0;
+            for (int x = 0; x < 8; ++x) bits |= (pixel(m, b * 8 + x, y) ? 0 : 1) << (7 - x);
+            row[b] = bits;
+        }
+        fwrite(row, 1, sizeof(row), f);
+    }
+    fclose(f);
+    rename(tmp, m->pbm_path);
+}
+
+static void render_term(const ssd1306_model_t *m) {
+    // Two pixel rows per text line: 32 lines of up to 3 UTF-8 bytes per column.
+    static char frame[(COLS * 3 + 8) * (PAGES * 4 + 2) + 16];
+    size_t n = 0;
+    n += (size_t)snprintf(frame + n, sizeof(frame) - n, "\033[H+");
+    for (int x = 0; x < COLS; ++x) frame[n++] = '-';
+    n += (size_t)snprintf(frame + n, sizeof(frame) - n, "+\n");
+    for (int y = 0; y < PAGES * 8; y += 2) {
+        frame[n++] = '|';
+        for (int x = 0; x < COLS; ++x) {
+            bool top = pixel(m, x, y), bottom = pixel(m, x, y + 1);
+            const char *glyph = top ? (bottom ? "█" : "▀") : (bottom ? "▄" : " ");
+            size_t len = strlen(glyph);
+            memcpy(frame + n, glyph, len);
+            n += len;
+        }
+        frame[n++] = '|';
+        frame[n++] = '\n';
+    }
+    frame[n++] = '+';
+    for (int x = 0; x < COLS; ++x) frame[n++] = '-';
+    frame[n++] = '+';
+    frame[n++] = '\n';
+    fwrite(frame, 1, n, stdout);
+    fflush(stdout);
+}
+
+static esp_err_t model_write(void *ctx, const uint8_t *data, size_t len) {
+    ssd1306_model_t *m = ctx;
+    if (len == 0) return ESP_OK;
+    if (data[0] & CONTROL_DATA) {
+        write_pixels(m, data + 1, len - 1);
+        atomic_fetch_add(&s_frames, 1);
+        if (m->render == RENDER_PBM) render_pbm(m);
+        if (m->render == RENDER_TERM) render_term(m);
+        return ESP_OK;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if (m->pending_len < (int)sizeof(m->pending)) m->pending[m->pending_len++] = data[i];
+        if (m->pending_len > param_count(m->pending[0])) {
+            run_command(m, m->pending);
+            m->pending_len = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t model_read(void *ctx, uint8_t *data, size_t len) {
+    ssd1306_model_t *m = ctx;
+    // Status byte: bit 6 set while the display is off.
+    memset(data, m->display_on ? 0x00 : 0x40, len);
+    return ESP_OK;
+}
+
+void sim_ssd1306_attach(uint8_t addr) {
+    ssd1306_model_t *m = &s_model;
+    memset(m, 0, sizeof(*m));
+    m->col_end = COLS - 1;
+    m->page_end = PAGES - 1;
+    m->addr_mode = 2;  // page addressing after reset
+    m->mux = PAGES * 8 - 1;
+    const char *mode = sim_env_str("SIM_DISPLAY", "pbm");
+    m->render = strcmp(mode, "term") == 0 ? RENDER_TERM : strcmp(mode, "none") == 0 ? RENDER_NONE : RENDER_PBM;
+    m->pbm_path = sim_env_str("SIM_DISPLAY_FILE", "sim-display.pbm");
+    if (m->render == RENDER_TERM) fputs("\033[2J", stdout);
+    sim_i2c_device_t dev = {
+        .name = "SSD1306",
+        .addr = addr,
+        .write = model_write,
+        .read = model_read,
+        .ctx = m,
+    };
+    sim_i2c_attach(&dev);
+}
+
+// ---------------------------------------------------------------------------
+// esp_lcd panel IO over I2C
+
+struct esp_lcd_panel_io_t {
+    i2c_master_dev_handle_t dev;
+    size_t control_phase_bytes;
+    unsigned int dc_bit_offset;
+    bool dc_low_on_data;
+    int lcd_cmd_bits;
+};
+
+esp_err_t esp_lcd_new_panel_io_i2c(i2c_master_bus_handle_t bus, const esp_lcd_panel_io_i2c_config_t *io_config,
+                                   esp_lcd_panel_io_handle_t *ret_io) {
+    if (!bus || !io_config || !ret_io) return ESP_ERR_INVALID_ARG;
+    struct esp_lcd_panel_io_t *io = calloc(1, sizeof(*io));
+    if (!io) return ESP_ERR_NO_MEM;
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = (uint16_t)io_config->dev_addr,
+        .scl_speed_hz = io_config->scl_speed_hz,
+    };
+    esp_err_t err = i2c_master_bus_add_device(bus, &dev_cfg, &io->dev);
+    if (err != ESP_OK) {
+        free(io);
+        return err;
+    }
+    io->control_phase_bytes = io_config->flags.disable_control_phase ? 0 : io_config->control_phase_bytes;
+    io->dc_bit_offset = io_config->dc_bit_offset;
+    io->dc_low_on_data = io_config->flags.dc_low_on_data;
+    io->lcd_cmd_bits = io_config->lcd_cmd_bits;
+    *ret_io = io;
+    return ESP_OK;
+}
+
+// One transaction: control byte with the D/C bit, the command, then payload.
+static esp_err_t io_tx(esp_lcd_panel_io_handle_t io, bool is_data, int lcd_cmd, const void *payload, size_t size) {
+    size_t len = 0;
+    uint8_t *buf = malloc(2 + size);
+    if (!buf) return ESP_ERR_NO_MEM;
+    if (io->control_phase_bytes) {
+        bool dc = is_data != io->dc_low_on_data;
+        buf[len++] = dc ? (uint8_t)(1u << io->dc_bit_offset) : 0;
+    }
+    if (lcd_cmd >= 0 && io->lcd_cmd_bits > 0) buf[len++] = (uint8_t)lcd_cmd;
+    if (size) memcpy(buf + len, payload, size);
+    esp_err_t err = i2c_master_transmit(io->dev, buf, len + size, -1);
+    free(buf);
+    return err;
+}
+
+esp_err_t esp_lcd_panel_io_tx_param(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *param, size_t param_size) {
+    return io_tx(io, false, lcd_cmd, param, param_size);
+}
+
+esp_err_t esp_lcd_panel_io_tx_color(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *color, size_t color_size) {
+    return io_tx(io, true, lcd_cmd, color, color_size);
+}
+
+esp_err_t esp_lcd_panel_io_del(esp_lcd_panel_io_handle_t io) {
+    if (!io) return ESP_ERR_INVALID_ARG;
+    i2c_master_bus_rm_device(io->dev);
+    free(io);
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------------------
+// esp_lcd SSD1306 panel
+
+struct esp_lcd_panel_t {
+    esp_lcd_panel_io_handle_t io;
+    uint8_t height;
+};
+
+esp_err_t esp_lcd_new_panel_ssd1306(esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t *panel_dev_config,
+                                    esp_lcd_panel_handle_t *ret_panel) {
+    if (!io || !panel_dev_config || !ret_panel) return ESP_ERR_INVALID_ARG;
+    if (panel_dev_config->bits_per_pixel != 1) return ESP_ERR_INVALID_ARG;
+    struct esp_lcd_panel_t *panel = calloc(1, sizeof(*panel));
+    if (!panel) return ESP_ERR_NO_MEM;
+    const esp_lcd_panel_ssd1306_config_t *vendor = panel_dev_config->vendor_config;
+    panel->io = io;
+    panel->height = vendor && vendor->height ? vendor->height : 64;
+    *ret_panel = panel;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_reset(esp_lcd_panel_handle_t panel) {
+    // No reset GPIO on the module; the controller keeps its state.
+    return panel ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_lcd_panel_init(esp_lcd_panel_handle_t panel) {
+    if (!panel) return ESP_ERR_INVALID_ARG;
+    esp_lcd_panel_io_handle_t io = panel->io;
+    uint8_t mode = 0x00;  // horizontal addressing
+    uint8_t mux = panel->height - 1;
+    uint8_t com_pins = panel->height == 64 ? 0x12 : 0x02;
+    uint8_t charge_pump = 0x14;
+    esp_err_t err = esp_lcd_panel_io_tx_param(io, 0xAE, NULL, 0);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(io, 0x20, &mode, 1);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(io, 0xA8, &mux, 1);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(io, 0xDA, &com_pins, 1);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(io, 0x8D, &charge_pump, 1);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(io, 0xA0, NULL, 0);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(io, 0xC0, NULL, 0);
+    // The charge pump needs time to settle before the panel is switched on.
+    if (err == ESP_OK) vTaskDelay(pdMS_TO_TICKS(100));
+    return err;
+}
+
+esp_err_t esp_lcd_panel_del(esp_lcd_panel_handle_t panel) {
+    free(panel);
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+                                    const void *color_data) {
+    if (!panel || x_start >= x_end || y_start >= y_end) return ESP_ERR_INVALID_ARG;
+    uint8_t cols[2] = {(uint8_t)x_start, (uint8_t)(x_end - 1)};
+    uint8_t pages[2] = {(uint8_t)(y_start / 8), (uint8_t)((y_end - 1) / 8)};
+    esp_err_t err = esp_lcd_panel_io_tx_param(panel->io, 0x21, cols, 2);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(panel->io, 0x22, pages, 2);
+    if (err != ESP_OK) return err;
+    size_t len = (size_t)(x_end - x_start) * (size_t)(pages[1] - pages[0] + 1);
+    return esp_lcd_panel_io_tx_color(panel->io, -1, color_data, len);
+}
+
+esp_err_t esp_lcd_panel_mirror(esp_lcd_panel_handle_t panel, bool mirror_x, bool mirror_y) {
+    if (!panel) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = esp_lcd_panel_io_tx_param(panel->io, mirror_x ? 0xA1 : 0xA0, NULL, 0);
+    if (err == ESP_OK) err = esp_lcd_panel_io_tx_param(panel->io, mirror_y ? 0xC8 : 0xC0, NULL, 0);
+    return err;
+}
+
+esp_err_t esp_lcd_panel_disp_on_off(esp_lcd_panel_handle_t panel, bool on_off) {
+    if (!panel) return ESP_ERR_INVALID_ARG;
+    if (!on_off) ESP_LOGD(TAG, "Panel off");
+    return esp_lcd_panel_io_tx_param(panel->io, on_off ? 0xAF : 0xAE, NULL, 0);
+}
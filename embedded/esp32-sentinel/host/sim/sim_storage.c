@@ -0,0 +1,411 @@
+// NVS and data partitions backed by files in the working directory, so state
+// survives a simulator restart the way flash survives a reboot.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim.h"
+
+static const char *TAG = "sim_storage";
+
+// NVS: an in-memory key/value table; nvs_commit rewrites the file atomically.
+
+#define NVS_KEY_MAX 15
+#define NVS_MAX_HANDLES 16
+
+typedef enum {
+    NVS_TYPE_U8 = 0x01,
+    NVS_TYPE_U32 = 0x04,
+    NVS_TYPE_I64 = 0x18,
+    NVS_TYPE_STR = 0x21,
+    NVS_TYPE_BLOB = 0x42,
+} nvs_type_t;
+
+typedef struct entry {
+    char ns[NVS_KEY_MAX + 1];
+    char key[NVS_KEY_MAX + 1];
+    nvs_type_t type;
+    size_t len;
+    uint8_t *data;
+    struct entry *next;
+} entry_t;
+
+typedef struct {
+    bool used;
+    bool writable;
+    char ns[NVS_KEY_MAX + 1];
+} handle_t;
+
+static pthread_mutex_t s_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static entry_t *s_entries = NULL;
+static handle_t s_handles[NVS_MAX_HANDLES + 1];  // handle 0 is never issued
+static bool s_nvs_ready = false;
+
+static const char *nvs_path(void) {
+    return sim_env_str("SIM_NVS", "sim-nvs.bin");
+}
+
+static void free_entries(void) {
+    while (s_entries) {
+        entry_t *next = s_entries->next;
+        free(s_entries->data);
+        free(s_entries);
+        s_entries = next;
+    }
+}
+
+// File format: per entry [type][ns_len][ns][key_len][key][u32 len][data].
+static bool read_string(FILE *f, char *out) {
+    int len = fgetc(f);
+    if (len < 0 || len > NVS_KEY_MAX || fread(out, 1, (size_t)len, f) != (size_t)len) return false;
+    out[len] = '\0';
+    return true;
+}
+
+static void load_nvs(void) {
+    FILE *f = fopen(nvs_path(), "rb");
+    if (!f) return;
+    entry_t **tail = &s_entries;
+    int type;
+    while ((type = fgetc(f)) != EOF) {
+        entry_t *e = calloc(1, sizeof(*e));
+        uint32_t len = 0;
+        if (!e || !read_string(f, e->ns) || !read_string(f, e->key) || fread(&len, sizeof(len), 1, f) != 1 ||
+            len > 64 * 1024) {
+            free(e);
+            ESP_LOGW(TAG, "%s is truncated; keeping what was read", nvs_path());
+            break;
+        }
+        e->type = (nvs_type_t)type;
+        e->len = len;
+        e->data = malloc(len ? len : 1);
+        if (!e->data || fread(e->data, 1, len, f) != len) {
+            free(e->data);
+            free(e);
+            break;
+        }
+        *tail = e;
+        tail = &e->next;
+    }
+    fclose(f);
+}
+
+static esp_err_t save_nvs(void) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", nvs_path());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return ESP_FAIL;
+    for (entry_t *e = s_entries; e; e = e->next) {
+        uint8_t ns_len = (uint8_t)strlen(e->ns);
+        uint8_t key_len = (uint8_t)strlen(e->key);
+        uint32_t len = (uint32_t)e->len;
+        fputc(e->type, f);
+        fputc(ns_len, f);
+        fwrite(e->ns, 1, ns_len, f);
+        fputc(key_len, f);
+        fwrite(e->key, 1, key_len, f);
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(e->data, 1, e->len, f);
+    }
+    bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, nvs_path()) != 0) {
+        ESP_LOGE(TAG, "Writing %s failed: %s", nvs_path(), strerror(errno));
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void) {
+    pthread_mutex_lock(&s_nvs_lock);
+    if (!s_nvs_ready) {
+        load_nvs();
+        s_nvs_ready = true;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&s_nvs_lock);
+    free_entries();
+    unlink(nvs_path());
+    s_nvs_ready = false;
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+// Caller holds s_nvs_lock.
+static entry_t *find(const char *ns, const char *key) {
+    for (entry_t *e = s_entries; e; e = e->next) {
+        if (strcmp(e->ns, ns) == 0 && strcmp(e->key, key) == 0) return e;
+    }
+    return NULL;
+}
+
+static bool namespace_exists(const char *ns) {
+    for (entry_t *e = s_entries; e; e = e->next) {
+        if (strcmp(e->ns, ns) == 0) return true;
+    }
+    return false;
+}
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (strlen(name_space) > NVS_KEY_MAX) return ESP_ERR_NVS_KEY_TOO_LONG;
+    esp_err_t err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    pthread_mutex_lock(&s_nvs_lock);
+    if (!s_nvs_ready) {
+        err = ESP_ERR_NVS_NOT_INITIALIZED;
+    } else if (open_mode == NVS_READONLY && !namespace_exists(name_space)) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        for (nvs_handle_t h = 1; h <= NVS_MAX_HANDLES; ++h) {
+            if (!s_handles[h].used) {
+                s_handles[h] = (handle_t){.used = true, .writable = open_mode == NVS_READWRITE};
+                snprintf(s_handles[h].ns, sizeof(s_handles[h].ns), "%s", name_space);
+                *out_handle = h;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_nvs_lock);
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES) s_handles[handle].used = false;
+    pthread_mutex_unlock(&s_nvs_lock);
+}
+
+static handle_t *lookup(nvs_handle_t handle) {
+    if (handle < 1 || handle > NVS_MAX_HANDLES || !s_handles[handle].used) return NULL;
+    return &s_handles[handle];
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_nvs_lock);
+    esp_err_t err = lookup(handle) ? save_nvs() : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t len) {
+    if (strlen(key) > NVS_KEY_MAX) return ESP_ERR_NVS_KEY_TOO_LONG;
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_nvs_lock);
+    handle_t *h = lookup(handle);
+    if (!h) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        entry_t *e = find(h->ns, key);
+        if (!e) {
+            e = calloc(1, sizeof(*e));
+            if (e) {
+                snprintf(e->ns, sizeof(e->ns), "%s", h->ns);
+                snprintf(e->key, sizeof(e->key), "%s", key);
+                e->next = s_entries;
+                s_entries = e;
+            }
+        }
+        uint8_t *data = e ? malloc(len ? len : 1) : NULL;
+        if (!data) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            memcpy(data, value, len);
+            free(e->data);
+            e->data = data;
+            e->len = len;
+            e->type = type;
+        }
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+// Variable-length reads: with out NULL only the length is reported; a short
+// buffer is an error, as with the real API.
+static esp_err_t get_value(nvs_handle_t handle, const char *key, nvs_type_t type, void *out, size_t *length,
+                           bool fixed) {
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_nvs_lock);
+    handle_t *h = lookup(handle);
+    entry_t *e = h ? find(h->ns, key) : NULL;
+    if (!h) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!e || e->type != type) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (fixed) {
+        memcpy(out, e->data, e->len);
+    } else if (!out) {
+        *length = e->len;
+    } else if (*length < e->len) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out, e->data, e->len);
+        *length = e->len;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    pthread_mutex_lock(&s_nvs_lock);
+    handle_t *h = lookup(handle);
+    if (!h) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!h->writable) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        for (entry_t **p = &s_entries; *p; p = &(*p)->next) {
+            entry_t *e = *p;
+            if (strcmp(e->ns, h->ns) == 0 && strcmp(e->key, key) == 0) {
+                *p = e->next;
+                free(e->data);
+                free(e);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return set_value(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return get_value(handle, key, NVS_TYPE_STR, out_value, length, false);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return set_value(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return get_value(handle, key, NVS_TYPE_BLOB, out_value, length, false);
+}
+
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char *key, int64_t value) {
+    return set_value(handle, key, NVS_TYPE_I64, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char *key, int64_t *out_value) {
+    return get_value(handle, key, NVS_TYPE_I64, out_value, NULL, true);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return set_value(handle, key, NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    return get_value(handle, key, NVS_TYPE_U32, out_value, NULL, true);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return set_value(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    return get_value(handle, key, NVS_TYPE_U8, out_value, NULL, true);
+}
+
+// Data partitions from partitions.csv, each mmap'd from sim-<label>.bin.
+
+#define FLASH_SECTOR 4096
+
+typedef struct {
+    esp_partition_t part;
+    uint8_t *mem;
+} sim_partition_t;
+
+static sim_partition_t s_partitions[] = {
+    {.part = {.type = ESP_PARTITION_TYPE_DATA, .subtype = (esp_partition_subtype_t)0x40,
+              .address = 0x300000, .size = 0x100000, .erase_size = FLASH_SECTOR, .label = "tsdb"}},
+};
+
+static pthread_mutex_t s_part_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Caller holds s_part_lock. A new or wrongly sized file starts erased.
+static bool map_partition(sim_partition_t *p) {
+    if (p->mem) return true;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/sim-%s.bin", sim_env_str("SIM_FLASH_DIR", "."), p->part.label);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || st.st_size != (off_t)p->part.size;
+    if (fresh && ftruncate(fd, p->part.size) != 0) {
+        close(fd);
+        return false;
+    }
+    void *mem = mmap(NULL, p->part.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return false;
+    p->mem = mem;
+    if (fresh) memset(p->mem, 0xFF, p->part.size);
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    const esp_partition_t *found = NULL;
+    pthread_mutex_lock(&s_part_lock);
+    for (size_t i = 0; i < sizeof(s_partitions) / sizeof(s_partitions[0]); ++i) {
+        sim_partition_t *p = &s_partitions[i];
+        if (type != ESP_PARTITION_TYPE_ANY && p->part.type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p->part.subtype != subtype) continue;
+        if (label && strcmp(label, p->part.label) != 0) continue;
+        if (map_partition(p)) found = &p->part;
+        break;
+    }
+    pthread_mutex_unlock(&s_part_lock);
+    return found;
+}
+
+static sim_partition_t *backing(const esp_partition_t *partition) {
+    return (sim_partition_t *)((uint8_t *)partition - offsetof(sim_partition_t, part));
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (!partition || src_offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, backing(partition)->mem + src_offset, size);
+    return ESP_OK;
+}
+
+// NOR flash can only clear bits; writing over unerased data ANDs into it.
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src,
+                              size_t size) {
+    if (!partition || dst_offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+    uint8_t *mem = backing(partition)->mem + dst_offset;
+    const uint8_t *in = src;
+    for (size_t i = 0; i < size; ++i) mem[i] &= in[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (!partition || offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+    if (offset % FLASH_SECTOR != 0 || size % FLASH_SECTOR != 0) return ESP_ERR_INVALID_ARG;
+    memset(backing(partition)->mem + offset, 0xFF, size);
+    return ESP_OK;
+}
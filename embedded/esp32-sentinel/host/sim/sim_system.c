@@ -0,0 +1,530 @@
+// System services: clock, logging, error names, RNG, MAC, restart, chip and
+// app descriptors, the task watchdog, power management, ROM CRC and base64.
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_app_desc.h"
+#include "esp_chip_info.h"
+#include "esp_flash.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_pm.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "mbedtls/base64.h"
+#include "nvs.h"
+#include "sim.h"
+
+#ifndef PROJECT_VER
+#define PROJECT_VER "sim"
+#endif
+
+// Free internal RAM of a running sentinel, reported by the heap calls.
+#define SIM_FREE_HEAP (180 * 1024)
+#define SIM_LARGEST_BLOCK (110 * 1024)
+
+static const char *TAG = "sim_system";
+
+static struct timespec s_start;
+
+int64_t sim_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - s_start.tv_sec) * 1000000 + (now.tv_nsec - s_start.tv_nsec) / 1000;
+}
+
+void sim_sleep_us(int64_t us) {
+    if (us <= 0) return;
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+bool sim_deadline(TickType_t ticks, struct timespec *out) {
+    if (ticks == portMAX_DELAY) return false;
+    clock_gettime(CLOCK_MONOTONIC, out);
+    int64_t ns = out->tv_nsec + (int64_t)ticks * (1000000000 / configTICK_RATE_HZ);
+    out->tv_sec += ns / 1000000000;
+    out->tv_nsec = ns % 1000000000;
+    return true;
+}
+
+const char *sim_env_str(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    return value && value[0] ? value : fallback;
+}
+
+long sim_env_long(const char *name, long fallback) {
+    const char *value = getenv(name);
+    return value && value[0] ? strtol(value, NULL, 0) : fallback;
+}
+
+double sim_env_double(const char *name, double fallback) {
+    const char *value = getenv(name);
+    return value && value[0] ? strtod(value, NULL) : fallback;
+}
+
+bool sim_device_enabled(const char *name, int *count) {
+    const char *list = sim_env_str("SIM_DEVICES", "bme280,opt3001,veml7700,ssd1306,ds18b20:2");
+    size_t name_len = strlen(name);
+    for (const char *p = list; *p;) {
+        size_t len = strcspn(p, ",");
+        size_t key_len = strcspn(p, ",:");
+        if (key_len > len) key_len = len;
+        if (key_len == name_len && strncmp(p, name, name_len) == 0) {
+            if (count) *count = p[key_len] == ':' ? atoi(p + key_len + 1) : 1;
+            return true;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    return false;
+}
+
+const char *sim_api_base(void) {
+    return sim_env_str("SIM_API_BASE", "http://127.0.0.1:3000/api");
+}
+
+const char *sim_faults(void) {
+    return sim_env_str("SIM_FAULTS", "");
+}
+
+// Logging, in the target's "I (1234) tag: message" format.
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+static vprintf_like_t s_vprintf = vprintf;
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int write_log(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = s_vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > s_log_level || level == ESP_LOG_NONE) return;
+    static const char letters[] = "NEWIDV";
+    static const char *colors[] = {"", "\033[0;31m", "\033[0;33m", "\033[0;32m", "", ""};
+    bool color = isatty(STDOUT_FILENO) && level <= ESP_LOG_INFO;
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    pthread_mutex_lock(&s_log_lock);
+    write_log("%s%c (%" PRIu32 ") %s: %s%s\n", color ? colors[level] : "", letters[level],
+              esp_log_timestamp(), tag, message, color ? "\033[0m" : "");
+    fflush(stdout);
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0) s_log_level = level;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    vprintf_like_t previous = s_vprintf;
+    s_vprintf = func;
+    return previous;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(sim_now_us() / 1000);
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_INVALID_MAC: return "ESP_ERR_INVALID_MAC";
+        case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NOT_ALLOWED: return "ESP_ERR_NOT_ALLOWED";
+        case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NOT_ENOUGH_SPACE: return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+        case ESP_ERR_HTTP_MAX_REDIRECT: return "ESP_ERR_HTTP_MAX_REDIRECT";
+        case ESP_ERR_HTTP_CONNECT: return "ESP_ERR_HTTP_CONNECT";
+        case ESP_ERR_HTTP_WRITE_DATA: return "ESP_ERR_HTTP_WRITE_DATA";
+        case ESP_ERR_HTTP_FETCH_HEADER: return "ESP_ERR_HTTP_FETCH_HEADER";
+        case ESP_ERR_HTTP_INVALID_TRANSPORT: return "ESP_ERR_HTTP_INVALID_TRANSPORT";
+        case ESP_ERR_HTTP_CONNECTING: return "ESP_ERR_HTTP_CONNECTING";
+        case ESP_ERR_HTTP_EAGAIN: return "ESP_ERR_HTTP_EAGAIN";
+        case ESP_ERR_HTTP_CONNECTION_CLOSED: return "ESP_ERR_HTTP_CONNECTION_CLOSED";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+// xorshift64*: seeded from SIM_SEED when set, so a run can be replayed.
+static uint64_t s_rng_state;
+static pthread_mutex_t s_rng_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t esp_random(void) {
+    pthread_mutex_lock(&s_rng_lock);
+    uint64_t x = s_rng_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    s_rng_state = x;
+    pthread_mutex_unlock(&s_rng_lock);
+    return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+void esp_fill_random(void *buf, size_t len) {
+    uint8_t *out = buf;
+    for (size_t i = 0; i < len; i += 4) {
+        uint32_t r = esp_random();
+        size_t n = len - i < 4 ? len - i : 4;
+        memcpy(out + i, &r, n);
+    }
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    unsigned int b[6];
+    const char *text = sim_env_str("SIM_MAC", "24:0a:c4:00:5e:01");
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+        return ESP_ERR_INVALID_MAC;
+    }
+    for (int i = 0; i < 6; ++i) mac[i] = (uint8_t)b[i];
+    if (type == ESP_MAC_WIFI_SOFTAP) mac[5] += 1;
+    return ESP_OK;
+}
+
+static char **s_argv;
+static esp_reset_reason_t s_reset_reason = ESP_RST_POWERON;
+
+void esp_restart(void) {
+    ESP_LOGW(TAG, "esp_restart: re-executing");
+    fflush(NULL);
+    setenv("SIM_RESET_REASON", "sw", 1);
+    execv("/proc/self/exe", s_argv);
+    ESP_LOGE(TAG, "exec failed: %s", strerror(errno));
+    _exit(1);
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return s_reset_reason;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return SIM_FREE_HEAP;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return SIM_FREE_HEAP;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return SIM_FREE_HEAP;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return SIM_FREE_HEAP;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return SIM_LARGEST_BLOCK;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+void esp_chip_info(esp_chip_info_t *out_info) {
+    *out_info = (esp_chip_info_t){
+        .model = CHIP_ESP32,
+        .features = CHIP_FEATURE_EMB_FLASH | CHIP_FEATURE_WIFI_BGN | CHIP_FEATURE_BT | CHIP_FEATURE_BLE,
+        .revision = 301,
+        .cores = 2,
+    };
+}
+
+esp_err_t esp_flash_get_size(esp_flash_t *chip, uint32_t *out_size) {
+    *out_size = 4 * 1024 * 1024;
+    return ESP_OK;
+}
+
+static esp_app_desc_t s_app_desc = {
+    .magic_word = 0xABCD5432,
+    .version = PROJECT_VER,
+    .project_name = "esp32-sentinel",
+    .time = __TIME__,
+    .date = __DATE__,
+    .idf_ver = "v5.5.1-sim",
+};
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    return &s_app_desc;
+}
+
+int esp_app_get_elf_sha256(char *dst, size_t size) {
+    size_t n = 0;
+    for (size_t i = 0; i < sizeof(s_app_desc.app_elf_sha256) && n + 2 < size; ++i, n += 2) {
+        snprintf(dst + n, 3, "%02x", s_app_desc.app_elf_sha256[i]);
+    }
+    if (size > 0) dst[n] = '\0';
+    return (int)n;
+}
+
+// Task watchdog: subscribed threads must reset within the timeout.
+#define WDT_MAX_TASKS 16
+
+typedef struct {
+    TaskHandle_t task;
+    int64_t last_reset_us;
+    bool reported;
+} wdt_entry_t;
+
+static pthread_mutex_t s_wdt_lock = PTHREAD_MUTEX_INITIALIZER;
+static wdt_entry_t s_wdt[WDT_MAX_TASKS];
+static esp_task_wdt_config_t s_wdt_config;
+static bool s_wdt_running = false;
+
+static void *wdt_thread(void *arg) {
+    pthread_setname_np(pthread_self(), "task_wdt");
+    while (true) {
+        sim_sleep_us(1000000);
+        pthread_mutex_lock(&s_wdt_lock);
+        int64_t now = sim_now_us();
+        for (int i = 0; i < WDT_MAX_TASKS; ++i) {
+            wdt_entry_t *e = &s_wdt[i];
+            if (!e->task || e->reported) continue;
+            if (now - e->last_reset_us > (int64_t)s_wdt_config.timeout_ms * 1000) {
+                ESP_LOGE(TAG, "Task watchdog got triggered by %s", pcTaskGetName(e->task));
+                e->reported = true;
+                if (s_wdt_config.trigger_panic) abort();
+            }
+        }
+        pthread_mutex_unlock(&s_wdt_lock);
+    }
+    return NULL;
+}
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config) {
+    pthread_mutex_lock(&s_wdt_lock);
+    s_wdt_config = *config;
+    bool start = !s_wdt_running;
+    s_wdt_running = true;
+    pthread_mutex_unlock(&s_wdt_lock);
+    if (start) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, wdt_thread, NULL);
+        pthread_detach(thread);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config) {
+    pthread_mutex_lock(&s_wdt_lock);
+    s_wdt_config = *config;
+    pthread_mutex_unlock(&s_wdt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_wdt_lock);
+    if (!s_wdt_running) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        for (int i = 0; i < WDT_MAX_TASKS; ++i) {
+            if (s_wdt[i].task == task) {
+                err = ESP_ERR_INVALID_ARG;
+                break;
+            }
+            if (!s_wdt[i].task) {
+                s_wdt[i] = (wdt_entry_t){.task = task, .last_reset_us = sim_now_us()};
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_wdt_lock);
+    return err;
+}
+
+esp_err_t esp_task_wdt_delete(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&s_wdt_lock);
+    for (int i = 0; i < WDT_MAX_TASKS; ++i) {
+        if (s_wdt[i].task == task) s_wdt[i].task = NULL;
+    }
+    pthread_mutex_unlock(&s_wdt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    pthread_mutex_lock(&s_wdt_lock);
+    for (int i = 0; i < WDT_MAX_TASKS; ++i) {
+        if (s_wdt[i].task == task) {
+            s_wdt[i].last_reset_us = sim_now_us();
+            s_wdt[i].reported = false;
+            err = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_wdt_lock);
+    return err;
+}
+
+// Power management: configuration and locks are accepted and counted. The
+// host never scales its clock or light-sleeps, so no sleep callbacks fire.
+struct esp_pm_lock {
+    const char *name;
+    int held;
+};
+
+esp_err_t esp_pm_configure(const void *config) {
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name,
+                             esp_pm_lock_handle_t *out_handle) {
+    struct esp_pm_lock *lock = calloc(1, sizeof(*lock));
+    if (!lock) return ESP_ERR_NO_MEM;
+    lock->name = name;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    __atomic_add_fetch(&handle->held, 1, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    return __atomic_sub_fetch(&handle->held, 1, __ATOMIC_RELAXED) < 0 ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t esp_pm_light_sleep_register_cbs(esp_pm_sleep_cbs_register_config_t *cbs_conf) {
+    return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    // Same convention as the ROM: the caller's running value, pre/post inverted.
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static int base64_value(unsigned char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+    size_t chars = 0;
+    size_t pad = 0;
+    for (size_t i = 0; i < slen; ++i) {
+        if (src[i] == '\r' || src[i] == '\n' || src[i] == ' ') continue;
+        if (src[i] == '=') {
+            pad++;
+        } else if (pad > 0 || base64_value(src[i]) < 0) {
+            return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        }
+        chars++;
+    }
+    if (pad > 2 || chars % 4 != 0) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    size_t need = chars / 4 * 3 - pad;
+    *olen = need;
+    if (!dst || dlen < need) return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < slen; ++i) {
+        int v = base64_value(src[i]);
+        if (v < 0) continue;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            dst[n++] = (unsigned char)(acc >> bits);
+        }
+    }
+    *olen = n;
+    return 0;
+}
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t need = (slen + 2) / 3 * 4;
+    *olen = need + 1;
+    if (!dst || dlen < need + 1) return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    size_t n = 0;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < slen) v |= (uint32_t)src[i + 1] << 8;
+        if (i + 2 < slen) v |= src[i + 2];
+        dst[n++] = alphabet[(v >> 18) & 63];
+        dst[n++] = alphabet[(v >> 12) & 63];
+        dst[n++] = i + 1 < slen ? alphabet[(v >> 6) & 63] : '=';
+        dst[n++] = i + 2 < slen ? alphabet[v & 63] : '=';
+    }
+    dst[n] = '\0';
+    *olen = n;
+    return 0;
+}
+
+void sim_system_init(char **argv) {
+    clock_gettime(CLOCK_MONOTONIC, &s_start);
+    s_argv = argv;
+    const char *reason = getenv("SIM_RESET_REASON");
+    if (reason && strcmp(reason, "sw") == 0) s_reset_reason = ESP_RST_SW;
+    unsetenv("SIM_RESET_REASON");
+
+    long seed = sim_env_long("SIM_SEED", 0);
+    s_rng_state = seed ? (uint64_t)seed * 0x9E3779B97F4A7C15ULL : (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    if (s_rng_state == 0) s_rng_state = 1;
+
+    const char *level = sim_env_str("SIM_LOG", "info");
+    static const char *names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+    for (int i = 0; i < 6; ++i) {
+        if (strcmp(level, names[i]) == 0) s_log_level = (esp_log_level_t)i;
+    }
+
+    // A stable stand-in for the image hash, derived from the version string.
+    uint32_t h = esp_rom_crc32_le(0, (const uint8_t *)PROJECT_VER, sizeof(PROJECT_VER) - 1);
+    for (size_t i = 0; i < sizeof(s_app_desc.app_elf_sha256); ++i) {
+        h = h * 1103515245u + 12345u;
+        s_app_desc.app_elf_sha256[i] = (uint8_t)(h >> 16);
+    }
+}
@@ -0,0 +1,159 @@
+// esp_timer: a sorted list of armed timers and one dispatcher thread that
+// runs their callbacks in deadline order.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sim.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t deadline_us;
+    uint64_t period_us;
+    bool armed;
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static struct esp_timer *s_armed = NULL;
+static bool s_started = false;
+
+int64_t esp_timer_get_time(void) {
+    return sim_now_us();
+}
+
+// Caller holds s_lock.
+static void unlink_timer(struct esp_timer *timer) {
+    for (struct esp_timer **p = &s_armed; *p; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            break;
+        }
+    }
+    timer->armed = false;
+    timer->next = NULL;
+}
+
+// Caller holds s_lock.
+static void insert_timer(struct esp_timer *timer) {
+    struct esp_timer **p = &s_armed;
+    while (*p && (*p)->deadline_us <= timer->deadline_us) p = &(*p)->next;
+    timer->next = *p;
+    *p = timer;
+    timer->armed = true;
+    pthread_cond_signal(&s_cond);
+}
+
+static void *dispatcher(void *arg) {
+    pthread_setname_np(pthread_self(), "esp_timer");
+    pthread_mutex_lock(&s_lock);
+    while (true) {
+        if (!s_armed) {
+            pthread_cond_wait(&s_cond, &s_lock);
+            continue;
+        }
+        int64_t wait_us = s_armed->deadline_us - sim_now_us();
+        if (wait_us > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            int64_t ns = deadline.tv_nsec + wait_us * 1000;
+            deadline.tv_sec += ns / 1000000000;
+            deadline.tv_nsec = ns % 1000000000;
+            pthread_cond_timedwait(&s_cond, &s_lock, &deadline);
+            continue;
+        }
+        struct esp_timer *timer = s_armed;
+        unlink_timer(timer);
+        if (timer->period_us > 0) {
+            timer->deadline_us += (int64_t)timer->period_us;
+            insert_timer(timer);
+        }
+        esp_timer_cb_t callback = timer->callback;
+        void *cb_arg = timer->arg;
+        pthread_mutex_unlock(&s_lock);
+        callback(cb_arg);
+        pthread_mutex_lock(&s_lock);
+    }
+    return NULL;
+}
+
+static void ensure_started(void) {
+    if (s_started) return;
+    s_started = true;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_t thread;
+    pthread_create(&thread, NULL, dispatcher, NULL);
+    pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) return ESP_ERR_NO_MEM;
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    pthread_mutex_lock(&s_lock);
+    ensure_started();
+    pthread_mutex_unlock(&s_lock);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start_timer(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (!timer->armed) {
+        timer->deadline_us = sim_now_us() + (int64_t)timeout_us;
+        timer->period_us = period_us;
+        insert_timer(timer);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return start_timer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return start_timer(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = timer->armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+    if (timer->armed) unlink_timer(timer);
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    bool armed = timer->armed;
+    pthread_mutex_unlock(&s_lock);
+    if (armed) return ESP_ERR_INVALID_STATE;
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&s_lock);
+    bool armed = timer && timer->armed;
+    pthread_mutex_unlock(&s_lock);
+    return armed;
+}
@@ -0,0 +1,93 @@
+// VEML7700 ambient light sensor: the ALS configuration register and a
+// 16-bit ALS count (LSB first) for the simulated lighting at the configured
+// gain and integration time.
+
+#include <math.h>
+
+#include "sim.h"
+
+#define REG_ALS_CONF 0x00
+#define REG_ALS 0x04
+#define REG_WHITE 0x05
+#define REG_ID 0x07
+
+#define CONF_SD 0x0001  // shut down
+#define CONF_RESET CONF_SD
+
+typedef struct {
+    uint8_t ptr;
+    uint16_t conf;
+    int64_t started_us;
+} veml7700_model_t;
+
+static veml7700_model_t s_model;
+
+// The sensor sits further from the rack lights than the OPT3001.
+#define VEML7700_LIGHT_SHARE 0.85
+
+// lux per count at gain x1 and 100 ms; other settings scale it.
+static double resolution(uint16_t conf) {
+    static const double gain[] = {1.0, 2.0, 0.125, 0.25};
+    double g = gain[(conf >> 11) & 3];
+    double it_ms;
+    switch ((conf >> 6) & 0x0F) {
+    case 0x0C: it_ms = 25; break;
+    case 0x08: it_ms = 50; break;
+    case 0x01: it_ms = 200; break;
+    case 0x02: it_ms = 400; break;
+    case 0x03: it_ms = 800; break;
+    default: it_ms = 100; break;
+    }
+    return 0.0576 * (100.0 / it_ms) / g;
+}
+
+static uint16_t read_register(veml7700_model_t *m, uint8_t reg) {
+    switch (reg) {
+    case REG_ALS_CONF:
+        return m->conf;
+    case REG_ALS:
+    case REG_WHITE: {
+        // Power-on wake-up plus one integration before the first count.
+        if ((m->conf & CONF_SD) || sim_now_us() - m->started_us < 105000) return 0;
+        sim_env_t env;
+        sim_env_read(&env);
+        double counts = env.lux * VEML7700_LIGHT_SHARE / resolution(m->conf);
+        if (reg == REG_WHITE) counts *= 1.6;
+        return counts >= 65535.0 ? 0xFFFF : (uint16_t)lround(counts);
+    }
+    case REG_ID:
+        return 0xC481;
+    default:
+        return 0;
+    }
+}
+
+static esp_err_t model_write(void *ctx, const uint8_t *data, size_t len) {
+    veml7700_model_t *m = ctx;
+    m->ptr = data[0];
+    if (len >= 3 && m->ptr == REG_ALS_CONF) {
+        uint16_t conf = (uint16_t)(data[1] | (data[2] << 8));
+        if ((m->conf & CONF_SD) && !(conf & CONF_SD)) m->started_us = sim_now_us();
+        m->conf = conf;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t model_read(void *ctx, uint8_t *data, size_t len) {
+    veml7700_model_t *m = ctx;
+    uint16_t value = read_register(m, m->ptr);
+    for (size_t i = 0; i < len; ++i) data[i] = (i % 2 == 0) ? (uint8_t)value : (uint8_t)(value >> 8);
+    return ESP_OK;
+}
+
+void sim_veml7700_attach(uint8_t addr) {
+    s_model = (veml7700_model_t){.conf = CONF_RESET};
+    sim_i2c_device_t dev = {
+        .name = "VEML7700",
+        .addr = addr,
+        .write = model_write,
+        .read = model_read,
+        .ctx = &s_model,
+    };
+    sim_i2c_attach(&dev);
+}
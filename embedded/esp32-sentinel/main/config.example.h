@@ -8,6 +8,22 @@
 #define DEVICE_ID "esp32-sentinel-1"
 #define CLAIM_CODE "set-per-device-claim-code"
 
+// Optional: static IPv4 instead of DHCP (saves the DHCP exchange on reconnect)
+// #define CELLAR_STATIC_IP "192.168.1.50"
+// #define CELLAR_STATIC_GATEWAY "192.168.1.1"
+// #define CELLAR_STATIC_NETMASK "255.255.255.0"
+// #define CELLAR_STATIC_DNS "192.168.1.1"  // defaults to the gateway
+
+// Optional: Wi-Fi reconnect backoff (jittered exponential, milliseconds)
+// #define WIFI_BACKOFF_BASE_MS 500
+// #define WIFI_BACKOFF_MAX_MS (60 * 1000)
+// Optional: Wi-Fi power save (modem sleep) and beacons between wake-ups
+// #define CELLAR_WIFI_PS_MODE WIFI_PS_MAX_MODEM
+// #define CELLAR_WIFI_LISTEN_INTERVAL 3
+
+// Optional: how long boot waits for Wi-Fi before sampling offline (default 20s)
+// #define WIFI_STARTUP_WAIT_MS 20000
+
 // I2C bus
 #define I2C_SDA 21
 #define I2C_SCL 22
@@ -36,12 +52,118 @@
 
 // #define CELLAR_API_USE_HTTPS 0
 
+// Optional: TLS profile for the API connections (components/cellar_tls):
+// resident trust anchors, ECDHE-ECDSA (then ECDHE-RSA) over P-256, session
+// tickets. Set CELLAR_TLS_ECDSA_ONLY 1 to drop the RSA fallback once the
+// server presents an ECDSA certificate, or CELLAR_TLS_PROFILE 0 for esp-tls's
+// defaults.
+// #define CELLAR_TLS_PROFILE 1
+// #define CELLAR_TLS_ECDSA_ONLY 0
+
 // Optional: how often to post telemetry (milliseconds, default 30s)
 // #define POST_INTERVAL_MS (30 * 1000)
 
+// Optional: samples per request when draining a backlog, and gzip for bodies >= 512 B
+// #define UPLINK_BATCH_MAX 10
+// #define CELLAR_HTTP_GZIP 1
+
+// Optional: uplink backoff after a failed post (milliseconds, jittered exponential)
+// #define UPLINK_BACKOFF_BASE_MS 5000
+// #define UPLINK_BACKOFF_MAX_MS (5 * 60 * 1000)
+
+// Optional: publish readings over MQTT instead of HTTPS (QoS 1, persistent
+// session). Topics are cellar/<device_id>/{readings,cmd,status}. The broker
+// must be mqtts:// (or wss://), verified with server_root_cert.pem, and this
+// device needs its own password there; the username is the full device id
+// (logged at boot as id=...). Without both the client does not start.
+// #define CELLAR_UPLINK_MQTT 1
+// #define CELLAR_MQTT_URI "mqtts://192.168.1.10:8883"
+// #define CELLAR_MQTT_PASSWORD "per-device-secret"
+// #define CELLAR_MQTT_KEEPALIVE_S 120
+
+// Optional: local HTTP endpoint with /latest, /metrics (Prometheus) and
+// /history?from=&to= over the last CELLAR_HTTPD_HISTORY_LEN queued samples
+// #define CELLAR_LOCAL_HTTPD 1
+// #define CELLAR_HTTPD_PORT 80
+// #define CELLAR_HTTPD_HISTORY_LEN 60
+
+// Optional: alarms, checked on every sample and sent at once (see README)
+// #define CELLAR_ALARM_RULES \
+//     {.channel = "bme280", .min = 8.0f, .max = 18.0f, .max_rate_per_min = 0.5f}, \
+//     {.channel = "opt3001_lux", .min = NAN, .max = 20.0f, .max_rate_per_min = NAN},
+// #define CELLAR_ALARM_CLEAR_MS (60 * 1000)
+// #define CELLAR_ALARM_RATE_SPAN_MS (30 * 1000)
+
+// Optional: on-flash history (components/cellar_tsdb, "tsdb" partition)
+// #define CELLAR_TSDB_BLOCK_SIZE 512
+// #define CELLAR_TSDB_TS_RESOLUTION_MS 1000
+// #define CELLAR_TSDB_MAX_CHANNELS 10
+
+// Optional: per-sensor sample periods (milliseconds, default POST_INTERVAL_MS).
+// The display refreshes whenever a faster sensor produces a new value.
+// #define SENSOR_PERIOD_DS18B20_MS (10 * 1000)
+// #define SENSOR_PERIOD_BME280_MS (30 * 1000)
+// #define SENSOR_PERIOD_OPT3001_MS (30 * 1000)
+// #define SENSOR_PERIOD_VEML7700_MS (30 * 1000)
+
+// Optional: retry a sensor less often after this many consecutive failures
+// (default 3), backing off to at most CELLAR_SENSOR_BACKOFF_MAX periods (default 8)
+// #define CELLAR_SENSOR_BACKOFF_AFTER 3
+// #define CELLAR_SENSOR_BACKOFF_MAX 8
+
+// Optional: bus faults to inject; needs `idf.py -D CELLAR_FAULT_INJECTION=1 build`
+// (spec in components/cellar_fault/include/cellar_fault.h)
+// #define CELLAR_FAULTS "i2c@0x76:nack=0.3;ow:corrupt=0.1"
+
+// Optional: task watchdog period for the liveness supervisor, which is the
+// only task on it (milliseconds, default 60 s)
+// #define CELLAR_SUPERVISOR_WDT_MS (60 * 1000)
+
+// Optional: deferred log records waiting for the drain task (a power of two,
+// default 64), and records kept for GET /log (default 32)
+// #define CELLAR_BINLOG_SLOTS 64
+// #define CELLAR_BINLOG_RECENT 32
+
+// Optional: samples buffered in RAM while offline or unclaimed (default 60)
+// #define CELLAR_QUEUE_CAPACITY 60
+
+// Optional: static network buffers (components/cellar_netbuf). Large slots
+// must hold UPLINK_BATCH_MAX readings at 640 bytes each plus 512.
+// #define CELLAR_NETBUF_SMALL_SIZE 1024
+// #define CELLAR_NETBUF_SMALL_COUNT 7
+// #define CELLAR_NETBUF_LARGE_SIZE 8192
+// #define CELLAR_NETBUF_LARGE_COUNT 2
+
+// Optional: SNTP server and resync period (milliseconds, default 1h)
+// #define CELLAR_SNTP_SERVER "pool.ntp.org"
+// #define CELLAR_SNTP_RESYNC_MS (60 * 60 * 1000)
+
+// Optional: "PERF {json}" log lines for tools/perf_harness.py (boot milestones,
+// post latency, heap and stack headroom)
+// #define CELLAR_PERF_LOG 1
+
 // Optional: clear the stored claim code on boot (useful during development)
 // #define RESET_CLAIM_CODE 1
 
 /* Optional: pin your TLS cert for HTTPS endpoints
 static const char CELLAR_API_CERT_PEM[] = "-----BEGIN CERTIFICATE-----\n...\n-----END CERTIFICATE-----\n";
 */
+
+// Optional: current model (mA) for the per-cycle charge estimate
+// #define CELLAR_CURRENT_RADIO_MA 120.0f
+// #define CELLAR_CURRENT_CPU_MA 40.0f
+// #define CELLAR_CURRENT_IDLE_MA 15.0f
+// #define CELLAR_CURRENT_SLEEP_MA 2.0f
+
+// Optional: DFS range and automatic light sleep (needs CONFIG_PM_ENABLE)
+// #define CELLAR_PM_MIN_FREQ_MHZ 40
+// #define CELLAR_PM_MAX_FREQ_MHZ 160
+// #define CELLAR_PM_LIGHT_SLEEP 1
+
+// Optional: OTA updates from GET /api/device-firmware (default on). The first
+// check runs 2 min after boot, then every 6 h; a freshly installed image that
+// has not reached the backend within 10 min rolls back.
+// #define CELLAR_OTA 1
+// #define CELLAR_OTA_FIRST_CHECK_MS (2 * 60 * 1000)
+// #define CELLAR_OTA_CHECK_INTERVAL_MS (6 * 60 * 60 * 1000)
+// #define CELLAR_OTA_CONFIRM_TIMEOUT_MS (10 * 60 * 1000)
@@ -3,33 +3,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
-#include "bme280.h"
 #include "driver/i2c_master.h"
+#include "esp_app_desc.h"
 #include "esp_chip_info.h"
-#include "esp_event.h"
 #include "esp_flash.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "esp_netif.h"
-#include "esp_netif_sntp.h"
-#include "esp_sntp.h"
+#include "esp_random.h"
 #include "esp_system.h"
-#include "esp_task_wdt.h"
-#include "esp_wifi.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/event_groups.h"
 #include "freertos/task.h"
 #include "i2c_bus.h"
 #include "nvs_flash.h"
 
+#include "cellar_alarm.h"
 #include "cellar_auth.h"
+#include "cellar_binlog.h"
 #include "cellar_display.h"
+#include "cellar_fault.h"
 #include "cellar_http.h"
-#include "opt3001.h"
-#include "veml7700.h"
-#include "onewire_bus.h"
-#include "ds18b20.h"
+#include "cellar_httpd.h"
+#include "cellar_mqtt.h"
+#include "cellar_netbuf.h"
+#include "cellar_ota.h"
+#include "cellar_power.h"
+#include "cellar_queue.h"
+#include "cellar_sensors.h"
+#include "cellar_supervisor.h"
+#include "cellar_tasks.h"
+#include "cellar_time.h"
+#include "cellar_tsdb.h"
+#include "cellar_wifi.h"
 #include "config.h"  // User-provided Wi-Fi + API settings (see config.example.h)
 
 #ifndef I2C_SDA
@@ -45,64 +51,187 @@
 #define I2C_FREQ_HZ 100000
 #endif
 
-// Default to standard BME280 address if not in config
-#ifndef BME280_ADDRESS
-#define BME280_ADDRESS BME280_I2C_ADDRESS_DEFAULT
-#endif
-
 // Optional local altitude (meters above sea level) to derive sea-level pressure.
 #ifndef SENSOR_ALTITUDE_M
 #define SENSOR_ALTITUDE_M 0.0f
 #endif
 
-#ifndef WIFI_SSID
-#error "WIFI_SSID must be defined in config.h"
-#endif
-
-#ifndef WIFI_PASS
-#error "WIFI_PASS must be defined in config.h"
-#endif
-
 #ifndef CELLAR_API_BASE
 #error "CELLAR_API_BASE must be defined in config.h"
 #endif
 
 
 
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
-#define WIFI_STARTUP_MAX_RETRY 5
-#define MAX_CONSECUTIVE_POST_FAILURES 20
+// Liveness (components/cellar_supervisor): each cycle checks in within the
+// first figure and has stalled once it is the second one late.
+#define SAMPLER_CHECKIN_MS (10 * 1000)
+#define SAMPLER_STALL_MS (20 * 1000)
+#define UPLINK_CHECKIN_MS (30 * 1000)  // a probe or a post, TLS handshake included
+#define UPLINK_STALL_MS (60 * 1000)
+
+#define UPLINK_AUTH_WAIT_MS 2000
+#define UPLINK_OFFLINE_POLL_MS 5000
+#define UPLINK_IDLE_WAIT_MS 60000
+#define UPLINK_PROBE_TIMEOUT_MS 3000
+#define POWER_LOG_EVERY_N_SAMPLES 10
+#ifndef UPLINK_BATCH_MAX
+#define UPLINK_BATCH_MAX 10
+#endif
+// The batch body, its gzip output, the bearer header and the health block
+// come from cellar_netbuf; the stack covers the TLS handshake and formatting.
+#define UPLINK_TASK_STACK 7168
 #ifndef POST_INTERVAL_MS
 #define POST_INTERVAL_MS (30 * 1000)
 #endif
+// After a failed post the uplink waits base * 2^n (capped, jittered) and then
+// probes the API with a bare TCP connect before trying a full post again.
+#ifndef UPLINK_BACKOFF_BASE_MS
+#define UPLINK_BACKOFF_BASE_MS 5000
+#endif
+#ifndef UPLINK_BACKOFF_MAX_MS
+#define UPLINK_BACKOFF_MAX_MS (5 * 60 * 1000)
+#endif
+// Publish readings over MQTT (QoS 1, persistent session) instead of HTTPS.
+#ifndef CELLAR_UPLINK_MQTT
+#define CELLAR_UPLINK_MQTT 0
+#endif
+#define UPLINK_MQTT_ACK_TIMEOUT_MS 5000
+#define UPLINK_MQTT_PAYLOAD_MAX 768
+// Bounds for a post interval pushed over the MQTT command topic.
+#define POST_INTERVAL_MIN_MS (5 * 1000)
+#define POST_INTERVAL_MAX_MS (60 * 60 * 1000)
+// Local /latest, /metrics and /history endpoint (components/cellar_httpd).
+#ifndef CELLAR_LOCAL_HTTPD
+#define CELLAR_LOCAL_HTTPD 0
+#endif
+// Alarm rules from config.h, e.g.
+//   #define CELLAR_ALARM_RULES {.channel = "bme280", .min = 8.0f, .max = 18.0f, .max_rate_per_min = NAN},
+#ifdef CELLAR_ALARM_RULES
+static const cellar_alarm_rule_t s_alarm_rules[] = {CELLAR_ALARM_RULES};
+#define ALARM_RULE_COUNT (sizeof(s_alarm_rules) / sizeof(s_alarm_rules[0]))
+#else
+static const cellar_alarm_rule_t *const s_alarm_rules = NULL;
+#define ALARM_RULE_COUNT 0
+#endif
+// Firmware updates from the API (components/cellar_ota).
+#ifndef CELLAR_OTA
+#define CELLAR_OTA 1
+#endif
+// How long boot waits for the first IP before sampling offline.
+#ifndef WIFI_STARTUP_WAIT_MS
+#define WIFI_STARTUP_WAIT_MS 20000
+#endif
+
+// One-line "PERF {json}" records for tools/perf_harness.py: boot milestones,
+// each post's latency and status with heap and stack headroom, and recovery
+// after a failed uplink.
+#ifndef CELLAR_PERF_LOG
+#define CELLAR_PERF_LOG 0
+#endif
 
 static const char *TAG = "sentinel";
-static EventGroupHandle_t s_wifi_event_group;
-static int s_retry_num = 0;
-static bool s_wifi_ever_connected = false;
 
 // i2c_bus handle (wrapper)
 static i2c_bus_handle_t s_i2c_bus_handle = NULL;
 // Native handle extracted from wrapper (for cellar_display and bme280)
 static i2c_master_bus_handle_t s_i2c_bus = NULL;
 
-static bme280_handle_t s_bme280;
-static bool s_bme280_ready = false;
-
-static opt3001_handle_t s_opt3001;
-static bool s_opt3001_ready = false;
+static volatile int s_last_http_status = -1;
+static volatile esp_err_t s_last_post_err = ESP_OK;
+static volatile bool s_uplink_offline = false;
+static volatile uint32_t s_post_interval_ms = POST_INTERVAL_MS;
+#if CELLAR_UPLINK_MQTT
+static TaskHandle_t s_sampler_task = NULL;
+#endif
+static cellar_supervisor_id_t s_sampler_sv = -1;
+static cellar_supervisor_id_t s_uplink_sv = -1;
+// Exported on the local /metrics endpoint.
+static volatile uint32_t s_samples_acquired = 0;
+static volatile uint32_t s_samples_queued = 0;
+static volatile uint32_t s_sends_ok = 0;
+static volatile uint32_t s_sends_failed = 0;
+static cellar_activity_stats_t s_post_latency;  // guarded by s_post_latency_mux
+static portMUX_TYPE s_post_latency_mux = portMUX_INITIALIZER_UNLOCKED;
+// Latest acquired sample, shared by the sampler and the uplink's display refresh.
+static cellar_sample_t s_latest_sample = {
+    .temp_count = 0,
+    .pressure_hpa = NAN,
+    .humidity_pct = NAN,
+    .opt3001_lux = NAN,
+    .veml7700_lux = NAN,
+};
+static portMUX_TYPE s_latest_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#if CELLAR_PERF_LOG
+// Tasks whose stack headroom each post record reports; absent ones are skipped.
+static const char *const s_perf_tasks[] = {
+    "main", "uplink", "auth", "display_task", "tiT", "sys_evt", "esp_timer",
+};
+static int64_t s_perf_down_since_us = 0;
+static bool s_perf_delivered = false;
+
+static void perf_milestone(const char *stage) {
+    ESP_LOGI(TAG, "PERF {\"event\":\"boot\",\"stage\":\"%s\",\"t_ms\":%lld}",
+             stage, (long long)(esp_timer_get_time() / 1000));
+}
 
-static veml7700_handle_t s_veml7700;
-static bool s_veml7700_ready = false;
+// Claim or stored tokens: the first time the uplink holds a usable access token.
+static void perf_authorized(void) {
+    static bool s_perf_authorized = false;
+    if (s_perf_authorized) return;
+    s_perf_authorized = true;
+    perf_milestone("token");
+}
 
-#define DS18B20_MAX_DEVICES 4
-static ds18b20_device_handle_t s_ds18b20_devices[DS18B20_MAX_DEVICES];
-static uint64_t s_ds18b20_addrs[DS18B20_MAX_DEVICES];
-static int s_ds18b20_count = 0;
+static void perf_post(int64_t started_us, size_t count, int status, esp_err_t err) {
+    int64_t now_us = esp_timer_get_time();
+    bool delivered = err == ESP_OK && status >= 200 && status < 300;
+    if (!delivered && s_perf_down_since_us == 0) s_perf_down_since_us = started_us;
+
+    char stacks[160];
+    int written = 0;
+    for (size_t i = 0; i < sizeof(s_perf_tasks) / sizeof(s_perf_tasks[0]); i++) {
+        TaskHandle_t task = xTaskGetHandle(s_perf_tasks[i]);
+        if (!task || written >= (int)sizeof(stacks)) continue;
+        written += snprintf(stacks + written, sizeof(stacks) - written, "%s\"%s\":%u",
+                            written > 0 ? "," : "", s_perf_tasks[i],
+                            (unsigned)uxTaskGetStackHighWaterMark(task));
+    }
+    if (written >= (int)sizeof(stacks)) stacks[0] = '\0';
+    cellar_netbuf_stats_t small, large;
+    cellar_netbuf_get_stats(CELLAR_NETBUF_SMALL, &small);
+    cellar_netbuf_get_stats(CELLAR_NETBUF_LARGE, &large);
+    // New connections (TCP + TLS handshake) so far and their summed time.
+    cellar_activity_stats_t connects;
+    cellar_power_get_activity(CELLAR_ACTIVITY_TLS_CONNECT, &connects);
+    ESP_LOGI(TAG, "PERF {\"event\":\"post\",\"t_ms\":%lld,\"latency_ms\":%.1f,\"status\":%d,\"err\":\"%s\""
+                  ",\"count\":%u,\"heap_free\":%lu,\"heap_min\":%lu,\"heap_largest\":%u,\"stack_free\":{%s}"
+                  ",\"netbuf_high_water\":{\"small\":%lu,\"large\":%lu},\"connects\":%lu,\"connect_us\":%lld}",
+             (long long)(now_us / 1000), (double)(now_us - started_us) / 1000.0, status, esp_err_to_name(err),
+             (unsigned)count, (unsigned long)esp_get_free_heap_size(),
+             (unsigned long)esp_get_minimum_free_heap_size(),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), stacks,
+             (unsigned long)small.high_water, (unsigned long)large.high_water, (unsigned long)connects.count,
+             (long long)connects.total_us);
+    if (delivered && !s_perf_delivered) {
+        s_perf_delivered = true;
+        perf_milestone("first_post");
+    }
+}
 
-static char s_ip_str[16] = "0.0.0.0";
-static bool s_time_synced = false;
+static void perf_recovered(int failures) {
+    if (s_perf_down_since_us == 0) return;
+    ESP_LOGI(TAG, "PERF {\"event\":\"recovered\",\"t_ms\":%lld,\"failures\":%d,\"down_ms\":%lld}",
+             (long long)(esp_timer_get_time() / 1000), failures,
+             (long long)((esp_timer_get_time() - s_perf_down_since_us) / 1000));
+    s_perf_down_since_us = 0;
+}
+#else
+static inline void perf_milestone(const char *stage) {}
+static inline void perf_authorized(void) {}
+static inline void perf_post(int64_t started_us, size_t count, int status, esp_err_t err) {}
+static inline void perf_recovered(int failures) {}
+#endif
 
 static inline float pressure_to_sea_level(float station_hpa, float altitude_m) {
     if (isnan(station_hpa) || altitude_m <= 0.0f) return station_hpa;
@@ -176,334 +305,442 @@ static void init_nvs(void) {
     ESP_ERROR_CHECK(ret);
 }
 
-static void wifi_event_handler(void *arg,
-                               esp_event_base_t event_base,
-                               int32_t event_id,
-                               void *event_data) {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        esp_wifi_connect();
-        s_retry_num++;
-        ESP_LOGW(TAG, "Wi-Fi disconnected, reconnecting (attempt %d)", s_retry_num);
-        if (!s_wifi_ever_connected && s_retry_num >= WIFI_STARTUP_MAX_RETRY) {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
-        esp_ip4addr_ntoa(&event->ip_info.ip, s_ip_str, sizeof(s_ip_str));
-        s_retry_num = 0;
-        s_wifi_ever_connected = true;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+static void wifi_connect(void) {
+    ESP_ERROR_CHECK(cellar_wifi_start());
+    esp_err_t err = cellar_wifi_wait_connected(pdMS_TO_TICKS(WIFI_STARTUP_WAIT_MS));
+    if (err == ESP_OK) {
+        perf_milestone("ip");
+        ESP_LOGI(TAG, "Connected to SSID:%s", WIFI_SSID);
+    } else {
+        // Wi-Fi keeps retrying in the background; samples queue until it is back.
+        ESP_LOGW(TAG, "Not connected to SSID:%s yet (%s); sampling offline",
+                 WIFI_SSID, esp_err_to_name(err));
     }
 }
 
-static void wifi_init_sta(void) {
-    s_wifi_event_group = xEventGroupCreate();
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
-    };
-
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+static void set_latest_sample(const cellar_sample_t *sample) {
+    portENTER_CRITICAL(&s_latest_mux);
+    memcpy(&s_latest_sample, sample, sizeof(s_latest_sample));
+    portEXIT_CRITICAL(&s_latest_mux);
+}
 
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
+// Render the latest sample plus uplink status. Called from both the sampler
+// and the uplink task; while unclaimed the screen shows the claim code instead.
+static void update_display(void) {
+    cellar_sample_t sample;
+    portENTER_CRITICAL(&s_latest_mux);
+    memcpy(&sample, &s_latest_sample, sizeof(sample));
+    portEXIT_CRITICAL(&s_latest_mux);
 
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to SSID:%s", WIFI_SSID);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGE(TAG, "Failed to connect to SSID:%s; rebooting in 30s", WIFI_SSID);
-        vTaskDelay(pdMS_TO_TICKS(30000));
-        esp_restart();
-    } else {
-        ESP_LOGE(TAG, "Unexpected event while waiting for Wi-Fi; rebooting");
-        esp_restart();
+    cellar_display_status_t display_status = {0};
+    display_status.temp_count = 0;
+    for (int i = 0; i < sample.temp_count && display_status.temp_count < CELLAR_DISPLAY_MAX_TEMPS; i++) {
+        const char *id = sample.temps[i].id;
+        display_status.temps[display_status.temp_count] = sample.temps[i].value_c;
+        snprintf(display_status.temp_labels[display_status.temp_count],
+                 CELLAR_DISPLAY_LABEL_LEN, "%s",
+                 strcmp(id, "bme280") == 0 ? "BME280" : id);
+        display_status.temp_count++;
     }
-}
+    display_status.lux_primary = cellar_sample_lux_primary(&sample);
+    display_status.lux_secondary = cellar_sample_lux_secondary(&sample);
+    display_status.pressure_hpa = pressure_to_sea_level(sample.pressure_hpa, SENSOR_ALTITUDE_M);
+    display_status.humidity_pct = sample.humidity_pct;
+    display_status.http_status = s_last_http_status;
+    display_status.post_err = s_last_post_err;
+    snprintf(display_status.ip_address, sizeof(display_status.ip_address), "%s", cellar_wifi_ip());
+    if (!cellar_auth_access_token()) {
+        snprintf(display_status.status_line, sizeof(display_status.status_line), "%s",
+                 cellar_auth_claim_code());
+    } else if (s_uplink_offline) {
+        snprintf(display_status.status_line, sizeof(display_status.status_line),
+                 "Offline, %u queued", (unsigned)cellar_queue_count());
+    }
+    cellar_alarm_banner(display_status.alarm_line, sizeof(display_status.alarm_line));
 
-static bool time_is_set(void) {
-    time_t now = 0;
-    time(&now);
-    // Rough cutoff: any value before 2023 likely means SNTP has not run yet.
-    return now > 1672531200;  // 2023-01-01T00:00:00Z
+    cellar_display_update(&display_status);
 }
 
-static bool sync_time_with_sntp(void) {
-    if (s_time_synced && time_is_set()) {
-        return true;
+#define HEALTH_JSON_MAX 384
+
+// Device health sent with each reading: firmware version, uptime, buffer state, raised alarms,
+// the energy estimate for the last completed telemetry cycle, and each core's load since the
+// previous health block.
+static void format_health_json(char *buf, size_t len) {
+    static cellar_tasks_window_t s_cpu_window;
+    int written = snprintf(buf, len, "{\"fw\":\"%s\",\"uptime_s\":%lld,\"queued\":%u,\"dropped\":%lu",
+                           esp_app_get_description()->version,
+                           (long long)(esp_timer_get_time() / 1000000),
+                           (unsigned)cellar_queue_count(),
+                           (unsigned long)cellar_queue_dropped());
+    if (cellar_alarm_active_count() > 0 && written > 0 && written < (int)len) {
+        char alarms[128];
+        if (cellar_alarm_format_json(alarms, sizeof(alarms)) > 0) {
+            written += snprintf(buf + written, len - written, ",\"alarms\":%s", alarms);
+        }
     }
-
-    if (!esp_sntp_enabled()) {
-        esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG("pool.ntp.org");
-        esp_err_t init_err = esp_netif_sntp_init(&config);
-        if (init_err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to init SNTP: %s", esp_err_to_name(init_err));
-            return false;
+    cellar_power_cycle_t cycle;
+    if (cellar_power_last_cycle(&cycle) && written > 0 && written < (int)len) {
+        int64_t radio_us = cycle.activity_us[CELLAR_ACTIVITY_WIFI_ASSOC] +
+                           cycle.activity_us[CELLAR_ACTIVITY_HTTP];
+        written += snprintf(buf + written, len - written,
+                            ",\"cycle_ms\":%lld,\"radio_ms\":%lld,\"tls_ms\":%lld"
+                            ",\"sensors_ms\":%lld,\"sleep_ms\":%lld"
+                            ",\"charge_uah\":%.2f,\"avg_ma\":%.3f",
+                            (long long)(cycle.cycle_us / 1000),
+                            (long long)(radio_us / 1000),
+                            (long long)(cycle.activity_us[CELLAR_ACTIVITY_TLS_CONNECT] / 1000),
+                            (long long)(cycle.activity_us[CELLAR_ACTIVITY_SENSORS] / 1000),
+                            (long long)(cycle.light_sleep_us / 1000),
+                            cycle.charge_uah, cycle.avg_ma);
+    }
+    uint8_t cpu[CELLAR_TASKS_CORES];
+    if (cellar_tasks_cpu_load(&s_cpu_window, cpu) && written > 0 && written < (int)len) {
+        written += snprintf(buf + written, len - written, ",\"cpu_pct\":[");
+        for (int core = 0; core < CELLAR_TASKS_CORES && written < (int)len; core++) {
+            written += snprintf(buf + written, len - written, "%s%u", core > 0 ? "," : "", cpu[core]);
         }
+        if (written < (int)len) written += snprintf(buf + written, len - written, "]");
     }
-
-    esp_err_t wait_err = esp_netif_sntp_sync_wait(pdMS_TO_TICKS(5000));
-    if (wait_err == ESP_OK && time_is_set()) {
-        s_time_synced = true;
-        time_t now = 0;
-        time(&now);
-        ESP_LOGI(TAG, "Time synced (epoch=%ld)", (long)now);
-        return true;
+    if (written > 0 && written < (int)len) {
+        snprintf(buf + written, len - written, "}");
+    } else if (len > 0) {
+        buf[0] = '\0';  // Truncated JSON is worse than none
     }
-
-    if (wait_err == ESP_ERR_TIMEOUT) {
-        ESP_LOGW(TAG, "SNTP sync timed out");
-    } else if (wait_err != ESP_OK) {
-        ESP_LOGW(TAG, "SNTP sync wait failed: %s", esp_err_to_name(wait_err));
-    }
-    return false;
 }
 
-static bool format_iso8601_now(char *out, size_t out_len) {
-    if (!time_is_set()) {
-        return false;
+static void sample_to_measurement(const cellar_sample_t *sample,
+                                  char *temps_json,
+                                  size_t temps_len,
+                                  cellar_measurement_t *out) {
+    float reported_pressure = pressure_to_sea_level(sample->pressure_hpa, SENSOR_ALTITUDE_M);
+    if (isnan(reported_pressure)) {
+        reported_pressure = sample->pressure_hpa;
     }
 
-    time_t now = 0;
-    struct tm timeinfo;
-    time(&now);
-    if (gmtime_r(&now, &timeinfo) == NULL) {
-        return false;
+    // Build ROM-keyed temperatures JSON: {"28AABB...":12.50,"bme280":11.80}
+    int tj_written = snprintf(temps_json, temps_len, "{");
+    for (int i = 0; i < sample->temp_count && tj_written < (int)temps_len; i++) {
+        tj_written += snprintf(temps_json + tj_written, temps_len - tj_written,
+                               "%s\"%s\":%.2f", i > 0 ? "," : "",
+                               sample->temps[i].id, sample->temps[i].value_c);
+    }
+    if (tj_written < (int)temps_len) {
+        snprintf(temps_json + tj_written, temps_len - tj_written, "}");
     }
 
-    size_t written = strftime(out, out_len, "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
-    return written > 0 && written < out_len;
+    *out = (cellar_measurement_t){
+        .temperatures_json = sample->temp_count > 0 ? temps_json : NULL,
+        .pressure_hpa = reported_pressure,
+        .humidity_pct = sample->humidity_pct,
+        .illuminance_lux = cellar_sample_lux_primary(sample),
+        .measured_at_ms = cellar_time_mono_to_utc_ms(sample->mono_ms),
+        .device_id = cellar_auth_device_id(),
+    };
 }
 
-static esp_err_t post_sensor_reading(void) {
-    if (cellar_auth_ensure_access_token() != ESP_OK) {
-        ESP_LOGW(TAG, "No valid access token; skipping post");
-        static char claim_line[32];
-        const char *claim = cellar_auth_claim_code();
-        snprintf(claim_line, sizeof(claim_line), "%s", claim);
-        
-        cellar_display_status_t waiting = {0};
-        waiting.temp_count = 0;
-        waiting.lux_primary = NAN;
-        waiting.lux_secondary = NAN;
-        waiting.pressure_hpa = NAN;
-        waiting.humidity_pct = NAN;
-        waiting.http_status = -1;
-        waiting.post_err = ESP_FAIL;
-        snprintf(waiting.ip_address, sizeof(waiting.ip_address), "%s", s_ip_str);
-        snprintf(waiting.status_line, sizeof(waiting.status_line), "%s", claim_line);
-
-        cellar_display_update(&waiting);
-        return ESP_FAIL;
-    }
+// One uplink send, for cellar_uplink_post_seconds on /metrics.
+static void record_post_latency(int64_t duration_us) {
+    portENTER_CRITICAL(&s_post_latency_mux);
+    cellar_power_hist_add(&s_post_latency, duration_us);
+    portEXIT_CRITICAL(&s_post_latency_mux);
+}
 
-    float temp_bme = NAN;
-    float pressure = NAN;
-    float humidity = NAN;
-    float lux_opt = NAN;
-    float lux_veml = NAN;
-
-    char timestamp[32] = {0};
-    bool have_timestamp = format_iso8601_now(timestamp, sizeof(timestamp));
-    if (!have_timestamp && !s_time_synced) {
-        s_time_synced = sync_time_with_sntp();
-        have_timestamp = format_iso8601_now(timestamp, sizeof(timestamp));
+// Batch buffers, used only by the uplink task; static to keep them off its stack.
+static cellar_sample_t s_batch[UPLINK_BATCH_MAX];
+static char s_batch_temps[UPLINK_BATCH_MAX][256];
+static cellar_measurement_t s_batch_measurements[UPLINK_BATCH_MAX];
+
+static esp_err_t post_sensor_readings(const cellar_sample_t *samples, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        sample_to_measurement(&samples[i], s_batch_temps[i], sizeof(s_batch_temps[i]),
+                              &s_batch_measurements[i]);
     }
+    char *health_json = cellar_netbuf_take(HEALTH_JSON_MAX);
+    if (health_json) format_health_json(health_json, HEALTH_JSON_MAX);
+    s_batch_measurements[count - 1].health_json = health_json;
 
-    // BME280 Reading
-    if (s_bme280_ready) {
-        esp_err_t t_err = bme280_read_temperature(s_bme280, &temp_bme);
-        esp_err_t p_err = bme280_read_pressure(s_bme280, &pressure);
-        esp_err_t h_err = bme280_read_humidity(s_bme280, &humidity);
-        
-        if (t_err != ESP_OK || p_err != ESP_OK || h_err != ESP_OK) {
-             ESP_LOGW(TAG, "BME280 read failed, retrying...");
-             vTaskDelay(pdMS_TO_TICKS(100));
-             t_err = bme280_read_temperature(s_bme280, &temp_bme);
-             p_err = bme280_read_pressure(s_bme280, &pressure);
-             h_err = bme280_read_humidity(s_bme280, &humidity);
-        }
+    cellar_http_result_t http_result;
+    int64_t started_us = esp_timer_get_time();
+    esp_err_t err = cellar_http_post_batch(s_batch_measurements, count, &http_result);
+    cellar_netbuf_give(health_json);
+    perf_post(started_us, count, http_result.status_code, err);
 
-        if (t_err != ESP_OK || p_err != ESP_OK || h_err != ESP_OK) {
-            ESP_LOGE(TAG, "BME280 read failed");
-            temp_bme = NAN;
-            pressure = NAN;
-            humidity = NAN;
-        } else {
-            ESP_LOGI(TAG, "BME280: T=%.2fC P=%.2fhPa H=%.1f%%", temp_bme, pressure, humidity);
-        }
-    }
+    s_last_http_status = http_result.status_code;
+    s_last_post_err = err;
+    update_display();
 
-    // DS18B20 Readings (multiple sensors)
-    float ds_temps[DS18B20_MAX_DEVICES];
-    int ds_temp_count = 0;
-    if (s_ds18b20_count > 0) {
-        // Trigger conversion on all devices
-        for (int i = 0; i < s_ds18b20_count; i++) {
-            esp_err_t ds_err = ds18b20_trigger_temperature_conversion(s_ds18b20_devices[i]);
-            if (ds_err != ESP_OK) {
-                ESP_LOGE(TAG, "DS18B20[%d] trigger failed: %s", i, esp_err_to_name(ds_err));
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(800)); // 12-bit conversion time
-        // Read temperatures
-        for (int i = 0; i < s_ds18b20_count; i++) {
-            float t = 0.0f;
-            esp_err_t ds_err = ds18b20_get_temperature(s_ds18b20_devices[i], &t);
-            if (ds_err == ESP_OK) {
-                ESP_LOGI(TAG, "DS18B20[%d]: T=%.2fC", i, t);
-                ds_temps[ds_temp_count++] = t;
-            } else {
-                ESP_LOGE(TAG, "DS18B20[%d] read failed: %s", i, esp_err_to_name(ds_err));
-            }
-        }
+    if (http_result.status_code == 401 || http_result.status_code == 403) {
+        ESP_LOGW(TAG, "Auth rejected (status %d), clearing tokens to force re-claim", http_result.status_code);
+        cellar_auth_clear();
+        return ESP_ERR_NOT_ALLOWED;  // Signal auth failure to the uplink
     }
-
-    // OPT3001 Reading
-    if (s_opt3001_ready) {
-        esp_err_t opt_err = opt3001_read_lux(&s_opt3001, &lux_opt);
-        if (opt_err != ESP_OK) {
-             ESP_LOGE(TAG, "OPT3001 read failed: %s", esp_err_to_name(opt_err));
-             lux_opt = NAN;
-        } else {
-             ESP_LOGI(TAG, "OPT3001: Lux=%.2f", lux_opt);
-        }
+    if (err != ESP_OK) return err;
+    int status = http_result.status_code;
+    if (status >= 200 && status < 300) return ESP_OK;
+    if (status >= 400 && status < 500 && status != 408 && status != 429) {
+        // The API refused this payload; sending it again will not help.
+        ESP_LOGW(TAG, "API rejected %u sample(s) with status %d", (unsigned)count, status);
+        return ESP_ERR_INVALID_RESPONSE;
     }
-    
-    // VEML7700 Reading
-    if (s_veml7700_ready) {
-        esp_err_t veml_err = veml7700_read_lux(&s_veml7700, &lux_veml);
-        if (veml_err != ESP_OK) {
-             ESP_LOGE(TAG, "VEML7700 read failed: %s", esp_err_to_name(veml_err));
-             lux_veml = NAN;
-        } else {
-             ESP_LOGI(TAG, "VEML7700: Lux=%.2f", lux_veml);
+    return ESP_FAIL;  // Keep the samples queued and retry
+}
+
+#if CELLAR_UPLINK_MQTT
+static char s_mqtt_payload[UPLINK_MQTT_PAYLOAD_MAX];
+
+// Publish each sample as its own QoS 1 message, stopping at the first one the
+// broker does not acknowledge. *out_done counts the leading samples that are
+// finished with (acknowledged, or unsendable and skipped).
+static esp_err_t publish_sensor_readings(const cellar_sample_t *samples, size_t count, size_t *out_done) {
+    char *health_json = cellar_netbuf_take(HEALTH_JSON_MAX);
+    if (health_json) format_health_json(health_json, HEALTH_JSON_MAX);
+
+    esp_err_t err = ESP_OK;
+    size_t done = 0;
+    for (; done < count; done++) {
+        cellar_measurement_t m;
+        sample_to_measurement(&samples[done], s_batch_temps[0], sizeof(s_batch_temps[0]), &m);
+        if (done == count - 1) m.health_json = health_json;
+        int len = cellar_http_format_reading(s_mqtt_payload, sizeof(s_mqtt_payload), &m);
+        if (len < 0) {
+            ESP_LOGW(TAG, "Skipping unsendable sample");
+            continue;
         }
+        err = cellar_mqtt_publish_reading(s_mqtt_payload, (size_t)len, UPLINK_MQTT_ACK_TIMEOUT_MS);
+        if (err != ESP_OK) break;
     }
+    *out_done = done;
+    cellar_netbuf_give(health_json);
 
-    // Prefer OPT3001 as primary
-    float lux_primary = NAN;
-    float lux_secondary = NAN;
-    if (!isnan(lux_opt)) {
-        lux_primary = lux_opt;
-        if (!isnan(lux_veml)) lux_secondary = lux_veml;
-    } else {
-        lux_primary = lux_veml;
-    }
+    s_last_post_err = err;
+    update_display();
+    return err;
+}
 
-    float reported_pressure = pressure_to_sea_level(pressure, SENSOR_ALTITUDE_M);
-    if (isnan(reported_pressure)) {
-        reported_pressure = pressure;
+// Commands arrive as small JSON objects on cellar/<id>/cmd, e.g.
+// {"sample_now":true} or {"interval_s":300}.
+static void handle_mqtt_command(const char *data, size_t len) {
+    char cmd[128];
+    if (len >= sizeof(cmd)) {
+        ESP_LOGW(TAG, "Ignoring oversized command (%u B)", (unsigned)len);
+        return;
     }
+    memcpy(cmd, data, len);
+    cmd[len] = '\0';
+    ESP_LOGI(TAG, "Command: %s", cmd);
 
-    // Build ROM-keyed temperatures JSON: {"28AABB...":12.50,"bme280":11.80}
-    char temps_json[256] = {0};
-    int tj_written = 0;
-    bool has_any_temp = false;
-    tj_written += snprintf(temps_json + tj_written, sizeof(temps_json) - tj_written, "{");
-    for (int i = 0; i < ds_temp_count; i++) {
-        if (has_any_temp) {
-            tj_written += snprintf(temps_json + tj_written, sizeof(temps_json) - tj_written, ",");
+    const char *interval = strstr(cmd, "\"interval_s\":");
+    if (interval) {
+        long seconds = strtol(interval + strlen("\"interval_s\":"), NULL, 10);
+        // Range-check before scaling so a huge value cannot wrap into range.
+        if (seconds < POST_INTERVAL_MIN_MS / 1000 || seconds > POST_INTERVAL_MAX_MS / 1000) {
+            ESP_LOGW(TAG, "Post interval %lds out of range", seconds);
+        } else {
+            s_post_interval_ms = (uint32_t)seconds * 1000;
+            ESP_LOGI(TAG, "Post interval now %lds", seconds);
         }
-        tj_written += snprintf(temps_json + tj_written, sizeof(temps_json) - tj_written,
-                               "\"%012llX\":%.2f", (unsigned long long)s_ds18b20_addrs[i], ds_temps[i]);
-        has_any_temp = true;
     }
-    if (!isnan(temp_bme)) {
-        if (has_any_temp) {
-            tj_written += snprintf(temps_json + tj_written, sizeof(temps_json) - tj_written, ",");
-        }
-        tj_written += snprintf(temps_json + tj_written, sizeof(temps_json) - tj_written,
-                               "\"bme280\":%.2f", temp_bme);
-        has_any_temp = true;
+    if (strstr(cmd, "\"sample_now\":true") && s_sampler_task) {
+        xTaskNotifyGive(s_sampler_task);
+    }
+#if CELLAR_OTA
+    if (strstr(cmd, "\"ota_check\":true")) {
+        cellar_ota_check_now();
     }
-    tj_written += snprintf(temps_json + tj_written, sizeof(temps_json) - tj_written, "}");
+#endif
+}
+#endif
 
-    // Prepare HTTP Payload
-    cellar_measurement_t measurement = {
-        .temperatures_json = has_any_temp ? temps_json : NULL,
-        .pressure_hpa = reported_pressure,
-        .humidity_pct = humidity,
-        .illuminance_lux = lux_primary,
-        .timestamp_iso8601 = have_timestamp ? timestamp : NULL,
-        .device_id = cellar_auth_device_id(),
+#if CELLAR_LOCAL_HTTPD
+static bool local_latest(cellar_sample_t *out) {
+    portENTER_CRITICAL(&s_latest_mux);
+    memcpy(out, &s_latest_sample, sizeof(*out));
+    portEXIT_CRITICAL(&s_latest_mux);
+    return out->mono_ms > 0;
+}
+
+static int local_format_sample(const cellar_sample_t *sample, char *buf, size_t cap) {
+    char temps_json[256];
+    cellar_measurement_t m;
+    sample_to_measurement(sample, temps_json, sizeof(temps_json), &m);
+    return cellar_http_format_reading(buf, cap, &m);
+}
+
+static void local_counters(cellar_httpd_counters_t *out) {
+    *out = (cellar_httpd_counters_t){
+        .samples_acquired = s_samples_acquired,
+        .samples_queued = s_samples_queued,
+        .sends_ok = s_sends_ok,
+        .sends_failed = s_sends_failed,
+        .last_http_status = s_last_http_status,
     };
+    portENTER_CRITICAL(&s_post_latency_mux);
+    out->post_latency = s_post_latency;
+    portEXIT_CRITICAL(&s_post_latency_mux);
+}
 
-    cellar_http_result_t http_result;
-    esp_err_t err = cellar_http_post(&measurement, &http_result);
+static const cellar_httpd_sources_t s_local_sources = {
+    .latest = local_latest,
+    .format_sample = local_format_sample,
+    .counters = local_counters,
+};
+#endif
 
-    // Update Display – populate all temperature sensors
-    cellar_display_status_t display_status = {0};
-    display_status.temp_count = 0;
-    for (int i = 0; i < ds_temp_count && display_status.temp_count < CELLAR_DISPLAY_MAX_TEMPS; i++) {
-        display_status.temps[display_status.temp_count] = ds_temps[i];
-        snprintf(display_status.temp_labels[display_status.temp_count],
-                 CELLAR_DISPLAY_LABEL_LEN, "%012llX",
-                 (unsigned long long)s_ds18b20_addrs[i]);
-        display_status.temp_count++;
-    }
-    if (!isnan(temp_bme) && display_status.temp_count < CELLAR_DISPLAY_MAX_TEMPS) {
-        display_status.temps[display_status.temp_count] = temp_bme;
-        snprintf(display_status.temp_labels[display_status.temp_count],
-                 CELLAR_DISPLAY_LABEL_LEN, "BME280");
-        display_status.temp_count++;
-    }
-    display_status.lux_primary = lux_primary;
-    display_status.lux_secondary = lux_secondary;
-    display_status.pressure_hpa = reported_pressure;
-    display_status.humidity_pct = humidity;
-    display_status.http_status = http_result.status_code;
-    display_status.post_err = err;
-    snprintf(display_status.ip_address, sizeof(display_status.ip_address), "%s", s_ip_str);
-    
-    cellar_display_update(&display_status);
+static uint32_t uplink_backoff_ms(int failures) {
+    int shift = failures > 1 ? failures - 1 : 0;
+    if (shift > 10) shift = 10;
+    uint32_t ceiling = (uint32_t)UPLINK_BACKOFF_BASE_MS << shift;
+    if (ceiling > UPLINK_BACKOFF_MAX_MS) ceiling = UPLINK_BACKOFF_MAX_MS;
+    // Equal jitter, as for Wi-Fi reconnects.
+    return ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+}
 
-    if (http_result.status_code == 401 || http_result.status_code == 403) {
-        ESP_LOGW(TAG, "Auth rejected (status %d), clearing tokens to force re-claim", http_result.status_code);
-        cellar_auth_clear();
-        return ESP_ERR_NOT_ALLOWED;  // Signal auth failure to main loop
+static void set_uplink_offline(bool offline) {
+    if (s_uplink_offline == offline) return;
+    s_uplink_offline = offline;
+    update_display();
+}
+
+// Drains the sample queue oldest-first. Runs apart from the sampler so a slow
+// post, a refresh or the claim flow never delays sampling or the display.
+// While the AP or API is down it backs off and keeps the queue; the device
+// only restarts if the supervisor catches a post that never returns.
+static void uplink_task(void *arg) {
+    int failures = 0;
+    while (true) {
+        cellar_supervisor_op(s_uplink_sv, NULL);
+        cellar_supervisor_checkin_within(s_uplink_sv, UPLINK_IDLE_WAIT_MS);
+        if (!cellar_queue_wait(pdMS_TO_TICKS(UPLINK_IDLE_WAIT_MS))) continue;
+        if (!cellar_wifi_is_connected()) {
+            set_uplink_offline(true);
+            cellar_supervisor_checkin_within(s_uplink_sv, UPLINK_OFFLINE_POLL_MS);
+            vTaskDelay(pdMS_TO_TICKS(UPLINK_OFFLINE_POLL_MS));
+            continue;
+        }
+        if (cellar_auth_ensure_access_token() != ESP_OK) {
+            // The auth task is refreshing or waiting for approval; keep buffering.
+            cellar_supervisor_checkin_within(s_uplink_sv, UPLINK_AUTH_WAIT_MS);
+            vTaskDelay(pdMS_TO_TICKS(UPLINK_AUTH_WAIT_MS));
+            continue;
+        }
+        cellar_supervisor_checkin(s_uplink_sv);
+        perf_authorized();
+        // An alarm sample goes out on its own, ahead of the backlog and
+        // without waiting out the probe.
+        uint32_t first_seq = 0;
+        size_t batch = 0;
+        bool priority = cellar_queue_take_priority(&s_batch[0]);
+        if (priority) {
+            batch = 1;
+            ESP_LOGI(TAG, "Sending alarm sample ahead of %u queued", (unsigned)cellar_queue_count());
+        }
+#if !CELLAR_UPLINK_MQTT
+        // After a failure, confirm the API port answers before paying for a
+        // TLS handshake and a full post. (The MQTT client reconnects itself.)
+        cellar_supervisor_op(s_uplink_sv, "probe");
+        if (!priority && failures > 0 && cellar_http_probe(UPLINK_PROBE_TIMEOUT_MS) != ESP_OK) {
+            failures++;
+            uint32_t delay_ms = uplink_backoff_ms(failures);
+            ESP_LOGW(TAG, "API unreachable; probing again in %lums, %u queued",
+                     (unsigned long)delay_ms, (unsigned)cellar_queue_count());
+            cellar_supervisor_op(s_uplink_sv, NULL);
+            cellar_supervisor_checkin_within(s_uplink_sv, delay_ms);
+            cellar_queue_wait_priority(pdMS_TO_TICKS(delay_ms));
+            continue;
+        }
+#endif
+
+        // One sample in steady state; up to UPLINK_BATCH_MAX per request while
+        // draining a backlog.
+        if (!priority) {
+            batch = cellar_queue_peek(s_batch, UPLINK_BATCH_MAX, &first_seq);
+        }
+        if (batch == 0) continue;
+        size_t done = 0;
+        cellar_supervisor_checkin(s_uplink_sv);
+        int64_t send_started_us = esp_timer_get_time();
+#if CELLAR_UPLINK_MQTT
+        cellar_supervisor_op(s_uplink_sv, "mqtt publish");
+        esp_err_t err = publish_sensor_readings(s_batch, batch, &done);
+#else
+        cellar_supervisor_op(s_uplink_sv, "http post");
+        esp_err_t err = post_sensor_readings(s_batch, batch);
+        if (err == ESP_OK || err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_SIZE ||
+            err == ESP_ERR_INVALID_RESPONSE) {
+            done = batch;
+        }
+#endif
+        record_post_latency(esp_timer_get_time() - send_started_us);
+        if (priority) {
+            if (done == 0 && err != ESP_ERR_INVALID_ARG && err != ESP_ERR_INVALID_SIZE &&
+                err != ESP_ERR_INVALID_RESPONSE) {
+                // Not delivered: keep it with the backlog and retry as usual.
+                cellar_queue_push(&s_batch[0]);
+            }
+        } else if (done > 0) {
+            cellar_queue_pop(first_seq, done);
+        }
+        cellar_supervisor_op(s_uplink_sv, NULL);
+        if (err == ESP_OK) {
+            s_sends_ok++;
+#if CELLAR_OTA
+            // A delivered reading is the proof a freshly updated image needs.
+            cellar_ota_confirm();
+#endif
+            if (failures > 0) {
+                perf_recovered(failures);
+                ESP_LOGI(TAG, "Uplink restored after %d failure(s); %u queued",
+                         failures, (unsigned)cellar_queue_count());
+            }
+            failures = 0;
+            set_uplink_offline(false);
+        } else if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_SIZE) {
+            ESP_LOGW(TAG, "Dropped %u unsendable sample(s)", (unsigned)batch);
+        } else if (err == ESP_ERR_INVALID_RESPONSE) {
+            // Delivered but refused: not a success, and not a reason to back off.
+            s_sends_failed++;
+            ESP_LOGW(TAG, "Dropped %u rejected sample(s)", (unsigned)batch);
+        } else if (err == ESP_ERR_NOT_ALLOWED) {
+            ESP_LOGW(TAG, "Auth rejected; samples stay queued until re-claimed");
+        } else {
+            s_sends_failed++;
+            failures++;
+            set_uplink_offline(true);
+            uint32_t delay_ms = uplink_backoff_ms(failures);
+            ESP_LOGW(TAG, "Telemetry send failed (%d in a row), retrying in %lums, %u queued",
+                     failures, (unsigned long)delay_ms, (unsigned)cellar_queue_count());
+            cellar_supervisor_checkin_within(s_uplink_sv, delay_ms);
+            cellar_queue_wait_priority(pdMS_TO_TICKS(delay_ms));
+        }
     }
+}
 
-    return err;
+// Runs on the supervisor. The sampler only blocks on a sensor bus: reset it
+// once, which fails the hung transfer; a second stall restarts the device.
+static bool recover_sampler(int attempt, const char *op) {
+    const char *sensor = NULL;
+    const char *call = NULL;
+    uint32_t for_ms = 0;
+    if (!cellar_sensors_busy(&sensor, &call, &for_ms)) return false;
+    ESP_LOGW(TAG, "Sampler stuck %lums in %s %s", (unsigned long)for_ms, sensor, call);
+    return attempt == 1 && cellar_sensors_recover_stalled();
 }
 
 void app_main(void) {
+    ESP_ERROR_CHECK(cellar_binlog_start());
     log_chip_info();
     init_nvs();
+    cellar_power_init();
+    cellar_tsdb_init();
 #if defined(RESET_CLAIM_CODE) && RESET_CLAIM_CODE
     cellar_auth_clear_claim_code();
 #endif
-    wifi_init_sta();
+    wifi_connect();
+    cellar_http_init();
+#if CELLAR_LOCAL_HTTPD
+    ESP_ERROR_CHECK_WITHOUT_ABORT(cellar_httpd_start(&s_local_sources));
+#endif
     cellar_auth_init();
     const char *claim = cellar_auth_claim_code();
     static char claim_line[32];
@@ -517,113 +754,33 @@ void app_main(void) {
     waiting.humidity_pct = NAN;
     waiting.http_status = -1;
     waiting.post_err = ESP_OK;
-    snprintf(waiting.ip_address, sizeof(waiting.ip_address), "%s", s_ip_str);
+    snprintf(waiting.ip_address, sizeof(waiting.ip_address), "%s", cellar_wifi_ip());
     snprintf(waiting.status_line, sizeof(waiting.status_line), "%s", claim_line);
 
-    if (!sync_time_with_sntp()) {
-        ESP_LOGW(TAG, "Proceeding without SNTP timestamp; API will fill server time");
-    }
+    // Readings posted before the first sync go out unstamped; the API fills server time.
+    cellar_time_start();
+    cellar_auth_start();
+#if CELLAR_OTA
+    ESP_ERROR_CHECK_WITHOUT_ABORT(cellar_ota_start());
+#endif
+#if CELLAR_UPLINK_MQTT
+    s_sampler_task = xTaskGetCurrentTaskHandle();
+    ESP_ERROR_CHECK_WITHOUT_ABORT(cellar_mqtt_start(cellar_auth_device_id(), handle_mqtt_command));
+#endif
     
     // Init I2C bus (and display)
     ensure_i2c_bus();
     scan_i2c_bus();
 
-    // Init Sensors
-    if (s_i2c_bus) {
-        // Probe and Init BME280
-        if (i2c_master_probe(s_i2c_bus, BME280_ADDRESS, 50) == ESP_OK) {
-            ESP_LOGI(TAG, "Found BME280 at 0x%02X, initializing...", BME280_ADDRESS);
-            s_bme280 = bme280_create(s_i2c_bus_handle, BME280_ADDRESS);
-            if (!s_bme280) {
-                 ESP_LOGE(TAG, "BME280 create failed");
-            } else {
-                 esp_err_t bme_err = bme280_default_init(s_bme280);
-                 if (bme_err != ESP_OK) {
-                      ESP_LOGE(TAG, "BME280 init failed: %s", esp_err_to_name(bme_err));
-                 } else {
-                      ESP_LOGI(TAG, "BME280 init success");
-                      s_bme280_ready = true;
-                 }
-            }
-        } else {
-            ESP_LOGD(TAG, "BME280 not found at 0x%02X", BME280_ADDRESS);
-        }
-
-        // Probe and Init OPT3001
-        if (i2c_master_probe(s_i2c_bus, OPT3001_I2C_ADDR_DEFAULT, 50) == ESP_OK) {
-            ESP_LOGI(TAG, "Found OPT3001 at 0x%02X, initializing...", OPT3001_I2C_ADDR_DEFAULT);
-            esp_err_t opt_err = opt3001_init(s_i2c_bus, OPT3001_I2C_ADDR_DEFAULT, &s_opt3001);
-            if (opt_err != ESP_OK) {
-                 ESP_LOGE(TAG, "OPT3001 init failed: %s", esp_err_to_name(opt_err));
-            } else {
-                 ESP_LOGI(TAG, "OPT3001 init success");
-                 s_opt3001_ready = true;
-            }
-        } else {
-            ESP_LOGD(TAG, "OPT3001 not found at 0x%02X", OPT3001_I2C_ADDR_DEFAULT);
-        }
-
-        // Probe and Init VEML7700
-        if (i2c_master_probe(s_i2c_bus, VEML7700_I2C_ADDR_DEFAULT, 50) == ESP_OK) {
-            ESP_LOGI(TAG, "Found VEML7700 at 0x%02X, initializing...", VEML7700_I2C_ADDR_DEFAULT);
-            esp_err_t veml_err = veml7700_init(s_i2c_bus, VEML7700_I2C_ADDR_DEFAULT, &s_veml7700);
-            if (veml_err != ESP_OK) {
-                 ESP_LOGE(TAG, "VEML7700 init failed: %s", esp_err_to_name(veml_err));
-            } else {
-                 ESP_LOGI(TAG, "VEML7700 init success");
-                 s_veml7700_ready = true;
-            }
-        } else {
-             ESP_LOGD(TAG, "VEML7700 not found at 0x%02X", VEML7700_I2C_ADDR_DEFAULT);
-        }
-    }
-    
-    // Init 1-Wire (DS18B20) on GPIO 4
-    onewire_bus_handle_t ow_bus = NULL;
-    onewire_bus_config_t bus_config = {
-        .bus_gpio_num = ONEWIRE_BUS_GPIO,
-        .flags.en_pull_up = true, // Enables the ESP32 internal ~45k pull-up
-    };
-    onewire_bus_rmt_config_t rmt_config = {
-        .max_rx_bytes = 10,
+    // Init Sensors (I2C devices are skipped when the bus is unavailable)
+    cellar_sensor_bus_t sensor_bus = {
+        .i2c_bus_handle = s_i2c_bus_handle,
+        .i2c_bus = s_i2c_bus,
+        .onewire_gpio = ONEWIRE_BUS_GPIO,
     };
-
-    // Create 1-Wire bus and enumerate all DS18B20 devices
-    if (onewire_new_bus_rmt(&bus_config, &rmt_config, &ow_bus) == ESP_OK) {
-        onewire_device_iter_handle_t iter = NULL;
-        onewire_device_t next_onewire_device;
-        if (onewire_new_device_iter(ow_bus, &iter) == ESP_OK) {
-            ESP_LOGI(TAG, "Scanning 1-Wire bus on GPIO %d...", ONEWIRE_BUS_GPIO);
-            esp_err_t search_result;
-            do {
-                search_result = onewire_device_iter_get_next(iter, &next_onewire_device);
-                if (search_result == ESP_OK) {
-                    ds18b20_config_t ds_cfg = {};
-                    ds18b20_device_handle_t dev = NULL;
-                    if (ds18b20_new_device_from_enumeration(&next_onewire_device, &ds_cfg, &dev) == ESP_OK) {
-                        ds18b20_set_resolution(dev, DS18B20_RESOLUTION_12B);
-                        s_ds18b20_devices[s_ds18b20_count] = dev;
-                        s_ds18b20_addrs[s_ds18b20_count] = next_onewire_device.address;
-                        s_ds18b20_count++;
-                        ESP_LOGI(TAG, "DS18B20[%d] init success (addr: %016llX)",
-                                 s_ds18b20_count - 1, next_onewire_device.address);
-                    } else {
-                        ESP_LOGW(TAG, "1-Wire device at %016llX is not a DS18B20",
-                                 next_onewire_device.address);
-                    }
-                }
-            } while (search_result == ESP_OK && s_ds18b20_count < DS18B20_MAX_DEVICES);
-            onewire_del_device_iter(iter);
-
-            if (s_ds18b20_count == 0) {
-                ESP_LOGW(TAG, "No DS18B20 devices found on 1-Wire bus");
-            } else {
-                ESP_LOGI(TAG, "Found %d DS18B20 device(s)", s_ds18b20_count);
-            }
-        }
-    } else {
-        ESP_LOGE(TAG, "Failed to create 1-Wire bus RMT");
-    }
+    cellar_sensors_register_builtin();
+    int sensor_count = cellar_sensors_init(&sensor_bus);
+    ESP_LOGI(TAG, "%d sensor driver(s) ready", sensor_count);
 
     // Give the sensor a moment
     vTaskDelay(pdMS_TO_TICKS(50));
@@ -637,37 +794,100 @@ void app_main(void) {
 
     cellar_display_update(&waiting);
 
-    // Allow sensors to settle
-    vTaskDelay(pdMS_TO_TICKS(2000));
-
-    esp_task_wdt_config_t wdt_cfg = {
-        .timeout_ms = 900 * 1000,
-        .idle_core_mask = 0,
-        .trigger_panic = true,
+    cellar_supervisor_config_t sampler_sv = {
+        .name = "sampler",
+        .period_ms = SAMPLER_CHECKIN_MS,
+        .timeout_ms = SAMPLER_STALL_MS,
+        .recover = recover_sampler,
     };
-    ESP_ERROR_CHECK(esp_task_wdt_init(&wdt_cfg));
-    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
-
-    int consecutive_failures = 0;
+    s_sampler_sv = cellar_supervisor_add(&sampler_sv);
+    // No recover hook: a post that never returns may hold the TLS session or
+    // a pool buffer, so only a restart is safe.
+    cellar_supervisor_config_t uplink_sv = {
+        .name = "uplink",
+        .period_ms = UPLINK_CHECKIN_MS,
+        .timeout_ms = UPLINK_STALL_MS,
+    };
+    s_uplink_sv = cellar_supervisor_add(&uplink_sv);
+    ESP_ERROR_CHECK(cellar_supervisor_start());
+
+    ESP_ERROR_CHECK(cellar_queue_init());
+    ESP_ERROR_CHECK(cellar_alarm_init(s_alarm_rules, ALARM_RULE_COUNT));
+    xTaskCreatePinnedToCore(uplink_task, "uplink", UPLINK_TASK_STACK, NULL, CELLAR_PRIO_UPLINK, NULL,
+                            CELLAR_CORE_NET);
+    perf_milestone("ready");
+
+    // This is the main task, already on the app core (sdkconfig.defaults);
+    // from here on it is the sampler and must preempt the display there.
+    vTaskPrioritySet(NULL, CELLAR_PRIO_SAMPLER);
+
+    // Sampler: acquire on each sensor's schedule, check alarms, refresh the
+    // display, and queue one sample per post interval for the uplink. A sample
+    // that raises or clears an alarm is sent at once instead. A slot with no
+    // new reading since the last queued sample waits for one, so slow sensors
+    // are not posted again with a later timestamp.
+    int64_t next_queue_ms = 0;
+    unsigned queued_total = 0;
+    bool fresh = false;  // a sensor was read since the last queued sample
     while (true) {
-        esp_task_wdt_reset();
-        esp_err_t err = post_sensor_reading();
-        if (err == ESP_ERR_NOT_ALLOWED) {
-            ESP_LOGW(TAG, "Auth rejected, retrying claim immediately");
-            vTaskDelay(pdMS_TO_TICKS(2000));
-        } else {
-            if (err != ESP_OK) {
-                consecutive_failures++;
-                ESP_LOGW(TAG, "Telemetry send failed (%d/%d)",
-                         consecutive_failures, MAX_CONSECUTIVE_POST_FAILURES);
-                if (consecutive_failures >= MAX_CONSECUTIVE_POST_FAILURES) {
-                    ESP_LOGE(TAG, "Too many consecutive failures; rebooting");
-                    esp_restart();
-                }
+        cellar_supervisor_checkin(s_sampler_sv);
+        int64_t cycle_start_ms = esp_timer_get_time() / 1000;
+        cellar_sample_t sample;
+        cellar_supervisor_op(s_sampler_sv, "sensors");
+        int sensors_read = cellar_sensors_acquire(&sample);
+        bool alarm_changed = false;
+        if (sensors_read > 0) {
+            fresh = true;
+            s_samples_acquired++;
+            set_latest_sample(&sample);
+            alarm_changed = cellar_alarm_evaluate(&sample);
+            update_display();
+        }
+
+        if (alarm_changed || (fresh && cycle_start_ms >= next_queue_ms)) {
+            fresh = false;
+            if (alarm_changed) {
+                cellar_queue_push_priority(&sample);
             } else {
-                consecutive_failures = 0;
+                cellar_queue_push(&sample);
+            }
+            s_samples_queued++;
+#if CELLAR_LOCAL_HTTPD
+            cellar_httpd_record(&sample);
+#endif
+            // Flash history needs wall-clock stamps; nothing is kept before the first sync.
+            int64_t utc_ms = cellar_time_mono_to_utc_ms(sample.mono_ms);
+            if (utc_ms > 0) {
+                cellar_supervisor_op(s_sampler_sv, "history");
+                cellar_tsdb_append_sample(&sample, utc_ms);
+            }
+            // An alarm sample stands in for this slot; the regular cadence restarts from it.
+            next_queue_ms = cycle_start_ms + s_post_interval_ms;
+            cellar_power_end_cycle(NULL);
+            if (++queued_total % POWER_LOG_EVERY_N_SAMPLES == 0) {
+                cellar_power_log_stats();
+                cellar_sensors_log_stats();
+                cellar_fault_log_stats();
+                cellar_netbuf_log_stats();
+                cellar_tasks_log_stats();
             }
-            vTaskDelay(pdMS_TO_TICKS(POST_INTERVAL_MS));
+        }
+
+        // Sleep until the next sensor is due or the next queue slot, whichever
+        // is sooner. Without a new reading only a read can fill the slot.
+        int64_t now_ms = esp_timer_get_time() / 1000;
+        int64_t sleep_ms = fresh ? next_queue_ms - now_ms : (int64_t)s_post_interval_ms;
+        uint32_t sensor_wait_ms = cellar_sensors_ms_until_due();
+        if (sensor_wait_ms < sleep_ms) {
+            sleep_ms = sensor_wait_ms;
+        }
+        cellar_supervisor_op(s_sampler_sv, NULL);
+        if (sleep_ms > 0) cellar_supervisor_checkin_within(s_sampler_sv, (uint32_t)sleep_ms);
+        // A "sample_now" command ends the wait early, reads every sensor and
+        // queues the result.
+        if (sleep_ms > 0 && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleep_ms)) > 0) {
+            cellar_sensors_due_now();
+            next_queue_ms = 0;
         }
     }
 }
@@ -0,0 +1,48 @@
+#pragma once
+
+// config.h for the QEMU image (see main/config.example.h for the full list).
+// The API is tools/mock_api.py on the host, which QEMU's user-mode network
+// reaches as 10.0.2.2; qemu/main/CMakeLists.txt sets the port and scheme.
+#define WIFI_SSID "qemu"  // unused: the image brings up OpenETH instead
+#define WIFI_PASS "qemu"
+#if QEMU_API_TLS
+#define CELLAR_API_BASE "https://10.0.2.2:" QEMU_API_PORT "/api"
+#define CELLAR_API_USE_HTTPS 1
+#else
+#define CELLAR_API_BASE "http://10.0.2.2:" QEMU_API_PORT "/api"
+#define CELLAR_API_USE_HTTPS 0
+#endif
+#if QEMU_TLS_STOCK
+#define CELLAR_TLS_PROFILE 0  // the "before" image of perf_harness.py --stock-tls
+#endif
+#define DEVICE_ID "qemu-sentinel"
+#define CLAIM_CODE "qemu-claim"
+
+// QEMU emulates none of the sensors; qemu_sensor.c stands in for them.
+#define I2C_SDA 21
+#define I2C_SCL 22
+#define I2C_FREQ_HZ 100000
+#define ONEWIRE_BUS_GPIO 4
+#define BME280_ADDRESS 0x76
+#define OLED_ADDRESS 0x3C
+#define OLED_WIDTH 128
+#define OLED_HEIGHT 64
+
+// A short cadence so a scenario covers many posts in a few minutes.
+#define POST_INTERVAL_MS (5 * 1000)
+#define UPLINK_BACKOFF_BASE_MS 2000
+#define UPLINK_BACKOFF_MAX_MS (20 * 1000)
+#define CELLAR_HTTP_GZIP 1
+
+#define CELLAR_PERF_LOG 1
+#if QEMU_OTA
+// perf_harness.py --ota: check right after the first post, and leave the
+// new image long enough to confirm under emulation.
+#define CELLAR_OTA 1
+#define CELLAR_OTA_FIRST_CHECK_MS (15 * 1000)
+#define CELLAR_OTA_CONFIRM_TIMEOUT_MS (3 * 60 * 1000)
+#else
+#define CELLAR_OTA 0
+#endif
+#define CELLAR_UPLINK_MQTT 0
+#define CELLAR_LOCAL_HTTPD 0
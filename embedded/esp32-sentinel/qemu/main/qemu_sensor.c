@@ -0,0 +1,41 @@
+// Stand-in sensor for the QEMU image, which emulates no I2C or 1-Wire
+// devices. It reports a slowly drifting cellar so every sample carries values
+// and the uplink posts as it would on the bench.
+#include <math.h>
+
+#include "cellar_sensors.h"
+#include "config.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+static esp_err_t qemu_sensor_init(const cellar_sensor_bus_t *bus) {
+    return ESP_OK;
+}
+
+static esp_err_t qemu_sensor_read(cellar_sample_t *sample) {
+    float hours = (float)(esp_timer_get_time() / 1000000) / 3600.0f;
+    float noise = (float)(esp_random() % 100) / 1000.0f;
+    cellar_sample_set_temp(sample, "qemu", 12.5f + 0.5f * sinf(hours) + noise);
+    sample->pressure_hpa = 1013.0f + noise * 10.0f;
+    sample->humidity_pct = 65.0f + noise * 20.0f;
+    return ESP_OK;
+}
+
+static void qemu_sensor_invalidate(cellar_sample_t *sample) {
+    cellar_sample_clear_temp(sample, "qemu");
+    sample->pressure_hpa = NAN;
+    sample->humidity_pct = NAN;
+}
+
+static const cellar_sensor_driver_t s_qemu_sensor = {
+    .name = "qemu",
+    .init = qemu_sensor_init,
+    .read = qemu_sensor_read,
+    .invalidate = qemu_sensor_invalidate,
+    .period_ms = POST_INTERVAL_MS,
+};
+
+// Runs before app_main, so it is registered ahead of the built-in drivers.
+__attribute__((constructor)) static void qemu_sensor_register(void) {
+    cellar_sensors_register(&s_qemu_sensor);
+}
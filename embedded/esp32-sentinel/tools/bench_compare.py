@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Compare two `bench_firmware --json` runs.
+
+    bench_compare.py BASE.json NEW.json [--threshold 10]
+
+Prints ns/op and bytes/op per benchmark with the change from BASE, and
+exits 1 if any benchmark got slower by more than --threshold percent or
+allocates more bytes per call than before. ns/op is the fastest repetition
+of each run, so compare runs from the same machine.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {r["name"]: r for r in json.load(f)["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent (default 10)")
+    args = parser.parse_args()
+
+    base, new = load(args.base), load(args.new)
+    regressions = []
+    print("%-32s %10s %10s %8s %9s %9s" % ("benchmark", "base ns", "new ns", "delta", "base B", "new B"))
+    for name, r in new.items():
+        b = base.get(name)
+        if not b:
+            print("%-32s %10s %10.1f %8s %9s %9.1f" % (name, "-", r["ns_per_op"], "new", "-", r["bytes_per_op"]))
+            continue
+        delta = (r["ns_per_op"] / b["ns_per_op"] - 1.0) * 100.0 if b["ns_per_op"] > 0 else 0.0
+        flag = ""
+        if delta > args.threshold:
+            flag = " SLOWER"
+            regressions.append(name)
+        if r["bytes_per_op"] > b["bytes_per_op"] >= 0:
+            flag += " MORE-ALLOC"
+            regressions.append(name)
+        print("%-32s %10.1f %10.1f %+7.1f%% %9.1f %9.1f%s" % (name, b["ns_per_op"], r["ns_per_op"], delta,
+                                                              b["bytes_per_op"], r["bytes_per_op"], flag))
+    for name in base.keys() - new.keys():
+        print("%-32s %10.1f %10s %8s" % (name, base[name]["ns_per_op"], "-", "gone"))
+    if regressions:
+        print("regressed: %s" % ", ".join(sorted(set(regressions))), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Decode a cellar_binlog dump into log lines, using the firmware ELF.
+
+    binlog_decode.py --elf build/esp32-sentinel.elf dump.bin
+    binlog_decode.py --elf build/esp32-sentinel.elf --url http://sentinel.local/log
+    binlog_decode.py --elf build-host/sentinel_sim sim-binlog.bin
+
+A dump is what GET /log on the local endpoint serves, or sim-binlog.bin that
+sentinel_sim writes at exit: a header and the most recent deferred log
+records (see components/cellar_binlog/include/cellar_binlog.h). Each record
+holds its format and tag as offsets from the cellar_binlog_anchor symbol;
+this script reads those strings out of the ELF, so it must be the image the
+device runs. Prints one line per record, as the device's console would.
+"""
+
+import argparse
+import struct
+import sys
+import urllib.request
+
+HEADER = struct.Struct("<4sBBHI")
+RECORD = struct.Struct("<IiiBB46s")
+MAGIC = b"CBLG"
+VERSION = 1
+TRUNCATED = 0x80
+LEVELS = "NEWIDV"
+ANCHOR = b"cellar_binlog_anchor"
+
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+
+class Image:
+    """The allocated, file-backed sections of an ELF and its anchor address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[5] != 1:
+            sys.exit(f"{path}: not a little-endian ELF")
+        wide = data[4] == 2
+        if wide:
+            shoff, = struct.unpack_from("<Q", data, 0x28)
+            shentsize, shnum = struct.unpack_from("<HH", data, 0x3A)
+            section = struct.Struct("<IIQQQQIIQQ")
+        else:
+            shoff, = struct.unpack_from("<I", data, 0x20)
+            shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+            section = struct.Struct("<IIIIIIIIII")
+        sections = []
+        for i in range(shnum):
+            (_, sh_type, flags, addr, offset, size, link, _, _,
+             entsize) = section.unpack_from(data, shoff + i * shentsize)
+            sections.append((sh_type, flags, addr, offset, size, link, entsize))
+        self.data = data
+        self.loaded = [(addr, offset, size) for sh_type, flags, addr, offset, size, _, _ in sections
+                       if flags & SHF_ALLOC and sh_type != SHT_NOBITS and size]
+        self.anchor = None
+        symbol = struct.Struct("<IBBHQQ") if wide else struct.Struct("<IIIBBH")
+        for sh_type, _, _, offset, size, link, entsize in sections:
+            if sh_type != SHT_SYMTAB:
+                continue
+            strtab = sections[link][3]
+            for at in range(offset, offset + size, entsize or symbol.size):
+                fields = symbol.unpack_from(data, at)
+                name, value = fields[0], fields[4] if wide else fields[1]
+                end = data.index(b"\0", strtab + name)
+                if data[strtab + name:end] == ANCHOR:
+                    self.anchor = value
+        if self.anchor is None:
+            sys.exit(f"{path}: no cellar_binlog_anchor symbol (stripped, or built without cellar_binlog?)")
+
+    def string(self, offset):
+        addr = self.anchor + offset
+        for start, file_offset, size in self.loaded:
+            if start <= addr < start + size:
+                at = file_offset + addr - start
+                end = self.data.index(b"\0", at)
+                return self.data[at:end].decode("utf-8", "replace")
+        return f"<string at 0x{addr:x}?>"
+
+
+def conversions(fmt):
+    """Yield (literal, spec, conv, wide) like the firmware's parse_conv;
+    conv is None after the last conversion or at an unsupported one."""
+    i = 0
+    while True:
+        percent = fmt.find("%", i)
+        if percent < 0:
+            yield fmt[i:], None, None, False
+            return
+        literal = fmt[i:percent]
+        p = percent + 1
+        while p < len(fmt) and fmt[p] in "-+ #0":
+            p += 1
+        while p < len(fmt) and fmt[p].isdigit():
+            p += 1
+        if p < len(fmt) and fmt[p] == ".":
+            p += 1
+            while p < len(fmt) and fmt[p].isdigit():
+                p += 1
+        spec = fmt[percent:p]
+        length = ""
+        while p < len(fmt) and fmt[p] in "hlzjtL":
+            length += fmt[p]
+            p += 1
+        conv = fmt[p] if p < len(fmt) else ""
+        supported = "L" not in length and (conv in "diouxXceEfFgGaAp" or
+                                          (conv == "s" and "l" not in length) or
+                                          (conv == "%" and spec == "%" and not length))
+        if not supported:
+            yield literal, None, None, False
+            return
+        wide = "l" in length or any(c in length for c in "zjt")
+        yield literal, spec, conv, wide
+        i = p + 1
+
+
+def format_record(fmt, args, truncated):
+    out = []
+    pos = 0
+    for literal, spec, conv, wide in conversions(fmt):
+        out.append(literal)
+        if conv is None:
+            break
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv == "s":
+            if pos >= len(args) or pos + 1 + args[pos] > len(args):
+                break
+            text = args[pos + 1:pos + 1 + args[pos]].decode("utf-8", "replace")
+            pos += 1 + args[pos]
+            out.append((spec + "s") % text)
+            continue
+        size = 4 if conv in "diouxXc" and not wide else 8
+        if pos + size > len(args):
+            break
+        raw = args[pos:pos + size]
+        pos += size
+        if conv in "eEfFgGaA":
+            value, = struct.unpack("<d", raw)
+            out.append(value.hex() if conv in "aA" else (spec + conv) % value)
+        elif conv == "p":
+            out.append("0x%x" % struct.unpack("<Q", raw)[0])
+        else:
+            value, = struct.unpack("<i" if size == 4 else "<q", raw)
+            if conv in "ouxX":
+                value &= (1 << (8 * size)) - 1
+            out.append((spec + ("d" if conv == "i" else conv)) % value)
+    if truncated:
+        out.append(" [truncated]")
+    return "".join(out)
+
+
+def decode(image, dump):
+    if len(dump) < HEADER.size:
+        sys.exit("dump too short")
+    magic, version, record_size, count, dropped = HEADER.unpack_from(dump)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit(f"not a version {VERSION} binlog dump")
+    for i in range(count):
+        ms, fmt, tag, level, length, args = RECORD.unpack_from(dump, HEADER.size + i * RECORD.size)
+        level_char = LEVELS[level & ~TRUNCATED] if (level & ~TRUNCATED) < len(LEVELS) else "?"
+        message = format_record(image.string(fmt), args[:length], level & TRUNCATED)
+        print(f"{level_char} ({ms}) {image.string(tag)}: {message}")
+    if dropped:
+        print(f"({dropped} records dropped since boot: ring full)", file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--elf", required=True, help="firmware image the dump came from")
+    parser.add_argument("--url", help="fetch the dump from a sentinel's GET /log")
+    parser.add_argument("dump", nargs="?", help="dump file")
+    args = parser.parse_args()
+    if bool(args.url) == bool(args.dump):
+        parser.error("give a dump file or --url")
+    if args.url:
+        with urllib.request.urlopen(args.url, timeout=10) as response:
+            dump = response.read()
+    else:
+        with open(args.dump, "rb") as f:
+            dump = f.read()
+    decode(Image(args.elf), dump)
+
+
+if __name__ == "__main__":
+    main()
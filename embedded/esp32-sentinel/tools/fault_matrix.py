@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Run sentinel_sim under one bus fault at a time and check the others.
+
+    fault_matrix.py [--sim build-host/sentinel_sim] [--seconds 60] [--only NAME ...]
+
+Each scenario is a SIM_FAULTS spec (see components/cellar_fault) that breaks
+one sensor, or the I2C bus it sits on, from 3 s after boot so every part is
+found first. All scenarios run at once, each as its own fresh device with no
+API server. From each run's summary the matrix reports the worst sampling
+round (cellar_sensors_acquire wall time, conversion waits included), the
+most bus time any round took, and each sensor's reads and failures.
+
+A scenario fails if a sensor it does not target fails even once or reads
+fewer times than in the fault-free run, or if any round took longer than
+--max-round-ms. Exits 1 if any scenario failed.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+PROJECT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+I2C_SENSORS = {"BME280", "OPT3001", "VEML7700"}
+
+# name, SIM_FAULTS, sensors the fault may take down
+SCENARIOS = [
+    ("baseline", "", set()),
+    ("i2c-slow", "i2c:stretch=20,after=3000", set()),
+    ("bme280-nack", "i2c@0x76:nack=0.5,after=3000", {"BME280"}),
+    ("bme280-stretch", "i2c@0x76:stretch=150,after=3000", {"BME280"}),
+    ("opt3001-stretch", "i2c@0x44:stretch=500,after=3000", {"OPT3001"}),
+    ("veml7700-gone", "i2c@0x10:nack=1,after=3000", {"VEML7700"}),
+    ("i2c-stuck", "i2c@0x44:stuck=0.3/3000,after=3000", I2C_SENSORS),
+    ("ds18b20-crc", "ow:corrupt=0.3,after=3000", {"DS18B20"}),
+    ("onewire-presence", "ow:nack=0.5,after=3000", {"DS18B20"}),
+]
+
+ROUNDS_RE = re.compile(r"^sensors\s+(\d+) rounds, worst (\d+) ms \((\d+) ms on the bus\)")
+SENSOR_RE = re.compile(r"^  (\S+)\s+(\d+) reads, (\d+) failures, worst call (\d+) ms")
+FAULTS_RE = re.compile(r"^faults\s+(\d+) NACKs, (\d+) stretched, (\d+) stuck, (\d+) timeouts, (\d+) corrupted")
+
+
+def start(args, name, spec, workdir):
+    env = dict(os.environ, SIM_RUN_S=str(args.seconds), SIM_FAULTS=spec, SIM_DISPLAY="none",
+               SIM_API_BASE="http://127.0.0.1:9/api", SIM_NVS=os.path.join(workdir, "sim-nvs.bin"),
+               SIM_FLASH_DIR=workdir)
+    log = open(os.path.join(workdir, "device.log"), "w")
+    return subprocess.Popen([args.sim], env=env, stdout=log, stderr=subprocess.STDOUT, cwd=workdir), log
+
+
+def summary(path):
+    result = {"sensors": {}, "faults": None, "rounds": None}
+    with open(path) as f:
+        for line in f:
+            m = ROUNDS_RE.match(line)
+            if m:
+                result["rounds"], result["worst_ms"], result["bus_ms"] = map(int, m.groups())
+            m = SENSOR_RE.match(line)
+            if m:
+                result["sensors"][m.group(1)] = {"reads": int(m.group(2)), "failures": int(m.group(3)),
+                                                 "worst_call_ms": int(m.group(4))}
+            m = FAULTS_RE.match(line)
+            if m:
+                result["faults"] = dict(zip(("nack", "stretch", "stuck", "timeout", "corrupt"), map(int, m.groups())))
+    return result
+
+
+def check(result, affected, baseline, max_round_ms):
+    problems = []
+    if result["rounds"] is None:
+        return ["no summary"]
+    if result["worst_ms"] > max_round_ms:
+        problems.append("round took %d ms" % result["worst_ms"])
+    for name, sensor in result["sensors"].items():
+        if name in affected:
+            continue
+        if sensor["failures"] > 0:
+            problems.append("%s failed %d times" % (name, sensor["failures"]))
+        expected = baseline["sensors"].get(name, {}).get("reads", 0) if baseline else 0
+        if sensor["reads"] < expected:
+            problems.append("%s read %d times (%d without faults)" % (name, sensor["reads"], expected))
+    if baseline:
+        for name in baseline["sensors"].keys() - result["sensors"].keys() - affected:
+            problems.append("%s missing" % name)
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", default=os.path.join(PROJECT, "build-host", "sentinel_sim"))
+    parser.add_argument("--seconds", type=int, default=60, help="length of each run (default 60)")
+    parser.add_argument("--max-round-ms", type=int, default=1500,
+                        help="longest acceptable sampling round (default 1500)")
+    parser.add_argument("--only", nargs="+", help="run just these scenarios (baseline always runs)")
+    parser.add_argument("--workdir", help="keep each run's log here (default: a temp dir)")
+    args = parser.parse_args()
+
+    scenarios = [s for s in SCENARIOS if not args.only or s[0] == "baseline" or s[0] in args.only]
+    root = args.workdir or tempfile.mkdtemp(prefix="fault-matrix-")
+    print("%d scenarios, %d s each, logs in %s" % (len(scenarios), args.seconds, root), file=sys.stderr)
+    runs = []
+    for name, spec, affected in scenarios:
+        workdir = os.path.join(root, name)
+        os.makedirs(workdir, exist_ok=True)
+        runs.append((name, spec, affected, workdir) + start(args, name, spec, workdir))
+    for run in runs:
+        run[4].wait()
+        run[5].close()
+
+    results = {name: summary(os.path.join(workdir, "device.log")) for name, _, _, workdir, _, _ in runs}
+    baseline = results.get("baseline")
+    sensors = sorted(baseline["sensors"]) if baseline and baseline["sensors"] else []
+    print("%-18s %9s %7s  %s" % ("scenario", "worst ms", "bus ms",
+                                 "  ".join("%-14s" % ("%s r/f" % s) for s in sensors)))
+    failed = []
+    for name, spec, affected, _, _, _ in runs:
+        result = results[name]
+        problems = check(result, affected, baseline if name != "baseline" else None, args.max_round_ms)
+        if result["rounds"] is None:
+            print("%-18s %9s %7s  %s" % (name, "-", "-", "no summary (crashed or hung?)"))
+        else:
+            cells = []
+            for s in sensors:
+                sensor = result["sensors"].get(s)
+                cell = "%d/%d" % (sensor["reads"], sensor["failures"]) if sensor else "-"
+                cells.append("%-14s" % (cell + ("*" if s in affected else "")))
+            print("%-18s %9d %7d  %s" % (name, result["worst_ms"], result["bus_ms"], "  ".join(cells)))
+        for problem in problems:
+            print("    FAIL %s" % problem)
+        if problems:
+            failed.append(name)
+    print("* targeted by the scenario; r/f = reads/failures", file=sys.stderr)
+    if failed:
+        print("failed: %s" % ", ".join(failed), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
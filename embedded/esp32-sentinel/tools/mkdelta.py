@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+"""Binary firmware patches for the sentinel's delta OTA (components/cellar_delta).
+
+    mkdelta.py diff OLD.bin NEW.bin PATCH.cdp
+    mkdelta.py apply OLD.bin PATCH.cdp OUT.bin
+    mkdelta.py publish NEW.bin --dir FIRMWARE_DIR [--base OLD.bin ...]
+
+`publish` copies NEW.bin into FIRMWARE_DIR, makes a patch from every --base
+image to it, and rewrites FIRMWARE_DIR/manifest.json, which the backend
+serves to devices (see "Firmware updates" in docs/sensor-readings.md).
+Images are the app .bin files from build/, e.g. build/esp32-sentinel.bin.
+
+Patch format: an 80-byte header ("CDP1", u32 old_size, u32 new_size, the old
+image's ELF SHA-256, the new image's file SHA-256, 4 reserved bytes) and a raw
+deflate stream of bsdiff-style records (u32 add_len, u32 insert_len,
+i32 seek, add_len difference bytes, insert_len literal bytes).
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import struct
+import sys
+import zlib
+
+MAGIC = b"CDP1"
+HEADER = struct.Struct("<4sII32s32s4s")
+RECORD = struct.Struct("<IIi")
+
+# esp_app_desc_t sits at the start of the first segment: 24-byte image header
+# plus an 8-byte segment header. app_elf_sha256 is 144 bytes into it.
+APP_DESC_OFFSET = 32
+APP_DESC_MAGIC = 0xABCD5432
+ELF_SHA_OFFSET = APP_DESC_OFFSET + 144
+VERSION_OFFSET = APP_DESC_OFFSET + 16
+
+KEY = 8          # bytes hashed to find match candidates
+STEP = 4         # index every STEP-th offset of the old image
+GIVE_UP = 32     # stop extending a match once this far below its best score
+
+
+def app_info(image):
+    """(version, elf_sha256 hex) from the image's esp_app_desc_t."""
+    magic, = struct.unpack_from("<I", image, APP_DESC_OFFSET)
+    if magic != APP_DESC_MAGIC:
+        raise ValueError("not an ESP-IDF app image (no esp_app_desc_t)")
+    version = image[VERSION_OFFSET:VERSION_OFFSET + 32].split(b"\0")[0].decode()
+    return version, image[ELF_SHA_OFFSET:ELF_SHA_OFFSET + 32].hex()
+
+
+def extend(new, old, n0, o0, step):
+    """Length of the stretch from (n0, o0) in direction step (+1/-1) where
+    the two images mostly agree: the prefix maximising matches - mismatches."""
+    score = best = best_len = 0
+    n, o = n0, o0
+    i = 0
+    while 0 <= n < len(new) and 0 <= o < len(old):
+        score += 1 if new[n] == old[o] else -1
+        i += 1
+        if score > best:
+            best, best_len = score, i
+        elif score < best - GIVE_UP:
+            break
+        n += step
+        o += step
+    return best_len
+
+
+def find_blocks(old, new):
+    """Aligned blocks (new_start, length, old_start) covering the parts of
+    new that resemble old, in order and without overlap."""
+    index = {}
+    for i in range(0, len(old) - KEY + 1, STEP):
+        index.setdefault(old[i:i + KEY], i)
+
+    blocks = []
+    covered = 0      # new[:covered] is assigned
+    offset = None    # old - new of the last block; code that moved keeps it
+    p = 0
+    while p <= len(new) - KEY:
+        cand = []
+        if offset is not None and 0 <= p + offset <= len(old) - KEY:
+            cand.append(p + offset)
+        hit = index.get(new[p:p + KEY])
+        if hit is not None:
+            cand.append(hit)
+        best = None
+        for o in cand:
+            if old[o:o + KEY] != new[p:p + KEY]:
+                continue
+            length = extend(new, old, p, o, 1)
+            if best is None or length > best[1]:
+                best = (o, length)
+        if best is None or best[1] < KEY:
+            p += 1
+            continue
+        o, length = best
+        back = extend(new, old, p - 1, o - 1, -1) if p > covered else 0
+        back = min(back, p - covered, o)
+        blocks.append((p - back, length + back, o - back))
+        offset = o - p
+        covered = p = p + length
+    return blocks
+
+
+def make_patch(old, new):
+    blocks = find_blocks(old, new)
+    body = bytearray()
+    # Leading literal bytes before the first block.
+    first_new = blocks[0][0] if blocks else len(new)
+    next_old = blocks[0][2] if blocks else 0
+    body += RECORD.pack(0, first_new, next_old)
+    body += new[:first_new]
+    for k, (n0, length, o0) in enumerate(blocks):
+        gap_end = blocks[k + 1][0] if k + 1 < len(blocks) else len(new)
+        next_old = blocks[k + 1][2] if k + 1 < len(blocks) else o0 + length
+        diff = bytes((new[n0 + i] - old[o0 + i]) & 0xFF for i in range(length))
+        body += RECORD.pack(length, gap_end - (n0 + length), next_old - (o0 + length))
+        body += diff
+        body += new[n0 + length:gap_end]
+
+    comp = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    payload = comp.compress(bytes(body)) + comp.flush()
+    _, old_elf = app_info(old)
+    header = HEADER.pack(MAGIC, len(old), len(new), bytes.fromhex(old_elf),
+                         hashlib.sha256(new).digest(), b"\0" * 4)
+    return header + payload, len(blocks)
+
+
+def apply_patch(old, patch):
+    magic, old_size, new_size, old_elf, new_sha, _ = HEADER.unpack_from(patch)
+    if magic != MAGIC:
+        raise ValueError("not a CDP1 patch")
+    if old_size != len(old) or app_info(old)[1] != old_elf.hex():
+        raise ValueError("patch was made for a different base image")
+    body = zlib.decompress(patch[HEADER.size:], -15)
+    out = bytearray()
+    pos = i = 0
+    while len(out) < new_size:
+        add, ins, seek = RECORD.unpack_from(body, i)
+        i += RECORD.size
+        out += bytes((old[pos + k] + body[i + k]) & 0xFF for k in range(add))
+        i += add
+        pos += add
+        out += body[i:i + ins]
+        i += ins
+        pos += seek
+    if i != len(body) or hashlib.sha256(out).digest() != new_sha:
+        raise ValueError("patched image does not match")
+    return bytes(out)
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def cmd_diff(args):
+    old, new = read(args.old), read(args.new)
+    patch, blocks = make_patch(old, new)
+    apply_patch(old, patch)  # never publish a patch that does not round-trip
+    with open(args.patch, "wb") as f:
+        f.write(patch)
+    print(f"{args.patch}: {len(patch)} B for a {len(new)} B image "
+          f"({100.0 * len(patch) / len(new):.1f}%, {blocks} blocks)")
+
+
+def cmd_apply(args):
+    out = apply_patch(read(args.old), read(args.patch))
+    with open(args.out, "wb") as f:
+        f.write(out)
+    print(f"{args.out}: {len(out)} B, sha256 ok")
+
+
+def cmd_publish(args):
+    new = read(args.new)
+    version, elf = app_info(new)
+    os.makedirs(args.dir, exist_ok=True)
+    image_name = f"sentinel-{version}.bin"
+    shutil.copyfile(args.new, os.path.join(args.dir, image_name))
+    manifest = {
+        "version": version,
+        "elf_sha256": elf,
+        "image": {"file": image_name, "size": len(new),
+                  "sha256": hashlib.sha256(new).hexdigest()},
+        "deltas": {},
+    }
+    for base_path in args.base or []:
+        old = read(base_path)
+        base_version, base_elf = app_info(old)
+        if base_elf == elf:
+            continue
+        patch, _ = make_patch(old, new)
+        apply_patch(old, patch)
+        name = f"sentinel-{base_version}-to-{version}.cdp"
+        with open(os.path.join(args.dir, name), "wb") as f:
+            f.write(patch)
+        manifest["deltas"][base_elf] = {"file": name, "size": len(patch),
+                                        "base_version": base_version}
+        print(f"{name}: {len(patch)} B ({100.0 * len(patch) / len(new):.1f}% of the image)")
+    with open(os.path.join(args.dir, "manifest.json"), "w") as f:
+        json.dump(manifest, f, indent=2)
+    print(f"{args.dir}/manifest.json: {version}, {len(manifest['deltas'])} delta(s)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("diff", help="make a patch from OLD to NEW")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p.set_defaults(func=cmd_diff)
+    p = sub.add_parser("apply", help="apply a patch (reference implementation)")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("out")
+    p.set_defaults(func=cmd_apply)
+    p = sub.add_parser("publish", help="publish NEW with patches from each base")
+    p.add_argument("new")
+    p.add_argument("--dir", required=True)
+    p.add_argument("--base", action="append")
+    p.set_defaults(func=cmd_publish)
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except (OSError, ValueError, zlib.error) as e:
+        sys.exit(f"mkdelta: {e}")
+
+
+if __name__ == "__main__":
+    main()
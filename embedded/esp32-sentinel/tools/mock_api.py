@@ -0,0 +1,378 @@
+#!/usr/bin/env python3
+"""Stand-in for the wine-cellar device API, for the host simulation.
+
+    mock_api.py [--port 3000] [--approve-after 0] [--access-ttl 900]
+
+Serves the routes the sentinel firmware uses under /api, with the backend's
+status codes and bodies:
+
+    POST /api/device-claim        202 pending
+    POST /api/device-claim/poll   200 pending or approved + token pair
+                                  (long-polls up to wait_seconds, max 30)
+    POST /api/device-token        200 new token pair, 401 for an unknown
+                                  refresh token
+    POST /api/sensor-readings     201; 401 without a valid bearer token,
+                                  400 without readings; gzip bodies accepted
+    GET  /api/device-firmware     204 (no update); with --firmware-dir, the
+                                  offer for the device's image from the
+                                  manifest.json that mkdelta.py publish wrote
+    GET  /api/device-firmware/files/<file>
+                                  a file that manifest lists
+    GET  /stats                   request counters as JSON
+    POST /control                 {"outage": "503" | "reset" | null}: answer
+                                  every /api request with 503, or reset its
+                                  connection, until cleared
+
+Access tokens are HS256 JWTs with millisecond iat/exp like the backend's.
+HTTP/1.1 keep-alive is on, so the simulated client reuses its connection.
+--fail-rate and --latency-ms inject server errors and slowness into
+/sensor-readings. --tls-cert and --tls-key serve https instead; /stats then
+also counts handshakes as "TLS full <cipher>" and "TLS resumed <cipher>".
+"""
+
+import argparse
+import base64
+import gzip
+import hashlib
+import hmac
+import json
+import os
+import random
+import secrets
+import socket
+import ssl
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+MAX_CLAIM_WAIT_S = 30
+FIRMWARE_FILES = "/device-firmware/files/"
+
+
+def b64url(data):
+    return base64.urlsafe_b64encode(data).rstrip(b"=").decode()
+
+
+class State:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Condition()
+        self.secret = secrets.token_bytes(32)
+        self.devices = {}  # device_id -> {claim_code, claimed_at, refresh}
+        self.counters = {}
+        self.readings = 0
+        self.outage = None  # None, "503" or "reset"
+
+    def count(self, key):
+        with self.lock:
+            self.counters[key] = self.counters.get(key, 0) + 1
+
+    def sign(self, device_id):
+        now_ms = int(time.time() * 1000)
+        exp_ms = now_ms + self.args.access_ttl * 1000
+        header = {"alg": "HS256", "typ": "JWT"}
+        claims = {"sub": device_id, "device_id": device_id, "scope": ["device:ingest"],
+                  "type": "device", "aud": "device", "iat": now_ms, "exp": exp_ms}
+        signing_input = b64url(json.dumps(header).encode()) + "." + b64url(json.dumps(claims).encode())
+        sig = hmac.new(self.secret, signing_input.encode(), hashlib.sha256).digest()
+        expires = time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime(exp_ms / 1000))
+        return signing_input + "." + b64url(sig), expires
+
+    def verify(self, token):
+        """The device id of a valid, unexpired access token, else None."""
+        try:
+            signing_input, sig = token.rsplit(".", 1)
+            expected = b64url(hmac.new(self.secret, signing_input.encode(), hashlib.sha256).digest())
+            if not hmac.compare_digest(sig, expected):
+                return None
+            payload = signing_input.split(".")[1]
+            claims = json.loads(base64.urlsafe_b64decode(payload + "=" * (-len(payload) % 4)))
+        except (ValueError, IndexError):
+            return None
+        if claims.get("exp", 0) < time.time() * 1000:
+            return None
+        return claims.get("device_id")
+
+    def issue_pair(self, device_id):
+        """Caller holds lock."""
+        access, expires = self.sign(device_id)
+        refresh = secrets.token_urlsafe(32)
+        self.devices[device_id]["refresh"] = refresh
+        return {"device_id": device_id, "access_token": access,
+                "access_expires_at": expires, "refresh_token": refresh}
+
+    def approved(self, device):
+        return time.monotonic() - device["claimed_at"] >= self.args.approve_after
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "mock-cellar-api"
+    # Headers and body go out in separate writes; without this, Nagle holds
+    # the body until the client's delayed ACK (~40 ms per request).
+    disable_nagle_algorithm = True
+
+    @property
+    def state(self):
+        return self.server.state
+
+    def log_message(self, fmt, *args):
+        if self.state.args.verbose:
+            sys.stderr.write("%s %s\n" % (self.address_string(), fmt % args))
+
+    def reply(self, status, body=None):
+        data = b"" if body is None else json.dumps(body).encode()
+        self.send_response(status)
+        if body is not None:
+            self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+        self.state.count("%s %s %d" % (self.command, urlsplit(self.path).path, status))
+
+    def reply_file(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+        self.state.count("%s %s 200" % (self.command, self.path))
+
+    def drop(self):
+        """Reset the connection (RST, no response), as a crashed server would."""
+        self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+        self.close_connection = True
+        self.state.count("%s %s reset" % (self.command, self.path))
+
+    def in_outage(self):
+        """Apply an outage set through /control; True if the request was handled."""
+        outage = self.state.outage
+        if not outage or not self.path.startswith("/api/"):
+            return False
+        if outage == "reset":
+            self.drop()
+        else:
+            self.reply(503, {"error": "Injected outage"})
+        return True
+
+    def read_json(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        raw = self.rfile.read(length)
+        if self.headers.get("Content-Encoding") == "gzip":
+            raw = gzip.decompress(raw)
+        try:
+            return json.loads(raw or b"{}")
+        except json.JSONDecodeError:
+            return None
+
+    def do_GET(self):
+        if self.in_outage():
+            return
+        url = urlsplit(self.path)
+        if url.path == "/api/device-firmware":
+            if self.authorized():
+                self.firmware(parse_qs(url.query).get("elf_sha256", [""])[0])
+        elif url.path.startswith("/api" + FIRMWARE_FILES):
+            if self.authorized():
+                self.firmware_file(url.path[len("/api" + FIRMWARE_FILES):])
+        elif self.path == "/stats":
+            with self.state.lock:
+                body = {"readings": self.state.readings, "devices": len(self.state.devices),
+                        "requests": dict(self.state.counters)}
+            self.reply(200, body)
+        else:
+            self.reply(404, {"error": "Not found"})
+
+    def do_POST(self):
+        body = self.read_json()
+        if body is None:
+            self.reply(400, {"error": "Malformed JSON"})
+            return
+        if self.in_outage():
+            return
+        routes = {
+            "/api/device-claim": self.claim,
+            "/api/device-claim/poll": self.poll,
+            "/api/device-token": self.refresh,
+            "/api/sensor-readings": self.ingest,
+            "/control": self.control,
+        }
+        route = routes.get(self.path)
+        if route:
+            route(body)
+        else:
+            self.reply(404, {"error": "Not found"})
+
+    def authorized(self):
+        """The bearer token's device id; replies 401 and returns None without one."""
+        auth = self.headers.get("Authorization") or ""
+        device_id = self.state.verify(auth[7:]) if auth.startswith("Bearer ") else None
+        if not device_id:
+            self.reply(401, {"error": "Invalid or expired token"})
+        return device_id
+
+    def manifest(self):
+        firmware_dir = self.state.args.firmware_dir
+        path = firmware_dir and os.path.join(firmware_dir, "manifest.json")
+        if not path or not os.path.isfile(path):
+            return None
+        with open(path) as f:
+            return json.load(f)
+
+    def firmware(self, elf_sha256):
+        """The backend's offer (wine_cellar.firmware/update-for)."""
+        manifest = self.manifest()
+        if not manifest or manifest["elf_sha256"] == elf_sha256:
+            self.reply(204)
+            return
+        image = manifest["image"]
+        offer = {"version": manifest["version"], "image_path": FIRMWARE_FILES + image["file"],
+                 "image_size": image["size"], "image_sha256": image["sha256"]}
+        delta = manifest["deltas"].get(elf_sha256)
+        if delta:
+            offer.update(delta_path=FIRMWARE_FILES + delta["file"], delta_size=delta["size"])
+        self.reply(200, offer)
+
+    def firmware_file(self, name):
+        manifest = self.manifest()
+        listed = set()
+        if manifest:
+            listed = {manifest["image"]["file"]} | {d["file"] for d in manifest["deltas"].values()}
+        if name not in listed:
+            self.reply(404, {"error": "Firmware file not found"})
+            return
+        self.reply_file(os.path.join(self.state.args.firmware_dir, name))
+
+    def control(self, body):
+        outage = body.get("outage")
+        if outage not in (None, "503", "reset"):
+            self.reply(400, {"error": "outage must be \"503\", \"reset\" or null"})
+            return
+        self.state.outage = outage
+        sys.stderr.write("outage: %s\n" % (outage or "cleared"))
+        self.reply(200, {"outage": outage})
+
+    def claim(self, body):
+        device_id = body.get("device_id")
+        with self.state.lock:
+            device = self.state.devices.get(device_id)
+            if not device or device["claim_code"] != body.get("claim_code"):
+                self.state.devices[device_id] = {"claim_code": body.get("claim_code"),
+                                                 "claimed_at": time.monotonic(), "refresh": None}
+        self.reply(202, {"status": "pending", "device_id": device_id, "retry_after_seconds": 5})
+
+    def poll(self, body):
+        device_id = body.get("device_id")
+        deadline = time.monotonic() + min(int(body.get("wait_seconds") or 0), MAX_CLAIM_WAIT_S)
+        with self.state.lock:
+            device = self.state.devices.get(device_id)
+            if not device:
+                self.reply(404, {"error": "Device not found"})
+                return
+            if device["claim_code"] != body.get("claim_code"):
+                self.reply(401, {"error": "Invalid claim code"})
+                return
+            # Long-poll: hold a pending claim until approval or the wait ends.
+            while not self.state.approved(device) and time.monotonic() < deadline:
+                ready_at = device["claimed_at"] + self.state.args.approve_after
+                self.state.lock.wait(max(0.0, min(deadline, ready_at) - time.monotonic()))
+            if not self.state.approved(device):
+                self.reply(200, {"status": "pending", "retry_after_seconds": 5})
+                return
+            pair = self.state.issue_pair(device_id)
+        self.reply(200, dict(pair, status="approved"))
+
+    def refresh(self, body):
+        device_id = body.get("device_id")
+        with self.state.lock:
+            device = self.state.devices.get(device_id)
+            if not device:
+                self.reply(404, {"error": "Device not found"})
+                return
+            if not device["refresh"] or not hmac.compare_digest(device["refresh"], body.get("refresh_token") or ""):
+                self.reply(401, {"error": "Invalid refresh token"})
+                return
+            pair = self.state.issue_pair(device_id)
+        self.reply(200, pair)
+
+    def ingest(self, body):
+        args = self.state.args
+        if args.latency_ms:
+            time.sleep(args.latency_ms / 1000.0)
+        token_device = self.authorized()
+        if not token_device:
+            return
+        if token_device != body.get("device_id"):
+            self.reply(403, {"error": "device_id does not match the authenticated device"})
+            return
+        if args.fail_rate and random.random() < args.fail_rate:
+            self.reply(503, {"error": "Injected failure"})
+            return
+        readings = body.get("readings") if "readings" in body else [body]
+        if not readings:
+            self.reply(400, {"error": "At least one measurement value is required"})
+            return
+        with self.state.lock:
+            self.state.readings += len(readings)
+        if args.log_readings:
+            print(json.dumps(body), flush=True)
+        self.reply(201, {"count": len(readings)} if "readings" in body else readings[0])
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    tls = None  # ssl.SSLContext with --tls-cert
+
+    def finish_request(self, request, client_address):
+        if not self.tls:
+            super().finish_request(request, client_address)
+            return
+        # Handshake on the request's own thread so a slow client stalls only itself.
+        try:
+            request = self.tls.wrap_socket(request, server_side=True)
+        except (ssl.SSLError, OSError):
+            return  # e.g. the firmware's bare TCP probe
+        self.state.count("TLS %s %s" % ("resumed" if request.session_reused else "full", request.cipher()[0]))
+        try:
+            super().finish_request(request, client_address)
+        finally:
+            request.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=3000)
+    parser.add_argument("--approve-after", type=float, default=0.0,
+                        help="seconds between a claim and its approval (default: at once)")
+    parser.add_argument("--access-ttl", type=int, default=900, help="access token lifetime in seconds; the device refreshes a fifth of it "
+                             "(at least 60 s) early, so keep it well above 60")
+    parser.add_argument("--fail-rate", type=float, default=0.0, help="fraction of ingests answered with 503")
+    parser.add_argument("--latency-ms", type=int, default=0, help="extra delay before answering an ingest")
+    parser.add_argument("--tls-cert", help="PEM certificate to serve https with (needs --tls-key)")
+    parser.add_argument("--tls-key", help="PEM private key for --tls-cert")
+    parser.add_argument("--firmware-dir", help="serve OTA updates from this mkdelta.py publish directory")
+    parser.add_argument("--log-readings", action="store_true", help="print each ingested payload")
+    parser.add_argument("-v", "--verbose", action="store_true", help="log every request")
+    args = parser.parse_args()
+
+    server = Server((args.host, args.port), Handler)
+    server.state = State(args)
+    if args.tls_cert:
+        server.tls = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        server.tls.load_cert_chain(args.tls_cert, args.tls_key)
+    print("mock API on %s://%s:%d/api" % ("https" if server.tls else "http", args.host, server.server_address[1]),
+          flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,543 @@
+#!/usr/bin/env python3
+"""End-to-end performance run of the firmware against tools/mock_api.py.
+
+    perf_harness.py --target qemu [--tls [--stock-tls]] [--posts 10] [--out run.json] [--baseline base.json]
+    perf_harness.py --target qemu --ota [--tls]
+    perf_harness.py --target sim [--sim build-host/sentinel_sim] [...]
+
+--target qemu builds qemu/ (the device image with OpenETH in place of Wi-Fi)
+and boots it in Espressif's QEMU on user-mode networking, where the mock API
+on this machine is 10.0.2.2. It needs an ESP-IDF environment (idf.py,
+esptool) and qemu-system-xtensa on PATH; --no-build reuses qemu/build.
+--target sim runs the host simulation instead, for a quick check of the
+scenario and the harness itself.
+
+Every run is one fixed scenario from a fresh device:
+  1. boot, claim (the mock approves at once) and the first post
+  2. --posts delivered posts; access tokens live 75 s, so the device
+     refreshes every 15 s and at least once in this phase
+  3. an outage: the mock resets every connection for --outage seconds (and
+     until a post or refresh has hit it), then recovery
+  4. --posts more delivered posts
+
+The firmware reports itself on "PERF {json}" log lines (CELLAR_PERF_LOG):
+boot milestones, each post's latency and status with free heap, task stack
+headroom and cellar_netbuf slot high-water marks, the connections opened so
+far and their summed TCP + TLS handshake time, and how long the uplink was
+down. The results document has boot times, post latency percentiles, the heap
+minimum, the smallest stack headroom per task, the most netbuf slots ever in
+use, handshake times, and outage recovery. With --tls it also has the mock's
+count of full and resumed handshakes and the suites negotiated.
+
+--stock-tls builds the image without the TLS profile (components/cellar_tls:
+IDF's mbedTLS settings and esp-tls's per-connection certificate parse) in
+qemu/build-stock-tls, for the "before" side of a comparison:
+    perf_harness.py --target qemu --tls --stock-tls --save tls-before.json
+    perf_harness.py --target qemu --tls --baseline tls-before.json
+With --baseline the run is compared against a stored result and the harness
+exits 1 on a regression: a time more than --threshold percent (and --min-ms)
+worse, or heap or stack headroom down by more than --mem-slack bytes. --save
+writes the run as the new baseline.
+
+--ota runs the update path end to end instead. It builds the image twice with
+OTA on (qemu/build-ota and qemu/build-ota-next, versions qemu-ota-1 and
+qemu-ota-2), publishes the second with a patch from the first through
+mkdelta.py, and has the mock serve them. The device boots the first image,
+posts, downloads and applies the patch, restarts into the second image and
+must confirm it with a delivered reading. The result has both versions, the
+image and patch sizes, the time to download and apply the patch, the OTA
+task's smallest free stack, and the time from the restart to the confirmation. Any fallback to the full image, a
+rollback or a missing step fails the run.
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import shutil
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.request
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PROJECT = os.path.dirname(HERE)
+QEMU_PROJECT = os.path.join(PROJECT, "qemu")
+QEMU_BUILD = os.path.join(QEMU_PROJECT, "build")
+QEMU_APP_BIN = "esp32-sentinel-qemu.bin"
+OTA_VERSIONS = ("qemu-ota-1", "qemu-ota-2")
+PERF_LINE = re.compile(r"PERF (\{.*\})")
+# The device refreshes a fifth of the lifetime (at least 60 s) before expiry.
+ACCESS_TTL_S = 75
+
+
+class Device:
+    """A firmware process whose PERF records are collected as they arrive."""
+
+    def __init__(self, argv, env, log_path):
+        self.records = []
+        self.lines = []  # (host_s, line)
+        self.cond = threading.Condition()
+        self.log = open(log_path, "w")
+        self.proc = subprocess.Popen(argv, env=env, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT, text=True, errors="replace")
+        threading.Thread(target=self._read, daemon=True).start()
+
+    def _read(self):
+        for line in self.proc.stdout:
+            self.log.write(line)
+            with self.cond:
+                self.lines.append((time.monotonic(), line.rstrip("\n")))
+                self.cond.notify_all()
+            match = PERF_LINE.search(line)
+            if not match:
+                continue
+            try:
+                record = json.loads(match.group(1))
+            except json.JSONDecodeError:
+                continue
+            record["host_s"] = time.monotonic()
+            with self.cond:
+                self.records.append(record)
+                self.cond.notify_all()
+        with self.cond:
+            self.cond.notify_all()
+
+    def wait_for(self, predicate, timeout, what):
+        deadline = time.monotonic() + timeout
+        with self.cond:
+            while not predicate(self.records):
+                if self.proc.poll() is not None:
+                    raise RuntimeError("firmware exited (%d) waiting for %s" % (self.proc.returncode, what))
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    raise RuntimeError("timed out after %ds waiting for %s" % (timeout, what))
+                self.cond.wait(remaining)
+
+    def wait_for_line(self, pattern, timeout, what, since=0):
+        """The first log line from index since on that matches pattern, as
+        (index, host_s, match)."""
+        regex = re.compile(pattern)
+        found = []
+
+        def scan(_):
+            for i in range(since, len(self.lines)):
+                match = regex.search(self.lines[i][1])
+                if match:
+                    found.append((i, self.lines[i][0], match))
+                    return True
+            return False
+
+        self.wait_for(scan, timeout, what)
+        return found[0]
+
+    def find_line(self, pattern, since=0):
+        regex = re.compile(pattern)
+        with self.cond:
+            return next((line for _, line in self.lines[since:] if regex.search(line)), None)
+
+    def stop(self):
+        if self.proc.poll() is None:
+            self.proc.terminate()
+            try:
+                self.proc.wait(10)
+            except subprocess.TimeoutExpired:
+                self.proc.kill()
+                self.proc.wait()
+        self.log.close()
+
+
+class Mock:
+    def __init__(self, port, tls, log_path, firmware_dir=None):
+        argv = [sys.executable, os.path.join(HERE, "mock_api.py"), "--port", str(port),
+                "--access-ttl", str(ACCESS_TTL_S)]
+        if tls:
+            argv += ["--tls-cert", tls[0], "--tls-key", tls[1]]
+        if firmware_dir:
+            argv += ["--firmware-dir", firmware_dir]
+        self.scheme = "https" if tls else "http"
+        self.base = "%s://127.0.0.1:%d" % (self.scheme, port)
+        self.log = open(log_path, "w")
+        self.proc = subprocess.Popen(argv, stdout=subprocess.PIPE, stderr=self.log, text=True)
+        banner = self.proc.stdout.readline()
+        if "mock API on" not in banner:
+            raise RuntimeError("mock API did not start; see %s" % log_path)
+
+    def call(self, path, body=None):
+        data = None if body is None else json.dumps(body).encode()
+        req = urllib.request.Request(self.base + path, data=data, headers={"Content-Type": "application/json"})
+        context = ssl._create_unverified_context() if self.scheme == "https" else None
+        with urllib.request.urlopen(req, timeout=10, context=context) as resp:
+            return json.load(resp)
+
+    def outage(self, mode):
+        self.call("/control", {"outage": mode})
+
+    def count(self, key):
+        return self.call("/stats")["requests"].get(key, 0)
+
+    def resets(self):
+        return sum(n for key, n in self.call("/stats")["requests"].items() if key.endswith(" reset"))
+
+    def stop(self):
+        self.proc.terminate()
+        self.proc.wait()
+        self.log.close()
+
+
+def tls_files():
+    """A self-signed certificate for 10.0.2.2, kept so rebuilds embed the same one."""
+    tls_dir = os.path.join(QEMU_BUILD, "mock-tls")
+    os.makedirs(tls_dir, exist_ok=True)
+    cert, key = os.path.join(tls_dir, "cert.pem"), os.path.join(tls_dir, "key.pem")
+    if not (os.path.exists(cert) and os.path.exists(key)):
+        subprocess.run(["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                        "-nodes", "-days", "3650", "-subj", "/CN=10.0.2.2",
+                        "-addext", "subjectAltName=IP:10.0.2.2,IP:127.0.0.1",
+                        "-keyout", key, "-out", cert], check=True, capture_output=True)
+    return cert, key
+
+
+def build_qemu(args, tls, build, defines=()):
+    if args.no_build:
+        return
+    cmd = ["idf.py", "-C", QEMU_PROJECT, "-B", build, "-D", "QEMU_API_PORT=%d" % args.port,
+           "-D", "QEMU_API_TLS=%s" % ("ON" if tls else "OFF")]
+    if tls:
+        cmd += ["-D", "QEMU_API_CERT=%s" % tls[0]]
+    for define in defines:
+        cmd += ["-D", define]
+    subprocess.run(cmd + ["build"], check=True)
+
+
+def start_qemu(args, tls, workdir, build=None):
+    if build is None:
+        build = QEMU_BUILD + "-stock-tls" if args.stock_tls else QEMU_BUILD
+        defines = []
+        if args.stock_tls:
+            # Its own sdkconfig, so the profile's settings are not carried over.
+            defines = ["QEMU_TLS_STOCK=ON", "SDKCONFIG=%s" % os.path.join(build, "sdkconfig")]
+        build_qemu(args, tls, build, defines)
+    # QEMU boots from one flash image: bootloader, partition table and app
+    # merged, padded to the configured 4MB with an erased NVS (a fresh device).
+    flash = os.path.join(workdir, "flash.bin")
+    subprocess.run([sys.executable, "-m", "esptool", "--chip", "esp32", "merge_bin", "--fill-flash-size", "4MB",
+                    "-o", flash, "@flash_args"], cwd=build, check=True, capture_output=True)
+    argv = [args.qemu, "-nographic", "-machine", "esp32",
+            "-drive", "file=%s,if=mtd,format=raw" % flash,
+            "-nic", "user,model=open_eth",
+            # The emulated timer group watchdog fires under host scheduling jitter.
+            "-global", "driver=timer.esp32.timg,property=wdt_disable,value=true"]
+    return Device(argv, os.environ.copy(), os.path.join(workdir, "device.log"))
+
+
+def start_sim(args, tls, workdir):
+    env = dict(os.environ, SIM_API_BASE="http://127.0.0.1:%d/api" % args.port,
+               SIM_NVS=os.path.join(workdir, "sim-nvs.bin"), SIM_FLASH_DIR=workdir, SIM_DISPLAY="none")
+    return Device([args.sim], env, os.path.join(workdir, "device.log"))
+
+
+def posts(records, since=None):
+    return [r for r in records if r["event"] == "post" and (since is None or r["host_s"] >= since)]
+
+
+def delivered(records, since=None):
+    return [r for r in posts(records, since) if 200 <= r["status"] < 300]
+
+
+def percentile(values, pct):
+    """Nearest-rank percentile of a non-empty list."""
+    ordered = sorted(values)
+    return ordered[max(1, math.ceil(pct / 100.0 * len(ordered))) - 1]
+
+
+def run_scenario(device, mock, args):
+    device.wait_for(lambda rs: any(r.get("stage") == "first_post" for r in rs), args.boot_timeout,
+                    "the first post")
+    device.wait_for(lambda rs: len(delivered(rs)) >= args.posts and mock.count("POST /api/device-token 200") >= 1,
+                    args.posts * args.post_timeout + ACCESS_TTL_S, "%d posts and a token refresh" % args.posts)
+
+    # The outage lasts --outage seconds and at least until the device has hit
+    # it (a post, or a refresh if that falls due first), so a short outage
+    # cannot fall between two requests.
+    print("outage: resetting connections for %ds" % args.outage, file=sys.stderr)
+    outage_start = time.monotonic()
+    mock.outage("reset")
+    while mock.resets() == 0:
+        if time.monotonic() - outage_start > args.post_timeout * 2:
+            raise RuntimeError("no request reached the mock during the outage")
+        time.sleep(0.5)
+    time.sleep(max(0.0, outage_start + args.outage - time.monotonic()))
+    mock.outage(None)
+    outage_end = time.monotonic()
+    device.wait_for(lambda rs: len(delivered(rs, outage_end)) >= args.posts,
+                    args.posts * args.post_timeout * 2 + ACCESS_TTL_S, "%d posts after the outage" % args.posts)
+    return outage_start, outage_end
+
+
+def handshakes_ms(post_records):
+    """Each new connection's TCP + TLS handshake time, from the running totals
+    in the post records; skipped where two fell between the same posts."""
+    durations = []
+    prev_count, prev_us = 0, 0
+    for r in post_records:
+        if "connects" not in r:
+            continue
+        if r["connects"] == prev_count + 1:
+            durations.append(round((r["connect_us"] - prev_us) / 1000.0, 1))
+        prev_count, prev_us = r["connects"], r["connect_us"]
+    return durations
+
+
+def tls_counts(mock):
+    counts = {"full": 0, "resumed": 0, "suites": []}
+    for key, n in mock.call("/stats")["requests"].items():
+        if key.startswith("TLS "):
+            _, kind, suite = key.split(" ", 2)
+            counts[kind] += n
+            if suite not in counts["suites"]:
+                counts["suites"].append(suite)
+    return counts
+
+
+def summarize(records, mock, outage_start, outage_end, args):
+    boot = {r["stage"] + "_ms": r["t_ms"] for r in records if r["event"] == "boot"}
+    steady = [r for r in delivered(records) if not outage_start <= r["host_s"] <= outage_end]
+    latencies = [r["latency_ms"] for r in steady]
+    all_posts = posts(records)
+    stacks = {}
+    for r in all_posts:
+        for task, free in r.get("stack_free", {}).items():
+            stacks[task] = min(free, stacks.get(task, free))
+    netbuf = {}
+    for r in all_posts:
+        for size_class, used in r.get("netbuf_high_water", {}).items():
+            netbuf[size_class] = max(used, netbuf.get(size_class, used))
+    recovered = [r for r in records if r["event"] == "recovered" and r["host_s"] >= outage_start]
+    connects = handshakes_ms(all_posts)
+    result = {
+        "target": args.target,
+        "tls": args.tls,
+        "tls_profile": ("stock" if args.stock_tls else "profile") if args.tls else None,
+        "posts": {"delivered": len(delivered(records)), "failed": len(all_posts) - len(delivered(records))},
+        "boot": boot,
+        "post_latency_ms": {
+            "p50": percentile(latencies, 50),
+            "p90": percentile(latencies, 90),
+            "max": max(latencies),
+            "mean": round(sum(latencies) / len(latencies), 2),
+        },
+        "heap": {
+            "min_free": min(r["heap_min"] for r in all_posts),
+            "min_largest_block": min(r["heap_largest"] for r in all_posts),
+        },
+        "stack_free_min": stacks,
+        "netbuf_high_water": netbuf,
+        "outage": {
+            "seconds": round(outage_end - outage_start, 1),
+            "requests_reset": mock.resets(),
+            # Failed posts before the uplink recovered; 0 if the outage only
+            # held up a token refresh.
+            "post_failures": recovered[0]["failures"] if recovered else 0,
+            # From the server coming back to the first delivered post.
+            "recovery_ms": max(0, int((delivered(records, outage_end)[0]["host_s"] - outage_end) * 1000)),
+        },
+        "refreshes": mock.count("POST /api/device-token 200"),
+    }
+    if connects:
+        result["connect_ms"] = {
+            "count": len(connects),
+            "p50": percentile(connects, 50),
+            "max": max(connects),
+            "mean": round(sum(connects) / len(connects), 2),
+        }
+    if args.tls:
+        result["tls_handshakes"] = tls_counts(mock)
+    return result
+
+
+def prepare_ota(args, tls, workdir):
+    """Build both OTA images and publish the second, with a patch from the
+    first, for the mock. Returns the first image's build directory."""
+    builds = [os.path.join(QEMU_PROJECT, name) for name in ("build-ota", "build-ota-next")]
+    for build, version in zip(builds, OTA_VERSIONS):
+        build_qemu(args, tls, build, ["QEMU_OTA=ON", "QEMU_APP_VERSION=%s" % version])
+    firmware_dir = os.path.join(workdir, "firmware")
+    subprocess.run([sys.executable, os.path.join(HERE, "mkdelta.py"), "publish",
+                    os.path.join(builds[1], QEMU_APP_BIN), "--dir", firmware_dir,
+                    "--base", os.path.join(builds[0], QEMU_APP_BIN)], check=True)
+    return builds[0], firmware_dir
+
+
+def run_ota(device, mock, firmware_dir, args):
+    """Boot the first image through to the second one's confirmation."""
+    with open(os.path.join(firmware_dir, "manifest.json")) as f:
+        manifest = json.load(f)
+    patch = next(iter(manifest["deltas"].values()), None)
+    if not patch:
+        raise RuntimeError("mkdelta.py published no patch")
+    old, new = OTA_VERSIONS
+    device.wait_for(lambda rs: any(r.get("stage") == "first_post" for r in rs), args.boot_timeout,
+                    "the first post")
+    i, _, _ = device.wait_for_line(r"Update %s -> %s available" % (old, new), args.ota_timeout,
+                                   "the update offer")
+    i, _, wrote = device.wait_for_line(r"Wrote (\d+) B to \S+ from (\d+) B downloaded in (\d+) ms",
+                                       args.ota_timeout, "the update to be written", i)
+    fallback = device.find_line(r"Delta update failed")
+    if fallback:
+        raise RuntimeError("the patch was not applied: %s" % fallback)
+    i, restart_s, restart = device.wait_for_line(r"Restarting into %s \(stack (\d+) B free\)" % new,
+                                                 args.ota_timeout, "the restart", i)
+    i, _, _ = device.wait_for_line(r"First boot of %s" % new, args.boot_timeout, "the new image to boot", i)
+    i, confirm_s, _ = device.wait_for_line(r"Image %s confirmed|rolling back" % new, args.ota_timeout,
+                                           "the new image to be confirmed", i)
+    if not device.lines[i][1].endswith("confirmed"):
+        raise RuntimeError("the new image rolled back: %s" % device.lines[i][1])
+    served = "GET /api/device-firmware/files/%s 200" % patch["file"]
+    if mock.count(served) == 0:
+        raise RuntimeError("the mock never served %s" % patch["file"])
+    return {
+        "target": args.target,
+        "tls": args.tls,
+        "ota": {
+            "from": old,
+            "to": new,
+            "image_bytes": manifest["image"]["size"],
+            "patch_bytes": patch["size"],
+            "downloaded_bytes": int(wrote.group(2)),
+            "written_bytes": int(wrote.group(1)),
+            "apply_ms": int(wrote.group(3)),
+            # The OTA task's smallest free stack over the check, download and apply.
+            "stack_free_min": int(restart.group(1)),
+            # From the restart log line to the confirmation: boot, reconnect,
+            # re-authenticate and the first delivered reading.
+            "restart_to_confirm_s": round(confirm_s - restart_s, 1),
+        },
+    }
+
+
+# (section, key, value, kind): a "time" regresses when it grows, "bytes" when they shrink.
+def metrics(result):
+    for key, value in result["boot"].items():
+        yield "boot", key, value, "time"
+    for key, value in result["post_latency_ms"].items():
+        yield "post_latency_ms", key, value, "time"
+    yield "outage", "recovery_ms", result["outage"]["recovery_ms"], "time"
+    for key in ("p50", "max", "mean"):
+        if key in result.get("connect_ms", {}):
+            yield "connect_ms", key, result["connect_ms"][key], "time"
+    for key, value in result["heap"].items():
+        yield "heap", key, value, "bytes"
+    for key, value in result["stack_free_min"].items():
+        yield "stack_free_min", key, value, "bytes"
+
+
+def compare(base, new, args):
+    regressions = []
+    print("%-34s %12s %12s %9s" % ("metric", "base", "new", "delta"))
+    for section, key, value, kind in metrics(new):
+        old = base.get(section, {}).get(key)
+        name = "%s.%s" % (section, key)
+        if old is None:
+            print("%-34s %12s %12s %9s" % (name, "-", value, "new"))
+            continue
+        delta = (value / old - 1.0) * 100.0 if old else 0.0
+        if kind == "time":
+            worse = value - old > args.min_ms and delta > args.threshold
+        else:
+            worse = old - value > args.mem_slack
+        print("%-34s %12s %12s %+8.1f%%%s" % (name, old, value, delta, " WORSE" if worse else ""))
+        if worse:
+            regressions.append(name)
+    if regressions:
+        print("regressed: %s" % ", ".join(regressions), file=sys.stderr)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--target", choices=["qemu", "sim"], default="qemu")
+    parser.add_argument("--tls", action="store_true", help="https to the mock (qemu only: mbedTLS on the target)")
+    parser.add_argument("--stock-tls", action="store_true", help="with --tls: build without the TLS profile, "
+                        "in qemu/build-stock-tls (the before side of a comparison)")
+    parser.add_argument("--port", type=int, default=3300, help="mock API port (built into the qemu image)")
+    parser.add_argument("--posts", type=int, default=10, help="delivered posts before and after the outage")
+    parser.add_argument("--outage", type=int, default=20, help="seconds of connection resets")
+    parser.add_argument("--boot-timeout", type=int, default=120)
+    parser.add_argument("--post-timeout", type=int, default=15, help="seconds allowed per post (a post interval "
+                        "plus slack: qemu posts every 5 s, the sim every 10 s)")
+    parser.add_argument("--ota", action="store_true", help="qemu only: update the device to a second image "
+                        "through a patch instead of the post scenario")
+    parser.add_argument("--ota-timeout", type=int, default=180, help="seconds allowed for each OTA step")
+    parser.add_argument("--no-build", action="store_true", help="reuse the existing qemu/build")
+    parser.add_argument("--qemu", default="qemu-system-xtensa")
+    parser.add_argument("--sim", default=os.path.join(PROJECT, "build-host", "sentinel_sim"))
+    parser.add_argument("--workdir", help="keep logs and the flash image here (default: a temp dir)")
+    parser.add_argument("--out", help="write the results document here (default: stdout)")
+    parser.add_argument("--baseline", help="compare against this results document")
+    parser.add_argument("--save", help="also write the results here as the new baseline")
+    parser.add_argument("--threshold", type=float, default=20.0, help="allowed slowdown in percent (default 20)")
+    parser.add_argument("--min-ms", type=float, default=5.0, help="ignore slowdowns smaller than this (default 5)")
+    parser.add_argument("--mem-slack", type=int, default=1024, help="allowed loss of heap or stack headroom "
+                        "in bytes (default 1024)")
+    args = parser.parse_args()
+    if args.tls and args.target == "sim":
+        parser.error("the host simulation speaks plain http only")
+    if args.stock_tls and not args.tls:
+        parser.error("--stock-tls needs --tls")
+    if args.ota and (args.target != "qemu" or args.stock_tls or args.baseline):
+        parser.error("--ota runs on --target qemu, without --stock-tls or --baseline")
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="sentinel-perf-")
+    os.makedirs(workdir, exist_ok=True)
+    tls = tls_files() if args.tls else None
+    mock = device = None
+    try:
+        if args.ota:
+            build, firmware_dir = prepare_ota(args, tls, workdir)
+            mock = Mock(args.port, tls, os.path.join(workdir, "mock.log"), firmware_dir)
+            device = start_qemu(args, tls, workdir, build)
+            result = run_ota(device, mock, firmware_dir, args)
+        else:
+            mock = Mock(args.port, tls, os.path.join(workdir, "mock.log"))
+            device = (start_qemu if args.target == "qemu" else start_sim)(args, tls, workdir)
+            outage_start, outage_end = run_scenario(device, mock, args)
+            result = summarize(device.records, mock, outage_start, outage_end, args)
+    except (RuntimeError, subprocess.CalledProcessError) as e:
+        print("perf run failed: %s (logs in %s)" % (e, workdir), file=sys.stderr)
+        return 2
+    finally:
+        if device:
+            device.stop()
+        if mock:
+            mock.stop()
+
+    text = json.dumps(result, indent=2) + "\n"
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    if args.save:
+        with open(args.save, "w") as f:
+            f.write(text)
+    if not args.workdir:
+        shutil.rmtree(workdir, ignore_errors=True)
+    if args.baseline:
+        with open(args.baseline) as f:
+            base = json.load(f)
+        if base.get("target") != result["target"] or base.get("tls") != result["tls"]:
+            print("baseline is for target %s (tls %s); not comparable" % (base.get("target"), base.get("tls")),
+                  file=sys.stderr)
+            return 2
+        if compare(base, result, args):
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
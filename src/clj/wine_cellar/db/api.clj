@@ -46,11 +46,14 @@
           (Date/valueOf)))
 
 (defn- ->sql-timestamp
-  [^String input]
-  (when input
-    (try (Timestamp/from (Instant/parse input))
+  [input]
+  (cond
+    (nil? input) nil
+    (number? input) (Timestamp. (long input))
+    :else
+    (try (Timestamp/from (Instant/parse ^String input))
          (catch Exception _
-           (try (let [date (java.time.LocalDate/parse input)]
+           (try (let [date (java.time.LocalDate/parse ^String input)]
                   (Timestamp/from (-> date
                                       (.atStartOfDay (java.time.ZoneId/of
                                                       "UTC"))
@@ -158,12 +161,14 @@
           Timestamp/from))
 
 (defn device->db-device
-  [{:keys [capabilities sensor_config token_expires_at last_seen] :as device}]
+  [{:keys [capabilities sensor_config health token_expires_at last_seen]
+    :as device}]
   (cond-> device
     capabilities (update :capabilities
                          #(sql-cast :jsonb (json/write-value-as-string %)))
     sensor_config (update :sensor_config
                           #(sql-cast :jsonb (json/write-value-as-string %)))
+    health (update :health #(sql-cast :jsonb (json/write-value-as-string %)))
     (instance? Instant token_expires_at) (update :token_expires_at
                                                  instant->sql-timestamp)
     (instance? Instant last_seen) (update :last_seen instant->sql-timestamp)))
@@ -877,6 +882,12 @@
                                                                   temp))}]}))))
       inserted))))
 
+(defn create-sensor-readings!
+  "Insert a batch of readings in one transaction; returns the inserted rows."
+  [readings]
+  (jdbc/with-transaction [tx ds]
+                         (mapv #(create-sensor-reading! tx %) readings)))
+
 (defn list-sensor-readings
   ([] (list-sensor-readings {}))
   ([{:keys [device_id limit]}]
@@ -1095,12 +1106,12 @@
 
 (defn touch-device!
   "Update last_seen and optionally token_expires_at (when a new access token is
-  minted)."
-  [device-id & [{:keys [token_expires_at]}]]
+  minted) and the health block the device reported with its latest reading."
+  [device-id & [{:keys [token_expires_at health]}]]
   (update-device! device-id
                   (cond-> {:last_seen [:now]}
-                    token_expires_at (assoc :token_expires_at
-                                            token_expires_at))))
+                    token_expires_at (assoc :token_expires_at token_expires_at)
+                    health (assoc :health health))))
 
 ;; Bar: Spirits
 (defn- spirit->db-spirit
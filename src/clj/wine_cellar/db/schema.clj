@@ -217,7 +217,7 @@
     [:claim_code_hash :varchar] [:refresh_token_hash :varchar]
     [:token_expires_at :timestamptz] [:last_seen :timestamptz]
     [:firmware_version :varchar] [:capabilities :jsonb] [:sensor_config :jsonb]
-    [:notes :text] [:created_at :timestamp [:default [:now]]]
+    [:health :jsonb] [:notes :text] [:created_at :timestamp [:default [:now]]]
     [:updated_at :timestamp [:default [:now]]]]})
 
 (def spirits-table-schema
@@ -97,6 +97,9 @@
    (sql-execute-helper
     tx
     {:raw ["ALTER TABLE cocktail_recipes DROP COLUMN IF EXISTS spirit_tags;"]})
+   (sql-execute-helper
+    tx
+    {:raw ["ALTER TABLE devices ADD COLUMN IF NOT EXISTS health jsonb;"]})
    (sql-execute-helper
     tx
     {:raw
@@ -5,7 +5,9 @@
   (:import [java.security MessageDigest SecureRandom]
            [java.time Instant]
            [java.time.temporal ChronoUnit]
-           [java.util Base64]))
+           [java.util Base64]
+           [java.util.concurrent Executors ScheduledExecutorService
+            ScheduledFuture TimeUnit]))
 
 (def access-token-ttl-minutes 30)
 
@@ -80,3 +82,46 @@
 (defn public-device-view
   [device]
   (dissoc device :claim_code_hash :refresh_token_hash))
+
+;; Long-poll support for /device-claim/poll: one-shot callbacks per device id,
+;; fired on approval or when their wait expires.
+(defonce ^:private approval-waiters (atom {}))
+
+(defonce ^:private ^ScheduledExecutorService waiter-timer
+  (Executors/newSingleThreadScheduledExecutor))
+
+(defn- remove-waiter!
+  [device-id waiter]
+  (swap! approval-waiters
+    (fn [waiters]
+      (let [remaining (disj (get waiters device-id #{}) waiter)]
+        (if (seq remaining)
+          (assoc waiters device-id remaining)
+          (dissoc waiters device-id))))))
+
+(defn await-approval!
+  "Call (respond!) once: when `device-id` is approved or after `wait-seconds`,
+  whichever comes first. Returns {:fire! f :cancel! c}: f fires the callback
+  early, c unregisters it without calling it (the client went away)."
+  [device-id wait-seconds respond!]
+  (let [fired? (atom false)
+        self (promise)
+        timeout (promise)
+        finish! (fn [respond?]
+                  (when (compare-and-set! fired? false true)
+                    (remove-waiter! device-id @self)
+                    (.cancel ^ScheduledFuture @timeout false)
+                    (when respond? (respond!))))
+        fire! #(finish! true)]
+    (deliver self fire!)
+    (swap! approval-waiters update device-id (fnil conj #{}) fire!)
+    (deliver timeout
+             (.schedule waiter-timer
+                        ^Runnable fire!
+                        (long wait-seconds)
+                        TimeUnit/SECONDS))
+    {:fire! fire! :cancel! #(finish! false)}))
+
+(defn notify-approved!
+  [device-id]
+  (doseq [fire! (get @approval-waiters device-id)] (fire!)))
@@ -0,0 +1,46 @@
+(ns wine-cellar.firmware
+  "Sentinel firmware published for OTA. FIRMWARE_DIR holds the images and
+  patches written by `embedded/esp32-sentinel/tools/mkdelta.py publish` and
+  their manifest.json. Without it every device is told it is up to date."
+  (:require [clojure.java.io :as io]
+            [jsonista.core :as json]))
+
+(def files-path "/device-firmware/files/")
+
+(defn- firmware-dir [] (not-empty (System/getenv "FIRMWARE_DIR")))
+
+(defn- read-manifest
+  "The current manifest with string keys (delta keys are ELF hashes), or nil."
+  [dir]
+  (let [f (io/file dir "manifest.json")]
+    (when (.isFile f) (json/read-value f))))
+
+(defn update-for
+  "The update a device running the image with `elf-sha256` should install, or
+  nil when it already runs the published image. A patch is offered when the
+  manifest has one for that exact base image."
+  [elf-sha256]
+  (when-let [manifest (some-> (firmware-dir)
+                              read-manifest)]
+    (when (not= elf-sha256 (get manifest "elf_sha256"))
+      (let [image (get manifest "image")
+            delta (get-in manifest ["deltas" elf-sha256])]
+        (cond-> {:version (get manifest "version")
+                 :image_path (str files-path (get image "file"))
+                 :image_size (get image "size")
+                 :image_sha256 (get image "sha256")}
+          delta (assoc :delta_path (str files-path (get delta "file"))
+                       :delta_size (get delta "size")))))))
+
+(defn published-file
+  "The file called `file-name` if the current manifest lists it, else nil.
+  Only listed names are served, so a request cannot reach anything else in
+  FIRMWARE_DIR."
+  [file-name]
+  (when-let [dir (firmware-dir)]
+    (when-let [manifest (read-manifest dir)]
+      (let [listed (into #{(get-in manifest ["image" "file"])}
+                         (map #(get % "file"))
+                         (vals (get manifest "deltas")))
+            f (io/file dir file-name)]
+        (when (and (contains? listed file-name) (.isFile f)) f)))))
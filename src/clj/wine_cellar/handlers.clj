@@ -6,7 +6,10 @@
             [wine-cellar.db.setup :as db-setup]
             [wine-cellar.admin.bulk-operations]
             [wine-cellar.devices :as devices]
+            [wine-cellar.firmware :as firmware]
             [wine-cellar.reports.core :as reports]
+            [jsonista.core :as json]
+            [org.httpkit.server :as http-kit]
             [ring.util.response :as response]
             [wine-cellar.summary :as summary]
             [wine-cellar.logging :as logging]
@@ -63,11 +66,13 @@
   (let [user (:user request)] (when (device-token? user) (:device_id user))))
 
 (defn- touch-device!
-  "Mark device as seen and optionally update token expiry from JWT exp."
-  [device-id request]
+  "Mark device as seen and optionally update token expiry from JWT exp and the
+  device's self-reported health block."
+  [device-id request health]
   (let [exp-ms (get-in request [:user :exp])
         exp (when exp-ms (Instant/ofEpochMilli exp-ms))]
-    (when device-id (db-api/touch-device! device-id {:token_expires_at exp}))))
+    (when device-id
+      (db-api/touch-device! device-id {:token_expires_at exp :health health}))))
 
 (defn- handle-ai-error
   [e]
@@ -866,25 +871,69 @@
                  :device_id device_id
                  :retry_after_seconds retry-after-seconds}})))))
 
+(def max-claim-wait-seconds 30)
+
+(defn- claim-poll-response
+  [device_id claim_code]
+  (if-device
+   device_id
+   (fn [device]
+     (let [claim-hash (devices/hash-string claim_code)]
+       (cond (not= claim-hash (:claim_code_hash device))
+             {:status 401 :body {:error "Invalid claim code"}}
+             (= "blocked" (:status device)) (device-blocked-response)
+             (= "pending" (:status device)) {:status 200
+                                             :body {:status "pending"
+                                                    :retry_after_seconds
+                                                    retry-after-seconds}}
+             :else (let [{:keys [tokens]} (devices/issue-and-store-token-pair!
+                                           device_id)]
+                     {:status 200
+                      :body (merge {:status "approved" :device_id device_id}
+                                   tokens)}))))))
+
+(defn- json-response
+  [{:keys [status body]}]
+  {:status status
+   :headers {"Content-Type" "application/json"}
+   :body (json/write-value-as-string body)})
+
 (defn poll-device-claim
+  "Report claim status. With `wait_seconds`, a pending claim is held open
+  (long-poll) until the device is approved or the wait expires."
   [request]
-  (let [{:keys [device_id claim_code]} (get-in request [:parameters :body])]
-    (if-device
-     device_id
-     (fn [device]
-       (let [claim-hash (devices/hash-string claim_code)]
-         (cond (not= claim-hash (:claim_code_hash device))
-               {:status 401 :body {:error "Invalid claim code"}}
-               (= "blocked" (:status device)) (device-blocked-response)
-               (= "pending" (:status device)) {:status 200
-                                               :body {:status "pending"
-                                                      :retry_after_seconds
-                                                      retry-after-seconds}}
-               :else (let [{:keys [tokens]} (devices/issue-and-store-token-pair!
-                                             device_id)]
-                       {:status 200
-                        :body (merge {:status "approved" :device_id device_id}
-                                     tokens)})))))))
+  (let [{:keys [device_id claim_code wait_seconds]} (get-in request
+                                                            [:parameters :body])
+        wait (min (or wait_seconds 0) max-claim-wait-seconds)
+        result (claim-poll-response device_id claim_code)]
+    (if (and (pos? wait)
+             (= "pending" (get-in result [:body :status]))
+             (:async-channel request))
+      (let [waiter (promise)]
+        (http-kit/as-channel
+         request
+         {:on-open (fn [ch]
+                     (let [{:keys [fire!] :as w}
+                           (devices/await-approval!
+                            device_id
+                            wait
+                            ;; Issue tokens only for a client still there.
+                            #(when (http-kit/open? ch)
+                               (http-kit/send! ch
+                                               (json-response
+                                                (claim-poll-response
+                                                 device_id
+                                                 claim_code)))))]
+                       (deliver waiter w)
+                       ;; Approved between the first check and registering.
+                       (when (not= "pending"
+                                   (:status (db-api/get-device device_id)))
+                         (fire!))))
+          ;; The device went away: drop its waiter without responding.
+          :on-close (fn [_ch _status]
+                      (when-let [{:keys [cancel!]} (deref waiter 0 nil)]
+                        (cancel!)))}))
+      result)))
 
 (defn refresh-device-token
   [request]
@@ -917,6 +966,7 @@
                                                       {:status "active"
                                                        :refresh_token_hash nil
                                                        :token_expires_at nil})]
+                   (devices/notify-approved! device_id)
                    {:status 200 :body (devices/public-device-view updated)})))))
 
 (defn- device-status-update
@@ -963,12 +1013,44 @@
              (db-api/update-device! device-id {:sensor_config merged})))
          (catch Exception _ nil))))
 
+(defn- payload-readings
+  "The readings in an ingest payload: the payload itself, or each entry of a
+  batched `readings` array stamped with the payload's device_id."
+  [payload]
+  (if (contains? payload :readings)
+    (mapv #(assoc % :device_id (:device_id payload)) (:readings payload))
+    [(dissoc payload :health :readings)]))
+
+(defn- device-status-error
+  "An error response if `device-id` may not post readings, else nil."
+  [device-id]
+  (let [device (db-api/get-device device-id)]
+    (cond (nil? device) {:status 404 :body {:error "Device is not registered"}}
+          (not= "active" (:status device))
+          {:status 403 :body {:error "Device is not active"}})))
+
+(defn- store-readings!
+  "Insert `readings` (a single reading, or a batch when the payload carried a
+  `readings` array) and fold any new sensor addresses into the device's
+  sensor_config."
+  [payload readings recorded-by]
+  (let [readings (cond->> readings
+                   recorded-by (mapv #(assoc % :recorded_by recorded-by)))
+        batch? (contains? payload :readings)
+        records (if batch?
+                  (db-api/create-sensor-readings! readings)
+                  [(db-api/create-sensor-reading! (first readings))])]
+    (merge-sensor-config! (:device_id payload)
+                          (apply merge (map :temperatures readings)))
+    {:status 201 :body (if batch? {:count (count records)} (first records))}))
+
 (defn ingest-sensor-reading
   [request]
   (let [payload (get-in request [:parameters :body])
+        readings (payload-readings payload)
         token-device-id (device-id-from-token request)
         payload-device-id (:device_id payload)]
-    (cond (not (measurement-present? payload))
+    (cond (or (empty? readings) (not-every? measurement-present? readings))
           {:status 400
            :body {:error "At least one measurement value is required"}}
           (and token-device-id (not= token-device-id payload-device-id))
@@ -976,29 +1058,32 @@
            :body {:error "device_id does not match the authenticated device"}}
           :else
           (try
-            (let [device-status
-                  (when token-device-id
-                    (let [device (db-api/get-device token-device-id)]
-                      (cond (nil? device) {:status 404
-                                           :body {:error
-                                                  "Device is not registered"}}
-                            (not= "active" (:status device))
-                            {:status 403 :body {:error "Device is not active"}}
-                            :else (do (touch-device! token-device-id request)
-                                      nil))))
-                  recorded-by (or token-device-id
-                                  (get-in request [:user :email])
-                                  (get-in request [:user :sub]))]
-              (if device-status
-                device-status
-                (let [record (db-api/create-sensor-reading!
-                              (cond-> payload
-                                recorded-by (assoc :recorded_by recorded-by)))]
-                  (merge-sensor-config! (:device_id payload)
-                                        (:temperatures payload))
-                  {:status 201 :body record})))
+            (if-let [error (when token-device-id
+                             (device-status-error token-device-id))]
+              error
+              (do (when token-device-id
+                    (touch-device! token-device-id request (:health payload)))
+                  (store-readings! payload
+                                   readings
+                                   (or token-device-id
+                                       (get-in request [:user :email])
+                                       (get-in request [:user :sub])))))
             (catch Exception e (server-error e))))))
 
+(defn ingest-device-message
+  "Store a reading payload that arrived outside HTTP (the MQTT bridge). The
+  transport has already authenticated `device-id`, so it overrides any
+  device_id in the payload. Returns a ring-style response map."
+  [device-id payload]
+  (let [payload (assoc payload :device_id device-id)
+        readings (payload-readings payload)]
+    (if (or (empty? readings) (not-every? measurement-present? readings))
+      {:status 400 :body {:error "At least one measurement value is required"}}
+      (try (or (device-status-error device-id)
+               (do (db-api/touch-device! device-id {:health (:health payload)})
+                   (store-readings! payload readings device-id)))
+           (catch Exception e (server-error e))))))
+
 (defn list-sensor-readings
   [request]
   (let [{:keys [device_id limit]} (or (get-in request [:parameters :query]) {})]
@@ -1021,6 +1106,27 @@
       (db-api/sensor-reading-series
        {:device_id device_id :bucket bucket :from from :to to})))))
 
+(defn device-firmware
+  "Tell a device which firmware to install, or 204 when it is up to date."
+  [request]
+  (let [{:keys [version elf_sha256]} (get-in request [:parameters :query])
+        device-id (device-id-from-token request)]
+    (with-server-error
+     (if-let [offer (firmware/update-for elf_sha256)]
+       (do (tap> ["📦 Firmware update offered" device-id version "->"
+                  (:version offer) (if (:delta_path offer) "delta" "full")])
+           (response/response offer))
+       (no-content)))))
+
+(defn device-firmware-file
+  [request]
+  (let [file-name (get-in request [:parameters :path :file])]
+    (with-server-error
+     (if-let [f (firmware/published-file file-name)]
+       (-> (response/file-response (.getPath f))
+           (response/content-type "application/octet-stream"))
+       (not-found "Firmware file")))))
+
 (defn- start-bulk-job
   [request {:keys [job-label start-fn message]}]
   (with-server-error
@@ -0,0 +1,142 @@
+(ns wine-cellar.mqtt-bridge
+  "Subscribes to device readings published over MQTT and stores them through
+  the same path as POST /sensor-readings. Only runs when MQTT_BRIDGE_URI is
+  set.
+
+  The device id comes from the topic, and nothing in the message proves it,
+  so the broker does the authentication that the device JWT does over HTTP.
+  The firmware only connects over TLS (mqtts:// or wss://), with its device
+  id as the username and a per-device password (CELLAR_MQTT_PASSWORD). The
+  broker must refuse anonymous clients, accept devices on its TLS listener
+  only, and restrict each username to <prefix>/<username>/ topics (Mosquitto:
+  `pattern readwrite cellar/%u/#`). See docs/sensor-readings.md."
+  (:require [clojure.spec.alpha :as s]
+            [clojure.string :as str]
+            [jsonista.core :as json]
+            [mount.core :refer [defstate]]
+            [spec-tools.core :as st]
+            [wine-cellar.handlers :as handlers]
+            [wine-cellar.routes])
+  (:import [org.eclipse.paho.client.mqttv3 MqttCallbackExtended MqttClient
+            MqttConnectOptions MqttException MqttMessage]
+           [org.eclipse.paho.client.mqttv3.persist MemoryPersistence]))
+
+(def ^:private topic-prefix
+  (or (System/getenv "MQTT_BRIDGE_TOPIC_PREFIX") "cellar"))
+
+(def ^:private readings-topic (str topic-prefix "/+/readings"))
+
+(def ^:private connect-retry-ms 10000)
+
+(defn- topic-device-id
+  "The device id in `<prefix>/<device-id>/readings`, or nil."
+  [topic]
+  (let [[prefix device-id leaf & more] (str/split topic #"/")]
+    (when (and (= prefix topic-prefix)
+               (= leaf "readings")
+               (nil? more)
+               (not (str/blank? device-id)))
+      device-id)))
+
+(defn- coerce-payload
+  "Parse a readings message and check it against the HTTP body spec, dropping
+  unknown keys as the route coercion does. nil when it is not valid."
+  [device-id ^bytes body]
+  (let [payload (try (json/read-value body json/keyword-keys-object-mapper)
+                     (catch Exception _ nil))]
+    (when (map? payload)
+      (let [coerced (st/coerce :wine-cellar.routes/sensor-reading
+                               (assoc payload :device_id device-id)
+                               st/strip-extra-keys-transformer)]
+        (when (s/valid? :wine-cellar.routes/sensor-reading coerced) coerced)))))
+
+(defn- handle-message
+  "Store one readings message. Rejected messages are logged and acknowledged;
+  a server error throws so Paho drops the connection and the broker
+  redelivers the message (QoS 1) once the bridge reconnects."
+  [topic ^MqttMessage message]
+  (let [device-id (topic-device-id topic)
+        payload (when device-id (coerce-payload device-id (.getPayload message)))
+        result (cond (nil? device-id) {:status 400
+                                       :body {:error "Unexpected topic"}}
+                     (nil? payload) {:status 400
+                                     :body {:error "Invalid reading payload"}}
+                     :else (handlers/ingest-device-message device-id payload))]
+    (when (not= 201 (:status result))
+      (tap> ["📡 MQTT bridge: message not stored" topic result]))
+    (when (>= (:status result) 500)
+      (throw (ex-info "MQTT reading not stored; leaving it for redelivery"
+                      {:topic topic :result result})))))
+
+(defn- connect-options
+  ^MqttConnectOptions []
+  (let [opts (doto (MqttConnectOptions.)
+               ;; Persistent session: the broker queues QoS 1 readings while
+               ;; the bridge is down and keeps its subscription.
+               (.setCleanSession false)
+               (.setAutomaticReconnect true)
+               (.setKeepAliveInterval 60))]
+    (when-let [username (System/getenv "MQTT_BRIDGE_USERNAME")]
+      (.setUserName opts username))
+    (when-let [password (System/getenv "MQTT_BRIDGE_PASSWORD")]
+      (.setPassword opts (.toCharArray ^String password)))
+    opts))
+
+(defn- connect-loop
+  "Keep trying the first connection in the background; Paho's automatic
+  reconnect only takes over once one has succeeded."
+  [^MqttClient client running]
+  (future (loop []
+            (when @running
+              (if (try (.connect client (connect-options))
+                       (.subscribe client ^String readings-topic 1)
+                       true
+                       (catch MqttException e
+                         (tap> ["📡 MQTT bridge: connect failed" (.getMessage e)])
+                         false))
+                (tap> (str "📡 MQTT bridge: subscribed to " readings-topic))
+                (do (Thread/sleep connect-retry-ms) (recur)))))))
+
+(defn start-bridge
+  [uri]
+  (let [client-id (or (System/getenv "MQTT_BRIDGE_CLIENT_ID")
+                      "wine-cellar-bridge")
+        client (MqttClient. ^String uri ^String client-id (MemoryPersistence.))
+        running (atom true)]
+    (.setCallback
+     client
+     (reify
+      MqttCallbackExtended
+        (connectComplete [_ reconnect? server-uri]
+          (when reconnect?
+            (tap> (str "📡 MQTT bridge: reconnected to " server-uri))
+            ;; Blocking calls are not allowed on the callback thread. The
+            ;; session normally keeps the subscription; this covers a broker
+            ;; that lost it.
+            (future (try (.subscribe client ^String readings-topic 1)
+                         (catch MqttException e
+                           (tap> ["📡 MQTT bridge: resubscribe failed"
+                                  (.getMessage e)]))))))
+        (connectionLost [_ cause]
+          (tap> ["📡 MQTT bridge: connection lost" (.getMessage cause)]))
+        (messageArrived [_ topic message] (handle-message topic message))
+        (deliveryComplete [_ _token] nil)))
+    (connect-loop client running)
+    (tap> (str "📡 MQTT bridge: connecting to " uri " as " client-id))
+    {:client client :running running}))
+
+(defn stop-bridge
+  [{:keys [^MqttClient client running]}]
+  (when client
+    (reset! running false)
+    (try (when (.isConnected client) (.disconnect client))
+         (.close client)
+         (catch MqttException e
+           (tap> ["📡 MQTT bridge: error while stopping" (.getMessage e)])))
+    (tap> "📡 MQTT bridge stopped")))
+
+(defstate bridge
+  :start
+  (when-let [uri (not-empty (System/getenv "MQTT_BRIDGE_URI"))] (start-bridge uri))
+  :stop
+  (stop-bridge bridge))
@@ -18,7 +18,9 @@
             [expound.alpha :as expound]
             [wine-cellar.config-utils :as config-utils]
             [wine-cellar.logging :as logging]
-            [mount.core :refer [defstate]]))
+            [mount.core :refer [defstate]])
+  (:import [java.io ByteArrayInputStream]
+           [java.util.zip GZIPInputStream]))
 
 (defn- tap-middleware-wrap
   [handler]
@@ -50,6 +52,41 @@
 
 (def tap-middleware {:name ::tap :wrap tap-middleware-wrap})
 
+(def max-inflated-body-bytes (* 1024 1024))
+
+(defn- gunzip-request-wrap
+  "Inflate a `Content-Encoding: gzip` request body before muuntaja decodes it.
+  Bodies that inflate past `max-inflated-body-bytes` are rejected."
+  [handler]
+  (fn [request]
+    (if (= "gzip"
+           (some-> (get-in request [:headers "content-encoding"])
+                   str/trim
+                   str/lower-case))
+      (let [inflated (try (with-open [in (GZIPInputStream. (:body request))]
+                            (.readNBytes in (inc max-inflated-body-bytes)))
+                          (catch java.io.IOException _ nil))]
+        (cond (nil? inflated) {:status 400 :body {:error "Invalid gzip body"}}
+              (> (alength ^bytes inflated) max-inflated-body-bytes)
+              {:status 413 :body {:error "Request body too large"}}
+              :else (handler (-> request
+                                 (assoc :body (ByteArrayInputStream. inflated))
+                                 (update :headers
+                                         dissoc
+                                         "content-encoding"
+                                         "content-length")))))
+      (handler request))))
+
+;; Mounted only on routes whose data sets `:gzip-request true`. It checks
+;; authentication itself, before inflating anything, so an anonymous client
+;; cannot make the server inflate a body; `auth/wrap-auth` runs ahead of it to
+;; set `:user`.
+(def gunzip-request-middleware
+  {:name ::gunzip-request
+   :compile (fn [{:keys [gzip-request]} _]
+              (when gzip-request
+                (comp auth/require-authentication gunzip-request-wrap)))})
+
 ;; Specs for individual fields
 (s/def ::producer string?)
 (s/def ::country string?)
@@ -125,7 +162,8 @@
 (s/def ::tasting-sources (s/coll-of ::tasting-source))
 (s/def ::enabled? boolean?)
 (s/def ::device_id (s/and string? (complement str/blank?)))
-(s/def ::measured_at (s/nilable string?))
+;; ISO8601 string, or epoch milliseconds as sent by the ESP32 sentinel
+(s/def ::measured_at (s/nilable (s/or :iso string? :epoch-ms int?)))
 (s/def ::temperatures (s/nilable map?))
 (s/def ::humidity_pct (s/nilable number?))
 (s/def ::pressure_hpa (s/nilable number?))
@@ -137,8 +175,8 @@
 (s/def ::reason (s/nilable string?))
 (s/def ::oz (s/and number? pos?))
 (s/def ::bucket #{"15m" "1h" "6h" "1d"})
-(s/def ::from ::measured_at)
-(s/def ::to ::measured_at)
+(s/def ::from (s/nilable string?))
+(s/def ::to (s/nilable string?))
 (s/def ::claim_code (s/and string? (complement str/blank?)))
 (s/def ::refresh_token (s/and string? (complement str/blank?)))
 (s/def ::firmware_version (s/nilable string?))
@@ -146,15 +184,28 @@
 (s/def ::series-query (s/keys :opt-un [::device_id ::bucket ::from ::to]))
 (s/def ::metadata (s/nilable map?))
 (s/def ::sensor_config (s/nilable map?))
+(s/def ::health (s/nilable map?))
+(s/def ::batched-reading
+  (s/keys :opt-un [::measured_at ::temperatures ::humidity_pct ::pressure_hpa
+                   ::illuminance_lux ::co2_ppm ::battery_mv ::leak_detected
+                   ::notes]))
+(s/def ::readings (s/coll-of ::batched-reading :kind vector? :max-count 500))
 (s/def ::sensor-reading
   (s/keys :req-un [::device_id]
           :opt-un [::measured_at ::temperatures ::humidity_pct ::pressure_hpa
                    ::illuminance_lux ::co2_ppm ::battery_mv ::leak_detected
-                   ::notes]))
+                   ::notes ::health ::readings]))
 (s/def ::device-claim
   (s/keys :req-un [::device_id ::claim_code]
           :opt-un [::firmware_version ::capabilities]))
+(s/def ::wait_seconds (s/and int? (complement neg?)))
+(s/def ::device-claim-poll
+  (s/keys :req-un [::device_id ::claim_code] :opt-un [::wait_seconds]))
 (s/def ::device-token-request (s/keys :req-un [::device_id ::refresh_token]))
+(s/def ::version (s/nilable string?))
+(s/def ::elf_sha256 (s/and string? #(re-matches #"[0-9a-f]{64}" %)))
+(s/def ::device-firmware-query
+  (s/keys :req-un [::elf_sha256] :opt-un [::version]))
 (s/def ::limit
   (s/and int?
          pos?
@@ -321,7 +372,7 @@
            :handler handlers/claim-device}}]
   ["/api/device-claim/poll"
    {:post {:summary "Poll for device approval and obtain initial tokens"
-           :parameters {:body ::device-claim}
+           :parameters {:body ::device-claim-poll}
            :responses {200 {:body map?}
                        401 {:body map?}
                        403 {:body map?}
@@ -340,7 +391,8 @@
   ;; Protected API routes - require authentication
   ["/api" {:middleware [auth/require-authentication]}
    ["/sensor-readings"
-    {:post {:summary "Record sensor reading"
+    {:gzip-request true
+     :post {:summary "Record a sensor reading or a batch of readings"
             :parameters {:body ::sensor-reading}
             :responses {201 {:body map?} 400 {:body map?} 500 {:body map?}}
             :handler handlers/ingest-sensor-reading}
@@ -358,6 +410,15 @@
            :parameters {:query ::series-query}
            :responses {200 {:body vector?} 500 {:body map?}}
            :handler handlers/sensor-reading-series}}]
+   ["/device-firmware"
+    {:get {:summary "Firmware the calling device should install, if any"
+           :parameters {:query ::device-firmware-query}
+           :responses {200 {:body map?} 204 {:body nil?} 500 {:body map?}}
+           :handler handlers/device-firmware}}]
+   ["/device-firmware/files/:file"
+    {:get {:summary "Download a published firmware image or patch"
+           :parameters {:path {:file string?}}
+           :handler handlers/device-firmware-file}}]
    ["/reports"
     {:get {:summary "List all cellar insight reports"
            :responses {200 {:body vector?} 500 {:body map?}}
@@ -819,10 +880,13 @@
                :reitit.coercion/response-coercion (coercion-error-handler
                                                    500)}))
       parameters/parameters-middleware muuntaja/format-negotiate-middleware
-      muuntaja/format-response-middleware muuntaja/format-request-middleware
-      tap-middleware coercion/coerce-request-middleware
-      coercion/coerce-response-middleware swagger/swagger-feature
-      auth/wrap-auth]}})
+      muuntaja/format-response-middleware
+      ;; Sets `:user` for gunzip-request-middleware, which authenticates
+      ;; before it inflates.
+      auth/wrap-auth gunzip-request-middleware
+      muuntaja/format-request-middleware tap-middleware
+      coercion/coerce-request-middleware coercion/coerce-response-middleware
+      swagger/swagger-feature]}})
   ; https://github.com/metosin/reitit/blob/master/doc/ring/static.md
   (ring/routes (ring/create-file-handler {:path "/" :root "public"})
                (fn [{:keys [request-method]}]
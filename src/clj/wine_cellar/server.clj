@@ -8,6 +8,7 @@
             [wine-cellar.auth.config :as auth-config]
             [wine-cellar.config-utils :refer [backend-port production?]]
             [wine-cellar.db.setup :as db-setup]
+            [wine-cellar.mqtt-bridge]
             [wine-cellar.routes :refer [app]]
             [wine-cellar.scheduler]))
 